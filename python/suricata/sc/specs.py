@@ -166,4 +166,24 @@ argsd = {
             "required": 1,
         },
     ],
+    "dataset-add": [
+        {
+            "name": "setname",
+            "required": 1,
+        },
+        {
+            "name": "datavalue",
+            "required": 1,
+        },
+    ],
+    "dataset-remove": [
+        {
+            "name": "setname",
+            "required": 1,
+        },
+        {
+            "name": "datavalue",
+            "required": 1,
+        },
+    ],
     }
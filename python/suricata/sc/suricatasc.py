@@ -90,6 +90,7 @@ class SuricataSC:
                 "pcap-last-processed",
                 "pcap-interrupt",
                 "iface-list",
+                "dataset-list",
                 ]
         self.fn_commands = [
                 "pcap-file",
@@ -106,6 +107,8 @@ class SuricataSC:
                 "list-hostbit",
                 "memcap-set",
                 "memcap-show",
+                "dataset-add",
+                "dataset-remove",
                 ]
         self.cmd_list = self.basic_commands + self.fn_commands
         self.sck_path = sck_path
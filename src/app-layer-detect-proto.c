@@ -108,6 +108,15 @@ typedef struct AppLayerProtoDetectProbingParser_ {
     struct AppLayerProtoDetectProbingParser_ *next;
 } AppLayerProtoDetectProbingParser;
 
+/** port lookup for an ipproto, compiled from its port list */
+typedef struct AppLayerProtoDetectPPPortMap_ {
+    /* per port the position + 1 in 'ports' of the entry
+     * AppLayerProtoDetectGetProbingParsers() would return, 0 if none */
+    uint16_t idx[UINT16_MAX + 1];
+    /* the port list as an array */
+    AppLayerProtoDetectProbingParserPort **ports;
+} AppLayerProtoDetectPPPortMap;
+
 typedef struct AppLayerProtoDetectPMSignature_ {
     AppProto alproto;
     uint8_t direction;  /**< direction for midstream */
@@ -155,6 +164,14 @@ typedef struct AppLayerProtoDetectCtx_ {
 
     AppLayerProtoDetectProbingParser *ctx_pp;
 
+    /* Port lookup compiled from ctx_pp by AppLayerProtoDetectPrepareState()
+     * per ipproto map. NULL if not compiled, in which case the ctx_pp
+     * lists are walked. */
+    AppLayerProtoDetectPPPortMap *pp_port_map[FLOW_PROTO_APPLAYER_MAX];
+
+    /* AppLayerProtoDetectPPCost per protocol */
+    uint8_t pp_cost[ALPROTO_MAX];
+
     /* Indicates the protocols that have registered themselves
      * for protocol detection.  This table is independent of the
      * ipproto. */
@@ -426,6 +443,22 @@ static AppLayerProtoDetectProbingParserPort *AppLayerProtoDetectGetProbingParser
     SCReturnPtr(pp_port, "AppLayerProtoDetectProbingParserPort *");
 }
 
+/** \internal
+ *  \brief get the probing parsers for a port, using the compiled port
+ *         map if available */
+static inline AppLayerProtoDetectProbingParserPort *AppLayerProtoDetectPPGetPort(
+        uint8_t ipproto, uint16_t port)
+{
+    const uint8_t ipproto_map = FlowGetProtoMapping(ipproto);
+    if (ipproto_map < FLOW_PROTO_APPLAYER_MAX &&
+            alpd_ctx.pp_port_map[ipproto_map] != NULL) {
+        const AppLayerProtoDetectPPPortMap *map = alpd_ctx.pp_port_map[ipproto_map];
+        const uint16_t idx = map->idx[port];
+        return idx ? map->ports[idx - 1] : NULL;
+    }
+    return AppLayerProtoDetectGetProbingParsers(alpd_ctx.ctx_pp, ipproto, port);
+}
+
 
 /**
  * \brief Call the probing expectation to see if there is some for this flow.
@@ -509,7 +542,7 @@ again_midstream:
 
     if (dir == STREAM_TOSERVER) {
         /* first try the destination port */
-        pp_port_dp = AppLayerProtoDetectGetProbingParsers(alpd_ctx.ctx_pp, ipproto, dp);
+        pp_port_dp = AppLayerProtoDetectPPGetPort(ipproto, dp);
         alproto_masks = &f->probing_parser_toserver_alproto_masks;
         if (pp_port_dp != NULL) {
             SCLogDebug("toserver - Probing parser found for destination port %"PRIu16, dp);
@@ -520,7 +553,7 @@ again_midstream:
             SCLogDebug("toserver - No probing parser registered for dest port %"PRIu16, dp);
         }
 
-        pp_port_sp = AppLayerProtoDetectGetProbingParsers(alpd_ctx.ctx_pp, ipproto, sp);
+        pp_port_sp = AppLayerProtoDetectPPGetPort(ipproto, sp);
         if (pp_port_sp != NULL) {
             SCLogDebug("toserver - Probing parser found for source port %"PRIu16, sp);
 
@@ -531,7 +564,7 @@ again_midstream:
         }
     } else {
         /* first try the destination port */
-        pp_port_dp = AppLayerProtoDetectGetProbingParsers(alpd_ctx.ctx_pp, ipproto, dp);
+        pp_port_dp = AppLayerProtoDetectPPGetPort(ipproto, dp);
         alproto_masks = &f->probing_parser_toclient_alproto_masks;
         if (pp_port_dp != NULL) {
             SCLogDebug("toclient - Probing parser found for destination port %"PRIu16, dp);
@@ -542,7 +575,7 @@ again_midstream:
             SCLogDebug("toclient - No probing parser registered for dest port %"PRIu16, dp);
         }
 
-        pp_port_sp = AppLayerProtoDetectGetProbingParsers(alpd_ctx.ctx_pp, ipproto, sp);
+        pp_port_sp = AppLayerProtoDetectPPGetPort(ipproto, sp);
         if (pp_port_sp != NULL) {
             SCLogDebug("toclient - Probing parser found for source port %"PRIu16, sp);
 
@@ -1560,6 +1593,111 @@ static void AppLayerProtoDetectFreeProbingParsers(AppLayerProtoDetectProbingPars
     SCReturn;
 }
 
+static void AppLayerProtoDetectPPFreePortMap(void)
+{
+    for (int i = 0; i < FLOW_PROTO_APPLAYER_MAX; i++) {
+        if (alpd_ctx.pp_port_map[i] != NULL) {
+            SCFree(alpd_ctx.pp_port_map[i]->ports);
+            SCFree(alpd_ctx.pp_port_map[i]);
+            alpd_ctx.pp_port_map[i] = NULL;
+        }
+    }
+}
+
+/** \internal
+ *  \brief compile the probing parser port lists into a table indexed by
+ *         port, so that the lookup per packet is a single load instead of
+ *         a walk over all registered ports.
+ *
+ *  The table holds the position in the list of the entry
+ *  AppLayerProtoDetectGetProbingParsers() returns for each port: the
+ *  first one for the port or for 'port 0', the catch all. If the list is
+ *  too long to index with 16 bits, it's walked as before. */
+static int AppLayerProtoDetectPPCompilePortMap(void)
+{
+    AppLayerProtoDetectPPFreePortMap();
+
+    for (AppLayerProtoDetectProbingParser *pp = alpd_ctx.ctx_pp; pp != NULL; pp = pp->next) {
+        const uint8_t ipproto_map = FlowGetProtoMapping(pp->ipproto);
+        if (ipproto_map >= FLOW_PROTO_APPLAYER_MAX || pp->port == NULL)
+            continue;
+
+        uint32_t cnt = 0;
+        AppLayerProtoDetectProbingParserPort *pp_port;
+        for (pp_port = pp->port; pp_port != NULL; pp_port = pp_port->next)
+            cnt++;
+        if (cnt > UINT16_MAX)
+            continue;
+
+        AppLayerProtoDetectPPPortMap *map = SCCalloc(1, sizeof(*map));
+        if (map == NULL)
+            return -1;
+        map->ports = SCCalloc(cnt, sizeof(*map->ports));
+        if (map->ports == NULL) {
+            SCFree(map);
+            return -1;
+        }
+
+        uint16_t idx = 0;
+        for (pp_port = pp->port; pp_port != NULL; pp_port = pp_port->next) {
+            map->ports[idx++] = pp_port;
+            if (pp_port->port == 0) {
+                /* catch all: the ports without an earlier entry */
+                for (uint32_t port = 0; port <= UINT16_MAX; port++) {
+                    if (map->idx[port] == 0)
+                        map->idx[port] = idx;
+                }
+                break;
+            }
+            if (map->idx[pp_port->port] == 0)
+                map->idx[pp_port->port] = idx;
+        }
+        alpd_ctx.pp_port_map[ipproto_map] = map;
+    }
+    return 0;
+}
+
+/** \internal
+ *  \brief order a list of probing parsers so that the cheap ones run
+ *         first
+ *
+ *  The catch all parsers of 'port 0' stay at the end of the list, where
+ *  AppLayerProtoDetectProbingParserElementAppend() expects them. The
+ *  order of parsers of the same cost doesn't change. */
+static void AppLayerProtoDetectPPSortElements(AppLayerProtoDetectProbingParserElement **head)
+{
+#define PP_SORT_KEY(pe) \
+    ((((pe)->port == 0) << 8) | alpd_ctx.pp_cost[(pe)->alproto])
+
+    AppLayerProtoDetectProbingParserElement *sorted = NULL;
+    AppLayerProtoDetectProbingParserElement *pe = *head;
+    while (pe != NULL) {
+        AppLayerProtoDetectProbingParserElement *next = pe->next;
+
+        /* insert after the elements with a key lower or equal */
+        AppLayerProtoDetectProbingParserElement **pos = &sorted;
+        while (*pos != NULL && PP_SORT_KEY(*pos) <= PP_SORT_KEY(pe))
+            pos = &(*pos)->next;
+        pe->next = *pos;
+        *pos = pe;
+
+        pe = next;
+    }
+    *head = sorted;
+#undef PP_SORT_KEY
+}
+
+static void AppLayerProtoDetectPPSortByCost(void)
+{
+    for (AppLayerProtoDetectProbingParser *pp = alpd_ctx.ctx_pp; pp != NULL; pp = pp->next) {
+        for (AppLayerProtoDetectProbingParserPort *pp_port = pp->port;
+                pp_port != NULL; pp_port = pp_port->next) {
+            AppLayerProtoDetectPPSortElements(&pp_port->dp);
+            AppLayerProtoDetectPPSortElements(&pp_port->sp);
+        }
+    }
+}
+
 /***** State Preparation *****/
 
 int AppLayerProtoDetectPrepareState(void)
@@ -1587,6 +1725,10 @@ int AppLayerProtoDetectPrepareState(void)
         }
     }
 
+    AppLayerProtoDetectPPSortByCost();
+    if (AppLayerProtoDetectPPCompilePortMap() < 0)
+        goto error;
+
 #ifdef DEBUG
     if (SCLogDebugEnabled()) {
         AppLayerProtoDetectPrintProbingParsers(alpd_ctx.ctx_pp);
@@ -1616,6 +1758,10 @@ void AppLayerProtoDetectPPRegister(uint8_t ipproto,
 {
     SCEnter();
 
+    /* the compiled port map is stale now, it's rebuilt by
+     * AppLayerProtoDetectPrepareState() */
+    AppLayerProtoDetectPPFreePortMap();
+
     DetectPort *head = NULL;
     DetectPortParse(NULL,&head, portstr);
     DetectPort *temp_dp = head;
@@ -1816,6 +1962,7 @@ int AppLayerProtoDetectDeSetup(void)
 
     SpmDestroyGlobalThreadCtx(alpd_ctx.spm_global_thread_ctx);
 
+    AppLayerProtoDetectPPFreePortMap();
     AppLayerProtoDetectFreeProbingParsers(alpd_ctx.ctx_pp);
 
     SCReturnInt(0);
@@ -1831,6 +1978,20 @@ void AppLayerProtoDetectRegisterProtocol(AppProto alproto, const char *alproto_n
     SCReturn;
 }
 
+/** \brief set the cost of the probing parsers of a protocol
+ *
+ *  Of the parsers registered for a port the cheap ones are run first.
+ *  Applied by AppLayerProtoDetectPrepareState(). */
+void AppLayerProtoDetectPPSetCost(AppProto alproto, AppLayerProtoDetectPPCost cost)
+{
+    SCEnter();
+
+    if (alproto > ALPROTO_UNKNOWN && alproto < ALPROTO_MAX)
+        alpd_ctx.pp_cost[alproto] = (uint8_t)cost;
+
+    SCReturn;
+}
+
 /** \brief request applayer to wrap up this protocol and rerun protocol
  *         detection.
  *
@@ -3616,6 +3777,119 @@ static int AppLayerProtoDetectTest19(void)
     return result;
 }
 
+/**
+ * \test the compiled port map gives the same port entries as the lists
+ */
+static int AppLayerProtoDetectTest20(void)
+{
+    AppLayerProtoDetectUnittestCtxBackup();
+    AppLayerProtoDetectSetup();
+
+    AppLayerProtoDetectPPRegister(IPPROTO_TCP, "80", ALPROTO_HTTP, 5, 8,
+            STREAM_TOSERVER, ProbingParserDummyForTesting, NULL);
+    AppLayerProtoDetectPPRegister(IPPROTO_TCP, "0", ALPROTO_SMTP, 12, 0,
+            STREAM_TOSERVER, ProbingParserDummyForTesting, NULL);
+    AppLayerProtoDetectPPRegister(IPPROTO_TCP, "1000:1010", ALPROTO_FTP, 7, 10,
+            STREAM_TOSERVER, ProbingParserDummyForTesting, NULL);
+    AppLayerProtoDetectPPRegister(IPPROTO_UDP, "53", ALPROTO_DNS, 12, 0,
+            STREAM_TOSERVER, ProbingParserDummyForTesting, NULL);
+
+    FAIL_IF(AppLayerProtoDetectPrepareState() != 0);
+    FAIL_IF_NULL(alpd_ctx.pp_port_map[FLOW_PROTO_TCP]);
+    FAIL_IF_NULL(alpd_ctx.pp_port_map[FLOW_PROTO_UDP]);
+
+    const uint8_t ipprotos[] = { IPPROTO_TCP, IPPROTO_UDP };
+    for (int i = 0; i < 2; i++) {
+        for (uint32_t port = 0; port <= UINT16_MAX; port++) {
+            FAIL_IF(AppLayerProtoDetectPPGetPort(ipprotos[i], (uint16_t)port) !=
+                    AppLayerProtoDetectGetProbingParsers(alpd_ctx.ctx_pp,
+                        ipprotos[i], (uint16_t)port));
+        }
+    }
+
+    AppLayerProtoDetectProbingParserPort *pp_port =
+        AppLayerProtoDetectPPGetPort(IPPROTO_TCP, 80);
+    FAIL_IF_NULL(pp_port);
+    FAIL_IF(pp_port->port != 80);
+    pp_port = AppLayerProtoDetectPPGetPort(IPPROTO_TCP, 1005);
+    FAIL_IF_NULL(pp_port);
+    FAIL_IF(pp_port->port != 1005);
+    pp_port = AppLayerProtoDetectPPGetPort(IPPROTO_TCP, 443);
+    FAIL_IF_NULL(pp_port);
+    FAIL_IF(pp_port->port != 0);
+    FAIL_IF_NOT_NULL(AppLayerProtoDetectPPGetPort(IPPROTO_UDP, 54));
+
+    /* registering a parser drops the map until the next prepare */
+    AppLayerProtoDetectPPRegister(IPPROTO_UDP, "54", ALPROTO_DNS, 12, 0,
+            STREAM_TOSERVER, ProbingParserDummyForTesting, NULL);
+    FAIL_IF_NOT_NULL(alpd_ctx.pp_port_map[FLOW_PROTO_TCP]);
+    FAIL_IF_NOT_NULL(alpd_ctx.pp_port_map[FLOW_PROTO_UDP]);
+    FAIL_IF_NULL(AppLayerProtoDetectPPGetPort(IPPROTO_UDP, 54));
+    FAIL_IF(AppLayerProtoDetectPrepareState() != 0);
+    FAIL_IF_NULL(AppLayerProtoDetectPPGetPort(IPPROTO_UDP, 54));
+
+    AppLayerProtoDetectDeSetup();
+    AppLayerProtoDetectUnittestCtxRestore();
+    PASS;
+}
+
+/**
+ * \test expensive probing parsers run after the cheap ones of a port, the
+ *       catch all ones stay last
+ */
+static int AppLayerProtoDetectTest21(void)
+{
+    AppLayerProtoDetectUnittestCtxBackup();
+    AppLayerProtoDetectSetup();
+
+    AppLayerProtoDetectPPSetCost(ALPROTO_DNS, APP_LAYER_PP_COST_HIGH);
+    AppLayerProtoDetectPPSetCost(ALPROTO_NFS, APP_LAYER_PP_COST_HIGH);
+
+    AppLayerProtoDetectPPRegister(IPPROTO_TCP, "80", ALPROTO_DNS, 0, 0,
+            STREAM_TOSERVER, ProbingParserDummyForTesting, NULL);
+    AppLayerProtoDetectPPRegister(IPPROTO_TCP, "80", ALPROTO_HTTP, 0, 0,
+            STREAM_TOSERVER, ProbingParserDummyForTesting, NULL);
+    AppLayerProtoDetectPPRegister(IPPROTO_TCP, "0", ALPROTO_NFS, 0, 0,
+            STREAM_TOSERVER, ProbingParserDummyForTesting, NULL);
+    AppLayerProtoDetectPPRegister(IPPROTO_TCP, "80", ALPROTO_SMTP, 0, 0,
+            STREAM_TOSERVER, ProbingParserDummyForTesting, NULL);
+    AppLayerProtoDetectPPRegister(IPPROTO_TCP, "0", ALPROTO_FTP, 0, 0,
+            STREAM_TOSERVER, ProbingParserDummyForTesting, NULL);
+
+    FAIL_IF(AppLayerProtoDetectPrepareState() != 0);
+
+    const AppLayerProtoDetectProbingParserPort *pp_port =
+        AppLayerProtoDetectPPGetPort(IPPROTO_TCP, 80);
+    FAIL_IF_NULL(pp_port);
+    const AppProto expected[] = { ALPROTO_HTTP, ALPROTO_SMTP, ALPROTO_DNS,
+        ALPROTO_FTP, ALPROTO_NFS };
+    const AppLayerProtoDetectProbingParserElement *pe = pp_port->dp;
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        FAIL_IF_NULL(pe);
+        FAIL_IF(pe->alproto != expected[i]);
+        pe = pe->next;
+    }
+    FAIL_IF_NOT_NULL(pe);
+
+    /* registering after the sort keeps the catch all parsers last */
+    AppLayerProtoDetectPPRegister(IPPROTO_TCP, "80", ALPROTO_TLS, 0, 0,
+            STREAM_TOSERVER, ProbingParserDummyForTesting, NULL);
+    pp_port = AppLayerProtoDetectPPGetPort(IPPROTO_TCP, 80);
+    FAIL_IF_NULL(pp_port);
+    pe = pp_port->dp;
+    for (int i = 0; i < 3; i++)
+        pe = pe->next;
+    FAIL_IF(pe->alproto != ALPROTO_TLS);
+    FAIL_IF(AppLayerProtoDetectPrepareState() != 0);
+    pe = pp_port->dp->next->next;
+    FAIL_IF(pe->alproto != ALPROTO_TLS);
+    FAIL_IF(pe->next->alproto != ALPROTO_DNS);
+
+    AppLayerProtoDetectDeSetup();
+    AppLayerProtoDetectUnittestCtxRestore();
+    PASS;
+}
+
 void AppLayerProtoDetectUnittestsRegister(void)
 {
     SCEnter();
@@ -3639,6 +3913,8 @@ void AppLayerProtoDetectUnittestsRegister(void)
     UtRegisterTest("AppLayerProtoDetectTest17", AppLayerProtoDetectTest17);
     UtRegisterTest("AppLayerProtoDetectTest18", AppLayerProtoDetectTest18);
     UtRegisterTest("AppLayerProtoDetectTest19", AppLayerProtoDetectTest19);
+    UtRegisterTest("AppLayerProtoDetectTest20", AppLayerProtoDetectTest20);
+    UtRegisterTest("AppLayerProtoDetectTest21", AppLayerProtoDetectTest21);
 
     SCReturn;
 }
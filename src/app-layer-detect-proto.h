@@ -63,6 +63,12 @@ int AppLayerProtoDetectPrepareState(void);
 
 /***** PP registration *****/
 
+/** \brief cost of a protocol's probing parsers */
+typedef enum AppLayerProtoDetectPPCost_ {
+    APP_LAYER_PP_COST_LOW = 0,  /**< default, checks a few header fields */
+    APP_LAYER_PP_COST_HIGH,     /**< parses the message */
+} AppLayerProtoDetectPPCost;
+
 void AppLayerProtoDetectPPRegister(uint8_t ipproto,
                                    const char *portstr,
                                    AppProto alproto,
@@ -80,6 +86,7 @@ int AppLayerProtoDetectPPParseConfPorts(const char *ipproto_name,
                                          uint16_t min_depth, uint16_t max_depth,
                                          ProbingParserFPtr ProbingParserTs,
                                          ProbingParserFPtr ProbingParserTc);
+void AppLayerProtoDetectPPSetCost(AppProto alproto, AppLayerProtoDetectPPCost cost);
 
 /***** PM registration *****/
 
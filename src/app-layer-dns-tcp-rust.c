@@ -122,6 +122,8 @@ void RegisterRustDNSTCPParsers(void)
     /** DNS */
     if (AppLayerProtoDetectConfProtoDetectionEnabled("tcp", proto_name)) {
         AppLayerProtoDetectRegisterProtocol(ALPROTO_DNS, proto_name);
+        /* the probe parses the whole request */
+        AppLayerProtoDetectPPSetCost(ALPROTO_DNS, APP_LAYER_PP_COST_HIGH);
 
         if (RunmodeIsUnittests()) {
             AppLayerProtoDetectPPRegister(IPPROTO_TCP, "53", ALPROTO_DNS, 0,
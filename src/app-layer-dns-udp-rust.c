@@ -128,6 +128,8 @@ void RegisterRustDNSUDPParsers(void)
     /** DNS */
     if (AppLayerProtoDetectConfProtoDetectionEnabled("udp", proto_name)) {
         AppLayerProtoDetectRegisterProtocol(ALPROTO_DNS, proto_name);
+        /* the probe parses the whole request */
+        AppLayerProtoDetectPPSetCost(ALPROTO_DNS, APP_LAYER_PP_COST_HIGH);
 
         if (RunmodeIsUnittests()) {
             AppLayerProtoDetectPPRegister(IPPROTO_UDP, "53", ALPROTO_DNS, 0,
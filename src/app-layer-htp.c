@@ -486,6 +486,34 @@ void AppLayerHtpNeedFileInspection(void)
     SCReturn;
 }
 
+/**
+ * \brief Sets a flag that informs the HTP app layer that some module in the
+ *        engine needs the normalized request uri.
+ *
+ * \initonly
+ */
+void AppLayerHtpNeedNormalizedUri(void)
+{
+    SCEnter();
+
+    SC_ATOMIC_OR(htp_config_flags, HTP_REQUIRE_REQUEST_URI_NORMALIZED);
+    SCReturn;
+}
+
+/**
+ * \brief Sets a flag that informs the HTP app layer that some module in the
+ *        engine needs the raw request and response headers.
+ *
+ * \initonly
+ */
+void AppLayerHtpNeedRawHeaders(void)
+{
+    SCEnter();
+
+    SC_ATOMIC_OR(htp_config_flags, HTP_REQUIRE_HEADERS_RAW);
+    SCReturn;
+}
+
 /* below error messages updated up to libhtp 0.5.7 (git 379632278b38b9a792183694a4febb9e0dbd1e7a) */
 struct {
     const char *msg;
@@ -2141,27 +2169,33 @@ static int HTPCallbackResponse(htp_tx_t *tx)
 static int HTPCallbackRequestLine(htp_tx_t *tx)
 {
     HtpTxUserData *tx_ud;
-    bstr *request_uri_normalized;
+    bstr *request_uri_normalized = NULL;
     HtpState *hstate = htp_connp_get_user_data(tx->connp);
     const HTPCfgRec *cfg = hstate->cfg;
 
-    request_uri_normalized = SCHTPGenerateNormalizedUri(tx, tx->parsed_uri, cfg->uri_include_all);
-    if (request_uri_normalized == NULL)
-        return HTP_OK;
+    /* only normalize the uri if some part of the engine uses it */
+    if (SC_ATOMIC_GET(htp_config_flags) & HTP_REQUIRE_REQUEST_URI_NORMALIZED) {
+        request_uri_normalized = SCHTPGenerateNormalizedUri(tx, tx->parsed_uri, cfg->uri_include_all);
+        if (request_uri_normalized == NULL)
+            return HTP_OK;
+    }
 
     tx_ud = htp_tx_get_user_data(tx);
     if (likely(tx_ud == NULL)) {
         tx_ud = HTPMalloc(sizeof(*tx_ud));
         if (unlikely(tx_ud == NULL)) {
-            bstr_free(request_uri_normalized);
+            if (request_uri_normalized != NULL)
+                bstr_free(request_uri_normalized);
             return HTP_OK;
         }
         memset(tx_ud, 0, sizeof(*tx_ud));
         htp_tx_set_user_data(tx, tx_ud);
     }
-    if (unlikely(tx_ud->request_uri_normalized != NULL))
-        bstr_free(tx_ud->request_uri_normalized);
-    tx_ud->request_uri_normalized = request_uri_normalized;
+    if (request_uri_normalized != NULL) {
+        if (unlikely(tx_ud->request_uri_normalized != NULL))
+            bstr_free(tx_ud->request_uri_normalized);
+        tx_ud->request_uri_normalized = request_uri_normalized;
+    }
 
     if (tx->flags) {
         HTPErrorCheckTxRequestFlags(hstate, tx);
@@ -2225,6 +2259,11 @@ static int HTPCallbackRequestHeaderData(htp_tx_data_t *tx_data)
         memset(tx_ud, 0, sizeof(*tx_ud));
         htp_tx_set_user_data(tx_data->tx, tx_ud);
     }
+    /* only keep a copy of the raw headers if some part of the engine
+     * uses them */
+    if (!(SC_ATOMIC_GET(htp_config_flags) & HTP_REQUIRE_HEADERS_RAW))
+        goto end;
+
     ptmp = HTPRealloc(tx_ud->request_headers_raw,
                      tx_ud->request_headers_raw_len,
                      tx_ud->request_headers_raw_len + tx_data->len);
@@ -2241,6 +2280,7 @@ static int HTPCallbackRequestHeaderData(htp_tx_data_t *tx_data)
            tx_data->data, tx_data->len);
     tx_ud->request_headers_raw_len += tx_data->len;
 
+end:
     if (tx_data->tx && tx_data->tx->flags) {
         HtpState *hstate = htp_connp_get_user_data(tx_data->tx->connp);
         HTPErrorCheckTxRequestFlags(hstate, tx_data->tx);
@@ -2262,6 +2302,9 @@ static int HTPCallbackResponseHeaderData(htp_tx_data_t *tx_data)
         memset(tx_ud, 0, sizeof(*tx_ud));
         htp_tx_set_user_data(tx_data->tx, tx_ud);
     }
+    if (!(SC_ATOMIC_GET(htp_config_flags) & HTP_REQUIRE_HEADERS_RAW))
+        return HTP_OK;
+
     ptmp = HTPRealloc(tx_ud->response_headers_raw,
                      tx_ud->response_headers_raw_len,
                      tx_ud->response_headers_raw_len + tx_data->len);
@@ -2398,7 +2441,8 @@ static void HTPConfigSetDefaultsPhase2(const char *name, HTPCfgRec *cfg_prec)
 
     htp_config_register_request_line(cfg_prec->cfg, HTPCallbackRequestLine);
 
-    cfg_prec->request.sbcfg.flags = 0;
+    cfg_prec->request.sbcfg.flags =
+        cfg_prec->request.sbcfg.page_size ? STREAMING_BUFFER_PAGED : 0;
     cfg_prec->request.sbcfg.buf_size = cfg_prec->request.inspect_window ?
                                        cfg_prec->request.inspect_window : 256;
     cfg_prec->request.sbcfg.buf_slide = 0;
@@ -2407,7 +2451,8 @@ static void HTPConfigSetDefaultsPhase2(const char *name, HTPCfgRec *cfg_prec)
     cfg_prec->request.sbcfg.Realloc = HTPRealloc;
     cfg_prec->request.sbcfg.Free = HTPFree;
 
-    cfg_prec->response.sbcfg.flags = 0;
+    cfg_prec->response.sbcfg.flags =
+        cfg_prec->response.sbcfg.page_size ? STREAMING_BUFFER_PAGED : 0;
     cfg_prec->response.sbcfg.buf_size = cfg_prec->response.inspect_window ?
                                         cfg_prec->response.inspect_window : 256;
     cfg_prec->response.sbcfg.buf_slide = 0;
@@ -2537,6 +2582,17 @@ static void HTPConfigParseParameters(HTPCfgRec *cfg_prec, ConfNode *s,
                 exit(EXIT_FAILURE);
             }
 
+        } else if (strcasecmp("body-page-size", p->name) == 0) {
+            uint32_t page_size = 0;
+            if (ParseSizeStringU32(p->val, &page_size) < 0 ||
+                    (page_size != 0 && page_size < STREAMING_BUFFER_PAGE_SIZE_MIN)) {
+                SCLogError(SC_ERR_SIZE_PARSE, "Error parsing body-page-size "
+                           "from conf file - %s.  Killing engine", p->val);
+                exit(EXIT_FAILURE);
+            }
+            cfg_prec->request.sbcfg.page_size = page_size;
+            cfg_prec->response.sbcfg.page_size = page_size;
+
         } else if (strcasecmp("response-body-decompress-layer-limit", p->name) == 0) {
             uint32_t value = 2;
             if (ParseSizeStringU32(p->val, &value) < 0) {
@@ -260,6 +260,12 @@ typedef struct HtpState_ {
 #define HTP_REQUIRE_REQUEST_FILE        (1 << 2)
 /** part of the engine needs the request body (e.g. file_data keyword) */
 #define HTP_REQUIRE_RESPONSE_BODY       (1 << 3)
+/** part of the engine needs the normalized request uri (e.g. http_uri
+ *  keyword) */
+#define HTP_REQUIRE_REQUEST_URI_NORMALIZED  (1 << 4)
+/** part of the engine needs the raw request and response headers (e.g.
+ *  http_raw_header keyword) */
+#define HTP_REQUIRE_HEADERS_RAW         (1 << 5)
 
 SC_ATOMIC_DECLARE(uint32_t, htp_config_flags);
 
@@ -275,6 +281,8 @@ void HTPStateFree(void *);
 void AppLayerHtpEnableRequestBodyCallback(void);
 void AppLayerHtpEnableResponseBodyCallback(void);
 void AppLayerHtpNeedFileInspection(void);
+void AppLayerHtpNeedNormalizedUri(void);
+void AppLayerHtpNeedRawHeaders(void);
 void AppLayerHtpPrintStats(void);
 
 void HTPConfigure(void);
@@ -299,6 +299,8 @@ void RegisterNFSTCPParsers(void)
         SCLogDebug("NFSTCP TCP protocol detection enabled.");
 
         AppLayerProtoDetectRegisterProtocol(ALPROTO_NFS, proto_name);
+        /* the probe parses the RPC header */
+        AppLayerProtoDetectPPSetCost(ALPROTO_NFS, APP_LAYER_PP_COST_HIGH);
 
         if (RunmodeIsUnittests()) {
 
@@ -267,6 +267,8 @@ void RegisterNFSUDPParsers(void)
         SCLogDebug("NFS UDP protocol detection enabled.");
 
         AppLayerProtoDetectRegisterProtocol(ALPROTO_NFS, proto_name);
+        /* the probe parses the RPC header */
+        AppLayerProtoDetectPPSetCost(ALPROTO_NFS, APP_LAYER_PP_COST_HIGH);
 
         if (RunmodeIsUnittests()) {
 
@@ -87,6 +87,12 @@ AppLayerCounterNames applayer_counter_names[FLOW_PROTO_APPLAYER_MAX][ALPROTO_MAX
 /* counter id's. Used that runtime. */
 AppLayerCounters applayer_counters[FLOW_PROTO_APPLAYER_MAX][ALPROTO_MAX];
 
+#ifdef PROFILING
+/* proto detection cost counter id's */
+static uint16_t applayer_pd_ticks_id = 0;
+static uint16_t applayer_pd_ticks_max_id = 0;
+#endif
+
 void AppLayerSetupCounters(void);
 void AppLayerDeSetupCounters(void);
 
@@ -118,6 +124,22 @@ void AppLayerIncTxCounter(ThreadVars *tv, Flow *f, uint64_t step)
     }
 }
 
+/** \brief account the ticks of the last protocol detection run
+ *
+ *  The total divided by the app_layer.flow counters is the average
+ *  detection cost per flow. */
+static inline void AppLayerProtoDetectProfilingUpdate(ThreadVars *tv,
+        const AppLayerThreadCtx *app_tctx)
+{
+#ifdef PROFILING
+    const uint64_t ticks = app_tctx->proto_detect_ticks_spent;
+    if (tv != NULL && ticks > 0 && applayer_pd_ticks_id > 0) {
+        StatsAddUI64(tv, applayer_pd_ticks_id, ticks);
+        StatsSetUI64(tv, applayer_pd_ticks_max_id, ticks);
+    }
+#endif
+}
+
 /* in IDS mode protocol detection is done in reverse order:
  * when TCP data is ack'd. We want to flag the correct packet,
  * so in this case we set a flag in the flow so that the first
@@ -329,6 +351,7 @@ static int TCPProtoDetect(ThreadVars *tv,
             f, data, data_len,
             IPPROTO_TCP, flags, &reverse_flow);
     PACKET_PROFILING_APP_PD_END(app_tctx);
+    AppLayerProtoDetectProfilingUpdate(tv, app_tctx);
     SCLogDebug("alproto %u rev %s", *alproto, reverse_flow ? "true" : "false");
 
     if (*alproto != ALPROTO_UNKNOWN) {
@@ -714,6 +737,7 @@ int AppLayerHandleUdp(ThreadVars *tv, AppLayerThreadCtx *tctx, Packet *p, Flow *
                                   f, p->payload, p->payload_len,
                                   IPPROTO_UDP, flags, &reverse_flow);
         PACKET_PROFILING_APP_PD_END(tctx);
+        AppLayerProtoDetectProfilingUpdate(tv, tctx);
 
         if (f->alproto != ALPROTO_UNKNOWN) {
             AppLayerIncFlowCounter(tv, f);
@@ -948,12 +972,25 @@ void AppLayerRegisterThreadCounters(ThreadVars *tv)
             }
         }
     }
+
+#ifdef PROFILING
+    if (profiling_packets_enabled) {
+        applayer_pd_ticks_id =
+            StatsRegisterCounter("app_layer.proto_detect.ticks", tv);
+        applayer_pd_ticks_max_id =
+            StatsRegisterMaxCounter("app_layer.proto_detect.ticks_max", tv);
+    }
+#endif
 }
 
 void AppLayerDeSetupCounters()
 {
     memset(applayer_counter_names, 0, sizeof(applayer_counter_names));
     memset(applayer_counters, 0, sizeof(applayer_counters));
+#ifdef PROFILING
+    applayer_pd_ticks_id = 0;
+    applayer_pd_ticks_max_id = 0;
+#endif
 }
 
 /***** Unittests *****/
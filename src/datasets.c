@@ -0,0 +1,906 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Named sets of values for matching large lists of indicators.
+ *
+ * Sets are defined in the 'datasets' section of the yaml. A set is an
+ * open addressing hash table stored in a compiled set file, so that it
+ * can be mapped read only instead of parsed at startup. The set file is
+ * (re)built from a text list with one value per line when it is missing
+ * or older than the list.
+ *
+ * The sets are kept in a global list and shared by all detection engines.
+ * A rule reload only loads a set again if its files changed. Values added
+ * or removed through the unix socket are kept in small hash tables next
+ * to the read only table.
+ */
+
+#include "suricata-common.h"
+#include "conf.h"
+#include "datasets.h"
+#include "util-debug.h"
+#include "util-error.h"
+#include "util-hash-lookup3.h"
+#include "util-unittest.h"
+
+#define DATASET_FILE_MAGIC          "SCDSET1"
+#define DATASET_FILE_BYTE_ORDER     0x01020304
+#define DATASET_HASH_SEED           0x7a3c9b15
+/** slots = 2^n >= DATASET_SLOTS_PER_VALUE * values */
+#define DATASET_SLOTS_PER_VALUE     2
+#define DATASET_MIN_SLOTS           16
+#define DATASET_OVERLAY_HASH_SIZE   4096
+
+static Dataset *sets = NULL;
+static SCMutex sets_lock = SCMUTEX_INITIALIZER;
+
+const char *DatasetTypeToString(enum DatasetTypes type)
+{
+    switch (type) {
+        case DATASET_TYPE_STRING:
+            return "string";
+        case DATASET_TYPE_MD5:
+            return "md5";
+        case DATASET_TYPE_SHA256:
+            return "sha256";
+        default:
+            return "unknown";
+    }
+}
+
+static enum DatasetTypes DatasetTypeFromString(const char *str)
+{
+    if (strcmp(str, "string") == 0)
+        return DATASET_TYPE_STRING;
+    if (strcmp(str, "md5") == 0)
+        return DATASET_TYPE_MD5;
+    if (strcmp(str, "sha256") == 0)
+        return DATASET_TYPE_SHA256;
+    return DATASET_TYPE_NOTSET;
+}
+
+static uint16_t DatasetTypeValueLen(enum DatasetTypes type)
+{
+    switch (type) {
+        case DATASET_TYPE_MD5:
+            return 16;
+        case DATASET_TYPE_SHA256:
+            return 32;
+        default:
+            return 0;
+    }
+}
+
+static int HexValue(const uint8_t c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/** \internal
+ *  \brief convert a value as found in a list, on the unix socket or in
+ *         a buffer to the form stored in the set
+ *
+ *  Hashes are stored as raw bytes, but are hex strings in the lists, on the
+ *  unix socket and in buffers like ja3.hash. Only the hex form is accepted,
+ *  so a binary buffer of the right length can't match by accident.
+ *
+ *  \param out buffer of at least DatasetTypeValueLen() bytes
+ *  \retval len length of the value or -1 if it's not valid for the set
+ */
+static int DatasetParseValue(const enum DatasetTypes type,
+        const uint8_t *in, const uint32_t in_len, uint8_t *out,
+        const uint8_t **value)
+{
+    const uint16_t value_len = DatasetTypeValueLen(type);
+    if (value_len == 0) {
+        if (in_len > UINT16_MAX)
+            return -1;
+        *value = in;
+        return (int)in_len;
+    }
+
+    if (in_len != (uint32_t)value_len * 2)
+        return -1;
+    for (uint16_t i = 0; i < value_len; i++) {
+        const int hi = HexValue(in[i * 2]);
+        const int lo = HexValue(in[i * 2 + 1]);
+        if (hi < 0 || lo < 0)
+            return -1;
+        out[i] = (uint8_t)(hi << 4 | lo);
+    }
+    *value = out;
+    return value_len;
+}
+
+static inline uint32_t DatasetHash(const uint8_t *value, const uint16_t len)
+{
+    return hashlittle_safe(value, len, DATASET_HASH_SEED);
+}
+
+/** \internal
+ *  \brief look up a value in the read only table
+ *
+ *  The probe count and the value offsets are bounded so that a corrupt
+ *  set file can't make us loop or read outside of the image.
+ */
+static int DatasetTableLookup(const Dataset *set, const uint8_t *value,
+        const uint16_t len, const uint32_t hash)
+{
+    if (set->slots == NULL)
+        return 0;
+
+    uint64_t idx = hash & set->mask;
+    for (uint64_t n = 0; n <= set->mask; n++, idx = (idx + 1) & set->mask) {
+        const DatasetSlot *slot = &set->slots[idx];
+        if (slot->offset == 0)
+            return 0;
+        if (slot->hash != hash)
+            continue;
+
+        uint16_t vlen;
+        if ((uint64_t)slot->offset + sizeof(vlen) + len > set->data_len)
+            continue;
+        memcpy(&vlen, set->data + slot->offset, sizeof(vlen));
+        if (vlen == len && memcmp(set->data + slot->offset + sizeof(vlen), value, len) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ *  \brief check if a buffer is in a set
+ *
+ *  \retval 1 in the set
+ *  \retval 0 not in the set or not a valid value for the set's type
+ */
+int DatasetLookup(Dataset *set, const uint8_t *data, const uint32_t data_len)
+{
+    uint8_t raw[32];
+    const uint8_t *value = NULL;
+
+    const int len = DatasetParseValue(set->type, data, data_len, raw, &value);
+    if (len < 0)
+        return 0;
+    const uint32_t hash = DatasetHash(value, (uint16_t)len);
+
+    int r;
+    if (likely(SC_ATOMIC_GET(set->overlay_cnt) == 0)) {
+        r = DatasetTableLookup(set, value, (uint16_t)len, hash);
+    } else {
+        SCRWLockRDLock(&set->overlay_lock);
+        if (HashListTableLookup(set->removed, (void *)value, (uint16_t)len) != NULL) {
+            r = 0;
+        } else {
+            r = DatasetTableLookup(set, value, (uint16_t)len, hash) ||
+                HashListTableLookup(set->added, (void *)value, (uint16_t)len) != NULL;
+        }
+        SCRWLockUnlock(&set->overlay_lock);
+    }
+    return r;
+}
+
+static uint32_t DatasetOverlayHash(HashListTable *ht, void *data, uint16_t len)
+{
+    return DatasetHash(data, len) % ht->array_size;
+}
+
+static char DatasetOverlayCompare(void *data1, uint16_t len1, void *data2, uint16_t len2)
+{
+    return len1 == len2 && memcmp(data1, data2, len1) == 0;
+}
+
+static void DatasetOverlayFree(void *data)
+{
+    SCFree(data);
+}
+
+/** \internal
+ *  \retval 1 added, 0 already there, -1 error */
+static int DatasetOverlayInsert(HashListTable *ht, const uint8_t *value, const uint16_t len)
+{
+    if (HashListTableLookup(ht, (void *)value, len) != NULL)
+        return 0;
+
+    uint8_t *copy = SCMalloc(len ? len : 1);
+    if (unlikely(copy == NULL))
+        return -1;
+    memcpy(copy, value, len);
+    if (HashListTableAdd(ht, copy, len) != 0) {
+        SCFree(copy);
+        return -1;
+    }
+    return 1;
+}
+
+/** \internal
+ *  \brief add or remove a value, overlay lock held for writing */
+static int DatasetOverlayUpdate(Dataset *set, const uint8_t *value,
+        const uint16_t len, const bool add)
+{
+    const bool in_table = DatasetTableLookup(set, value, len, DatasetHash(value, len));
+    HashListTable *from = add ? set->removed : set->added;
+    HashListTable *to = add ? set->added : set->removed;
+    int r = 0;
+
+    if (HashListTableRemove(from, (void *)value, len) == 0)
+        (void)SC_ATOMIC_SUB(set->overlay_cnt, 1);
+    if (in_table != add) {
+        r = DatasetOverlayInsert(to, value, len);
+        if (r == 1) {
+            (void)SC_ATOMIC_ADD(set->overlay_cnt, 1);
+            r = 0;
+        }
+    }
+    return r;
+}
+
+/** \internal
+ *  \brief set up the table pointers for a set file image
+ *
+ *  \retval 0 ok, -1 not a valid set file for this set
+ */
+static int DatasetTableSetup(Dataset *set, const char *filename)
+{
+    const DatasetFileHeader *hdr = (const DatasetFileHeader *)set->image;
+
+    if (set->image_len < sizeof(*hdr) ||
+            memcmp(hdr->magic, DATASET_FILE_MAGIC, sizeof(hdr->magic)) != 0) {
+        SCLogError(SC_ERR_DATASET, "%s: not a set file", filename);
+        return -1;
+    }
+    if (hdr->byte_order != DATASET_FILE_BYTE_ORDER) {
+        SCLogError(SC_ERR_DATASET, "%s: set file was built on a host with "
+                "a different byte order", filename);
+        return -1;
+    }
+    if (hdr->type != (uint32_t)set->type) {
+        SCLogError(SC_ERR_DATASET, "%s: set file is of type %s, not %s",
+                filename, DatasetTypeToString(hdr->type),
+                DatasetTypeToString(set->type));
+        return -1;
+    }
+    if (hdr->slots < DATASET_MIN_SLOTS || (hdr->slots & (hdr->slots - 1)) != 0 ||
+            hdr->slots > (set->image_len - sizeof(*hdr)) / sizeof(DatasetSlot) ||
+            hdr->data_len != set->image_len - sizeof(*hdr) - hdr->slots * sizeof(DatasetSlot)) {
+        SCLogError(SC_ERR_DATASET, "%s: set file is corrupt", filename);
+        return -1;
+    }
+
+    set->slots = (const DatasetSlot *)(set->image + sizeof(*hdr));
+    set->mask = hdr->slots - 1;
+    set->count = hdr->count;
+    set->data = set->image + sizeof(*hdr) + hdr->slots * sizeof(DatasetSlot);
+    set->data_len = hdr->data_len;
+    return 0;
+}
+
+/** \internal
+ *  \brief build a set file image from a list with one value per line
+ *
+ *  Empty lines and lines starting with a '#' are skipped.
+ *
+ *  \retval 0 ok, -1 error
+ */
+static int DatasetBuildImage(const enum DatasetTypes type, const char *source,
+        uint8_t **out, size_t *out_len)
+{
+    FILE *fp = fopen(source, "r");
+    if (fp == NULL) {
+        SCLogError(SC_ERR_FOPEN, "failed to open %s: %s", source, strerror(errno));
+        return -1;
+    }
+
+    /* values, each preceded by its 16 bit length. Offset 0 marks an empty
+     * slot so the first byte is not used. */
+    uint8_t *data = NULL;
+    uint64_t data_len = 1, data_size = 0;
+    uint32_t *offsets = NULL;
+    uint64_t cnt = 0, size = 0;
+    char line[8192];
+    int line_no = 0;
+    int r = -1;
+
+    while (fgets(line, (int)sizeof(line), fp) != NULL) {
+        line_no++;
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0 || line[0] == '#')
+            continue;
+
+        uint8_t raw[32];
+        const uint8_t *value = NULL;
+        const int vlen = DatasetParseValue(type, (uint8_t *)line, (uint32_t)len, raw, &value);
+        if (vlen < 0) {
+            SCLogWarning(SC_ERR_DATASET, "%s:%d: invalid %s value, skipping",
+                    source, line_no, DatasetTypeToString(type));
+            continue;
+        }
+        const uint16_t len16 = (uint16_t)vlen;
+
+        if (data_len + sizeof(len16) + len16 > UINT32_MAX) {
+            SCLogError(SC_ERR_DATASET, "%s: list too large", source);
+            goto end;
+        }
+        if (data_len + sizeof(len16) + len16 > data_size) {
+            uint64_t new_size = data_size ? data_size * 2 : 65536;
+            while (new_size < data_len + sizeof(len16) + len16)
+                new_size *= 2;
+            uint8_t *ptmp = SCRealloc(data, new_size);
+            if (ptmp == NULL)
+                goto end;
+            data = ptmp;
+            data_size = new_size;
+        }
+        if (cnt == size) {
+            uint64_t new_size = size ? size * 2 : 4096;
+            uint32_t *ptmp = SCRealloc(offsets, new_size * sizeof(uint32_t));
+            if (ptmp == NULL)
+                goto end;
+            offsets = ptmp;
+            size = new_size;
+        }
+
+        offsets[cnt++] = (uint32_t)data_len;
+        memcpy(data + data_len, &len16, sizeof(len16));
+        memcpy(data + data_len + sizeof(len16), value, len16);
+        data_len += sizeof(len16) + len16;
+    }
+
+    uint64_t slots = DATASET_MIN_SLOTS;
+    while (slots < cnt * DATASET_SLOTS_PER_VALUE)
+        slots *= 2;
+
+    const size_t image_len = sizeof(DatasetFileHeader) +
+        slots * sizeof(DatasetSlot) + data_len;
+    uint8_t *image = SCCalloc(1, image_len);
+    if (image == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "%s: can't allocate %"PRIuMAX" bytes for the set",
+                source, (uintmax_t)image_len);
+        goto end;
+    }
+    DatasetFileHeader *hdr = (DatasetFileHeader *)image;
+    DatasetSlot *table = (DatasetSlot *)(image + sizeof(*hdr));
+    uint8_t *table_data = image + sizeof(*hdr) + slots * sizeof(DatasetSlot);
+    if (data != NULL)
+        memcpy(table_data, data, data_len);
+
+    uint64_t inserted = 0;
+    for (uint64_t i = 0; i < cnt; i++) {
+        uint16_t len16;
+        memcpy(&len16, data + offsets[i], sizeof(len16));
+        const uint8_t *value = data + offsets[i] + sizeof(len16);
+        const uint32_t hash = DatasetHash(value, len16);
+
+        uint64_t idx = hash & (slots - 1);
+        for ( ; table[idx].offset != 0; idx = (idx + 1) & (slots - 1)) {
+            uint16_t l;
+            memcpy(&l, data + table[idx].offset, sizeof(l));
+            if (table[idx].hash == hash && l == len16 &&
+                    memcmp(data + table[idx].offset + sizeof(l), value, len16) == 0)
+                break;
+        }
+        if (table[idx].offset != 0)
+            continue; /* duplicate */
+        table[idx].hash = hash;
+        table[idx].offset = offsets[i];
+        inserted++;
+    }
+
+    memcpy(hdr->magic, DATASET_FILE_MAGIC, sizeof(hdr->magic));
+    hdr->byte_order = DATASET_FILE_BYTE_ORDER;
+    hdr->type = type;
+    hdr->slots = slots;
+    hdr->count = inserted;
+    hdr->data_len = data_len;
+
+    SCLogConfig("%s: %"PRIu64" values, %"PRIu64" duplicates", source,
+            inserted, cnt - inserted);
+    *out = image;
+    *out_len = image_len;
+    r = 0;
+end:
+    fclose(fp);
+    if (data != NULL)
+        SCFree(data);
+    if (offsets != NULL)
+        SCFree(offsets);
+    return r;
+}
+
+/** \internal
+ *  \brief write an image to the set file, through a temp file so that
+ *         other instances mapping the file don't see a partial file */
+static int DatasetWriteFile(const char *filename, const uint8_t *image, const size_t len)
+{
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", filename) >= (int)sizeof(tmp))
+        return -1;
+
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL) {
+        SCLogWarning(SC_ERR_FOPEN, "failed to write set file %s: %s",
+                tmp, strerror(errno));
+        return -1;
+    }
+    size_t written = fwrite(image, 1, len, fp);
+    if (fclose(fp) != 0 || written != len) {
+        SCLogWarning(SC_ERR_FWRITE, "failed to write set file %s", tmp);
+        unlink(tmp);
+        return -1;
+    }
+    if (rename(tmp, filename) != 0) {
+        SCLogWarning(SC_ERR_FWRITE, "failed to rename %s to %s: %s",
+                tmp, filename, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static int DatasetMapFile(Dataset *set)
+{
+    int fd = open(set->file, O_RDONLY);
+    if (fd < 0) {
+        SCLogError(SC_ERR_FOPEN, "failed to open %s: %s", set->file, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &set->file_st) != 0 || set->file_st.st_size <= 0) {
+        SCLogError(SC_ERR_DATASET, "%s: empty or unreadable set file", set->file);
+        close(fd);
+        return -1;
+    }
+    set->image_len = (size_t)set->file_st.st_size;
+
+#ifdef HAVE_SYS_MMAN_H
+    void *image = mmap(NULL, set->image_len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        SCLogError(SC_ERR_DATASET, "failed to map %s: %s", set->file, strerror(errno));
+        return -1;
+    }
+    set->image = image;
+    set->mapped = true;
+#else
+    set->image = SCMalloc(set->image_len);
+    if (set->image == NULL) {
+        close(fd);
+        return -1;
+    }
+    ssize_t r = read(fd, set->image, set->image_len);
+    close(fd);
+    if (r < 0 || (size_t)r != set->image_len) {
+        SCLogError(SC_ERR_DATASET, "failed to read %s", set->file);
+        return -1;
+    }
+#endif
+    return DatasetTableSetup(set, set->file);
+}
+
+static void DatasetFree(Dataset *set)
+{
+    if (set->image != NULL) {
+#ifdef HAVE_SYS_MMAN_H
+        if (set->mapped)
+            munmap(set->image, set->image_len);
+        else
+#endif
+            SCFree(set->image);
+    }
+    if (set->added != NULL)
+        HashListTableFree(set->added);
+    if (set->removed != NULL)
+        HashListTableFree(set->removed);
+    if (set->file != NULL)
+        SCFree(set->file);
+    if (set->source != NULL)
+        SCFree(set->source);
+    SCRWLockDestroy(&set->overlay_lock);
+    SCFree(set);
+}
+
+/** \internal
+ *  \brief load a set as defined in the 'datasets' yaml section
+ *
+ *  With a 'source' list the set file is rebuilt when it's missing or older
+ *  than the list. Without a set file the table is built on the heap.
+ *  Without either the set only holds the values added at runtime.
+ */
+static Dataset *DatasetLoad(const char *name)
+{
+    ConfNode *root = ConfGetNode("datasets");
+    ConfNode *node = root ? ConfNodeLookupChild(root, name) : NULL;
+    if (node == NULL) {
+        SCLogError(SC_ERR_DATASET, "dataset '%s' is not defined in the "
+                "'datasets' section of the configuration", name);
+        return NULL;
+    }
+    const char *type_str = ConfNodeLookupChildValue(node, "type");
+    const char *file = ConfNodeLookupChildValue(node, "file");
+    const char *source = ConfNodeLookupChildValue(node, "source");
+
+    const enum DatasetTypes type = type_str ? DatasetTypeFromString(type_str) : DATASET_TYPE_NOTSET;
+    if (type == DATASET_TYPE_NOTSET) {
+        SCLogError(SC_ERR_DATASET, "dataset '%s': type must be one of "
+                "string, md5 or sha256", name);
+        return NULL;
+    }
+
+    Dataset *set = SCCalloc(1, sizeof(*set));
+    if (unlikely(set == NULL))
+        return NULL;
+    strlcpy(set->name, name, sizeof(set->name));
+    set->type = type;
+    set->value_len = DatasetTypeValueLen(type);
+    SCRWLockInit(&set->overlay_lock, NULL);
+    SC_ATOMIC_INIT(set->overlay_cnt);
+    set->added = HashListTableInit(DATASET_OVERLAY_HASH_SIZE, DatasetOverlayHash,
+            DatasetOverlayCompare, DatasetOverlayFree);
+    set->removed = HashListTableInit(DATASET_OVERLAY_HASH_SIZE, DatasetOverlayHash,
+            DatasetOverlayCompare, DatasetOverlayFree);
+    if (set->added == NULL || set->removed == NULL)
+        goto error;
+    if (file != NULL && (set->file = SCStrdup(file)) == NULL)
+        goto error;
+    if (source != NULL && (set->source = SCStrdup(source)) == NULL)
+        goto error;
+
+    if (source != NULL && stat(source, &set->source_st) != 0) {
+        SCLogError(SC_ERR_FOPEN, "dataset '%s': can't read %s: %s", name,
+                source, strerror(errno));
+        goto error;
+    }
+
+    bool build = (source != NULL);
+    if (file != NULL && source != NULL) {
+        struct stat st;
+        if (stat(file, &st) == 0 && st.st_mtime >= set->source_st.st_mtime)
+            build = false;
+    }
+
+    if (build) {
+        uint8_t *image = NULL;
+        size_t image_len = 0;
+        if (DatasetBuildImage(type, source, &image, &image_len) < 0)
+            goto error;
+        if (file == NULL || DatasetWriteFile(file, image, image_len) < 0) {
+            /* use the heap copy */
+            set->image = image;
+            set->image_len = image_len;
+            if (set->file != NULL) {
+                SCFree(set->file);
+                set->file = NULL;
+            }
+            if (DatasetTableSetup(set, source) < 0)
+                goto error;
+        } else {
+            SCFree(image);
+        }
+    }
+    if (set->image == NULL && set->file != NULL) {
+        if (DatasetMapFile(set) < 0)
+            goto error;
+    }
+
+    SCLogConfig("dataset '%s': %s, %"PRIu64" values, %"PRIu64" bytes", name,
+            DatasetTypeToString(type), set->count, DatasetMemoryUse(set));
+    return set;
+
+error:
+    DatasetFree(set);
+    return NULL;
+}
+
+static bool DatasetFileChanged(const char *filename, const struct stat *old)
+{
+    struct stat st;
+    if (filename == NULL)
+        return false;
+    if (stat(filename, &st) != 0)
+        return false;
+    return st.st_mtime != old->st_mtime || st.st_size != old->st_size ||
+        st.st_ino != old->st_ino;
+}
+
+/** \internal
+ *  \brief copy the runtime changes to a newly loaded version of a set */
+static void DatasetCopyOverlay(Dataset *from, Dataset *to)
+{
+    SCRWLockRDLock(&from->overlay_lock);
+    SCRWLockWRLock(&to->overlay_lock);
+    for (HashListTableBucket *b = HashListTableGetListHead(from->added); b != NULL;
+            b = HashListTableGetListNext(b))
+        (void)DatasetOverlayUpdate(to, HashListTableGetListData(b), b->size, true);
+    for (HashListTableBucket *b = HashListTableGetListHead(from->removed); b != NULL;
+            b = HashListTableGetListNext(b))
+        (void)DatasetOverlayUpdate(to, HashListTableGetListData(b), b->size, false);
+    SCRWLockUnlock(&to->overlay_lock);
+    SCRWLockUnlock(&from->overlay_lock);
+}
+
+/** \internal
+ *  \brief unlink a set from the list and drop the list's reference,
+ *         sets lock held */
+static void DatasetUnlink(Dataset *set)
+{
+    Dataset *prev = NULL;
+    for (Dataset *s = sets; s != NULL; prev = s, s = s->next) {
+        if (s != set)
+            continue;
+        if (prev == NULL)
+            sets = s->next;
+        else
+            prev->next = s->next;
+        s->next = NULL;
+        if (--s->ref_cnt == 0)
+            DatasetFree(s);
+        return;
+    }
+}
+
+/** \internal
+ *  \brief find a set in the list, sets lock held */
+static Dataset *DatasetLookupName(const char *name)
+{
+    for (Dataset *s = sets; s != NULL; s = s->next) {
+        if (strcmp(s->name, name) == 0)
+            return s;
+    }
+    return NULL;
+}
+
+/**
+ *  \brief get a reference to a set, loading it on first use or when its
+ *         files changed
+ *
+ *  \retval set or NULL if the set is not defined or failed to load
+ */
+Dataset *DatasetGet(const char *name)
+{
+    SCMutexLock(&sets_lock);
+    Dataset *set = DatasetLookupName(name);
+    if (set != NULL &&
+            (DatasetFileChanged(set->file, &set->file_st) ||
+             DatasetFileChanged(set->source, &set->source_st)))
+    {
+        SCLogInfo("dataset '%s': files changed, loading it again", name);
+        Dataset *new_set = DatasetLoad(name);
+        if (new_set != NULL) {
+            DatasetCopyOverlay(set, new_set);
+            DatasetUnlink(set);
+            new_set->ref_cnt = 1;
+            new_set->next = sets;
+            sets = new_set;
+            set = new_set;
+        }
+    } else if (set == NULL) {
+        set = DatasetLoad(name);
+        if (set != NULL) {
+            set->ref_cnt = 1;
+            set->next = sets;
+            sets = set;
+        }
+    }
+    if (set != NULL)
+        set->ref_cnt++;
+    SCMutexUnlock(&sets_lock);
+    return set;
+}
+
+void DatasetRelease(Dataset *set)
+{
+    if (set == NULL)
+        return;
+    SCMutexLock(&sets_lock);
+    if (--set->ref_cnt == 0)
+        DatasetFree(set);
+    SCMutexUnlock(&sets_lock);
+}
+
+static int DatasetUpdate(const char *name, const char *value, const bool add)
+{
+    int r = -1;
+    SCMutexLock(&sets_lock);
+    Dataset *set = DatasetLookupName(name);
+    if (set != NULL) {
+        uint8_t raw[32];
+        const uint8_t *v = NULL;
+        const int len = DatasetParseValue(set->type, (const uint8_t *)value,
+                (uint32_t)strlen(value), raw, &v);
+        if (len >= 0) {
+            SCRWLockWRLock(&set->overlay_lock);
+            r = DatasetOverlayUpdate(set, v, (uint16_t)len, add);
+            SCRWLockUnlock(&set->overlay_lock);
+        }
+    }
+    SCMutexUnlock(&sets_lock);
+    return r;
+}
+
+/**
+ *  \brief add a value to a loaded set
+ *
+ *  \retval 0 ok, -1 unknown set or invalid value
+ */
+int DatasetAdd(const char *name, const char *value)
+{
+    return DatasetUpdate(name, value, true);
+}
+
+/**
+ *  \brief remove a value from a loaded set
+ *
+ *  \retval 0 ok, -1 unknown set or invalid value
+ */
+int DatasetRemove(const char *name, const char *value)
+{
+    return DatasetUpdate(name, value, false);
+}
+
+void DatasetListAll(void (*Callback)(const Dataset *, void *), void *data)
+{
+    SCMutexLock(&sets_lock);
+    for (Dataset *s = sets; s != NULL; s = s->next) {
+        SCRWLockRDLock(&s->overlay_lock);
+        Callback(s, data);
+        SCRWLockUnlock(&s->overlay_lock);
+    }
+    SCMutexUnlock(&sets_lock);
+}
+
+uint64_t DatasetMemoryUse(const Dataset *set)
+{
+    return sizeof(*set) + set->image_len;
+}
+
+/** \brief drop the sets that are not used by a detection engine anymore */
+void DatasetsDestroy(void)
+{
+    SCMutexLock(&sets_lock);
+    while (sets != NULL) {
+        DatasetUnlink(sets);
+    }
+    SCMutexUnlock(&sets_lock);
+}
+
+#ifdef UNITTESTS
+#include "conf-yaml-loader.h"
+
+static int DatasetTestWriteList(const char *filename, const char *list)
+{
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL)
+        return -1;
+    fputs(list, fp);
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * \test build a set file from a list, map it and update it at runtime
+ */
+static int DatasetTest01(void)
+{
+    char source[PATH_MAX], file[PATH_MAX], conf[PATH_MAX * 2 + 256];
+    snprintf(source, sizeof(source), "/tmp/suricata-dataset-test-%d.txt", (int)getpid());
+    snprintf(file, sizeof(file), "/tmp/suricata-dataset-test-%d.set", (int)getpid());
+    FAIL_IF(DatasetTestWriteList(source,
+                "# comment\nexample.com\nexample.net\n\nexample.com\nwww.example.org\n") < 0);
+    snprintf(conf, sizeof(conf),
+            "%%YAML 1.1\n---\n"
+            "datasets:\n"
+            "  domains:\n"
+            "    type: string\n"
+            "    source: %s\n"
+            "    file: %s\n", source, file);
+
+    ConfCreateContextBackup();
+    ConfInit();
+    FAIL_IF(ConfYamlLoadString(conf, strlen(conf)) != 0);
+
+    Dataset *set = DatasetGet("domains");
+    FAIL_IF_NULL(set);
+    FAIL_IF_NOT(set->mapped);
+    FAIL_IF_NOT(set->count == 3);
+    FAIL_IF_NOT(DatasetLookup(set, (const uint8_t *)"example.com", 11));
+    FAIL_IF_NOT(DatasetLookup(set, (const uint8_t *)"www.example.org", 15));
+    FAIL_IF(DatasetLookup(set, (const uint8_t *)"example.co", 10));
+    FAIL_IF(DatasetLookup(set, (const uint8_t *)"example.org", 11));
+
+    /* second user shares the set */
+    Dataset *set2 = DatasetGet("domains");
+    FAIL_IF_NOT(set == set2);
+    DatasetRelease(set2);
+
+    FAIL_IF(DatasetAdd("domains", "example.org") != 0);
+    FAIL_IF(DatasetRemove("domains", "example.net") != 0);
+    FAIL_IF(DatasetAdd("nosuchset", "example.org") == 0);
+    FAIL_IF_NOT(SC_ATOMIC_GET(set->overlay_cnt) == 2);
+    FAIL_IF_NOT(DatasetLookup(set, (const uint8_t *)"example.org", 11));
+    FAIL_IF(DatasetLookup(set, (const uint8_t *)"example.net", 11));
+    FAIL_IF(DatasetAdd("domains", "example.net") != 0);
+    FAIL_IF_NOT(DatasetLookup(set, (const uint8_t *)"example.net", 11));
+    FAIL_IF_NOT(SC_ATOMIC_GET(set->overlay_cnt) == 1);
+    FAIL_IF(DatasetAdd("domains", "example.org") != 0);
+    FAIL_IF_NOT(SC_ATOMIC_GET(set->overlay_cnt) == 1);
+
+    DatasetRelease(set);
+    DatasetsDestroy();
+    ConfRestoreContextBackup();
+    unlink(source);
+    unlink(file);
+    PASS;
+}
+
+/**
+ * \test hash set matching hex buffers, without a set file
+ */
+static int DatasetTest02(void)
+{
+    char source[PATH_MAX], conf[PATH_MAX + 256];
+    snprintf(source, sizeof(source), "/tmp/suricata-dataset-test-%d.txt", (int)getpid());
+    FAIL_IF(DatasetTestWriteList(source,
+                "e7eca2a2b3ae8a9e6d9f4b7a9e4f3f4e\nnot a hash\n"
+                "E7ECA2A2B3AE8A9E6D9F4B7A9E4F3F4F\n") < 0);
+    snprintf(conf, sizeof(conf),
+            "%%YAML 1.1\n---\n"
+            "datasets:\n"
+            "  ja3:\n"
+            "    type: md5\n"
+            "    source: %s\n", source);
+
+    ConfCreateContextBackup();
+    ConfInit();
+    FAIL_IF(ConfYamlLoadString(conf, strlen(conf)) != 0);
+
+    Dataset *set = DatasetGet("ja3");
+    FAIL_IF_NULL(set);
+    FAIL_IF(set->mapped);
+    FAIL_IF_NOT(set->count == 2);
+    FAIL_IF_NOT(DatasetLookup(set, (const uint8_t *)"e7eca2a2b3ae8a9e6d9f4b7a9e4f3f4e", 32));
+    FAIL_IF_NOT(DatasetLookup(set, (const uint8_t *)"e7eca2a2b3ae8a9e6d9f4b7a9e4f3f4f", 32));
+    FAIL_IF(DatasetLookup(set, (const uint8_t *)"e7eca2a2b3ae8a9e6d9f4b7a9e4f3f40", 32));
+    FAIL_IF(DatasetLookup(set, (const uint8_t *)"e7eca2a2b3ae8a9e6d9f4b7a9e4f3f4", 31));
+    /* only the hex form matches, not the 16 raw bytes */
+    const uint8_t raw[16] = { 0xe7, 0xec, 0xa2, 0xa2, 0xb3, 0xae, 0x8a, 0x9e,
+                              0x6d, 0x9f, 0x4b, 0x7a, 0x9e, 0x4f, 0x3f, 0x4e };
+    FAIL_IF(DatasetLookup(set, raw, sizeof(raw)));
+
+    DatasetRelease(set);
+    DatasetsDestroy();
+    ConfRestoreContextBackup();
+    unlink(source);
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void DatasetRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("DatasetTest01", DatasetTest01);
+    UtRegisterTest("DatasetTest02", DatasetTest02);
+#endif
+}
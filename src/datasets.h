@@ -0,0 +1,101 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Named sets of values for matching large lists of indicators.
+ */
+
+#ifndef __DATASETS_H__
+#define __DATASETS_H__
+
+#include "util-hashlist.h"
+
+#define DATASET_NAME_MAX_LEN 63
+
+enum DatasetTypes {
+    DATASET_TYPE_NOTSET = 0,
+    DATASET_TYPE_STRING,
+    DATASET_TYPE_MD5,
+    DATASET_TYPE_SHA256,
+};
+
+/** compiled set file header, followed by the slots and the values. The
+ *  file is in host byte order. */
+typedef struct DatasetFileHeader_ {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t type;
+    uint64_t slots;     /**< power of 2 */
+    uint64_t count;
+    uint64_t data_len;
+} DatasetFileHeader;
+
+/** open addressing slot, offset 0 is an empty slot */
+typedef struct DatasetSlot_ {
+    uint32_t hash;
+    uint32_t offset;    /**< of the value's 16 bit length in the data */
+} DatasetSlot;
+
+typedef struct Dataset_ {
+    char name[DATASET_NAME_MAX_LEN + 1];
+    enum DatasetTypes type;
+    uint16_t value_len;     /**< 0 for strings */
+
+    /* read only table: the mapped set file or a heap copy */
+    uint8_t *image;
+    size_t image_len;
+    bool mapped;
+    const DatasetSlot *slots;
+    uint64_t mask;
+    uint64_t count;
+    const uint8_t *data;
+    uint64_t data_len;
+
+    /* files the table was built from, to detect changes on reload */
+    char *file;
+    char *source;
+    struct stat file_st;
+    struct stat source_st;
+
+    /* values added and removed at runtime. Lookups take the lock for
+     * reading, and only when there are runtime changes. */
+    SCRWLock overlay_lock;
+    HashListTable *added;
+    HashListTable *removed;
+    SC_ATOMIC_DECLARE(uint32_t, overlay_cnt);
+
+    /** references from rules and the set list, protected by the list lock */
+    uint32_t ref_cnt;
+    struct Dataset_ *next;
+} Dataset;
+
+Dataset *DatasetGet(const char *name);
+void DatasetRelease(Dataset *set);
+int DatasetLookup(Dataset *set, const uint8_t *data, const uint32_t data_len);
+
+int DatasetAdd(const char *name, const char *value);
+int DatasetRemove(const char *name, const char *value);
+void DatasetListAll(void (*Callback)(const Dataset *, void *), void *data);
+const char *DatasetTypeToString(enum DatasetTypes type);
+uint64_t DatasetMemoryUse(const Dataset *set);
+
+void DatasetsDestroy(void);
+void DatasetRegisterTests(void);
+
+#endif /* __DATASETS_H__ */
@@ -689,6 +689,10 @@ typedef struct DecodeThreadVars_
      * flow recycle during lookups */
     void *output_flow_thread_data;
 
+    /** flow hash partition owned by this thread, NULL if the
+     *  flow hash is shared */
+    struct FlowPartition_ *flow_partition;
+
 } DecodeThreadVars;
 
 typedef struct CaptureStats_ {
@@ -365,6 +365,10 @@ void DetectContentFree(void *ptr)
         SCReturn;
 
     SpmDestroyCtx(cd->spm_ctx);
+    if (cd->ci_fast != NULL)
+        SCFree(cd->ci_fast);
+    if (cd->ci_multi != NULL && cd->ci_multi_owner)
+        SCFree(cd->ci_multi);
 
     SCFree(cd);
     SCReturn;
@@ -104,6 +104,16 @@ typedef struct DetectContentData_ {
     SpmCtx *spm_ctx;
     /* pointer to replacement data */
     uint8_t *replace;
+    /* specialized matcher for the list starting with this content */
+    struct DetectContentInspectFast_ *ci_fast;
+    /* secondary matcher of the list this content is in. Owned by the
+     * first content of the list. */
+    struct DetectContentMultiSpm_ *ci_multi;
+    uint8_t ci_multi_id;    /**< pattern of this content in ci_multi */
+    bool ci_multi_owner;
+    /* id shared by the contents with the same pattern in the inspection
+     * cache, 0 if not cached */
+    uint32_t ci_cache_id;
 } DetectContentData;
 
 /* prototypes */
@@ -0,0 +1,206 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Implements the dataset keyword: match a sticky buffer against a set
+ * of values.
+ */
+
+#include "suricata-common.h"
+#include "util-unittest.h"
+
+#include "detect.h"
+#include "detect-parse.h"
+#include "detect-engine.h"
+
+#include "datasets.h"
+#include "detect-dataset.h"
+
+#include "util-debug.h"
+
+static int DetectDatasetSetup (DetectEngineCtx *, Signature *, const char *);
+static void DetectDatasetFree (void *);
+#ifdef UNITTESTS
+static void DetectDatasetRegisterTests(void);
+#endif
+
+void DetectDatasetRegister (void)
+{
+    sigmatch_table[DETECT_DATASET].name = "dataset";
+    sigmatch_table[DETECT_DATASET].desc = "match sticky buffer against a set of values";
+    sigmatch_table[DETECT_DATASET].url = DOC_URL DOC_VERSION "/rules/datasets.html";
+    sigmatch_table[DETECT_DATASET].Setup = DetectDatasetSetup;
+    sigmatch_table[DETECT_DATASET].Free = DetectDatasetFree;
+#ifdef UNITTESTS
+    sigmatch_table[DETECT_DATASET].RegisterTests = DetectDatasetRegisterTests;
+#endif
+}
+
+/**
+ *  \brief match a buffer against the set
+ *
+ *  \retval 1 match
+ *  \retval 0 no match
+ */
+int DetectDatasetBufferMatch(DetectEngineThreadCtx *det_ctx,
+        const DetectDatasetData *sd, const uint8_t *data, const uint32_t data_len)
+{
+    if (data == NULL || data_len == 0)
+        return 0;
+
+    const int r = DatasetLookup(sd->set, data, data_len);
+    StatsIncr(det_ctx->tv, det_ctx->counter_dataset_lookups);
+    if (r)
+        StatsIncr(det_ctx->tv, det_ctx->counter_dataset_hits);
+    if (sd->cmd == DETECT_DATASET_CMD_ISNOTSET)
+        return !r;
+    return r;
+}
+
+/** \internal
+ *  \brief parse "<isset|isnotset>,<name>"
+ */
+static int DetectDatasetParse(const char *str, uint8_t *cmd,
+        char *name, const size_t name_size)
+{
+    char copy[DATASET_NAME_MAX_LEN + 32];
+    if (strlcpy(copy, str, sizeof(copy)) >= sizeof(copy))
+        return -1;
+
+    char *sep = strchr(copy, ',');
+    if (sep == NULL)
+        return -1;
+    *sep = '\0';
+
+    char *c = copy;
+    char *n = sep + 1;
+    while (isspace((unsigned char)*c))
+        c++;
+    while (isspace((unsigned char)*n))
+        n++;
+    for (char *e = c + strlen(c); e > c && isspace((unsigned char)e[-1]); )
+        *--e = '\0';
+    for (char *e = n + strlen(n); e > n && isspace((unsigned char)e[-1]); )
+        *--e = '\0';
+
+    if (strcmp(c, "isset") == 0)
+        *cmd = DETECT_DATASET_CMD_ISSET;
+    else if (strcmp(c, "isnotset") == 0)
+        *cmd = DETECT_DATASET_CMD_ISNOTSET;
+    else
+        return -1;
+
+    if (strlen(n) == 0 || strlen(n) >= name_size)
+        return -1;
+    strlcpy(name, n, name_size);
+    return 0;
+}
+
+static int DetectDatasetSetup (DetectEngineCtx *de_ctx, Signature *s, const char *rawstr)
+{
+    uint8_t cmd = 0;
+    char name[DATASET_NAME_MAX_LEN + 1];
+
+    if (DetectBufferGetActiveList(de_ctx, s) == -1)
+        return -1;
+    int list = s->init_data->list;
+    if (list == DETECT_SM_LIST_NOTSET) {
+        SCLogError(SC_ERR_INVALID_SIGNATURE, "dataset is only supported "
+                "with sticky buffers");
+        return -1;
+    }
+
+    if (DetectDatasetParse(rawstr, &cmd, name, sizeof(name)) < 0) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "invalid dataset option \"%s\", "
+                "expected isset,<name> or isnotset,<name>", rawstr);
+        return -1;
+    }
+
+    DetectDatasetData *sd = SCCalloc(1, sizeof(*sd));
+    if (unlikely(sd == NULL))
+        return -1;
+    sd->cmd = cmd;
+    sd->set = DatasetGet(name);
+    if (sd->set == NULL) {
+        SCFree(sd);
+        return -1;
+    }
+
+    SigMatch *sm = SigMatchAlloc();
+    if (sm == NULL) {
+        DetectDatasetFree(sd);
+        return -1;
+    }
+    sm->type = DETECT_DATASET;
+    sm->ctx = (SigMatchCtx *)sd;
+    SigMatchAppendSMToList(s, sm, list);
+    return 0;
+}
+
+static void DetectDatasetFree (void *ptr)
+{
+    DetectDatasetData *sd = (DetectDatasetData *)ptr;
+    if (sd == NULL)
+        return;
+    DatasetRelease(sd->set);
+    SCFree(sd);
+}
+
+#ifdef UNITTESTS
+#include "conf-yaml-loader.h"
+
+static int DetectDatasetTest01(void)
+{
+    const char *conf =
+        "%YAML 1.1\n---\n"
+        "datasets:\n"
+        "  domains:\n"
+        "    type: string\n";
+
+    ConfCreateContextBackup();
+    ConfInit();
+    FAIL_IF(ConfYamlLoadString(conf, strlen(conf)) != 0);
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    FAIL_IF_NULL(de_ctx);
+
+    FAIL_IF_NULL(DetectEngineAppendSig(de_ctx, "alert dns any any -> any any "
+                "(dns.query; dataset:isset,domains; sid:1;)"));
+    FAIL_IF_NULL(DetectEngineAppendSig(de_ctx, "alert http any any -> any any "
+                "(http.host; dataset: isnotset , domains; sid:2;)"));
+    FAIL_IF_NOT_NULL(DetectEngineAppendSig(de_ctx, "alert dns any any -> any any "
+                "(dataset:isset,domains; sid:3;)"));
+    FAIL_IF_NOT_NULL(DetectEngineAppendSig(de_ctx, "alert dns any any -> any any "
+                "(dns.query; dataset:isset,nosuchset; sid:4;)"));
+    FAIL_IF_NOT_NULL(DetectEngineAppendSig(de_ctx, "alert dns any any -> any any "
+                "(dns.query; dataset:has,domains; sid:5;)"));
+    FAIL_IF_NOT_NULL(DetectEngineAppendSig(de_ctx, "alert dns any any -> any any "
+                "(dns.query; dataset:isset; sid:6;)"));
+
+    DetectEngineCtxFree(de_ctx);
+    DatasetsDestroy();
+    ConfRestoreContextBackup();
+    PASS;
+}
+
+static void DetectDatasetRegisterTests(void)
+{
+    UtRegisterTest("DetectDatasetTest01", DetectDatasetTest01);
+}
+#endif
@@ -32,6 +32,7 @@
 #include "detect-engine-analyzer.h"
 #include "detect-engine-mpm.h"
 #include "conf.h"
+#include "app-layer-htp.h"
 #include "detect-content.h"
 #include "detect-flow.h"
 #include "detect-tcp-flags.h"
@@ -344,6 +345,79 @@ void CleanupRuleAnalyzer(void)
     }
 }
 
+typedef struct EngineAnalysisBufferUse_ {
+    const char *name;
+    AppProto alproto;
+    uint32_t cnt;
+    SigIntId last;  /**< num + 1 of the last sig counted */
+} EngineAnalysisBufferUse;
+
+/**
+ * \brief Prints the app-layer buffers the loaded rules use and the
+ *        optional app-layer parser data that is built for them.
+ */
+void EngineAnalysisBuffers(const DetectEngineCtx *de_ctx)
+{
+    if (rule_engine_analysis_FD == NULL || rule_warnings_only)
+        return;
+
+    EngineAnalysisBufferUse *use = NULL;
+    uint32_t use_cnt = 0;
+
+    for (const Signature *s = de_ctx->sig_list; s != NULL; s = s->next) {
+        const DetectEngineAppInspectionEngine *app = s->app_inspect;
+        for ( ; app != NULL; app = app->next) {
+            const char *name = DetectBufferTypeGetNameById(de_ctx, app->sm_list);
+            if (name == NULL)
+                continue;
+
+            /* transformed buffers share the name of their base buffer */
+            uint32_t i;
+            for (i = 0; i < use_cnt; i++) {
+                if (use[i].name == name && use[i].alproto == app->alproto)
+                    break;
+            }
+            if (i == use_cnt) {
+                void *ptr = SCRealloc(use, (use_cnt + 1) * sizeof(*use));
+                if (ptr == NULL)
+                    goto end;
+                use = ptr;
+                use[i].name = name;
+                use[i].alproto = app->alproto;
+                use[i].cnt = 0;
+                use[i].last = 0;
+                use_cnt++;
+            }
+            if (use[i].last != s->num + 1) {
+                use[i].last = s->num + 1;
+                use[i].cnt++;
+            }
+        }
+    }
+
+    fprintf(rule_engine_analysis_FD, "== App-layer buffers used by the rules ==\n");
+    for (uint32_t i = 0; i < use_cnt; i++) {
+        fprintf(rule_engine_analysis_FD, "    %s (%s): %u rule(s)\n",
+                use[i].name, AppProtoToString(use[i].alproto), use[i].cnt);
+    }
+
+    const uint32_t htp_flags = SC_ATOMIC_GET(htp_config_flags);
+    fprintf(rule_engine_analysis_FD, "== HTTP parser data ==\n");
+    fprintf(rule_engine_analysis_FD, "    normalized uri: %s\n",
+            (htp_flags & HTP_REQUIRE_REQUEST_URI_NORMALIZED) ? "yes" : "no");
+    fprintf(rule_engine_analysis_FD, "    raw headers: %s\n",
+            (htp_flags & HTP_REQUIRE_HEADERS_RAW) ? "yes" : "no");
+    fprintf(rule_engine_analysis_FD, "    request body: %s\n",
+            (htp_flags & HTP_REQUIRE_REQUEST_BODY) ? "yes" : "no");
+    fprintf(rule_engine_analysis_FD, "    response body: %s\n",
+            (htp_flags & HTP_REQUIRE_RESPONSE_BODY) ? "yes" : "no");
+    fprintf(rule_engine_analysis_FD, "\n");
+
+end:
+    if (use != NULL)
+        SCFree(use);
+}
+
 /**
  * \brief Compiles regex for rule analysis
  * \retval 1 if successful
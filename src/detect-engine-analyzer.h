@@ -40,6 +40,7 @@ void EngineAnalysisFP(const DetectEngineCtx *de_ctx,
 void EngineAnalysisRules(const DetectEngineCtx *de_ctx,
         const Signature *s, const char *line);
 void EngineAnalysisRulesFailure(char *line, char *file, int lineno);
+void EngineAnalysisBuffers(const DetectEngineCtx *de_ctx);
 
 #ifdef HAVE_LIBJANSSON
 void EngineAnalysisRules2(const DetectEngineCtx *de_ctx, const Signature *s);
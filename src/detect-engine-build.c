@@ -22,8 +22,11 @@
 
 #include "detect-engine-address.h"
 #include "detect-engine-analyzer.h"
+#include "detect-engine-content-inspection.h"
+#include "detect-engine-fp-profile.h"
 #include "detect-engine-iponly.h"
 #include "detect-engine-mpm.h"
+#include "util-mpm-hs.h"
 #include "detect-engine-siggroup.h"
 #include "detect-engine-port.h"
 #include "detect-engine-prefilter.h"
@@ -1822,12 +1825,17 @@ extern int rule_engine_analysis_set;
  *
  *  - Create SigMatchData arrays from the init only SigMatch lists
  *  - Setup per signature inspect engines
+ *  - Setup specialized matchers for simple content lists and the
+ *    inspection cache ids
  *  - remove signature init data.
  */
 static int SigMatchPrepare(DetectEngineCtx *de_ctx)
 {
     SCEnter();
 
+    if (DetectEngineContentInspectionCacheInit(de_ctx) != 0)
+        SCReturnInt(-1);
+
     Signature *s = de_ctx->sig_list;
     for (; s != NULL; s = s->next) {
         /* set up inspect engines */
@@ -1844,6 +1852,8 @@ static int SigMatchPrepare(DetectEngineCtx *de_ctx)
         }
         /* set up the pkt inspection engines */
         DetectEnginePktInspectionSetup(s);
+        /* specialized matchers for simple content lists */
+        DetectEngineContentInspectionPrepare(de_ctx, s);
 
         if (rule_engine_analysis_set) {
 #ifdef HAVE_LIBJANSSON
@@ -1866,10 +1876,26 @@ static int SigMatchPrepare(DetectEngineCtx *de_ctx)
         s->init_data = NULL;
     }
 
-
+    DetectEngineContentInspectionCacheFree(de_ctx);
     SCReturnInt(0);
 }
 
+/** \internal
+ *  \brief log how long a SigGroupBuild() phase took and restart the clock */
+static void SigGroupBuildPhaseDone(const DetectEngineCtx *de_ctx,
+        const char *phase, struct timeval *start)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    if (!(de_ctx->flags & DE_QUIET)) {
+        int64_t usecs = (int64_t)(now.tv_sec - start->tv_sec) * 1000000 +
+            (now.tv_usec - start->tv_usec);
+        SCLogPerf("rule group build: %s took %"PRId64" ms", phase, usecs / 1000);
+    }
+    *start = now;
+}
+
 /**
  * \brief Convert the signature list into the runtime match structure.
  *
@@ -1882,6 +1908,8 @@ static int SigMatchPrepare(DetectEngineCtx *de_ctx)
 int SigGroupBuild(DetectEngineCtx *de_ctx)
 {
     Signature *s = de_ctx->sig_list;
+    struct timeval start;
+    gettimeofday(&start, NULL);
 
     /* Assign the unique order id of signatures after sorting,
      * so the IP Only engine process them in order too.  Also
@@ -1897,6 +1925,7 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
 
     if (DetectSetFastPatternAndItsId(de_ctx) < 0)
         return -1;
+    DetectFastPatternProfileReport(de_ctx);
 
     SigInitStandardMpmFactoryContexts(de_ctx);
 
@@ -1904,6 +1933,7 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    SigGroupBuildPhaseDone(de_ctx, "signature setup", &start);
 
     if (SigAddressPrepareStage2(de_ctx) != 0) {
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
@@ -1914,23 +1944,39 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    SigGroupBuildPhaseDone(de_ctx, "address and port grouping", &start);
+
     if (SigAddressPrepareStage4(de_ctx) != 0) {
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    SigGroupBuildPhaseDone(de_ctx, "rule group and prefilter setup", &start);
 
+    /* the unique mpm contexts were queued during stage 4, add the shared
+     * ones and prepare them all in parallel */
     int r = DetectMpmPrepareBuiltinMpms(de_ctx);
     r |= DetectMpmPrepareAppMpms(de_ctx);
     r |= DetectMpmPreparePktMpms(de_ctx);
+    r |= DetectMpmPrepareQueued(de_ctx);
     if (r != 0) {
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    if (DetectFastPatternTrainSetup(de_ctx) != 0) {
+        SCLogError(SC_ERR_DETECT_PREPARE, "initializing the fast pattern training failed");
+        exit(EXIT_FAILURE);
+    }
+#ifdef BUILD_HYPERSCAN
+    if (de_ctx->mpm_matcher == MPM_HS)
+        MpmHSCacheReport();
+#endif
+    SigGroupBuildPhaseDone(de_ctx, "mpm preparation", &start);
 
     if (SigMatchPrepare(de_ctx) != 0) {
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    SigGroupBuildPhaseDone(de_ctx, "signature match setup", &start);
 
 #ifdef PROFILING
     SCProfilingKeywordInitCounters(de_ctx);
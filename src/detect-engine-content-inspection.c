@@ -42,6 +42,7 @@
 #include "detect-uricontent.h"
 #include "detect-urilen.h"
 #include "detect-bsize.h"
+#include "detect-dataset.h"
 #include "detect-lua.h"
 #include "detect-base64-decode.h"
 #include "detect-base64-data.h"
@@ -49,6 +50,9 @@
 #include "app-layer-dcerpc.h"
 
 #include "util-spm.h"
+#include "util-hashlist.h"
+#include "util-memcmp.h"
+#include "util-memcpy.h"
 #include "util-debug.h"
 #include "util-print.h"
 
@@ -60,6 +64,610 @@
 #include "util-lua.h"
 #endif
 
+/** \internal
+ *  \brief search a content in buffer[offset:depth] using the results of
+ *         the other signatures that inspected the same tx buffer
+ *
+ *  Same result as SpmScan() on that part of the buffer. An entry holds
+ *  the leftmost match in the whole buffer, which answers all searches that
+ *  start at or before it. Only searches from the start of the buffer update
+ *  the entry.
+ */
+static inline uint8_t *DetectContentCacheSearch(DetectEngineThreadCtx *det_ctx,
+        const SpmCtx *spm_ctx, const uint32_t cache_id, const uint16_t content_len,
+        const uint8_t *buffer, const uint32_t buffer_len,
+        const uint32_t offset, const uint32_t depth)
+{
+    const int list_id = det_ctx->ci_cache.list_id;
+    if (cache_id == 0 || list_id < 0) {
+        return SpmScan(spm_ctx, det_ctx->spm_thread_ctx,
+                buffer + offset, depth - offset);
+    }
+
+    DetectInspectCacheEntry *e = &det_ctx->ci_cache.entries[
+        (cache_id + (uint32_t)list_id * 61) & (DETECT_CI_CACHE_SIZE - 1)];
+    if (e->gen == det_ctx->ci_cache.gen && e->id == cache_id &&
+            e->list_id == list_id && e->buffer == buffer &&
+            e->buffer_len == buffer_len) {
+        if (e->found != UINT32_MAX) {
+            if (e->found >= offset) {
+                det_ctx->ci_cache.hits++;
+                if (e->found + content_len <= depth)
+                    return (uint8_t *)buffer + e->found;
+                return NULL;
+            }
+        } else if (depth <= e->scanned) {
+            det_ctx->ci_cache.hits++;
+            return NULL;
+        }
+    }
+
+    det_ctx->ci_cache.misses++;
+    uint8_t *found = SpmScan(spm_ctx, det_ctx->spm_thread_ctx,
+            buffer + offset, depth - offset);
+    if (offset == 0) {
+        e->gen = det_ctx->ci_cache.gen;
+        e->id = cache_id;
+        e->list_id = list_id;
+        e->buffer = buffer;
+        e->buffer_len = buffer_len;
+        e->found = found ? (uint32_t)(found - buffer) : UINT32_MAX;
+        e->scanned = depth;
+    }
+    return found;
+}
+
+/** \internal
+ *  \brief inspect a list of plain contents without recursion
+ *
+ *  Follows the content logic of DetectEngineContentInspection() step by
+ *  step, including the recursion counter and discontinue_matching, but
+ *  keeps the state of the 'recursive' calls in small arrays. It is
+ *  instantiated for each list length so the compiler can unroll it.
+ *
+ *  \retval 0 no match
+ *  \retval 1 match
+ */
+static inline int __attribute__((always_inline))
+DetectContentInspectFastMatch(const DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, const DetectContentInspectFast *ci,
+        const uint8_t *buffer, const uint32_t buffer_len, const int cnt)
+{
+    uint32_t prev_buffer_offsets[DETECT_CI_FAST_MAX];
+    uint32_t prev_offsets[DETECT_CI_FAST_MAX];
+    const DetectContentInspectFastItem *cd;
+    int k = 0;
+
+enter:
+    det_ctx->inspection_recursion_counter++;
+    if (det_ctx->inspection_recursion_counter == de_ctx->inspection_recursion_limit) {
+        det_ctx->discontinue_matching = 1;
+        goto no_match;
+    }
+    prev_buffer_offsets[k] = det_ctx->buffer_offset;
+    prev_offsets[k] = 0;
+
+search:
+    cd = &ci->c[k];
+    {
+        uint32_t offset;
+        uint32_t depth = buffer_len;
+        const uint32_t prev_buffer_offset = prev_buffer_offsets[k];
+
+        if (cd->flags & (DETECT_CONTENT_DISTANCE|DETECT_CONTENT_WITHIN)) {
+            offset = prev_buffer_offset;
+
+            const int distance = cd->distance;
+            if (cd->flags & DETECT_CONTENT_DISTANCE) {
+                if (distance < 0 && (uint32_t)(abs(distance)) > offset)
+                    offset = 0;
+                else
+                    offset += distance;
+            }
+            if (cd->flags & DETECT_CONTENT_WITHIN) {
+                if ((int32_t)depth > (int32_t)(prev_buffer_offset + cd->within + distance)) {
+                    depth = prev_buffer_offset + cd->within + distance;
+                }
+            }
+            if (cd->depth != 0) {
+                if ((cd->depth + prev_buffer_offset) < depth) {
+                    depth = prev_buffer_offset + cd->depth;
+                }
+            }
+            if (cd->offset > offset) {
+                offset = cd->offset;
+            }
+        } else {
+            if (cd->depth != 0) {
+                depth = cd->depth;
+            }
+            offset = cd->offset;
+        }
+
+        if (prev_offsets[k] != 0)
+            offset = prev_offsets[k];
+        if (depth > buffer_len)
+            depth = buffer_len;
+        if (offset > depth || depth == 0)
+            goto no_match;
+
+        const uint32_t sbuffer_len = depth - offset;
+        const uint8_t *found = NULL;
+        if (cd->content_len <= sbuffer_len &&
+                !((cd->flags & DETECT_CONTENT_ENDS_WITH) && depth < buffer_len)) {
+            found = DetectContentCacheSearch(det_ctx, cd->spm_ctx, cd->ci_cache_id,
+                    cd->content_len, buffer, buffer_len, offset, depth);
+        }
+
+        if (found == NULL) {
+            if ((cd->flags & (DETECT_CONTENT_DISTANCE|DETECT_CONTENT_WITHIN)) == 0) {
+                /* independent match from previous matches, so failure is fatal */
+                det_ctx->discontinue_matching = 1;
+            }
+            goto no_match;
+        }
+
+        const uint32_t match_offset = (uint32_t)((found - buffer) + cd->content_len);
+        det_ctx->buffer_offset = match_offset;
+        /* on a retry, look for the next occurrence after this one */
+        prev_offsets[k] = match_offset - (cd->content_len - 1);
+
+        if ((cd->flags & DETECT_CONTENT_ENDS_WITH) && match_offset != buffer_len)
+            goto search;
+        if (k == cnt - 1)
+            return 1;
+
+        /* inspect the next content */
+        k++;
+        goto enter;
+    }
+
+no_match:
+    /* 'return' to the previous content */
+    if (k == 0)
+        return 0;
+    k--;
+    if (det_ctx->discontinue_matching)
+        goto no_match;
+    /* no match and no reason to look for another instance */
+    if ((ci->c[k].flags & DETECT_CONTENT_WITHIN_NEXT) == 0) {
+        det_ctx->discontinue_matching = 1;
+        goto no_match;
+    }
+    goto search;
+}
+
+static int DetectContentInspectFast1(const DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, const DetectContentInspectFast *ci,
+        const uint8_t *buffer, const uint32_t buffer_len)
+{
+    return DetectContentInspectFastMatch(de_ctx, det_ctx, ci, buffer, buffer_len, 1);
+}
+
+static int DetectContentInspectFast2(const DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, const DetectContentInspectFast *ci,
+        const uint8_t *buffer, const uint32_t buffer_len)
+{
+    return DetectContentInspectFastMatch(de_ctx, det_ctx, ci, buffer, buffer_len, 2);
+}
+
+static int DetectContentInspectFast3(const DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, const DetectContentInspectFast *ci,
+        const uint8_t *buffer, const uint32_t buffer_len)
+{
+    return DetectContentInspectFastMatch(de_ctx, det_ctx, ci, buffer, buffer_len, 3);
+}
+
+/** \internal
+ *  \brief set up the specialized matcher for a list if it is a short
+ *         list of plain contents
+ *
+ *  \retval 1 list uses the specialized matcher
+ *  \retval 0 list uses the generic inspection
+ */
+static int DetectContentInspectFastSetup(SigMatchData *smd)
+{
+    if (smd == NULL || smd->type != DETECT_CONTENT)
+        return 0;
+
+    DetectContentData *head = (DetectContentData *)smd->ctx;
+    if (head->ci_fast != NULL)
+        return 1;
+
+    DetectContentInspectFast ci;
+    memset(&ci, 0, sizeof(ci));
+
+    for (const SigMatchData *m = smd; ; m++) {
+        if (m->type != DETECT_CONTENT || ci.cnt == DETECT_CI_FAST_MAX)
+            return 0;
+
+        const DetectContentData *cd = (const DetectContentData *)m->ctx;
+        if (cd->flags & (DETECT_CONTENT_NEGATED|DETECT_CONTENT_REPLACE|
+                    DETECT_CONTENT_OFFSET_BE|DETECT_CONTENT_DEPTH_BE|
+                    DETECT_CONTENT_DISTANCE_BE|DETECT_CONTENT_WITHIN_BE))
+            return 0;
+
+        DetectContentInspectFastItem *c = &ci.c[ci.cnt++];
+        c->spm_ctx = cd->spm_ctx;
+        c->flags = cd->flags;
+        c->ci_cache_id = cd->ci_cache_id;
+        c->content_len = cd->content_len;
+        c->depth = cd->depth;
+        c->offset = cd->offset;
+        c->distance = cd->distance;
+        c->within = cd->within;
+
+        if (m->is_last)
+            break;
+    }
+
+    switch (ci.cnt) {
+        case 1:
+            ci.Match = DetectContentInspectFast1;
+            break;
+        case 2:
+            ci.Match = DetectContentInspectFast2;
+            break;
+        default:
+            ci.Match = DetectContentInspectFast3;
+            break;
+    }
+
+    head->ci_fast = SCMalloc(sizeof(ci));
+    if (unlikely(head->ci_fast == NULL))
+        return 0;
+    memcpy(head->ci_fast, &ci, sizeof(ci));
+    return 1;
+}
+
+/** \internal
+ *  \brief set up the secondary matcher for a list with enough contents
+ *
+ *  The list has to start with a content, as the results are reset when
+ *  that content is inspected.
+ */
+static void DetectContentMultiSpmSetup(SigMatchData *smd)
+{
+    if (smd == NULL || smd->type != DETECT_CONTENT)
+        return;
+
+    DetectContentData *head = (DetectContentData *)smd->ctx;
+    if (head->ci_multi != NULL)
+        return;
+
+    /* contents after the first 32 are left to the SPM */
+    DetectContentData *cds[32];
+    uint32_t cnt = 0;
+    uint32_t data_len = 0;
+    for (const SigMatchData *m = smd; ; m++) {
+        if (m->type == DETECT_CONTENT && cnt < 32) {
+            cds[cnt++] = (DetectContentData *)m->ctx;
+            data_len += cds[cnt - 1]->content_len;
+        }
+        if (m->is_last)
+            break;
+    }
+    if (cnt < DETECT_CI_MULTI_MIN_CONTENTS)
+        return;
+
+    DetectContentMultiSpm *ms = SCCalloc(1, sizeof(*ms) + data_len);
+    if (unlikely(ms == NULL))
+        return;
+
+    uint8_t *data = ms->data;
+    for (uint32_t i = 0; i < cnt; i++) {
+        DetectContentData *cd = cds[i];
+        const bool nocase = (cd->flags & DETECT_CONTENT_NOCASE) != 0;
+
+        /* contents with the same pattern share the results */
+        uint32_t id;
+        for (id = 0; id < ms->cnt; id++) {
+            const DetectContentMultiSpmPattern *pat = &ms->patterns[id];
+            if (pat->nocase == nocase && pat->content_len == cd->content_len &&
+                    (nocase ? SCMemcmpLowercase(pat->content, cd->content, cd->content_len) :
+                              SCMemcmp(pat->content, cd->content, cd->content_len)) == 0)
+                break;
+        }
+        if (id == ms->cnt) {
+            /* more patterns than fit in the masks are left to the SPM */
+            if (ms->cnt == DETECT_CI_MULTI_MAX_PATTERNS)
+                continue;
+
+            DetectContentMultiSpmPattern *pat = &ms->patterns[ms->cnt++];
+            if (nocase)
+                memcpy_tolower(data, cd->content, cd->content_len);
+            else
+                memcpy(data, cd->content, cd->content_len);
+            pat->content = data;
+            pat->content_len = cd->content_len;
+            pat->nocase = nocase;
+            data += cd->content_len;
+
+            const uint16_t bit = (uint16_t)(1 << id);
+            const uint8_t c0 = pat->content[0];
+            ms->first[c0] |= bit;
+            if (nocase)
+                ms->first[toupper(c0)] |= bit;
+            if (pat->content_len == 1) {
+                ms->short_patterns |= bit;
+                for (int c = 0; c < 256; c++)
+                    ms->second[c] |= bit;
+            } else {
+                const uint8_t c1 = pat->content[1];
+                ms->second[c1] |= bit;
+                if (nocase)
+                    ms->second[toupper(c1)] |= bit;
+            }
+        }
+        cd->ci_multi = ms;
+        cd->ci_multi_id = (uint8_t)id;
+    }
+    head->ci_multi_owner = true;
+}
+
+/** \internal
+ *  \brief record the match offsets of all patterns of the secondary matcher
+ */
+static void DetectContentMultiSpmRun(const DetectContentMultiSpm *ms,
+        DetectContentMultiSpmResults *res,
+        const uint8_t *buffer, const uint32_t buffer_len)
+{
+    res->ctx = ms;
+    res->buffer = buffer;
+    res->buffer_len = buffer_len;
+    res->overflow = 0;
+    memset(res->cnt, 0, sizeof(res->cnt));
+
+    /* patterns still being recorded */
+    uint16_t active = (uint16_t)((1 << ms->cnt) - 1);
+
+    for (uint32_t i = 0; i < buffer_len && active; i++) {
+        uint16_t cands = ms->first[buffer[i]] & active;
+        if (likely(cands == 0))
+            continue;
+        if (i + 1 < buffer_len)
+            cands &= ms->second[buffer[i + 1]];
+        else
+            cands &= ms->short_patterns;
+
+        while (cands) {
+            const uint32_t id = (uint32_t)__builtin_ctz(cands);
+            cands &= cands - 1;
+
+            const DetectContentMultiSpmPattern *pat = &ms->patterns[id];
+            if (pat->content_len > buffer_len - i)
+                continue;
+            if ((pat->nocase ? SCMemcmpLowercase(pat->content, buffer + i, pat->content_len) :
+                               SCMemcmp(pat->content, buffer + i, pat->content_len)) != 0)
+                continue;
+
+            if (res->cnt[id] < DETECT_CI_MULTI_MAX_OFFSETS) {
+                res->offsets[id][res->cnt[id]++] = i;
+            } else {
+                /* the rest of this pattern is left to the SPM */
+                res->overflow |= (uint16_t)(1 << id);
+                active &= ~(uint16_t)(1 << id);
+            }
+        }
+    }
+}
+
+/** \internal
+ *  \brief search a content in buffer[offset:depth]
+ *
+ *  Same result as SpmScan() on that part of the buffer. If the content is
+ *  part of a secondary matcher, the recorded offsets are used instead.
+ *  The first search of a list uses the SPM, as in many cases that is the
+ *  only search. The second one records the offsets of all contents.
+ */
+static inline uint8_t *DetectContentSearch(DetectEngineThreadCtx *det_ctx,
+        const DetectContentData *cd, uint8_t *buffer, const uint32_t buffer_len,
+        const uint32_t offset, const uint32_t depth)
+{
+    DetectContentMultiSpmResults *res = &det_ctx->ci_multi;
+
+    if (cd->ci_multi == NULL)
+        goto spm;
+
+    if (res->ctx != cd->ci_multi || res->buffer != buffer ||
+            res->buffer_len != buffer_len) {
+        if (res->searches++ == 0)
+            goto spm;
+        DetectContentMultiSpmRun(cd->ci_multi, res, buffer, buffer_len);
+    }
+
+    const uint32_t id = cd->ci_multi_id;
+    const uint32_t *offsets = res->offsets[id];
+    const uint32_t cnt = res->cnt[id];
+    uint32_t i = 0;
+    while (i < cnt && offsets[i] < offset)
+        i++;
+    if (i < cnt) {
+        /* leftmost match at or after offset */
+        if (offsets[i] + cd->content_len <= depth)
+            return buffer + offsets[i];
+        return NULL;
+    }
+    if (res->overflow & (1 << id))
+        goto spm;
+    return NULL;
+
+spm:
+    return DetectContentCacheSearch(det_ctx, cd->spm_ctx, cd->ci_cache_id,
+            cd->content_len, buffer, buffer_len, offset, depth);
+}
+
+/**
+ * \brief set up the specialized matchers for the content lists of a
+ *        signature
+ *
+ * Called after the SigMatchData arrays and inspect engines are set up.
+ * Lists that don't have one of the supported shapes are left to the
+ * generic inspection. If they have enough contents, those get a
+ * secondary matcher.
+ */
+static void DetectContentInspectListSetup(SigMatchData *smd)
+{
+    if (DetectContentInspectFastSetup(smd) == 0) {
+        DetectContentMultiSpmSetup(smd);
+    }
+}
+
+static uint32_t DetectContentCacheHashFunc(HashListTable *ht, void *data, uint16_t datalen)
+{
+    const DetectContentData *cd = data;
+    uint32_t hash = cd->content_len;
+
+    for (uint16_t u = 0; u < cd->content_len; u++) {
+        hash = hash * 31 + u8_tolower(cd->content[u]);
+    }
+
+    hash %= ht->array_size;
+    return hash;
+}
+
+static char DetectContentCacheCompareFunc(void *data1, uint16_t len1,
+                                          void *data2, uint16_t len2)
+{
+    const DetectContentData *cd1 = data1;
+    const DetectContentData *cd2 = data2;
+
+    if (cd1->content_len != cd2->content_len ||
+            (cd1->flags & DETECT_CONTENT_NOCASE) != (cd2->flags & DETECT_CONTENT_NOCASE))
+        return 0;
+
+    if (cd1->flags & DETECT_CONTENT_NOCASE) {
+        for (uint16_t u = 0; u < cd1->content_len; u++) {
+            if (u8_tolower(cd1->content[u]) != u8_tolower(cd2->content[u]))
+                return 0;
+        }
+        return 1;
+    }
+    return (SCMemcmp(cd1->content, cd2->content, cd1->content_len) == 0);
+}
+
+/**
+ * \brief set up the hash used to give the contents with the same pattern
+ *        the same inspection cache id
+ *
+ * \retval 0 ok
+ * \retval -1 error
+ */
+int DetectEngineContentInspectionCacheInit(DetectEngineCtx *de_ctx)
+{
+    de_ctx->ci_cache_id_cnt = 0;
+    de_ctx->ci_cache_hash_table = HashListTableInit(4096,
+            DetectContentCacheHashFunc, DetectContentCacheCompareFunc, NULL);
+    if (de_ctx->ci_cache_hash_table == NULL)
+        return -1;
+    return 0;
+}
+
+void DetectEngineContentInspectionCacheFree(DetectEngineCtx *de_ctx)
+{
+    if (de_ctx->ci_cache_hash_table != NULL) {
+        HashListTableFree(de_ctx->ci_cache_hash_table);
+        de_ctx->ci_cache_hash_table = NULL;
+    }
+}
+
+/** \internal
+ *  \brief give the contents of an app inspection list their inspection
+ *         cache id. Contents that fail to get one are not cached.
+ */
+static void DetectContentCacheSetIds(DetectEngineCtx *de_ctx, const SigMatchData *smd)
+{
+    if (smd == NULL || de_ctx->ci_cache_hash_table == NULL)
+        return;
+
+    for (const SigMatchData *m = smd; ; m++) {
+        if (m->type == DETECT_CONTENT) {
+            DetectContentData *cd = (DetectContentData *)m->ctx;
+            if (cd->ci_cache_id == 0) {
+                const DetectContentData *dup =
+                    HashListTableLookup(de_ctx->ci_cache_hash_table, cd, 0);
+                if (dup != NULL) {
+                    cd->ci_cache_id = dup->ci_cache_id;
+                } else if (HashListTableAdd(de_ctx->ci_cache_hash_table, cd, 0) == 0) {
+                    cd->ci_cache_id = ++de_ctx->ci_cache_id_cnt;
+                }
+            }
+        }
+        if (m->is_last)
+            break;
+    }
+}
+
+void DetectEngineContentInspectionPrepare(DetectEngineCtx *de_ctx, Signature *s)
+{
+    /* the specialized matchers take a copy of the cache ids */
+    for (DetectEngineAppInspectionEngine *e = s->app_inspect; e != NULL; e = e->next) {
+        if (e->v2.Callback == DetectEngineInspectBufferGeneric) {
+            DetectContentCacheSetIds(de_ctx, e->smd);
+        }
+    }
+
+    DetectContentInspectListSetup(s->sm_arrays[DETECT_SM_LIST_PMATCH]);
+    DetectContentInspectListSetup(s->sm_arrays[DETECT_SM_LIST_BASE64_DATA]);
+
+    for (DetectEngineAppInspectionEngine *e = s->app_inspect; e != NULL; e = e->next) {
+        DetectContentInspectListSetup(e->smd);
+    }
+    for (DetectEnginePktInspectionEngine *e = s->pkt_inspect; e != NULL; e = e->next) {
+        DetectContentInspectListSetup(e->smd);
+    }
+}
+
+static void DetectContentInspectPathCount(const SigMatchData *smd,
+        int *fast, int *generic)
+{
+    if (smd == NULL)
+        return;
+    if (smd->type == DETECT_CONTENT &&
+            ((const DetectContentData *)smd->ctx)->ci_fast != NULL) {
+        (*fast)++;
+        return;
+    }
+    for (const SigMatchData *m = smd; ; m++) {
+        if (m->type == DETECT_CONTENT) {
+            (*generic)++;
+            return;
+        }
+        if (m->is_last)
+            return;
+    }
+}
+
+/**
+ * \brief describe how the content lists of a signature are inspected
+ *
+ * \retval "fast" all content lists use a specialized matcher
+ * \retval "generic" all content lists use the generic inspection
+ * \retval "mixed" some of each
+ * \retval "-" no content lists
+ */
+const char *DetectEngineContentInspectionPath(const Signature *s)
+{
+    int fast = 0, generic = 0;
+
+    DetectContentInspectPathCount(s->sm_arrays[DETECT_SM_LIST_PMATCH], &fast, &generic);
+    DetectContentInspectPathCount(s->sm_arrays[DETECT_SM_LIST_BASE64_DATA], &fast, &generic);
+    for (const DetectEngineAppInspectionEngine *e = s->app_inspect; e != NULL; e = e->next) {
+        DetectContentInspectPathCount(e->smd, &fast, &generic);
+    }
+    for (const DetectEnginePktInspectionEngine *e = s->pkt_inspect; e != NULL; e = e->next) {
+        DetectContentInspectPathCount(e->smd, &fast, &generic);
+    }
+
+    if (fast && generic)
+        return "mixed";
+    if (fast)
+        return "fast";
+    if (generic)
+        return "generic";
+    return "-";
+}
+
 /**
  * \brief Run the actual payload match functions
  *
@@ -106,6 +714,28 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
                                   uint8_t inspection_mode)
 {
     SCEnter();
+
+    if (smd != NULL && smd->type == DETECT_CONTENT) {
+        const DetectContentData *cd = (const DetectContentData *)smd->ctx;
+
+        /* start of a list with a secondary matcher: results of an
+         * earlier inspection are no longer valid */
+        if (cd->ci_multi_owner) {
+            det_ctx->ci_multi.ctx = NULL;
+            det_ctx->ci_multi.searches = 0;
+        }
+
+        /* lists of plain contents have a specialized matcher. It doesn't
+         * handle buffers inspected in chunks. */
+        const DetectContentInspectFast *ci = cd->ci_fast;
+        if (ci != NULL && buffer_len > 0 && stream_start_offset == 0) {
+            KEYWORD_PROFILING_START;
+            const int r = ci->Match(de_ctx, det_ctx, ci, buffer, buffer_len);
+            KEYWORD_PROFILING_END(det_ctx, DETECT_CONTENT, r);
+            SCReturnInt(r);
+        }
+    }
+
     KEYWORD_PROFILING_START;
 
     det_ctx->inspection_recursion_counter++;
@@ -266,7 +896,6 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
                 }
             }
 
-            uint8_t *sbuffer = buffer + offset;
             uint32_t sbuffer_len = depth - offset;
             uint32_t match_offset = 0;
             SCLogDebug("sbuffer_len %"PRIu32, sbuffer_len);
@@ -280,8 +909,8 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
                 found = NULL;
             } else {
                 /* do the actual search */
-                found = SpmScan(cd->spm_ctx, det_ctx->spm_thread_ctx, sbuffer,
-                        sbuffer_len);
+                found = DetectContentSearch(det_ctx, cd, buffer, buffer_len,
+                        offset, depth);
             }
 
             /* next we evaluate the result in combination with the
@@ -539,6 +1168,16 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
         }
         goto match;
 
+    } else if (smd->type == DETECT_DATASET) {
+
+        /* the whole buffer is looked up, so inspecting it again from
+         * another offset can't change the result */
+        const DetectDatasetData *sd = (const DetectDatasetData *)smd->ctx;
+        if (DetectDatasetBufferMatch(det_ctx, sd, buffer, buffer_len) == 1)
+            goto match;
+        det_ctx->discontinue_matching = 1;
+        goto no_match;
+
     } else if (smd->type == DETECT_AL_URILEN) {
         SCLogDebug("inspecting uri len");
 
@@ -45,6 +45,63 @@ enum {
  *  inspection function contains both start and end of the data. */
 #define DETECT_CI_FLAGS_SINGLE  (DETECT_CI_FLAGS_START|DETECT_CI_FLAGS_END)
 
+/** max number of contents in a list for the specialized matchers */
+#define DETECT_CI_FAST_MAX      3
+
+/** content settings copied from the DetectContentData */
+typedef struct DetectContentInspectFastItem_ {
+    SpmCtx *spm_ctx;
+    uint32_t flags;
+    uint32_t ci_cache_id;
+    uint16_t content_len;
+    uint16_t depth;
+    uint16_t offset;
+    int32_t distance;
+    int32_t within;
+} DetectContentInspectFastItem;
+
+/** \brief specialized matcher for a list of only plain contents
+ *
+ *  Set up at rule load time for lists of 1 to DETECT_CI_FAST_MAX contents
+ *  without negation, replace or byte_extract variables. Held by the
+ *  DetectContentData of the first content in the list. */
+typedef struct DetectContentInspectFast_ {
+    int (*Match)(const DetectEngineCtx *, DetectEngineThreadCtx *,
+            const struct DetectContentInspectFast_ *,
+            const uint8_t *, const uint32_t);
+    uint8_t cnt;
+    DetectContentInspectFastItem c[DETECT_CI_FAST_MAX];
+} DetectContentInspectFast;
+
+/** min number of contents in a list for the secondary matcher */
+#define DETECT_CI_MULTI_MIN_CONTENTS    4
+
+typedef struct DetectContentMultiSpmPattern_ {
+    const uint8_t *content;     /**< lowercased for nocase */
+    uint16_t content_len;
+    bool nocase;
+} DetectContentMultiSpmPattern;
+
+/** \brief secondary matcher for the contents of a list
+ *
+ *  Finds the contents of a list in a single pass over the buffer and
+ *  records where they match, so that the content inspection doesn't need
+ *  a SpmScan per content. Set up at rule load time for lists of at least
+ *  DETECT_CI_MULTI_MIN_CONTENTS contents. Each pattern has a bit in the
+ *  masks. */
+typedef struct DetectContentMultiSpm_ {
+    /** patterns with this first byte */
+    uint16_t first[256];
+    /** patterns with this second byte. 1 byte patterns are in all. */
+    uint16_t second[256];
+    /** 1 byte patterns */
+    uint16_t short_patterns;
+    uint8_t cnt;
+    DetectContentMultiSpmPattern patterns[DETECT_CI_MULTI_MAX_PATTERNS];
+    /** memory for the pattern bytes */
+    uint8_t data[];
+} DetectContentMultiSpm;
+
 int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx,
                                   const Signature *s, const SigMatchData *smd,
                                   Packet *p, Flow *f,
@@ -52,6 +109,11 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
                                   uint32_t stream_start_offset, uint8_t flags,
                                   uint8_t inspection_mode);
 
+int DetectEngineContentInspectionCacheInit(DetectEngineCtx *de_ctx);
+void DetectEngineContentInspectionCacheFree(DetectEngineCtx *de_ctx);
+void DetectEngineContentInspectionPrepare(DetectEngineCtx *de_ctx, Signature *s);
+const char *DetectEngineContentInspectionPath(const Signature *s);
+
 void DetectEngineContentInspectionRegisterTests(void);
 
 #endif /* __DETECT_ENGINE_CONTENT_INSPECTION_H__ */
@@ -0,0 +1,808 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Fast pattern selection based on measured pattern hit rates.
+ *
+ * Training (--fp-train <pcap>) adds every content that could be a rule's
+ * fast pattern to a per buffer MPM and runs it on each buffer the
+ * prefilter engines inspect. The number of buffers each pattern was found
+ * in is written to a profile at shutdown.
+ *
+ * When a profile is configured (detect.fast-pattern-profile),
+ * RetrieveFPForSig() uses it to replace the default fast pattern of a rule
+ * by the content with the lowest hit rate in the same priority buffers.
+ * Rules with an explicit fast_pattern are left alone.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "conf.h"
+#include "detect.h"
+#include "detect-parse.h"
+#include "detect-engine.h"
+#include "detect-engine-mpm.h"
+#include "detect-engine-fp-profile.h"
+#include "detect-content.h"
+#include "detect-fast-pattern.h"
+#include "util-byte.h"
+#include "util-conf.h"
+#include "util-debug.h"
+#include "util-hashlist.h"
+#include "util-memcpy.h"
+#include "util-mpm.h"
+#include "util-prefilter.h"
+#include "util-unittest.h"
+#include "util-fmemopen.h"
+
+/** default profile file name, in the log dir */
+#define DETECT_FP_PROFILE_DEFAULT_NAME  "fast_pattern_profile.txt"
+/** buffers a list needs to have been inspected before its hit rates are
+ *  trusted */
+#define DETECT_FP_PROFILE_MIN_RUNS      100
+
+typedef struct DetectFPPattern_ {
+    char *buffer;           /**< buffer name */
+    int list_id;            /**< list the pattern is trained on, -1 if loaded */
+    uint32_t id;
+    uint8_t nocase;
+    uint16_t content_len;
+    uint8_t *content;       /**< lowercase if nocase */
+    uint64_t hits;          /**< buffers the pattern was found in */
+    uint64_t runs;          /**< buffers inspected, loaded profile only */
+} DetectFPPattern;
+
+typedef struct DetectFastPatternProfile_ {
+    HashListTable *hash;
+    uint32_t cnt;
+
+    /* selection stats for DetectFastPatternProfileReport() */
+    uint32_t rules;         /**< rules with profile data for their default */
+    uint32_t changed;
+    double rate_default;
+    double rate_selected;
+} DetectFastPatternProfile;
+
+typedef struct DetectFastPatternTrain_ {
+    HashListTable *hash;
+    DetectFPPattern **patterns;     /**< indexed by pattern id */
+    uint32_t cnt;
+
+    /* per list id: mpm with the candidate patterns (NULL if the list has
+     * none) and the number of buffers inspected */
+    MpmCtx **mpm_ctx;
+    uint64_t *runs;
+    int list_cnt;
+
+    SCMutex lock;                   /**< protects merging the thread counts */
+    char filename[PATH_MAX];
+} DetectFastPatternTrain;
+
+typedef struct DetectFastPatternTrainThread_ {
+    MpmThreadCtx mtc;
+    PrefilterRuleStore pmq;
+    uint64_t *hits;         /**< per pattern id */
+    uint64_t *runs;         /**< per list id */
+} DetectFastPatternTrainThread;
+
+static const char *ListName(const DetectEngineCtx *de_ctx, const int list_id)
+{
+    if (list_id < DETECT_SM_LIST_DYNAMIC_START)
+        return DetectListToHumanString(list_id);
+    return DetectBufferTypeGetNameById(de_ctx, list_id);
+}
+
+static uint32_t FPPatternHashContent(const DetectFPPattern *p)
+{
+    uint32_t hash = p->content_len + p->nocase;
+    for (uint16_t u = 0; u < p->content_len; u++) {
+        const uint8_t c = p->nocase ? u8_tolower(p->content[u]) : p->content[u];
+        hash = hash * 31 + c;
+    }
+    return hash;
+}
+
+static int FPPatternCompareContent(const DetectFPPattern *p1,
+        const DetectFPPattern *p2)
+{
+    if (p1->nocase != p2->nocase || p1->content_len != p2->content_len)
+        return 0;
+    if (!p1->nocase)
+        return SCMemcmp(p1->content, p2->content, p1->content_len) == 0;
+    for (uint16_t u = 0; u < p1->content_len; u++) {
+        if (u8_tolower(p1->content[u]) != u8_tolower(p2->content[u]))
+            return 0;
+    }
+    return 1;
+}
+
+/* loaded profile: patterns are keyed by buffer name */
+
+static uint32_t ProfileHashFunc(HashListTable *ht, void *data, uint16_t datalen)
+{
+    const DetectFPPattern *p = data;
+    uint32_t hash = FPPatternHashContent(p);
+    for (const char *c = p->buffer; *c != '\0'; c++)
+        hash = hash * 31 + (uint8_t)*c;
+    return hash % ht->array_size;
+}
+
+static char ProfileCompareFunc(void *data1, uint16_t len1, void *data2, uint16_t len2)
+{
+    const DetectFPPattern *p1 = data1;
+    const DetectFPPattern *p2 = data2;
+    if (strcmp(p1->buffer, p2->buffer) != 0)
+        return 0;
+    return FPPatternCompareContent(p1, p2);
+}
+
+/* training: patterns are keyed by list id as each list has its own mpm */
+
+static uint32_t TrainHashFunc(HashListTable *ht, void *data, uint16_t datalen)
+{
+    const DetectFPPattern *p = data;
+    return (FPPatternHashContent(p) + (uint32_t)p->list_id) % ht->array_size;
+}
+
+static char TrainCompareFunc(void *data1, uint16_t len1, void *data2, uint16_t len2)
+{
+    const DetectFPPattern *p1 = data1;
+    const DetectFPPattern *p2 = data2;
+    if (p1->list_id != p2->list_id)
+        return 0;
+    return FPPatternCompareContent(p1, p2);
+}
+
+static void FPPatternFree(void *data)
+{
+    DetectFPPattern *p = data;
+    if (p == NULL)
+        return;
+    if (p->buffer)
+        SCFree(p->buffer);
+    if (p->content)
+        SCFree(p->content);
+    SCFree(p);
+}
+
+static DetectFPPattern *FPPatternNew(const char *buffer, const int list_id,
+        const uint8_t nocase, const uint8_t *content, const uint16_t content_len)
+{
+    DetectFPPattern *p = SCCalloc(1, sizeof(*p));
+    if (unlikely(p == NULL))
+        return NULL;
+    p->buffer = SCStrdup(buffer);
+    p->content = SCMalloc(content_len);
+    if (p->buffer == NULL || p->content == NULL) {
+        FPPatternFree(p);
+        return NULL;
+    }
+    if (nocase)
+        memcpy_tolower(p->content, content, content_len);
+    else
+        memcpy(p->content, content, content_len);
+    p->content_len = content_len;
+    p->nocase = nocase;
+    p->list_id = list_id;
+    return p;
+}
+
+static int HexToRaw(const char *hex, uint8_t *raw, const size_t raw_size,
+        uint16_t *raw_len)
+{
+    const size_t len = strlen(hex);
+    if (len == 0 || len % 2 != 0 || len / 2 > raw_size)
+        return -1;
+
+    for (size_t i = 0; i < len; i += 2) {
+        uint8_t v = 0;
+        for (size_t j = i; j < i + 2; j++) {
+            const char c = hex[j];
+            v <<= 4;
+            if (c >= '0' && c <= '9')
+                v |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                v |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                v |= c - 'A' + 10;
+            else
+                return -1;
+        }
+        raw[i / 2] = v;
+    }
+    *raw_len = (uint16_t)(len / 2);
+    return 0;
+}
+
+/**
+ *  \brief load a profile
+ *
+ *  Lines are: \<buffer\> \<nocase\> \<hits\> \<buffers inspected\> \<hex\>
+ *  Lines starting with '#' are comments. Entries for the same pattern
+ *  are added up.
+ *
+ *  \retval cnt number of invalid lines
+ */
+static int DetectFastPatternProfileLoad(DetectFastPatternProfile *fpp, FILE *fp)
+{
+    char line[4096];
+    uint8_t content[sizeof(line) / 2];
+    int invalid = 0;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        } else if (!feof(fp)) {
+            /* skip the rest of an overlong line */
+            int c;
+            while ((c = fgetc(fp)) != EOF && c != '\n')
+                ;
+            invalid++;
+            continue;
+        }
+        if (len > 0 && line[len - 1] == '\r')
+            line[--len] = '\0';
+        if (line[0] == '#' || line[0] == '\0')
+            continue;
+
+        char *saveptr = NULL;
+        const char *buffer = strtok_r(line, " \t", &saveptr);
+        const char *nocase = strtok_r(NULL, " \t", &saveptr);
+        const char *hits = strtok_r(NULL, " \t", &saveptr);
+        const char *runs = strtok_r(NULL, " \t", &saveptr);
+        const char *hex = strtok_r(NULL, " \t", &saveptr);
+        if (hex == NULL) {
+            invalid++;
+            continue;
+        }
+
+        DetectFPPattern lookup;
+        memset(&lookup, 0, sizeof(lookup));
+        lookup.buffer = (char *)buffer;
+        lookup.list_id = -1;
+        lookup.content = content;
+        if ((strcmp(nocase, "0") != 0 && strcmp(nocase, "1") != 0) ||
+                ByteExtractStringUint64(&lookup.hits, 10, 0, hits) <= 0 ||
+                ByteExtractStringUint64(&lookup.runs, 10, 0, runs) <= 0 ||
+                lookup.hits > lookup.runs ||
+                HexToRaw(hex, content, sizeof(content), &lookup.content_len) < 0)
+        {
+            invalid++;
+            continue;
+        }
+        lookup.nocase = (nocase[0] == '1');
+
+        DetectFPPattern *p = HashListTableLookup(fpp->hash, &lookup, 0);
+        if (p != NULL) {
+            p->hits += lookup.hits;
+            p->runs += lookup.runs;
+            continue;
+        }
+        p = FPPatternNew(buffer, -1, lookup.nocase, content, lookup.content_len);
+        if (p == NULL)
+            break;
+        p->hits = lookup.hits;
+        p->runs = lookup.runs;
+        if (HashListTableAdd(fpp->hash, p, 0) != 0) {
+            FPPatternFree(p);
+            break;
+        }
+        fpp->cnt++;
+    }
+    return invalid;
+}
+
+static DetectFastPatternProfile *DetectFastPatternProfileNew(void)
+{
+    DetectFastPatternProfile *fpp = SCCalloc(1, sizeof(*fpp));
+    if (unlikely(fpp == NULL))
+        return NULL;
+    fpp->hash = HashListTableInit(4096, ProfileHashFunc, ProfileCompareFunc,
+            FPPatternFree);
+    if (fpp->hash == NULL) {
+        SCFree(fpp);
+        return NULL;
+    }
+    return fpp;
+}
+
+static int DetectFastPatternTrainInit(DetectEngineCtx *de_ctx, const char *filename)
+{
+    DetectFastPatternTrain *fpt = SCCalloc(1, sizeof(*fpt));
+    if (unlikely(fpt == NULL))
+        return -1;
+    fpt->hash = HashListTableInit(4096, TrainHashFunc, TrainCompareFunc,
+            FPPatternFree);
+    if (fpt->hash == NULL) {
+        SCFree(fpt);
+        return -1;
+    }
+    SCMutexInit(&fpt->lock, NULL);
+
+    if (filename != NULL) {
+        strlcpy(fpt->filename, filename, sizeof(fpt->filename));
+    } else {
+        snprintf(fpt->filename, sizeof(fpt->filename), "%s/%s",
+                ConfigGetLogDirectory(), DETECT_FP_PROFILE_DEFAULT_NAME);
+    }
+    de_ctx->fp_train = fpt;
+    SCLogConfig("fast pattern training: profile will be written to %s",
+            fpt->filename);
+    return 0;
+}
+
+/**
+ *  \brief set up fast pattern training or load the fast pattern profile
+ *
+ *  A profile that can't be read is not fatal: the default fast pattern
+ *  selection is used.
+ */
+int DetectFastPatternProfileInit(DetectEngineCtx *de_ctx)
+{
+    int train = 0;
+    const char *filename = NULL;
+
+    (void)ConfGetBool("detect.fast-pattern-train", &train);
+    if (ConfGet("detect.fast-pattern-profile", &filename) != 1 ||
+            (filename != NULL && strlen(filename) == 0))
+        filename = NULL;
+
+    if (train)
+        return DetectFastPatternTrainInit(de_ctx, filename);
+    if (filename == NULL)
+        return 0;
+
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        SCLogWarning(SC_ERR_FOPEN, "failed to open fast pattern profile %s: %s",
+                filename, strerror(errno));
+        return 0;
+    }
+    DetectFastPatternProfile *fpp = DetectFastPatternProfileNew();
+    if (fpp == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    int invalid = DetectFastPatternProfileLoad(fpp, fp);
+    fclose(fp);
+
+    if (invalid > 0) {
+        SCLogWarning(SC_ERR_INVALID_VALUE, "fast pattern profile %s: "
+                "skipped %d invalid lines", filename, invalid);
+    }
+    SCLogConfig("fast pattern profile %s: %u patterns", filename, fpp->cnt);
+    de_ctx->fp_profile = fpp;
+    return 0;
+}
+
+static void DetectFastPatternTrainWrite(const DetectFastPatternTrain *fpt)
+{
+    uint64_t runs = 0;
+    for (int i = 0; i < fpt->list_cnt; i++)
+        runs += fpt->runs[i];
+    if (runs == 0) {
+        SCLogInfo("fast pattern training: no buffers inspected, not "
+                "writing %s", fpt->filename);
+        return;
+    }
+
+    FILE *fp = fopen(fpt->filename, "w");
+    if (fp == NULL) {
+        SCLogError(SC_ERR_FOPEN, "failed to open %s: %s", fpt->filename,
+                strerror(errno));
+        return;
+    }
+    fprintf(fp, "# fast pattern profile\n");
+    fprintf(fp, "# <buffer> <nocase> <hits> <buffers inspected> <pattern as hex>\n");
+    for (uint32_t i = 0; i < fpt->cnt; i++) {
+        const DetectFPPattern *p = fpt->patterns[i];
+        fprintf(fp, "%s %u %"PRIu64" %"PRIu64" ", p->buffer, p->nocase,
+                p->hits, fpt->runs[p->list_id]);
+        for (uint16_t u = 0; u < p->content_len; u++)
+            fprintf(fp, "%02x", p->content[u]);
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
+
+    SCLogInfo("fast pattern training: wrote %u patterns seen in %"PRIu64
+            " buffers to %s", fpt->cnt, runs, fpt->filename);
+}
+
+void DetectFastPatternProfileFree(DetectEngineCtx *de_ctx)
+{
+    DetectFastPatternProfile *fpp = de_ctx->fp_profile;
+    if (fpp != NULL) {
+        HashListTableFree(fpp->hash);
+        SCFree(fpp);
+        de_ctx->fp_profile = NULL;
+    }
+
+    DetectFastPatternTrain *fpt = de_ctx->fp_train;
+    if (fpt != NULL) {
+        if (fpt->patterns != NULL)
+            DetectFastPatternTrainWrite(fpt);
+
+        if (fpt->mpm_ctx != NULL) {
+            for (int i = 0; i < fpt->list_cnt; i++) {
+                MpmCtx *mpm_ctx = fpt->mpm_ctx[i];
+                if (mpm_ctx == NULL)
+                    continue;
+                mpm_table[mpm_ctx->mpm_type].DestroyCtx(mpm_ctx);
+                SCFree(mpm_ctx);
+            }
+            SCFree(fpt->mpm_ctx);
+        }
+        if (fpt->runs != NULL)
+            SCFree(fpt->runs);
+        if (fpt->patterns != NULL)
+            SCFree(fpt->patterns);
+        HashListTableFree(fpt->hash);
+        SCMutexDestroy(&fpt->lock);
+        SCFree(fpt);
+        de_ctx->fp_train = NULL;
+    }
+}
+
+static int ProfileRate(const DetectFastPatternProfile *fpp, const char *buffer,
+        const DetectContentData *cd, double *rate)
+{
+    DetectFPPattern lookup;
+    memset(&lookup, 0, sizeof(lookup));
+    lookup.buffer = (char *)buffer;
+    lookup.nocase = (cd->flags & DETECT_CONTENT_NOCASE) ? 1 : 0;
+    lookup.content = cd->content;
+    lookup.content_len = cd->content_len;
+
+    const DetectFPPattern *p = HashListTableLookup(fpp->hash, &lookup, 0);
+    if (p == NULL || p->runs < DETECT_FP_PROFILE_MIN_RUNS)
+        return 0;
+    *rate = (double)p->hits / (double)p->runs;
+    return 1;
+}
+
+/**
+ *  \brief pick the fast pattern with the lowest profiled hit rate
+ *
+ *  \param lists the highest priority lists with content in the rule
+ *  \param mpm_sm fast pattern picked by the default selection
+ *
+ *  \retval sm mpm_sm or a content in lists with a lower hit rate. Only
+ *             replaces the default if its hit rate is known.
+ */
+SigMatch *DetectFastPatternProfileSelect(const DetectEngineCtx *de_ctx,
+        const Signature *s, const int *lists, const int lists_cnt,
+        SigMatch *mpm_sm)
+{
+    DetectFastPatternProfile *fpp = de_ctx->fp_profile;
+    if (fpp == NULL || mpm_sm == NULL)
+        return mpm_sm;
+
+    /* with only negated content the hit rate says nothing about the
+     * number of candidates */
+    const DetectContentData *mpm_cd = (DetectContentData *)mpm_sm->ctx;
+    if (mpm_cd->flags & DETECT_CONTENT_NEGATED)
+        return mpm_sm;
+
+    int have_default = 0;
+    double default_rate = 0.0;
+    SigMatch *best_sm = NULL;
+    double best_rate = 0.0;
+
+    for (int i = 0; i < lists_cnt; i++) {
+        if (lists[i] >= (int)s->init_data->smlists_array_size)
+            continue;
+        const char *buffer = ListName(de_ctx, lists[i]);
+        if (buffer == NULL)
+            continue;
+
+        for (SigMatch *sm = s->init_data->smlists[lists[i]]; sm != NULL; sm = sm->next) {
+            if (sm->type != DETECT_CONTENT)
+                continue;
+            const DetectContentData *cd = (DetectContentData *)sm->ctx;
+            if (cd->flags & DETECT_CONTENT_NEGATED)
+                continue;
+
+            double rate;
+            if (!ProfileRate(fpp, buffer, cd, &rate))
+                continue;
+            if (sm == mpm_sm) {
+                have_default = 1;
+                default_rate = rate;
+            }
+            if (best_sm == NULL || rate < best_rate) {
+                best_sm = sm;
+                best_rate = rate;
+            }
+        }
+    }
+    if (!have_default)
+        return mpm_sm;
+
+    fpp->rules++;
+    fpp->rate_default += default_rate;
+    if (best_rate < default_rate) {
+        SCLogDebug("sid %u: fast pattern hit rate %f -> %f", s->id,
+                default_rate, best_rate);
+        fpp->changed++;
+        fpp->rate_selected += best_rate;
+        return best_sm;
+    }
+    fpp->rate_selected += default_rate;
+    return mpm_sm;
+}
+
+/**
+ *  \brief log how the profile changed the fast pattern selection
+ *
+ *  The sum of the hit rates of the fast patterns estimates the number of
+ *  candidate rules per inspected buffer.
+ */
+void DetectFastPatternProfileReport(const DetectEngineCtx *de_ctx)
+{
+    DetectFastPatternProfile *fpp = de_ctx->fp_profile;
+    if (fpp == NULL)
+        return;
+
+    double reduction = 0.0;
+    if (fpp->rate_default > 0.0)
+        reduction = 100.0 * (fpp->rate_default - fpp->rate_selected) / fpp->rate_default;
+    SCLogInfo("fast pattern profile: %u rules with profile data, fast pattern "
+            "changed for %u; estimated prefilter candidates per buffer "
+            "%.2f -> %.2f (%.1f%% less)", fpp->rules, fpp->changed,
+            fpp->rate_default, fpp->rate_selected, reduction);
+
+    fpp->rules = 0;
+    fpp->changed = 0;
+    fpp->rate_default = 0.0;
+    fpp->rate_selected = 0.0;
+}
+
+/**
+ *  \brief build the per buffer training mpms
+ *
+ *  Every non-negated content in a fast pattern capable list is a
+ *  candidate. Needs the rule's init data, so it runs before
+ *  SigMatchPrepare().
+ */
+int DetectFastPatternTrainSetup(DetectEngineCtx *de_ctx)
+{
+    DetectFastPatternTrain *fpt = de_ctx->fp_train;
+    if (fpt == NULL)
+        return 0;
+
+    fpt->list_cnt = de_ctx->buffer_type_id;
+    fpt->mpm_ctx = SCCalloc(fpt->list_cnt, sizeof(MpmCtx *));
+    fpt->runs = SCCalloc(fpt->list_cnt, sizeof(uint64_t));
+    if (fpt->mpm_ctx == NULL || fpt->runs == NULL)
+        return -1;
+
+    for (const Signature *s = de_ctx->sig_list; s != NULL; s = s->next) {
+        for (int list_id = 0; list_id < (int)s->init_data->smlists_array_size; list_id++) {
+            if (s->init_data->smlists[list_id] == NULL)
+                continue;
+            if (list_id >= fpt->list_cnt)
+                continue;
+            if (!FastPatternSupportEnabledForSigMatchList(de_ctx, list_id))
+                continue;
+            const char *buffer = ListName(de_ctx, list_id);
+            if (buffer == NULL)
+                continue;
+
+            for (const SigMatch *sm = s->init_data->smlists[list_id]; sm != NULL; sm = sm->next) {
+                if (sm->type != DETECT_CONTENT)
+                    continue;
+                const DetectContentData *cd = (DetectContentData *)sm->ctx;
+                if (cd->flags & DETECT_CONTENT_NEGATED)
+                    continue;
+
+                DetectFPPattern lookup;
+                memset(&lookup, 0, sizeof(lookup));
+                lookup.list_id = list_id;
+                lookup.nocase = (cd->flags & DETECT_CONTENT_NOCASE) ? 1 : 0;
+                lookup.content = cd->content;
+                lookup.content_len = cd->content_len;
+                if (HashListTableLookup(fpt->hash, &lookup, 0) != NULL)
+                    continue;
+
+                DetectFPPattern *p = FPPatternNew(buffer, list_id, lookup.nocase,
+                        cd->content, cd->content_len);
+                if (p == NULL)
+                    return -1;
+                p->id = fpt->cnt;
+                if (HashListTableAdd(fpt->hash, p, 0) != 0) {
+                    FPPatternFree(p);
+                    return -1;
+                }
+                fpt->cnt++;
+
+                if (fpt->mpm_ctx[list_id] == NULL) {
+                    fpt->mpm_ctx[list_id] = SCCalloc(1, sizeof(MpmCtx));
+                    if (fpt->mpm_ctx[list_id] == NULL)
+                        return -1;
+                    MpmInitCtx(fpt->mpm_ctx[list_id], de_ctx->mpm_matcher);
+                }
+                /* the pattern id is also reported as the 'sid' */
+                if (p->nocase) {
+                    MpmAddPatternCI(fpt->mpm_ctx[list_id], p->content,
+                            p->content_len, 0, 0, p->id, p->id, 0);
+                } else {
+                    MpmAddPatternCS(fpt->mpm_ctx[list_id], p->content,
+                            p->content_len, 0, 0, p->id, p->id, 0);
+                }
+            }
+        }
+    }
+
+    fpt->patterns = SCCalloc(MAX(fpt->cnt, 1), sizeof(DetectFPPattern *));
+    if (fpt->patterns == NULL)
+        return -1;
+    HashListTableBucket *htb = HashListTableGetListHead(fpt->hash);
+    for ( ; htb != NULL; htb = HashListTableGetListNext(htb)) {
+        DetectFPPattern *p = HashListTableGetListData(htb);
+        fpt->patterns[p->id] = p;
+    }
+
+    int buffers = 0;
+    for (int i = 0; i < fpt->list_cnt; i++) {
+        MpmCtx *mpm_ctx = fpt->mpm_ctx[i];
+        if (mpm_ctx == NULL)
+            continue;
+        if (mpm_table[mpm_ctx->mpm_type].Prepare(mpm_ctx) != 0)
+            return -1;
+        buffers++;
+    }
+    SCLogInfo("fast pattern training: %u candidate patterns in %d buffers",
+            fpt->cnt, buffers);
+    return 0;
+}
+
+int DetectFastPatternTrainThreadInit(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx)
+{
+    const DetectFastPatternTrain *fpt = de_ctx->fp_train;
+    if (fpt == NULL || fpt->patterns == NULL)
+        return 0;
+
+    DetectFastPatternTrainThread *t = SCCalloc(1, sizeof(*t));
+    if (unlikely(t == NULL))
+        return -1;
+    t->hits = SCCalloc(MAX(fpt->cnt, 1), sizeof(uint64_t));
+    t->runs = SCCalloc(fpt->list_cnt, sizeof(uint64_t));
+    if (t->hits == NULL || t->runs == NULL || PmqSetup(&t->pmq) != 0) {
+        if (t->hits)
+            SCFree(t->hits);
+        if (t->runs)
+            SCFree(t->runs);
+        SCFree(t);
+        return -1;
+    }
+    PatternMatchThreadPrepare(&t->mtc, de_ctx->mpm_matcher);
+    det_ctx->fp_train = t;
+    return 0;
+}
+
+/** \brief add the thread's counts to the detect engine and free the
+ *         thread's training state */
+void DetectFastPatternTrainThreadFree(DetectEngineThreadCtx *det_ctx)
+{
+    DetectFastPatternTrainThread *t = det_ctx->fp_train;
+    if (t == NULL)
+        return;
+
+    DetectFastPatternTrain *fpt = det_ctx->de_ctx ? det_ctx->de_ctx->fp_train : NULL;
+    if (fpt != NULL) {
+        SCMutexLock(&fpt->lock);
+        for (uint32_t i = 0; i < fpt->cnt; i++)
+            fpt->patterns[i]->hits += t->hits[i];
+        for (int i = 0; i < fpt->list_cnt; i++)
+            fpt->runs[i] += t->runs[i];
+        SCMutexUnlock(&fpt->lock);
+
+        PatternMatchThreadDestroy(&t->mtc, det_ctx->de_ctx->mpm_matcher);
+    }
+    PmqFree(&t->pmq);
+    SCFree(t->hits);
+    SCFree(t->runs);
+    SCFree(t);
+    det_ctx->fp_train = NULL;
+}
+
+void DetectFastPatternTrainScanBuffer(DetectEngineThreadCtx *det_ctx,
+        const int list_id, const uint8_t *data, const uint32_t data_len)
+{
+    DetectFastPatternTrainThread *t = det_ctx->fp_train;
+    const DetectFastPatternTrain *fpt = det_ctx->de_ctx->fp_train;
+
+    if (list_id < 0 || list_id >= fpt->list_cnt || data == NULL || data_len == 0)
+        return;
+    t->runs[list_id]++;
+
+    const MpmCtx *mpm_ctx = fpt->mpm_ctx[list_id];
+    if (mpm_ctx == NULL || data_len < mpm_ctx->minlen)
+        return;
+
+    (void)mpm_table[mpm_ctx->mpm_type].Search(mpm_ctx, &t->mtc, &t->pmq,
+            data, data_len);
+    for (uint32_t i = 0; i < t->pmq.rule_id_array_cnt; i++)
+        t->hits[t->pmq.rule_id_array[i]]++;
+    PmqReset(&t->pmq);
+}
+
+#ifdef UNITTESTS
+static int DetectFastPatternProfileTest01(void)
+{
+    /* "bbbb" is rare, the longer "aaaaaaaaaa" the default */
+    char profile[] =
+        "# comment\n"
+        "http_uri 0 500 1000 61616161616161616161\n"
+        "http_uri 0 10 1000 62626262\n"
+        "http_uri 0 not-a-number 1000 6363\n";
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    FAIL_IF_NULL(de_ctx);
+    de_ctx->fp_profile = DetectFastPatternProfileNew();
+    FAIL_IF_NULL(de_ctx->fp_profile);
+    FILE *fp = SCFmemopen(profile, strlen(profile), "r");
+    FAIL_IF_NULL(fp);
+    FAIL_IF_NOT(DetectFastPatternProfileLoad(de_ctx->fp_profile, fp) == 1);
+    fclose(fp);
+    FAIL_IF_NOT(de_ctx->fp_profile->cnt == 2);
+
+    Signature *s = DetectEngineAppendSig(de_ctx, "alert http any any -> any any "
+            "(content:\"aaaaaaaaaa\"; http_uri; content:\"bbbb\"; http_uri; sid:1;)");
+    FAIL_IF_NULL(s);
+    RetrieveFPForSig(de_ctx, s);
+    FAIL_IF_NULL(s->init_data->mpm_sm);
+    const DetectContentData *cd = (DetectContentData *)s->init_data->mpm_sm->ctx;
+    FAIL_IF_NOT(cd->content_len == 4 && memcmp(cd->content, "bbbb", 4) == 0);
+    FAIL_IF_NOT(de_ctx->fp_profile->changed == 1);
+
+    /* explicit fast_pattern is kept */
+    s = DetectEngineAppendSig(de_ctx, "alert http any any -> any any "
+            "(content:\"aaaaaaaaaa\"; http_uri; fast_pattern; "
+            "content:\"bbbb\"; http_uri; sid:2;)");
+    FAIL_IF_NULL(s);
+    RetrieveFPForSig(de_ctx, s);
+    FAIL_IF_NULL(s->init_data->mpm_sm);
+    cd = (DetectContentData *)s->init_data->mpm_sm->ctx;
+    FAIL_IF_NOT(cd->content_len == 10);
+
+    /* no profile data for the default: keep it */
+    s = DetectEngineAppendSig(de_ctx, "alert http any any -> any any "
+            "(content:\"cccccccccc\"; http_uri; content:\"bbbb\"; http_uri; sid:3;)");
+    FAIL_IF_NULL(s);
+    RetrieveFPForSig(de_ctx, s);
+    FAIL_IF_NULL(s->init_data->mpm_sm);
+    cd = (DetectContentData *)s->init_data->mpm_sm->ctx;
+    FAIL_IF_NOT(cd->content_len == 10);
+    FAIL_IF_NOT(de_ctx->fp_profile->changed == 1);
+
+    DetectEngineCtxFree(de_ctx);
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void DetectFastPatternProfileRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("DetectFastPatternProfileTest01",
+            DetectFastPatternProfileTest01);
+#endif
+}
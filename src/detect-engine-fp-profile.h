@@ -0,0 +1,52 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Fast pattern selection based on measured pattern hit rates.
+ */
+
+#ifndef __DETECT_ENGINE_FP_PROFILE_H__
+#define __DETECT_ENGINE_FP_PROFILE_H__
+
+int DetectFastPatternProfileInit(DetectEngineCtx *de_ctx);
+void DetectFastPatternProfileFree(DetectEngineCtx *de_ctx);
+SigMatch *DetectFastPatternProfileSelect(const DetectEngineCtx *de_ctx,
+        const Signature *s, const int *lists, const int lists_cnt,
+        SigMatch *mpm_sm);
+void DetectFastPatternProfileReport(const DetectEngineCtx *de_ctx);
+
+int DetectFastPatternTrainSetup(DetectEngineCtx *de_ctx);
+int DetectFastPatternTrainThreadInit(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx);
+void DetectFastPatternTrainThreadFree(DetectEngineThreadCtx *det_ctx);
+void DetectFastPatternTrainScanBuffer(DetectEngineThreadCtx *det_ctx,
+        const int list_id, const uint8_t *data, const uint32_t data_len);
+
+/** \brief count the candidate fast patterns found in a prefilter buffer
+ *         when training */
+static inline void DetectFastPatternTrainScan(DetectEngineThreadCtx *det_ctx,
+        const int list_id, const uint8_t *data, const uint32_t data_len)
+{
+    if (unlikely(det_ctx->fp_train != NULL))
+        DetectFastPatternTrainScanBuffer(det_ctx, list_id, data, data_len);
+}
+
+void DetectFastPatternProfileRegisterTests(void);
+
+#endif /* __DETECT_ENGINE_FP_PROFILE_H__ */
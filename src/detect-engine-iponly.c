@@ -909,6 +909,15 @@ void IPOnlyDeinit(DetectEngineCtx *de_ctx, DetectEngineIPOnlyCtx *io_ctx)
     if (io_ctx == NULL)
         return;
 
+    SCPoptrieFree(io_ctx->lpm_ipv4src);
+    io_ctx->lpm_ipv4src = NULL;
+    SCPoptrieFree(io_ctx->lpm_ipv4dst);
+    io_ctx->lpm_ipv4dst = NULL;
+    SCPoptrieFree(io_ctx->lpm_ipv6src);
+    io_ctx->lpm_ipv6src = NULL;
+    SCPoptrieFree(io_ctx->lpm_ipv6dst);
+    io_ctx->lpm_ipv6dst = NULL;
+
     if (io_ctx->tree_ipv4src != NULL)
         SCRadixReleaseRadixTree(io_ctx->tree_ipv4src);
     io_ctx->tree_ipv4src = NULL;
@@ -985,18 +994,34 @@ void IPOnlyMatchPacket(ThreadVars *tv,
     void *user_data_src = NULL, *user_data_dst = NULL;
 
     if (p->src.family == AF_INET) {
-        (void)SCRadixFindKeyIPV4BestMatch((uint8_t *)&GET_IPV4_SRC_ADDR_U32(p),
+        if (io_ctx->lpm_ipv4src != NULL)
+            user_data_src = SCPoptrieLookupIPV4(io_ctx->lpm_ipv4src,
+                                                (uint8_t *)&GET_IPV4_SRC_ADDR_U32(p));
+        else
+            (void)SCRadixFindKeyIPV4BestMatch((uint8_t *)&GET_IPV4_SRC_ADDR_U32(p),
                                               io_ctx->tree_ipv4src, &user_data_src);
     } else if (p->src.family == AF_INET6) {
-        (void)SCRadixFindKeyIPV6BestMatch((uint8_t *)&GET_IPV6_SRC_ADDR(p),
+        if (io_ctx->lpm_ipv6src != NULL)
+            user_data_src = SCPoptrieLookupIPV6(io_ctx->lpm_ipv6src,
+                                                (uint8_t *)&GET_IPV6_SRC_ADDR(p));
+        else
+            (void)SCRadixFindKeyIPV6BestMatch((uint8_t *)&GET_IPV6_SRC_ADDR(p),
                                               io_ctx->tree_ipv6src, &user_data_src);
     }
 
     if (p->dst.family == AF_INET) {
-        (void)SCRadixFindKeyIPV4BestMatch((uint8_t *)&GET_IPV4_DST_ADDR_U32(p),
+        if (io_ctx->lpm_ipv4dst != NULL)
+            user_data_dst = SCPoptrieLookupIPV4(io_ctx->lpm_ipv4dst,
+                                                (uint8_t *)&GET_IPV4_DST_ADDR_U32(p));
+        else
+            (void)SCRadixFindKeyIPV4BestMatch((uint8_t *)&GET_IPV4_DST_ADDR_U32(p),
                                               io_ctx->tree_ipv4dst, &user_data_dst);
     } else if (p->dst.family == AF_INET6) {
-        (void)SCRadixFindKeyIPV6BestMatch((uint8_t *)&GET_IPV6_DST_ADDR(p),
+        if (io_ctx->lpm_ipv6dst != NULL)
+            user_data_dst = SCPoptrieLookupIPV6(io_ctx->lpm_ipv6dst,
+                                                (uint8_t *)&GET_IPV6_DST_ADDR(p));
+        else
+            (void)SCRadixFindKeyIPV6BestMatch((uint8_t *)&GET_IPV6_DST_ADDR(p),
                                               io_ctx->tree_ipv6dst, &user_data_dst);
     }
 
@@ -1522,6 +1547,19 @@ void IPOnlyPrepare(DetectEngineCtx *de_ctx)
     SCRadixPrintTree((de_ctx->io_ctx).tree_ipv6dst);
     SCLogDebug("__________________");
     */
+
+    /* the trees are complete: compile them for the lookups. If that
+     * fails the lookups fall back to the trees. */
+    DetectEngineIPOnlyCtx *io_ctx = &de_ctx->io_ctx;
+    io_ctx->lpm_ipv4src = SCPoptrieFromRadixTree(io_ctx->tree_ipv4src, 32);
+    io_ctx->lpm_ipv4dst = SCPoptrieFromRadixTree(io_ctx->tree_ipv4dst, 32);
+    io_ctx->lpm_ipv6src = SCPoptrieFromRadixTree(io_ctx->tree_ipv6src, 128);
+    io_ctx->lpm_ipv6dst = SCPoptrieFromRadixTree(io_ctx->tree_ipv6dst, 128);
+    SCLogDebug("IP-only lookup tables: %"PRIu64" bytes",
+            SCPoptrieMemoryUse(io_ctx->lpm_ipv4src) +
+            SCPoptrieMemoryUse(io_ctx->lpm_ipv4dst) +
+            SCPoptrieMemoryUse(io_ctx->lpm_ipv6src) +
+            SCPoptrieMemoryUse(io_ctx->lpm_ipv6dst));
 }
 
 /**
@@ -372,6 +372,7 @@ int SigLoadSignatures(DetectEngineCtx *de_ctx, char *sig_file, int sig_file_excl
     gettimeofday(&de_ctx->last_reload, NULL);
     if (RunmodeGetCurrent() == RUNMODE_ENGINE_ANALYSIS) {
         if (rule_engine_analysis_set) {
+            EngineAnalysisBuffers(de_ctx);
             CleanupRuleAnalyzer();
         }
         if (fp_engine_analysis_set) {
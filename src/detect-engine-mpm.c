@@ -37,6 +37,7 @@
 #include "detect-engine-iponly.h"
 #include "detect-parse.h"
 #include "detect-engine-prefilter.h"
+#include "detect-engine-fp-profile.h"
 #include "util-mpm.h"
 #include "util-memcmp.h"
 #include "util-memcpy.h"
@@ -61,6 +62,7 @@
 #include "util-debug.h"
 #include "util-print.h"
 #include "util-validate.h"
+#include "util-hash-lookup3.h"
 
 const char *builtin_mpms[] = {
     "toserver TCP packet",
@@ -230,8 +232,142 @@ void DetectMpmInitializeAppMpms(DetectEngineCtx *de_ctx)
 }
 
 /**
- *  \brief initialize mpm contexts for applayer buffers that are in
- *         "single or "shared" mode.
+ *  \brief queue a mpm context to be prepared by DetectMpmPrepareQueued()
+ *
+ *  If the queue can't grow the context is prepared right away.
+ *
+ *  \retval 0 ok, -1 on error
+ */
+static int DetectMpmQueuePrepare(DetectEngineCtx *de_ctx, MpmCtx *mpm_ctx)
+{
+    if (mpm_table[de_ctx->mpm_matcher].Prepare == NULL)
+        return 0;
+
+    if (de_ctx->mpm_prepare_queue_cnt == de_ctx->mpm_prepare_queue_size) {
+        uint32_t size = MAX(64, de_ctx->mpm_prepare_queue_size * 2);
+        MpmCtx **queue = SCRealloc(de_ctx->mpm_prepare_queue,
+                size * sizeof(MpmCtx *));
+        if (queue == NULL) {
+            return mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+        }
+        de_ctx->mpm_prepare_queue = queue;
+        de_ctx->mpm_prepare_queue_size = size;
+    }
+    de_ctx->mpm_prepare_queue[de_ctx->mpm_prepare_queue_cnt++] = mpm_ctx;
+    return 0;
+}
+
+typedef struct DetectMpmPrepareTask_ {
+    MpmCtx **queue;
+    uint32_t cnt;
+    uint16_t mpm_matcher;
+    SC_ATOMIC_DECLARE(uint32_t, next);  /**< next queue entry to prepare */
+    SC_ATOMIC_DECLARE(int, result);
+} DetectMpmPrepareTask;
+
+/** \internal
+ *  \brief worker loop: take the next unprepared context until none are
+ *         left. Run by the pool threads and the caller alike. */
+static void *DetectMpmPrepareWorker(void *arg)
+{
+    DetectMpmPrepareTask *task = (DetectMpmPrepareTask *)arg;
+
+    uint32_t i;
+    while ((i = SC_ATOMIC_ADD(task->next, 1) - 1) < task->cnt) {
+        if (mpm_table[task->mpm_matcher].Prepare(task->queue[i]) != 0) {
+            SC_ATOMIC_OR(task->result, 1);
+        }
+    }
+    return NULL;
+}
+
+/** \internal
+ *  \brief sort biggest context first so a large database doesn't end up
+ *         being compiled last on an otherwise idle pool. Ties are sorted
+ *         by address so that duplicates end up next to each other. */
+static int DetectMpmPrepareCompare(const void *a, const void *b)
+{
+    const MpmCtx *ma = *(const MpmCtx **)a;
+    const MpmCtx *mb = *(const MpmCtx **)b;
+
+    if (ma->pattern_cnt > mb->pattern_cnt)
+        return -1;
+    if (ma->pattern_cnt < mb->pattern_cnt)
+        return 1;
+    if (ma < mb)
+        return -1;
+    if (ma > mb)
+        return 1;
+    return 0;
+}
+
+/**
+ *  \brief prepare all queued mpm contexts
+ *
+ *  The contexts are independent of each other, so they are spread over
+ *  'detect.mpm-prepare-threads' threads. The mpm implementations take care
+ *  of their own global state.
+ *
+ *  \retval 0 ok, -1 if any context failed to prepare
+ */
+int DetectMpmPrepareQueued(DetectEngineCtx *de_ctx)
+{
+    if (de_ctx->mpm_prepare_queue_cnt == 0)
+        return 0;
+
+    qsort(de_ctx->mpm_prepare_queue, de_ctx->mpm_prepare_queue_cnt,
+            sizeof(MpmCtx *), DetectMpmPrepareCompare);
+
+    /* shared contexts can be queued more than once, but must only be
+     * prepared once */
+    uint32_t cnt = 1;
+    for (uint32_t i = 1; i < de_ctx->mpm_prepare_queue_cnt; i++) {
+        if (de_ctx->mpm_prepare_queue[i] != de_ctx->mpm_prepare_queue[cnt - 1])
+            de_ctx->mpm_prepare_queue[cnt++] = de_ctx->mpm_prepare_queue[i];
+    }
+
+    DetectMpmPrepareTask task;
+    memset(&task, 0, sizeof(task));
+    task.queue = de_ctx->mpm_prepare_queue;
+    task.cnt = cnt;
+    task.mpm_matcher = de_ctx->mpm_matcher;
+    SC_ATOMIC_INIT(task.next);
+    SC_ATOMIC_INIT(task.result);
+
+    uint32_t nthreads = MIN(de_ctx->mpm_prepare_threads, cnt);
+    pthread_t threads[nthreads > 0 ? nthreads : 1];
+    uint32_t spawned = 0;
+    /* the calling thread is one of the workers */
+    for (uint32_t t = 1; t < nthreads; t++) {
+        int rc = pthread_create(&threads[spawned], NULL,
+                DetectMpmPrepareWorker, &task);
+        if (rc != 0) {
+            SCLogWarning(SC_ERR_THREAD_CREATE, "failed to create mpm "
+                    "prepare thread: %s", strerror(rc));
+            break;
+        }
+        spawned++;
+    }
+    DetectMpmPrepareWorker(&task);
+    for (uint32_t t = 0; t < spawned; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    SCLogDebug("prepared %u mpm contexts using %u threads", cnt, spawned + 1);
+
+    int r = SC_ATOMIC_GET(task.result) ? -1 : 0;
+    SC_ATOMIC_DESTROY(task.next);
+    SC_ATOMIC_DESTROY(task.result);
+
+    SCFree(de_ctx->mpm_prepare_queue);
+    de_ctx->mpm_prepare_queue = NULL;
+    de_ctx->mpm_prepare_queue_cnt = 0;
+    de_ctx->mpm_prepare_queue_size = 0;
+    return r;
+}
+
+/**
+ *  \brief queue mpm contexts for applayer buffers that are in
+ *         "single or "shared" mode for preparing.
  */
 int DetectMpmPrepareAppMpms(DetectEngineCtx *de_ctx)
 {
@@ -244,9 +380,7 @@ int DetectMpmPrepareAppMpms(DetectEngineCtx *de_ctx)
         {
             MpmCtx *mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, am->sgh_mpm_context, dir);
             if (mpm_ctx != NULL) {
-                if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-                    r |= mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-                }
+                r |= DetectMpmQueuePrepare(de_ctx, mpm_ctx);
             }
         }
         am = am->next;
@@ -397,8 +531,8 @@ void DetectMpmInitializePktMpms(DetectEngineCtx *de_ctx)
 }
 
 /**
- *  \brief initialize mpm contexts for applayer buffers that are in
- *         "single or "shared" mode.
+ *  \brief queue mpm contexts for pkt buffers that are in
+ *         "single or "shared" mode for preparing.
  */
 int DetectMpmPreparePktMpms(DetectEngineCtx *de_ctx)
 {
@@ -411,10 +545,8 @@ int DetectMpmPreparePktMpms(DetectEngineCtx *de_ctx)
         {
             MpmCtx *mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, am->sgh_mpm_context, 0);
             if (mpm_ctx != NULL) {
-                if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-                    r |= mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-                    SCLogDebug("%s: %d", am->name, r);
-                }
+                r |= DetectMpmQueuePrepare(de_ctx, mpm_ctx);
+                SCLogDebug("%s: %d", am->name, r);
             }
         }
         am = am->next;
@@ -456,8 +588,8 @@ void DetectMpmInitializeBuiltinMpms(DetectEngineCtx *de_ctx)
 }
 
 /**
- *  \brief initialize mpm contexts for builtin buffers that are in
- *         "single or "shared" mode.
+ *  \brief queue mpm contexts for builtin buffers that are in
+ *         "single or "shared" mode for preparing.
  */
 int DetectMpmPrepareBuiltinMpms(DetectEngineCtx *de_ctx)
 {
@@ -466,42 +598,28 @@ int DetectMpmPrepareBuiltinMpms(DetectEngineCtx *de_ctx)
 
     if (de_ctx->sgh_mpm_context_proto_tcp_packet != MPM_CTX_FACTORY_UNIQUE_CONTEXT) {
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_tcp_packet, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            r |= mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        r |= DetectMpmQueuePrepare(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_tcp_packet, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            r |= mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        r |= DetectMpmQueuePrepare(de_ctx, mpm_ctx);
     }
 
     if (de_ctx->sgh_mpm_context_proto_udp_packet != MPM_CTX_FACTORY_UNIQUE_CONTEXT) {
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_udp_packet, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            r |= mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        r |= DetectMpmQueuePrepare(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_udp_packet, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            r |= mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        r |= DetectMpmQueuePrepare(de_ctx, mpm_ctx);
     }
 
     if (de_ctx->sgh_mpm_context_proto_other_packet != MPM_CTX_FACTORY_UNIQUE_CONTEXT) {
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_other_packet, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            r |= mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        r |= DetectMpmQueuePrepare(de_ctx, mpm_ctx);
     }
 
     if (de_ctx->sgh_mpm_context_stream != MPM_CTX_FACTORY_UNIQUE_CONTEXT) {
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_stream, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            r |= mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        r |= DetectMpmQueuePrepare(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_stream, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            r |= mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        r |= DetectMpmQueuePrepare(de_ctx, mpm_ctx);
     }
 
     return r;
@@ -912,6 +1030,10 @@ void RetrieveFPForSig(const DetectEngineCtx *de_ctx, Signature *s)
         mpm_sm = GetMpmForList(s, final_sm_list[i], mpm_sm, max_len, skip_negated_content);
     }
 
+    /* a measured hit rate beats the length and strength heuristics */
+    mpm_sm = DetectFastPatternProfileSelect(de_ctx, s, final_sm_list,
+            count_final_sm_list, mpm_sm);
+
     /* assign to signature */
     SetMpm(s, mpm_sm);
     return;
@@ -976,11 +1098,36 @@ static char MpmStoreCompareFunc(void *data1, uint16_t len1, void *data2,
     return 1;
 }
 
+/* protects the reference counts of mpm contexts shared by engines */
+static SCMutex mpm_share_lock = SCMUTEX_INITIALIZER;
+
+/** \internal
+ *  \brief drop the reference of a store to its mpm_ctx
+ *
+ *  \retval 1 last reference, the mpm_ctx should be destroyed
+ *  \retval 0 the mpm_ctx is still used by another engine
+ */
+static int MpmStoreReleaseCtx(MpmStore *ms)
+{
+    if (ms->ctx_ref_cnt == NULL)
+        return 1;
+
+    SCMutexLock(&mpm_share_lock);
+    const int last = (--(*ms->ctx_ref_cnt) == 0);
+    SCMutexUnlock(&mpm_share_lock);
+
+    if (last)
+        SCFree(ms->ctx_ref_cnt);
+    ms->ctx_ref_cnt = NULL;
+    return last;
+}
+
 static void MpmStoreFreeFunc(void *ptr)
 {
     MpmStore *ms = ptr;
     if (ms != NULL) {
-        if (ms->mpm_ctx != NULL && !(ms->mpm_ctx->flags & MPMCTX_FLAGS_GLOBAL))
+        if (ms->mpm_ctx != NULL && !(ms->mpm_ctx->flags & MPMCTX_FLAGS_GLOBAL) &&
+            MpmStoreReleaseCtx(ms) == 1)
         {
             SCLogDebug("destroying mpm_ctx %p", ms->mpm_ctx);
             mpm_table[ms->mpm_ctx->mpm_type].DestroyCtx(ms->mpm_ctx);
@@ -988,11 +1135,45 @@ static void MpmStoreFreeFunc(void *ptr)
         }
         ms->mpm_ctx = NULL;
 
+        if (ms->sigs != NULL)
+            SCFree(ms->sigs);
+        if (ms->rule_id_map != NULL)
+            SCFree(ms->rule_id_map);
         SCFree(ms->sid_array);
         SCFree(ms);
     }
 }
 
+static uint32_t MpmStoreShareHashFunc(HashListTable *ht, void *data, uint16_t datalen)
+{
+    const MpmStore *ms = (MpmStore *)data;
+    return ms->sigs_hash % ht->array_size;
+}
+
+/**
+ * \brief The Compare function for the MpmStore share table: stores match if
+ *        their mpm is for the same buffer and has the patterns of the same
+ *        signatures. The rule id's may differ.
+ */
+static char MpmStoreShareCompareFunc(void *data1, uint16_t len1, void *data2,
+                                     uint16_t len2)
+{
+    const MpmStore *ms1 = (MpmStore *)data1;
+    const MpmStore *ms2 = (MpmStore *)data2;
+
+    if (ms1->sigs_hash != ms2->sigs_hash || ms1->sigs_cnt != ms2->sigs_cnt)
+        return 0;
+    if (ms1->buffer != ms2->buffer || ms1->direction != ms2->direction ||
+        ms1->sm_list != ms2->sm_list)
+        return 0;
+
+    for (uint32_t i = 0; i < ms1->sigs_cnt; i++) {
+        if (ms1->sigs[i].hash != ms2->sigs[i].hash)
+            return 0;
+    }
+    return 1;
+}
+
 /**
  * \brief Initializes the MpmStore mpm hash table to be used by the detection
  *        engine context.
@@ -1011,6 +1192,14 @@ int MpmStoreInit(DetectEngineCtx *de_ctx)
     if (de_ctx->mpm_hash_table == NULL)
         goto error;
 
+    /* stores are owned by mpm_hash_table */
+    de_ctx->mpm_share_hash_table = HashListTableInit(4096,
+                                                     MpmStoreShareHashFunc,
+                                                     MpmStoreShareCompareFunc,
+                                                     NULL);
+    if (de_ctx->mpm_share_hash_table == NULL)
+        goto error;
+
     return 0;
 
 error:
@@ -1143,6 +1332,68 @@ void MpmStoreReportStats(const DetectEngineCtx *de_ctx)
     }
 }
 
+/** \internal
+ *  \brief memory use of the mpm contexts of an engine
+ *
+ *  \param reused set to the memory of the contexts taken over from the
+ *                previous engine
+ *  \retval memory of all contexts
+ */
+static uint64_t MpmStoreMemoryUse(const DetectEngineCtx *de_ctx, uint64_t *reused)
+{
+    uint64_t total = 0;
+    *reused = 0;
+
+    if (de_ctx->mpm_hash_table != NULL) {
+        HashListTableBucket *htb = HashListTableGetListHead(de_ctx->mpm_hash_table);
+        for ( ; htb != NULL; htb = HashListTableGetListNext(htb)) {
+            const MpmStore *ms = (MpmStore *)HashListTableGetListData(htb);
+            if (ms == NULL || ms->mpm_ctx == NULL ||
+                ms->sgh_mpm_context != MPM_CTX_FACTORY_UNIQUE_CONTEXT)
+                continue;
+            total += ms->mpm_ctx->memory_size;
+            if (ms->ctx_ref_cnt != NULL)
+                *reused += ms->mpm_ctx->memory_size;
+        }
+    }
+
+    /* contexts shared by all rule groups: these are always built */
+    const MpmCtxFactoryContainer *fc = de_ctx->mpm_ctx_factory_container;
+    if (fc != NULL) {
+        for (int32_t i = 0; i < fc->no_of_items; i++) {
+            if (fc->items[i].mpm_ctx_ts != NULL)
+                total += fc->items[i].mpm_ctx_ts->memory_size;
+            if (fc->items[i].mpm_ctx_tc != NULL &&
+                fc->items[i].mpm_ctx_tc != fc->items[i].mpm_ctx_ts)
+                total += fc->items[i].mpm_ctx_tc->memory_size;
+        }
+    }
+    return total;
+}
+
+/**
+ * \brief Update the reload stats of an engine built by a rule reload with
+ *        the memory of its mpm contexts
+ *
+ * \param de_ctx     the new engine
+ * \param old_de_ctx the engine it replaces
+ */
+void MpmStoreReloadStats(DetectEngineCtx *de_ctx, const DetectEngineCtx *old_de_ctx)
+{
+    uint64_t reused = 0;
+    const uint64_t total = MpmStoreMemoryUse(de_ctx, &reused);
+    uint64_t old_reused = 0;
+    const uint64_t old_total = old_de_ctx ?
+        MpmStoreMemoryUse(old_de_ctx, &old_reused) : 0;
+
+    de_ctx->reload_stats.mpm_memory_reused = reused;
+    de_ctx->reload_stats.mpm_memory_built = total - reused;
+    /* when the old engine is freed, the contexts that were not taken over
+     * are released */
+    de_ctx->reload_stats.mpm_memory_delta =
+        (int64_t)(total - reused) - (int64_t)(old_total - MIN(reused, old_total));
+}
+
 /**
  * \brief Frees the hash table - DetectEngineCtx->mpm_hash_table, allocated by
  *        MpmStoreInit() function.
@@ -1151,6 +1402,11 @@ void MpmStoreReportStats(const DetectEngineCtx *de_ctx)
  */
 void MpmStoreFree(DetectEngineCtx *de_ctx)
 {
+    if (de_ctx->mpm_share_hash_table != NULL) {
+        HashListTableFree(de_ctx->mpm_share_hash_table);
+        de_ctx->mpm_share_hash_table = NULL;
+    }
+
     if (de_ctx->mpm_hash_table == NULL)
         return;
 
@@ -1159,7 +1415,210 @@ void MpmStoreFree(DetectEngineCtx *de_ctx)
     return;
 }
 
-static void MpmStoreSetup(const DetectEngineCtx *de_ctx, MpmStore *ms)
+/** \internal
+ *  \brief get the pattern a signature adds to the mpm of a store
+ *
+ *  \retval cd the pattern or NULL if the signature doesn't add one
+ */
+static const DetectContentData *MpmStoreGetSigPattern(const MpmStore *ms,
+        const Signature *s)
+{
+    if ((s->flags & ms->direction) == 0)
+        return NULL;
+    if (s->init_data->mpm_sm == NULL)
+        return NULL;
+    int list = SigMatchListSMBelongsTo(s, s->init_data->mpm_sm);
+    if (list < 0)
+        return NULL;
+    if (list != ms->sm_list)
+        return NULL;
+
+    const DetectContentData *cd = (DetectContentData *)s->init_data->mpm_sm->ctx;
+
+    /* negated logic: if mpm match can't be used to be sure about this
+     * pattern, we have to inspect the rule fully regardless of mpm
+     * match. So in this case there is no point of adding it at all.
+     * The non-mpm list entry for the sig will make sure the sig is
+     * inspected. */
+    if ((cd->flags & DETECT_CONTENT_NEGATED) &&
+        !(DETECT_CONTENT_MPM_IS_CONCLUSIVE(cd)))
+    {
+        SCLogDebug("not adding negated mpm as it's not 'single'");
+        return NULL;
+    }
+    return cd;
+}
+
+/** \internal
+ *  \brief 64 bit hash of a signature and the pattern it adds to a mpm */
+static uint64_t MpmStoreSigHash(const Signature *s, const DetectContentData *cd)
+{
+    struct {
+        uint32_t flags;
+        uint16_t offset;
+        uint16_t depth;
+        uint16_t fp_chop_offset;
+        uint16_t fp_chop_len;
+    } pat;
+    memset(&pat, 0, sizeof(pat));
+    pat.flags = cd->flags;
+    pat.offset = cd->offset;
+    pat.depth = cd->depth;
+    pat.fp_chop_offset = cd->fp_chop_offset;
+    pat.fp_chop_len = cd->fp_chop_len;
+
+    uint32_t h1 = 0;
+    uint32_t h2 = 0x9e3779b9;
+    if (s->sig_str != NULL) {
+        const size_t len = strlen(s->sig_str);
+        h1 = hashlittle_safe(s->sig_str, len, h1);
+        h2 = hashlittle_safe(s->sig_str, len, h2);
+    } else {
+        const uint32_t id[3] = { s->id, s->gid, s->rev };
+        h1 = hashlittle_safe(id, sizeof(id), h1);
+        h2 = hashlittle_safe(id, sizeof(id), h2);
+    }
+    h1 = hashlittle_safe(cd->content, cd->content_len, h1);
+    h2 = hashlittle_safe(cd->content, cd->content_len, h2);
+    h1 = hashlittle_safe(&pat, sizeof(pat), h1);
+    h2 = hashlittle_safe(&pat, sizeof(pat), h2);
+    return ((uint64_t)h1 << 32) | h2;
+}
+
+static int MpmStoreSigCompare(const void *a, const void *b)
+{
+    const MpmStoreSig *sa = a;
+    const MpmStoreSig *sb = b;
+    if (sa->hash != sb->hash)
+        return sa->hash < sb->hash ? -1 : 1;
+    if (sa->rule_id != sb->rule_id)
+        return sa->rule_id < sb->rule_id ? -1 : 1;
+    return 0;
+}
+
+/** \internal
+ *  \brief collect the sorted hashes of the signatures that add a pattern
+ *         to the mpm of a store
+ *
+ *  \retval 0 ok, ms->sigs is NULL if no signature adds a pattern
+ *  \retval -1 error
+ */
+static int MpmStoreSetupSigs(const DetectEngineCtx *de_ctx, MpmStore *ms)
+{
+    uint32_t max = 0;
+    for (uint32_t i = 0; i < ms->sid_array_size; i++)
+        max += __builtin_popcount(ms->sid_array[i]);
+    if (max == 0)
+        return 0;
+
+    ms->sigs = SCCalloc(max, sizeof(MpmStoreSig));
+    if (ms->sigs == NULL)
+        return -1;
+
+    uint32_t cnt = 0;
+    for (uint32_t sig = 0; sig < (ms->sid_array_size * 8); sig++) {
+        if (ms->sid_array[sig / 8] & (1 << (sig % 8))) {
+            const Signature *s = de_ctx->sig_array[sig];
+            if (s == NULL)
+                continue;
+            const DetectContentData *cd = MpmStoreGetSigPattern(ms, s);
+            if (cd == NULL)
+                continue;
+            ms->sigs[cnt].hash = MpmStoreSigHash(s, cd);
+            ms->sigs[cnt].rule_id = s->num;
+            cnt++;
+        }
+    }
+    if (cnt == 0) {
+        SCFree(ms->sigs);
+        ms->sigs = NULL;
+        return 0;
+    }
+
+    qsort(ms->sigs, cnt, sizeof(MpmStoreSig), MpmStoreSigCompare);
+    ms->sigs_cnt = cnt;
+    ms->sigs_hash = 0;
+    for (uint32_t i = 0; i < cnt; i++) {
+        ms->sigs_hash = hashlittle_safe(&ms->sigs[i].hash,
+                sizeof(ms->sigs[i].hash), ms->sigs_hash);
+    }
+    return 0;
+}
+
+/** \internal
+ *  \brief take over the mpm_ctx of an identical store of the engine that
+ *         is replaced by a rule reload
+ *
+ *  The signatures of both stores are in hash order, so the n-th signature
+ *  of the old store is the n-th of the new one. If their rule id's differ
+ *  a map is set up to translate the id's the mpm_ctx adds.
+ *
+ *  \retval 1 mpm_ctx taken over
+ *  \retval 0 no identical store, the mpm_ctx needs to be built
+ */
+static int MpmStoreShareFromBase(DetectEngineCtx *de_ctx, MpmStore *ms)
+{
+    const DetectEngineCtx *base = de_ctx->reload_base;
+    if (base == NULL || base->mpm_share_hash_table == NULL || ms->sigs == NULL)
+        return 0;
+
+    MpmStore *old = HashListTableLookup(base->mpm_share_hash_table, ms, 0);
+    if (old == NULL || old->mpm_ctx == NULL ||
+        old->mpm_ctx->mpm_type != de_ctx->mpm_matcher)
+        return 0;
+
+    SigIntId min = old->sigs[0].rule_id;
+    SigIntId max = min;
+    bool identity = true;
+    for (uint32_t i = 0; i < ms->sigs_cnt; i++) {
+        min = MIN(min, old->sigs[i].rule_id);
+        max = MAX(max, old->sigs[i].rule_id);
+        if (old->sigs[i].rule_id != ms->sigs[i].rule_id)
+            identity = false;
+    }
+
+    MpmRuleIdMap *map = NULL;
+    if (!identity) {
+        const uint32_t len = (uint32_t)(max - min) + 1;
+        map = SCCalloc(1, sizeof(MpmRuleIdMap) + len * sizeof(SigIntId));
+        if (map == NULL)
+            return 0;
+        map->base = min;
+        map->len = len;
+        for (uint32_t i = 0; i < ms->sigs_cnt; i++) {
+            map->map[old->sigs[i].rule_id - min] = ms->sigs[i].rule_id;
+        }
+    }
+
+    SCMutexLock(&mpm_share_lock);
+    if (old->ctx_ref_cnt == NULL) {
+        old->ctx_ref_cnt = SCCalloc(1, sizeof(uint32_t));
+        if (old->ctx_ref_cnt == NULL) {
+            SCMutexUnlock(&mpm_share_lock);
+            if (map != NULL)
+                SCFree(map);
+            return 0;
+        }
+        *old->ctx_ref_cnt = 1;
+    }
+    (*old->ctx_ref_cnt)++;
+    ms->ctx_ref_cnt = old->ctx_ref_cnt;
+    SCMutexUnlock(&mpm_share_lock);
+
+    /* keep the id's the mpm_ctx adds, so the next reload maps from those */
+    for (uint32_t i = 0; i < ms->sigs_cnt; i++) {
+        ms->sigs[i].rule_id = old->sigs[i].rule_id;
+    }
+    ms->mpm_ctx = old->mpm_ctx;
+    ms->rule_id_map = map;
+    de_ctx->reload_stats.mpm_reused++;
+
+    SCLogDebug("taking over mpm_ctx %p with %u patterns (%s)", ms->mpm_ctx,
+            ms->mpm_ctx->pattern_cnt, map ? "remapped" : "same rule id's");
+    return 1;
+}
+
+static void MpmStoreSetup(DetectEngineCtx *de_ctx, MpmStore *ms)
 {
     const Signature *s = NULL;
     uint32_t sig;
@@ -1194,6 +1653,16 @@ static void MpmStoreSetup(const DetectEngineCtx *de_ctx, MpmStore *ms)
             dir = 0;
     }
 
+    /* on a rule reload a unique mpm_ctx with the patterns of the same
+     * signatures can be taken over from the engine this one replaces */
+    const bool unique = (ms->sgh_mpm_context == MPM_CTX_FACTORY_UNIQUE_CONTEXT);
+    if (unique && de_ctx->delta_reload && MpmStoreSetupSigs(de_ctx, ms) == 0 &&
+        MpmStoreShareFromBase(de_ctx, ms) == 1)
+    {
+        (void)HashListTableAdd(de_ctx->mpm_share_hash_table, ms, 0);
+        return;
+    }
+
     ms->mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, ms->sgh_mpm_context, dir);
     if (ms->mpm_ctx == NULL)
         return;
@@ -1206,37 +1675,14 @@ static void MpmStoreSetup(const DetectEngineCtx *de_ctx, MpmStore *ms)
             s = de_ctx->sig_array[sig];
             if (s == NULL)
                 continue;
-            if ((s->flags & ms->direction) == 0)
-                continue;
-            if (s->init_data->mpm_sm == NULL)
-                continue;
-            int list = SigMatchListSMBelongsTo(s, s->init_data->mpm_sm);
-            if (list < 0)
-                continue;
-            if (list != ms->sm_list)
+            const DetectContentData *cd = MpmStoreGetSigPattern(ms, s);
+            if (cd == NULL)
                 continue;
 
             SCLogDebug("adding %u", s->id);
 
-            const DetectContentData *cd = (DetectContentData *)s->init_data->mpm_sm->ctx;
-
-            int skip = 0;
-            /* negated logic: if mpm match can't be used to be sure about this
-             * pattern, we have to inspect the rule fully regardless of mpm
-             * match. So in this case there is no point of adding it at all.
-             * The non-mpm list entry for the sig will make sure the sig is
-             * inspected. */
-            if ((cd->flags & DETECT_CONTENT_NEGATED) &&
-                !(DETECT_CONTENT_MPM_IS_CONCLUSIVE(cd)))
-            {
-                skip = 1;
-                SCLogDebug("not adding negated mpm as it's not 'single'");
-            }
-
-            if (!skip) {
-                PopulateMpmHelperAddPattern(ms->mpm_ctx,
-                        cd, s, 0, (cd->flags & DETECT_CONTENT_FAST_PATTERN_CHOP));
-            }
+            PopulateMpmHelperAddPattern(ms->mpm_ctx,
+                    cd, s, 0, (cd->flags & DETECT_CONTENT_FAST_PATTERN_CHOP));
         }
     }
 
@@ -1244,10 +1690,11 @@ static void MpmStoreSetup(const DetectEngineCtx *de_ctx, MpmStore *ms)
         MpmFactoryReClaimMpmCtx(de_ctx, ms->mpm_ctx);
         ms->mpm_ctx = NULL;
     } else {
-        if (ms->sgh_mpm_context == MPM_CTX_FACTORY_UNIQUE_CONTEXT) {
-            if (mpm_table[ms->mpm_ctx->mpm_type].Prepare != NULL) {
-                mpm_table[ms->mpm_ctx->mpm_type].Prepare(ms->mpm_ctx);
-            }
+        if (unique) {
+            (void)DetectMpmQueuePrepare(de_ctx, ms->mpm_ctx);
+            de_ctx->reload_stats.mpm_built++;
+            if (ms->sigs != NULL)
+                (void)HashListTableAdd(de_ctx->mpm_share_hash_table, ms, 0);
         }
     }
 }
@@ -1557,6 +2004,67 @@ static void SetRawReassemblyFlag(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
     SCLogDebug("rule group %p does NOT have SIG_GROUP_HEAD_HAVERAWSTREAM set", sgh);
 }
 
+/** \internal
+ *  \brief last engines of the prefilter engine lists of a sgh, to find
+ *         the engines a prefilter registration adds */
+typedef struct PrefilterListTails_ {
+    PrefilterEngineList *pkt;
+    PrefilterEngineList *payload;
+    PrefilterEngineList *tx;
+} PrefilterListTails;
+
+static PrefilterEngineList *PrefilterListTail(PrefilterEngineList *el)
+{
+    while (el != NULL && el->next != NULL)
+        el = el->next;
+    return el;
+}
+
+static void PrefilterListTailsGet(const SigGroupHead *sh, PrefilterListTails *t)
+{
+    t->pkt = PrefilterListTail(sh->init->pkt_engines);
+    t->payload = PrefilterListTail(sh->init->payload_engines);
+    t->tx = PrefilterListTail(sh->init->tx_engines);
+}
+
+static void PrefilterListSetRuleIdMap(PrefilterEngineList *list,
+        PrefilterEngineList *tail, const MpmRuleIdMap *map)
+{
+    PrefilterEngineList *el = tail ? tail->next : list;
+    for ( ; el != NULL; el = el->next) {
+        el->rule_id_map = map;
+    }
+}
+
+/** \internal
+ *  \brief register the prefilter engine(s) for a store
+ *
+ *  If the store took over its mpm_ctx from the previous engine, the
+ *  engines registered for it get the store's rule id map.
+ */
+static void MpmStoreRegisterPrefilter(DetectEngineCtx *de_ctx, SigGroupHead *sh,
+        const MpmStore *ms, const DetectBufferMpmRegistery *a,
+        int (*Register)(DetectEngineCtx *, SigGroupHead *, MpmCtx *))
+{
+    PrefilterListTails t;
+    if (ms->rule_id_map != NULL)
+        PrefilterListTailsGet(sh, &t);
+
+    if (a != NULL) {
+        BUG_ON(a->PrefilterRegisterWithListId(de_ctx,
+                    sh, ms->mpm_ctx, a, a->sm_list) != 0);
+        SCLogDebug("mpm %s %d set up", a->name, a->sm_list);
+    } else {
+        Register(de_ctx, sh, ms->mpm_ctx);
+    }
+
+    if (ms->rule_id_map != NULL) {
+        PrefilterListSetRuleIdMap(sh->init->pkt_engines, t.pkt, ms->rule_id_map);
+        PrefilterListSetRuleIdMap(sh->init->payload_engines, t.payload, ms->rule_id_map);
+        PrefilterListSetRuleIdMap(sh->init->tx_engines, t.tx, ms->rule_id_map);
+    }
+}
+
 static void PrepareAppMpms(DetectEngineCtx *de_ctx, SigGroupHead *sh)
 {
     if (de_ctx->app_mpms_list_cnt == 0)
@@ -1581,10 +2089,7 @@ static void PrepareAppMpms(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                 /* if we have just certain types of negated patterns,
                  * mpm_ctx can be NULL */
                 if (a->PrefilterRegisterWithListId && mpm_store->mpm_ctx) {
-                    BUG_ON(a->PrefilterRegisterWithListId(de_ctx,
-                                sh, mpm_store->mpm_ctx,
-                                a, a->sm_list) != 0);
-                    SCLogDebug("mpm %s %d set up", a->name, a->sm_list);
+                    MpmStoreRegisterPrefilter(de_ctx, sh, mpm_store, a, NULL);
                 }
             }
         }
@@ -1613,10 +2118,7 @@ static void PreparePktMpms(DetectEngineCtx *de_ctx, SigGroupHead *sh)
             /* if we have just certain types of negated patterns,
              * mpm_ctx can be NULL */
             if (a->PrefilterRegisterWithListId && mpm_store->mpm_ctx) {
-                BUG_ON(a->PrefilterRegisterWithListId(de_ctx,
-                            sh, mpm_store->mpm_ctx,
-                            a, a->sm_list) != 0);
-                SCLogDebug("mpm %s %d set up", a->name, a->sm_list);
+                MpmStoreRegisterPrefilter(de_ctx, sh, mpm_store, a, NULL);
             }
         }
         a = a->next;
@@ -1633,12 +2135,14 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
         if (SGH_DIRECTION_TS(sh)) {
             mpm_store = MpmStorePrepareBuffer(de_ctx, sh, MPMB_TCP_PKT_TS);
             if (mpm_store != NULL) {
-                PrefilterPktPayloadRegister(de_ctx, sh, mpm_store->mpm_ctx);
+                MpmStoreRegisterPrefilter(de_ctx, sh, mpm_store, NULL,
+                        PrefilterPktPayloadRegister);
             }
 
             mpm_store = MpmStorePrepareBuffer(de_ctx, sh, MPMB_TCP_STREAM_TS);
             if (mpm_store != NULL) {
-                PrefilterPktStreamRegister(de_ctx, sh, mpm_store->mpm_ctx);
+                MpmStoreRegisterPrefilter(de_ctx, sh, mpm_store, NULL,
+                        PrefilterPktStreamRegister);
             }
 
             SetRawReassemblyFlag(de_ctx, sh);
@@ -1646,12 +2150,14 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
         if (SGH_DIRECTION_TC(sh)) {
             mpm_store = MpmStorePrepareBuffer(de_ctx, sh, MPMB_TCP_PKT_TC);
             if (mpm_store != NULL) {
-                PrefilterPktPayloadRegister(de_ctx, sh, mpm_store->mpm_ctx);
+                MpmStoreRegisterPrefilter(de_ctx, sh, mpm_store, NULL,
+                        PrefilterPktPayloadRegister);
             }
 
             mpm_store = MpmStorePrepareBuffer(de_ctx, sh, MPMB_TCP_STREAM_TC);
             if (mpm_store != NULL) {
-                PrefilterPktStreamRegister(de_ctx, sh, mpm_store->mpm_ctx);
+                MpmStoreRegisterPrefilter(de_ctx, sh, mpm_store, NULL,
+                        PrefilterPktStreamRegister);
             }
 
             SetRawReassemblyFlag(de_ctx, sh);
@@ -1660,19 +2166,22 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
         if (SGH_DIRECTION_TS(sh)) {
             mpm_store = MpmStorePrepareBuffer(de_ctx, sh, MPMB_UDP_TS);
             if (mpm_store != NULL) {
-                PrefilterPktPayloadRegister(de_ctx, sh, mpm_store->mpm_ctx);
+                MpmStoreRegisterPrefilter(de_ctx, sh, mpm_store, NULL,
+                        PrefilterPktPayloadRegister);
             }
         }
         if (SGH_DIRECTION_TC(sh)) {
             mpm_store = MpmStorePrepareBuffer(de_ctx, sh, MPMB_UDP_TC);
             if (mpm_store != NULL) {
-                PrefilterPktPayloadRegister(de_ctx, sh, mpm_store->mpm_ctx);
+                MpmStoreRegisterPrefilter(de_ctx, sh, mpm_store, NULL,
+                        PrefilterPktPayloadRegister);
             }
         }
     } else {
         mpm_store = MpmStorePrepareBuffer(de_ctx, sh, MPMB_OTHERIP);
         if (mpm_store != NULL) {
-            PrefilterPktPayloadRegister(de_ctx, sh, mpm_store->mpm_ctx);
+            MpmStoreRegisterPrefilter(de_ctx, sh, mpm_store, NULL,
+                    PrefilterPktPayloadRegister);
         }
     }
 
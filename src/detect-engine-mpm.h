@@ -38,6 +38,7 @@ void DetectMpmInitializeAppMpms(DetectEngineCtx *de_ctx);
 int DetectMpmPrepareAppMpms(DetectEngineCtx *de_ctx);
 void DetectMpmInitializeBuiltinMpms(DetectEngineCtx *de_ctx);
 int DetectMpmPrepareBuiltinMpms(DetectEngineCtx *de_ctx);
+int DetectMpmPrepareQueued(DetectEngineCtx *de_ctx);
 
 uint32_t PatternStrength(uint8_t *, uint16_t);
 
@@ -67,6 +68,7 @@ void RetrieveFPForSig(const DetectEngineCtx *de_ctx, Signature *s);
 int MpmStoreInit(DetectEngineCtx *);
 void MpmStoreFree(DetectEngineCtx *);
 void MpmStoreReportStats(const DetectEngineCtx *de_ctx);
+void MpmStoreReloadStats(DetectEngineCtx *de_ctx, const DetectEngineCtx *old_de_ctx);
 MpmStore *MpmStorePrepareBuffer(DetectEngineCtx *de_ctx, SigGroupHead *sgh, enum MpmBuiltinBuffers buf);
 
 /**
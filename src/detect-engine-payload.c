@@ -35,6 +35,7 @@
 #include "detect-engine-prefilter.h"
 #include "detect-engine-state.h"
 #include "detect-engine-payload.h"
+#include "detect-engine-fp-profile.h"
 
 #include "stream.h"
 #include "stream-tcp.h"
@@ -56,6 +57,7 @@ struct StreamMpmData {
 static int StreamMpmFunc(void *cb_data, const uint8_t *data, const uint32_t data_len)
 {
     struct StreamMpmData *smd = cb_data;
+    DetectFastPatternTrainScan(smd->det_ctx, DETECT_SM_LIST_PMATCH, data, data_len);
     if (data_len >= smd->mpm_ctx->minlen) {
 #ifdef DEBUG
         smd->det_ctx->stream_mpm_cnt++;
@@ -94,6 +96,8 @@ static void PrefilterPktStream(DetectEngineThreadCtx *det_ctx,
      * as if they are stream chunks */
     if ((p->flags & (PKT_NOPAYLOAD_INSPECTION|PKT_STREAM_ADD)) == 0)
     {
+        DetectFastPatternTrainScan(det_ctx, DETECT_SM_LIST_PMATCH,
+                p->payload, p->payload_len);
         if (p->payload_len >= mpm_ctx->minlen) {
 #ifdef DEBUG
             det_ctx->payload_mpm_cnt++;
@@ -119,6 +123,8 @@ static void PrefilterPktPayload(DetectEngineThreadCtx *det_ctx,
     SCEnter();
 
     const MpmCtx *mpm_ctx = (MpmCtx *)pectx;
+    DetectFastPatternTrainScan(det_ctx, DETECT_SM_LIST_PMATCH,
+            p->payload, p->payload_len);
     if (p->payload_len < mpm_ctx->minlen)
         SCReturn;
 
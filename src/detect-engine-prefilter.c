@@ -41,7 +41,8 @@
  *
  * After the engines have run the resulting list of match candidates is
  * sorted by the rule id's so that the individual inspection happens in
- * the correct order.
+ * the correct order. Detection threads keep the candidates in a bitmap,
+ * which gives the ordered list without a sort.
  */
 
 #include "suricata-common.h"
@@ -49,11 +50,13 @@
 
 #include "detect-engine-prefilter.h"
 #include "detect-engine-mpm.h"
+#include "detect-engine-fp-profile.h"
 
 #include "app-layer-parser.h"
 #include "app-layer-htp.h"
 
 #include "util-profiling.h"
+#include "util-validate.h"
 
 static int PrefilterStoreGetId(DetectEngineCtx *de_ctx,
         const char *name, void (*FreeFunc)(void *));
@@ -84,6 +87,72 @@ static inline void QuickSortSigIntId(SigIntId *sids, uint32_t n)
     QuickSortSigIntId(l, sids + n - l);
 }
 
+/**
+ * \brief get the candidates in rule id order
+ *
+ * With the bitmap the candidates are already unique and only need to be
+ * collected. Otherwise sort the rule list.
+ * NOTE due to merging of 'stream' pmqs we *MAY* have duplicate entries
+ * in the array.
+ */
+static inline void PrefilterSortCandidates(DetectEngineThreadCtx *det_ctx,
+        Packet *p)
+{
+    if (det_ctx->pmq.rule_id_bitmap != NULL) {
+        if (det_ctx->pmq.rule_id_bitmap_cnt > 0) {
+            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_PF_SORT1);
+            PmqBitmapToArray(&det_ctx->pmq);
+            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_PF_SORT1);
+        }
+    } else if (likely(det_ctx->pmq.rule_id_array_cnt > 1)) {
+        PACKET_PROFILING_DETECT_START(p, PROF_DETECT_PF_SORT1);
+        QuickSortSigIntId(det_ctx->pmq.rule_id_array, det_ctx->pmq.rule_id_array_cnt);
+        PACKET_PROFILING_DETECT_END(p, PROF_DETECT_PF_SORT1);
+    }
+}
+
+/** \internal
+ *  \brief state for running an engine with a rule id map, see
+ *         PrefilterRemapStart() */
+typedef struct PrefilterRemapState_ {
+    uint64_t *bitmap;
+    uint32_t start;
+} PrefilterRemapState;
+
+/** \internal
+ *  \brief prepare the rule store for an engine that uses a mpm_ctx taken
+ *         over from a previous detect engine
+ *
+ *  Such a mpm_ctx adds the rule id's of the old engine. They are collected
+ *  at the end of the array, and PrefilterRemapEnd() translates them. */
+static inline void PrefilterRemapStart(PrefilterRuleStore *pmq,
+        PrefilterRemapState *st)
+{
+    st->bitmap = pmq->rule_id_bitmap;
+    st->start = pmq->rule_id_array_cnt;
+    pmq->rule_id_bitmap = NULL;
+}
+
+static void PrefilterRemapEnd(PrefilterRuleStore *pmq,
+        const MpmRuleIdMap *map, const PrefilterRemapState *st)
+{
+    SigIntId *ids = pmq->rule_id_array + st->start;
+    const uint32_t cnt = pmq->rule_id_array_cnt - st->start;
+
+    for (uint32_t i = 0; i < cnt; i++) {
+        DEBUG_VALIDATE_BUG_ON(ids[i] < map->base ||
+                ids[i] - map->base >= map->len);
+        ids[i] = map->map[ids[i] - map->base];
+    }
+
+    pmq->rule_id_bitmap = st->bitmap;
+    if (st->bitmap != NULL) {
+        pmq->rule_id_array_cnt = st->start;
+        if (cnt > 0)
+            PrefilterAddSidsBitmap(pmq, ids, cnt);
+    }
+}
+
 /**
  * \brief run prefilter engines on a transaction
  */
@@ -98,6 +167,7 @@ void DetectRunPrefilterTx(DetectEngineThreadCtx *det_ctx,
 {
     /* reset rule store */
     det_ctx->pmq.rule_id_array_cnt = 0;
+    det_ctx->pmq.rule_id_bitmap_adds = 0;
 
     SCLogDebug("tx %p progress %d", tx->tx_ptr, tx->tx_progress);
 
@@ -114,8 +184,16 @@ void DetectRunPrefilterTx(DetectEngineThreadCtx *det_ctx,
         }
 
         PREFILTER_PROFILING_START;
-        engine->cb.PrefilterTx(det_ctx, engine->pectx,
-                p, p->flow, tx->tx_ptr, tx->tx_id, flow_flags);
+        if (unlikely(engine->rule_id_map != NULL)) {
+            PrefilterRemapState st;
+            PrefilterRemapStart(&det_ctx->pmq, &st);
+            engine->cb.PrefilterTx(det_ctx, engine->pectx,
+                    p, p->flow, tx->tx_ptr, tx->tx_id, flow_flags);
+            PrefilterRemapEnd(&det_ctx->pmq, engine->rule_id_map, &st);
+        } else {
+            engine->cb.PrefilterTx(det_ctx, engine->pectx,
+                    p, p->flow, tx->tx_ptr, tx->tx_id, flow_flags);
+        }
         PREFILTER_PROFILING_END(det_ctx, engine->gid);
 
         if (tx->tx_progress > engine->tx_min_progress) {
@@ -127,13 +205,7 @@ void DetectRunPrefilterTx(DetectEngineThreadCtx *det_ctx,
         engine++;
     } while (1);
 
-    /* Sort the rule list to lets look at pmq.
-     * NOTE due to merging of 'stream' pmqs we *MAY* have duplicate entries */
-    if (likely(det_ctx->pmq.rule_id_array_cnt > 1)) {
-        PACKET_PROFILING_DETECT_START(p, PROF_DETECT_PF_SORT1);
-        QuickSortSigIntId(det_ctx->pmq.rule_id_array, det_ctx->pmq.rule_id_array_cnt);
-        PACKET_PROFILING_DETECT_END(p, PROF_DETECT_PF_SORT1);
-    }
+    PrefilterSortCandidates(det_ctx, p);
 }
 
 void Prefilter(DetectEngineThreadCtx *det_ctx, const SigGroupHead *sgh,
@@ -147,7 +219,14 @@ void Prefilter(DetectEngineThreadCtx *det_ctx, const SigGroupHead *sgh,
         PrefilterEngine *engine = sgh->pkt_engines;
         do {
             PREFILTER_PROFILING_START;
-            engine->cb.Prefilter(det_ctx, p, engine->pectx);
+            if (unlikely(engine->rule_id_map != NULL)) {
+                PrefilterRemapState st;
+                PrefilterRemapStart(&det_ctx->pmq, &st);
+                engine->cb.Prefilter(det_ctx, p, engine->pectx);
+                PrefilterRemapEnd(&det_ctx->pmq, engine->rule_id_map, &st);
+            } else {
+                engine->cb.Prefilter(det_ctx, p, engine->pectx);
+            }
             PREFILTER_PROFILING_END(det_ctx, engine->gid);
 
             if (engine->is_last)
@@ -166,7 +245,14 @@ void Prefilter(DetectEngineThreadCtx *det_ctx, const SigGroupHead *sgh,
         PrefilterEngine *engine = sgh->payload_engines;
         while (1) {
             PREFILTER_PROFILING_START;
-            engine->cb.Prefilter(det_ctx, p, engine->pectx);
+            if (unlikely(engine->rule_id_map != NULL)) {
+                PrefilterRemapState st;
+                PrefilterRemapStart(&det_ctx->pmq, &st);
+                engine->cb.Prefilter(det_ctx, p, engine->pectx);
+                PrefilterRemapEnd(&det_ctx->pmq, engine->rule_id_map, &st);
+            } else {
+                engine->cb.Prefilter(det_ctx, p, engine->pectx);
+            }
             PREFILTER_PROFILING_END(det_ctx, engine->gid);
 
             if (engine->is_last)
@@ -176,13 +262,7 @@ void Prefilter(DetectEngineThreadCtx *det_ctx, const SigGroupHead *sgh,
         PACKET_PROFILING_DETECT_END(p, PROF_DETECT_PF_PAYLOAD);
     }
 
-    /* Sort the rule list to lets look at pmq.
-     * NOTE due to merging of 'stream' pmqs we *MAY* have duplicate entries */
-    if (likely(det_ctx->pmq.rule_id_array_cnt > 1)) {
-        PACKET_PROFILING_DETECT_START(p, PROF_DETECT_PF_SORT1);
-        QuickSortSigIntId(det_ctx->pmq.rule_id_array, det_ctx->pmq.rule_id_array_cnt);
-        PACKET_PROFILING_DETECT_END(p, PROF_DETECT_PF_SORT1);
-    }
+    PrefilterSortCandidates(det_ctx, p);
     SCReturn;
 }
 
@@ -388,6 +468,7 @@ void PrefilterSetupRuleGroup(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
             e->pectx = el->pectx;
             el->pectx = NULL; // e now owns the ctx
             e->gid = el->gid;
+            e->rule_id_map = el->rule_id_map;
             if (el->next == NULL) {
                 e->is_last = TRUE;
             }
@@ -413,6 +494,7 @@ void PrefilterSetupRuleGroup(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
             e->pectx = el->pectx;
             el->pectx = NULL; // e now owns the ctx
             e->gid = el->gid;
+            e->rule_id_map = el->rule_id_map;
             if (el->next == NULL) {
                 e->is_last = TRUE;
             }
@@ -441,6 +523,7 @@ void PrefilterSetupRuleGroup(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
             e->pectx = el->pectx;
             el->pectx = NULL; // e now owns the ctx
             e->gid = el->gid;
+            e->rule_id_map = el->rule_id_map;
             if (el->next == NULL) {
                 e->is_last = TRUE;
             }
@@ -597,6 +680,8 @@ static void PrefilterMpm(DetectEngineThreadCtx *det_ctx,
     SCLogDebug("mpm'ing buffer:");
     //PrintRawDataFp(stdout, data, data_len);
 
+    DetectFastPatternTrainScan(det_ctx, ctx->list_id, data, data_len);
+
     if (data != NULL && data_len >= mpm_ctx->minlen) {
         (void)mpm_table[mpm_ctx->mpm_type].Search(mpm_ctx,
                 &det_ctx->mtcu, &det_ctx->pmq, data, data_len);
@@ -667,6 +752,8 @@ static void PrefilterMpmPkt(DetectEngineThreadCtx *det_ctx,
     SCLogDebug("mpm'ing buffer:");
     //PrintRawDataFp(stdout, data, data_len);
 
+    DetectFastPatternTrainScan(det_ctx, ctx->list_id, data, data_len);
+
     if (data != NULL && data_len >= mpm_ctx->minlen) {
         (void)mpm_table[mpm_ctx->mpm_type].Search(mpm_ctx,
                 &det_ctx->mtcu, &det_ctx->pmq, data, data_len);
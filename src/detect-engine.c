@@ -57,6 +57,7 @@
 #include "detect-tcphdr.h"
 #include "detect-engine-threshold.h"
 #include "detect-engine-content-inspection.h"
+#include "detect-engine-fp-profile.h"
 
 #include "detect-engine-loader.h"
 
@@ -73,6 +74,7 @@
 #include "util-signal.h"
 #include "util-spm.h"
 #include "util-device.h"
+#include "util-cpu.h"
 #include "util-var-name.h"
 #include "util-profiling.h"
 
@@ -998,6 +1000,14 @@ int DetectBufferGetActiveList(DetectEngineCtx *de_ctx, Signature *s)
 
 void InspectionBufferClean(DetectEngineThreadCtx *det_ctx)
 {
+    /* invalidate the inspection cache. At wrap around the old entries
+     * would become valid again, so clear them. */
+    if (++det_ctx->ci_cache.gen == 0 && det_ctx->ci_cache.entries != NULL) {
+        memset(det_ctx->ci_cache.entries, 0,
+                DETECT_CI_CACHE_SIZE * sizeof(DetectInspectCacheEntry));
+        det_ctx->ci_cache.gen = 1;
+    }
+
     /* single buffers */
     for (uint32_t i = 0; i < det_ctx->inspect.to_clear_idx; i++)
     {
@@ -1598,6 +1608,10 @@ int DetectEngineInspectBufferGeneric(
     det_ctx->buffer_offset = 0;
     det_ctx->inspection_recursion_counter = 0;
 
+    /* the buffer is the same for all signatures inspecting this list in
+     * this tx, so the content search results can be shared */
+    det_ctx->ci_cache.list_id = list_id;
+
     /* Inspect all the uricontents fetched on each
      * transaction at the app layer */
     int r = DetectEngineContentInspection(de_ctx, det_ctx,
@@ -1605,6 +1619,7 @@ int DetectEngineInspectBufferGeneric(
                                           NULL, f,
                                           (uint8_t *)data, data_len, offset, ci_flags,
                                           DETECT_ENGINE_CONTENT_INSPECTION_MODE_STATE);
+    det_ctx->ci_cache.list_id = -1;
     if (r == 1) {
         return DETECT_ENGINE_INSPECT_SIG_MATCH;
     } else {
@@ -1976,6 +1991,9 @@ static DetectEngineCtx *DetectEngineCtxInitReal(enum DetectEngineType type, cons
     if (DetectEngineCtxLoadConf(de_ctx) == -1) {
         goto error;
     }
+    if (DetectFastPatternProfileInit(de_ctx) < 0) {
+        goto error;
+    }
 
     SigGroupHeadHashInit(de_ctx);
     MpmStoreInit(de_ctx);
@@ -2088,6 +2106,8 @@ void DetectEngineCtxFree(DetectEngineCtx *de_ctx)
      */
     SigGroupHeadHashFree(de_ctx);
     MpmStoreFree(de_ctx);
+    if (de_ctx->mpm_prepare_queue != NULL)
+        SCFree(de_ctx->mpm_prepare_queue);
     DetectParseDupSigHashFree(de_ctx);
     SCSigSignatureOrderingModuleCleanup(de_ctx);
     ThresholdContextDestroy(de_ctx);
@@ -2110,6 +2130,7 @@ void DetectEngineCtxFree(DetectEngineCtx *de_ctx)
 
     DetectAddressMapFree(de_ctx);
     DetectMetadataHashFree(de_ctx);
+    DetectFastPatternProfileFree(de_ctx);
 
     /* if we have a config prefix, remove the config from the tree */
     if (strlen(de_ctx->config_prefix) > 0) {
@@ -2423,6 +2444,33 @@ static int DetectEngineCtxLoadConf(DetectEngineCtx *de_ctx)
             break;
     }
 
+    /* mpm contexts are prepared by a pool of short lived threads during
+     * SigGroupBuild(). Default to one per cpu. */
+    de_ctx->mpm_prepare_threads = (uint16_t)MIN(UtilCpuGetNumProcessorsOnline(), 16);
+    const char *prepare_threads = NULL;
+    if (ConfGet("detect.mpm-prepare-threads", &prepare_threads) == 1 &&
+            prepare_threads != NULL && strcmp(prepare_threads, "auto") != 0) {
+        int32_t threads = 0;
+        if (ByteExtractStringInt32(&threads, 10, 0, prepare_threads) <= 0 ||
+                threads < 1 || threads > 1024) {
+            SCLogWarning(SC_ERR_INVALID_YAML_CONF_ENTRY, "'%s' is not a valid "
+                    "value for detect.mpm-prepare-threads: using %u",
+                    prepare_threads, de_ctx->mpm_prepare_threads);
+        } else {
+            de_ctx->mpm_prepare_threads = (uint16_t)threads;
+        }
+    }
+    if (de_ctx->mpm_prepare_threads == 0)
+        de_ctx->mpm_prepare_threads = 1;
+    SCLogConfig("mpm contexts prepared by %u threads", de_ctx->mpm_prepare_threads);
+
+    /* on a rule reload, take over the unchanged per rule group mpm
+     * contexts of the engine that is replaced */
+    de_ctx->delta_reload = true;
+    int delta_reload = 0;
+    if (ConfGetBool("detect.delta-reload", &delta_reload) == 1)
+        de_ctx->delta_reload = delta_reload ? true : false;
+
     return 0;
 }
 
@@ -2659,6 +2707,13 @@ static TmEcode ThreadCtxDoInit (DetectEngineCtx *de_ctx, DetectEngineThreadCtx *
     PatternMatchThreadPrepare(&det_ctx->mtcu, de_ctx->mpm_matcher);
 
     PmqSetup(&det_ctx->pmq);
+    /* drop duplicate prefilter candidates on insertion so that they don't
+     * need to be sorted, see PrefilterSortCandidates() */
+    if (de_ctx->sig_array_len > 0) {
+        if (PmqSetupBitmap(&det_ctx->pmq, de_ctx->sig_array_len) < 0) {
+            return TM_ECODE_FAILED;
+        }
+    }
 
     det_ctx->spm_thread_ctx = SpmMakeThreadCtx(de_ctx->spm_global_thread_ctx);
     if (det_ctx->spm_thread_ctx == NULL) {
@@ -2727,6 +2782,16 @@ static TmEcode ThreadCtxDoInit (DetectEngineCtx *de_ctx, DetectEngineThreadCtx *
     }
     det_ctx->multi_inspect.to_clear_idx = 0;
 
+    det_ctx->ci_cache.entries = SCCalloc(DETECT_CI_CACHE_SIZE, sizeof(DetectInspectCacheEntry));
+    if (det_ctx->ci_cache.entries == NULL) {
+        return TM_ECODE_FAILED;
+    }
+    det_ctx->ci_cache.gen = 1;
+    det_ctx->ci_cache.list_id = -1;
+
+    if (DetectFastPatternTrainThreadInit(de_ctx, det_ctx) < 0) {
+        return TM_ECODE_FAILED;
+    }
 
     DetectEngineThreadCtxInitKeywords(de_ctx, det_ctx);
     DetectEngineThreadCtxInitGlobalKeywords(det_ctx);
@@ -2792,8 +2857,13 @@ TmEcode DetectEngineThreadCtxInit(ThreadVars *tv, void *initdata, void **data)
 
     /** alert counter setup */
     det_ctx->counter_alerts = StatsRegisterCounter("detect.alert", tv);
+    det_ctx->counter_ci_cache_hits = StatsRegisterCounter("detect.inspect_cache_hits", tv);
+    det_ctx->counter_ci_cache_misses = StatsRegisterCounter("detect.inspect_cache_misses", tv);
+    det_ctx->counter_dataset_lookups = StatsRegisterCounter("detect.dataset_lookups", tv);
+    det_ctx->counter_dataset_hits = StatsRegisterCounter("detect.dataset_hits", tv);
 #ifdef PROFILING
     det_ctx->counter_mpm_list = StatsRegisterAvgCounter("detect.mpm_list", tv);
+    det_ctx->counter_pf_candidates = StatsRegisterAvgCounter("detect.prefilter_candidates", tv);
     det_ctx->counter_nonmpm_list = StatsRegisterAvgCounter("detect.nonmpm_list", tv);
     det_ctx->counter_fnonmpm_list = StatsRegisterAvgCounter("detect.fnonmpm_list", tv);
     det_ctx->counter_match_list = StatsRegisterAvgCounter("detect.match_list", tv);
@@ -2850,12 +2920,18 @@ static DetectEngineThreadCtx *DetectEngineThreadCtxInitForReload(
 
     /** alert counter setup */
     det_ctx->counter_alerts = StatsRegisterCounter("detect.alert", tv);
+    det_ctx->counter_ci_cache_hits = StatsRegisterCounter("detect.inspect_cache_hits", tv);
+    det_ctx->counter_ci_cache_misses = StatsRegisterCounter("detect.inspect_cache_misses", tv);
+    det_ctx->counter_dataset_lookups = StatsRegisterCounter("detect.dataset_lookups", tv);
+    det_ctx->counter_dataset_hits = StatsRegisterCounter("detect.dataset_hits", tv);
 #ifdef PROFILING
     uint16_t counter_mpm_list = StatsRegisterAvgCounter("detect.mpm_list", tv);
+    uint16_t counter_pf_candidates = StatsRegisterAvgCounter("detect.prefilter_candidates", tv);
     uint16_t counter_nonmpm_list = StatsRegisterAvgCounter("detect.nonmpm_list", tv);
     uint16_t counter_fnonmpm_list = StatsRegisterAvgCounter("detect.fnonmpm_list", tv);
     uint16_t counter_match_list = StatsRegisterAvgCounter("detect.match_list", tv);
     det_ctx->counter_mpm_list = counter_mpm_list;
+    det_ctx->counter_pf_candidates = counter_pf_candidates;
     det_ctx->counter_nonmpm_list = counter_nonmpm_list;
     det_ctx->counter_fnonmpm_list = counter_fnonmpm_list;
     det_ctx->counter_match_list = counter_match_list;
@@ -2949,6 +3025,10 @@ static void DetectEngineThreadCtxFree(DetectEngineThreadCtx *det_ctx)
     if (det_ctx->multi_inspect.to_clear_queue) {
         SCFree(det_ctx->multi_inspect.to_clear_queue);
     }
+    if (det_ctx->ci_cache.entries) {
+        SCFree(det_ctx->ci_cache.entries);
+    }
+    DetectFastPatternTrainThreadFree(det_ctx);
 
     DetectEngineThreadCtxDeinitGlobalKeywords(det_ctx);
     if (det_ctx->de_ctx != NULL) {
@@ -4039,6 +4119,12 @@ int DetectEngineReload(const SCInstance *suri)
         DetectEngineDeReference(&old_de_ctx);
         return -1;
     }
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    if (new_de_ctx->delta_reload)
+        new_de_ctx->reload_base = old_de_ctx;
+
     if (SigLoadSignatures(new_de_ctx,
                           suri->sig_file, suri->sig_file_exclusive) != 0) {
         DetectEngineCtxFree(new_de_ctx);
@@ -4047,6 +4133,20 @@ int DetectEngineReload(const SCInstance *suri)
     }
     SCLogDebug("set up new_de_ctx %p", new_de_ctx);
 
+    MpmStoreReloadStats(new_de_ctx, old_de_ctx);
+    new_de_ctx->reload_base = NULL;
+    gettimeofday(&end, NULL);
+    new_de_ctx->reload_stats.time_ms =
+        ((uint64_t)(end.tv_sec - start.tv_sec) * 1000000 +
+         (end.tv_usec - start.tv_usec)) / 1000;
+
+    const DetectEngineReloadStats *rs = &new_de_ctx->reload_stats;
+    SCLogConfig("rule reload: engine built in %"PRIu64" ms, %u mpm contexts "
+            "taken over (%"PRIu64" bytes), %u built (%"PRIu64" bytes), "
+            "mpm memory change %"PRId64" bytes", rs->time_ms, rs->mpm_reused,
+            rs->mpm_memory_reused, rs->mpm_built, rs->mpm_memory_built,
+            rs->mpm_memory_delta);
+
     /* add to master */
     DetectEngineAddToMaster(new_de_ctx);
 
@@ -4216,6 +4316,8 @@ int DetectEngineGetEventInfo(const char *event_name, int *event_id,
 /*************************************Unittest*********************************/
 
 #ifdef UNITTESTS
+#include "detect-engine-alert.h"
+#include "util-unittest-helper.h"
 
 static int DetectEngineInitYamlConf(const char *conf)
 {
@@ -4452,6 +4554,115 @@ static int DetectEngineTest09(void)
     return result;
 }
 
+/** \test mpm contexts prepared by a thread pool */
+static int DetectEngineTest10(void)
+{
+    const char *conf =
+        "%YAML 1.1\n"
+        "---\n"
+        "detect:\n"
+        "  sgh-mpm-context: full\n"
+        "  mpm-prepare-threads: 4\n";
+
+    FAIL_IF(DetectEngineInitYamlConf(conf) == -1);
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    FAIL_IF_NULL(de_ctx);
+    FAIL_IF_NOT(de_ctx->mpm_prepare_threads == 4);
+    de_ctx->flags |= DE_QUIET;
+
+    char sig[128];
+    for (int i = 0; i < 16; i++) {
+        snprintf(sig, sizeof(sig), "alert tcp any any -> any %d "
+                "(content:\"pattern%02d\"; sid:%d;)", 1000 + i, i, i + 1);
+        FAIL_IF_NULL(DetectEngineAppendSig(de_ctx, sig));
+    }
+
+    uint8_t payload[] = "xxpattern05xx";
+    Packet *p1 = UTHBuildPacketSrcDstPorts(payload, sizeof(payload) - 1,
+            IPPROTO_TCP, 41424, 1005);
+    Packet *p2 = UTHBuildPacketSrcDstPorts(payload, sizeof(payload) - 1,
+            IPPROTO_TCP, 41424, 1006);
+    FAIL_IF_NULL(p1);
+    FAIL_IF_NULL(p2);
+    Packet *p[2] = { p1, p2 };
+
+    FAIL_IF_NOT(UTHMatchPackets(de_ctx, p, 2));
+    FAIL_IF(de_ctx->mpm_prepare_queue_cnt != 0);
+    FAIL_IF_NOT(PacketAlertCheck(p1, 6));
+    FAIL_IF(PacketAlertCheck(p2, 7));
+
+    UTHFreePackets(p, 2);
+    DetectEngineCtxFree(de_ctx);
+    DetectEngineDeInitYamlConf();
+    PASS;
+}
+
+/** \test mpm contexts taken over by the engine built by a rule reload */
+static int DetectEngineTest11(void)
+{
+    const char *conf =
+        "%YAML 1.1\n"
+        "---\n"
+        "detect:\n"
+        "  sgh-mpm-context: full\n";
+
+    FAIL_IF(DetectEngineInitYamlConf(conf) == -1);
+
+    DetectEngineCtx *old_de_ctx = DetectEngineCtxInit();
+    FAIL_IF_NULL(old_de_ctx);
+    FAIL_IF_NOT(old_de_ctx->delta_reload);
+    old_de_ctx->flags |= DE_QUIET;
+    FAIL_IF_NULL(DetectEngineAppendSig(old_de_ctx, "alert tcp any any -> any any "
+                "(content:\"abcdef\"; sid:1;)"));
+    FAIL_IF_NULL(DetectEngineAppendSig(old_de_ctx, "alert tcp any any -> any any "
+                "(content:\"ghijkl\"; sid:2;)"));
+    FAIL_IF(SigGroupBuild(old_de_ctx) != 0);
+    FAIL_IF(old_de_ctx->reload_stats.mpm_reused != 0);
+    FAIL_IF(old_de_ctx->reload_stats.mpm_built == 0);
+
+    /* the udp rule is added first, so the tcp rules get other rule id's */
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    FAIL_IF_NULL(de_ctx);
+    de_ctx->flags |= DE_QUIET;
+    de_ctx->reload_base = old_de_ctx;
+    FAIL_IF_NULL(DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+                "(content:\"abcdef\"; sid:1;)"));
+    FAIL_IF_NULL(DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+                "(content:\"ghijkl\"; sid:2;)"));
+    FAIL_IF_NULL(DetectEngineAppendSig(de_ctx, "alert udp any any -> any any "
+                "(content:\"mnopqr\"; sid:3;)"));
+    FAIL_IF(SigGroupBuild(de_ctx) != 0);
+    MpmStoreReloadStats(de_ctx, old_de_ctx);
+    de_ctx->reload_base = NULL;
+
+    FAIL_IF(de_ctx->reload_stats.mpm_reused != old_de_ctx->reload_stats.mpm_built);
+    FAIL_IF(de_ctx->reload_stats.mpm_built == 0);
+    FAIL_IF(de_ctx->reload_stats.mpm_memory_reused == 0);
+
+    /* the shared contexts outlive the old engine */
+    DetectEngineCtxFree(old_de_ctx);
+
+    uint8_t payload[] = "xxghijklxx";
+    Packet *p1 = UTHBuildPacket(payload, sizeof(payload) - 1, IPPROTO_TCP);
+    FAIL_IF_NULL(p1);
+
+    ThreadVars th_v;
+    memset(&th_v, 0, sizeof(th_v));
+    DetectEngineThreadCtx *det_ctx = NULL;
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+    FAIL_IF_NULL(det_ctx);
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p1);
+    FAIL_IF_NOT(PacketAlertCheck(p1, 2));
+    FAIL_IF(PacketAlertCheck(p1, 1));
+    FAIL_IF(PacketAlertCheck(p1, 3));
+
+    DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    UTHFreePackets(&p1, 1);
+    DetectEngineCtxFree(de_ctx);
+    DetectEngineDeInitYamlConf();
+    PASS;
+}
+
 #endif
 
 void DetectEngineRegisterTests()
@@ -4463,6 +4674,8 @@ void DetectEngineRegisterTests()
     UtRegisterTest("DetectEngineTest04", DetectEngineTest04);
     UtRegisterTest("DetectEngineTest08", DetectEngineTest08);
     UtRegisterTest("DetectEngineTest09", DetectEngineTest09);
+    UtRegisterTest("DetectEngineTest10", DetectEngineTest10);
+    UtRegisterTest("DetectEngineTest11", DetectEngineTest11);
 #endif
     return;
 }
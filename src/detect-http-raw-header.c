@@ -57,6 +57,8 @@ static int DetectHttpRawHeaderSetupSticky(DetectEngineCtx *de_ctx, Signature *s,
 #ifdef UNITTESTS
 static void DetectHttpRawHeaderRegisterTests(void);
 #endif
+static void DetectHttpRawHeaderSetupCallback(const DetectEngineCtx *de_ctx,
+        Signature *s);
 static _Bool DetectHttpRawHeaderValidateCallback(const Signature *s, const char **sigerror);
 static int g_http_raw_header_buffer_id = 0;
 static InspectionBuffer *GetData(DetectEngineThreadCtx *det_ctx,
@@ -109,6 +111,9 @@ void DetectHttpRawHeaderRegister(void)
     DetectBufferTypeSetDescriptionByName("http_raw_header",
             "raw http headers");
 
+    DetectBufferTypeRegisterSetupCallback("http_raw_header",
+            DetectHttpRawHeaderSetupCallback);
+
     DetectBufferTypeRegisterValidateCallback("http_raw_header",
             DetectHttpRawHeaderValidateCallback);
 
@@ -154,6 +159,13 @@ static int DetectHttpRawHeaderSetupSticky(DetectEngineCtx *de_ctx, Signature *s,
     return 0;
 }
 
+static void DetectHttpRawHeaderSetupCallback(const DetectEngineCtx *de_ctx,
+        Signature *s)
+{
+    SCLogDebug("callback invoked by %u", s->id);
+    AppLayerHtpNeedRawHeaders();
+}
+
 static _Bool DetectHttpRawHeaderValidateCallback(const Signature *s, const char **sigerror)
 {
     if ((s->flags & (SIG_FLAG_TOCLIENT|SIG_FLAG_TOSERVER)) == (SIG_FLAG_TOCLIENT|SIG_FLAG_TOSERVER)) {
@@ -189,6 +189,7 @@ static void DetectHttpUriSetupCallback(const DetectEngineCtx *de_ctx,
 {
     SCLogDebug("callback invoked by %u", s->id);
     DetectUrilenApplyToContent(s, g_http_uri_buffer_id);
+    AppLayerHtpNeedNormalizedUri();
 }
 
 /**
@@ -851,6 +851,10 @@ static int DetectLuaSetupPrime(DetectEngineCtx *de_ctx, DetectLuaData *ld)
 
             /* http types */
             ld->alproto = ALPROTO_HTTP;
+            /* the script can get to all http data through the lua
+             * http functions */
+            AppLayerHtpNeedNormalizedUri();
+            AppLayerHtpNeedRawHeaders();
 
             if (strcmp(k, "http.uri") == 0)
                 ld->flags |= DATATYPE_HTTP_URI;
@@ -695,6 +695,12 @@ static inline void DetectRunPrefilterPkt(
     if (tv) {
         StatsAddUI64(tv, det_ctx->counter_mpm_list,
                              (uint64_t)det_ctx->pmq.rule_id_array_cnt);
+        /* candidates as added by the prefilter engines, before the
+         * duplicates are removed */
+        StatsAddUI64(tv, det_ctx->counter_pf_candidates,
+                             (uint64_t)(det_ctx->pmq.rule_id_bitmap ?
+                                 det_ctx->pmq.rule_id_bitmap_adds :
+                                 det_ctx->pmq.rule_id_array_cnt));
         StatsAddUI64(tv, det_ctx->counter_nonmpm_list,
                              (uint64_t)det_ctx->non_pf_store_cnt);
         /* non mpm sigs after mask prefilter */
@@ -942,6 +948,13 @@ static inline void DetectRunPostRules(
         StatsAddUI64(tv, det_ctx->counter_alerts, (uint64_t)p->alerts.cnt);
     }
     PACKET_PROFILING_DETECT_END(p, PROF_DETECT_ALERT);
+
+    if (tv && (det_ctx->ci_cache.hits || det_ctx->ci_cache.misses)) {
+        StatsAddUI64(tv, det_ctx->counter_ci_cache_hits, det_ctx->ci_cache.hits);
+        StatsAddUI64(tv, det_ctx->counter_ci_cache_misses, det_ctx->ci_cache.misses);
+        det_ctx->ci_cache.hits = 0;
+        det_ctx->ci_cache.misses = 0;
+    }
 }
 
 static void DetectRunCleanup(DetectEngineThreadCtx *det_ctx,
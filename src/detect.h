@@ -42,6 +42,7 @@
 #include "util-debug.h"
 #include "util-error.h"
 #include "util-radix-tree.h"
+#include "util-poptrie.h"
 #include "util-file.h"
 #include "reputation.h"
 
@@ -679,6 +680,11 @@ typedef struct DetectEngineIPOnlyCtx_ {
     SCRadixTree *tree_ipv4src, *tree_ipv4dst;
     SCRadixTree *tree_ipv6src, *tree_ipv6dst;
 
+    /* read only versions of the trees for the packet path, compiled once
+     * the trees are complete */
+    SCPoptrie *lpm_ipv4src, *lpm_ipv4dst;
+    SCPoptrie *lpm_ipv6src, *lpm_ipv6dst;
+
     /* Used to build the radix trees */
     IPOnlyCIDRItem *ip_src, *ip_dst;
 
@@ -737,6 +743,16 @@ typedef struct SigFileLoaderStat_ {
     int bad_sigs_total;
 } SigFileLoaderStat;
 
+/** \brief Rule reload statistics */
+typedef struct DetectEngineReloadStats_ {
+    uint64_t time_ms;           /**< time to build the engine */
+    uint32_t mpm_reused;        /**< mpm contexts taken over from the old engine */
+    uint32_t mpm_built;         /**< mpm contexts built for this engine */
+    uint64_t mpm_memory_reused;
+    uint64_t mpm_memory_built;
+    int64_t mpm_memory_delta;   /**< mpm memory change after the old engine is freed */
+} DetectEngineReloadStats;
+
 typedef struct DetectEngineThreadKeywordCtxItem_ {
     void *(*InitFunc)(void *);
     void (*FreeFunc)(void *);
@@ -803,6 +819,9 @@ typedef struct DetectEngineCtx_ {
     HashListTable *sgh_hash_table;
 
     HashListTable *mpm_hash_table;
+    /** MpmStores with a unique mpm_ctx, by their signature hashes. Kept
+     *  so the next engine can take over the mpm_ctx on a rule reload. */
+    HashListTable *mpm_share_hash_table;
 
     /* hash table used to cull out duplicate sigs */
     HashListTable *dup_sig_hash_table;
@@ -832,6 +851,19 @@ typedef struct DetectEngineCtx_ {
 
     MpmCtxFactoryContainer *mpm_ctx_factory_container;
 
+    /* mpm contexts waiting to be prepared, see DetectMpmPrepareQueued() */
+    MpmCtx **mpm_prepare_queue;
+    uint32_t mpm_prepare_queue_cnt;
+    uint32_t mpm_prepare_queue_size;
+    /* number of threads preparing the queued mpm contexts */
+    uint16_t mpm_prepare_threads;
+
+    /* take over unchanged mpm contexts from the previous engine on reload */
+    bool delta_reload;
+    /* engine being replaced, only set while this engine is built by a
+     * rule reload */
+    struct DetectEngineCtx_ *reload_base;
+
     /* maximum recursion depth for content inspection */
     int inspection_recursion_limit;
 
@@ -936,8 +968,19 @@ typedef struct DetectEngineCtx_ {
     uint32_t prefilter_id;
     HashListTable *prefilter_hash_table;
 
+    /** ids for the inspection cache, only used while building */
+    HashListTable *ci_cache_hash_table;
+    uint32_t ci_cache_id_cnt;
+
+    /** fast pattern selection profile, see detect-engine-fp-profile.c */
+    struct DetectFastPatternProfile_ *fp_profile;
+    /** fast pattern training state, only set with --fp-train */
+    struct DetectFastPatternTrain_ *fp_train;
+
     /** time of last ruleset reload */
     struct timeval last_reload;
+    /** stats of the reload that built this engine */
+    DetectEngineReloadStats reload_stats;
 
     /** signatures stats */
     SigFileLoaderStat sig_stat;
@@ -998,6 +1041,43 @@ typedef struct RuleMatchCandidateTx {
     const Signature *s;     /**< ptr to sig */
 } RuleMatchCandidateTx;
 
+/** max number of patterns in a secondary content matcher */
+#define DETECT_CI_MULTI_MAX_PATTERNS    16
+/** number of match offsets recorded per pattern */
+#define DETECT_CI_MULTI_MAX_OFFSETS     32
+
+/** match offsets of the contents of the list being inspected, recorded
+ *  by its secondary content matcher */
+typedef struct DetectContentMultiSpmResults_ {
+    /** matcher the offsets are for, NULL if none */
+    const struct DetectContentMultiSpm_ *ctx;
+    const uint8_t *buffer;
+    uint32_t buffer_len;
+    /** content searches since the start of the list */
+    uint16_t searches;
+    /** patterns that have more matches than the recorded offsets */
+    uint16_t overflow;
+    uint8_t cnt[DETECT_CI_MULTI_MAX_PATTERNS];
+    uint32_t offsets[DETECT_CI_MULTI_MAX_PATTERNS][DETECT_CI_MULTI_MAX_OFFSETS];
+} DetectContentMultiSpmResults;
+
+/** number of entries in the inspection cache, power of 2 */
+#define DETECT_CI_CACHE_SIZE            1024
+
+/** search result of a content in a tx buffer, shared by all signatures
+ *  with the same content on that buffer */
+typedef struct DetectInspectCacheEntry_ {
+    uint32_t gen;           /**< entry is valid if this is the current gen */
+    uint32_t id;            /**< DetectContentData::ci_cache_id */
+    int list_id;
+    uint32_t buffer_len;
+    const uint8_t *buffer;
+    /** offset of the leftmost match in the buffer. If UINT32_MAX there is
+     *  no match that ends before 'scanned'. */
+    uint32_t found;
+    uint32_t scanned;
+} DetectInspectCacheEntry;
+
 /**
   * Detection engine thread data.
   */
@@ -1039,8 +1119,13 @@ typedef struct DetectEngineThreadCtx_ {
 
     /** id for alert counter */
     uint16_t counter_alerts;
+    uint16_t counter_ci_cache_hits;
+    uint16_t counter_ci_cache_misses;
+    uint16_t counter_dataset_lookups;
+    uint16_t counter_dataset_hits;
 #ifdef PROFILING
     uint16_t counter_mpm_list;
+    uint16_t counter_pf_candidates;
     uint16_t counter_nonmpm_list;
     uint16_t counter_fnonmpm_list;
     uint16_t counter_match_list;
@@ -1079,6 +1164,22 @@ typedef struct DetectEngineThreadCtx_ {
     /* holds the current recursion depth on content inspection */
     int inspection_recursion_counter;
 
+    /* content offsets from the secondary content matcher */
+    DetectContentMultiSpmResults ci_multi;
+
+    /* content search results for the buffers of the current tx. The
+     * generation is bumped when the inspection buffers are cleaned. */
+    struct {
+        DetectInspectCacheEntry *entries;
+        uint32_t gen;
+        int list_id;        /**< buffer being inspected, -1 if not cached */
+        uint32_t hits;
+        uint32_t misses;
+    } ci_cache;
+
+    /* fast pattern training, NULL unless running with --fp-train */
+    struct DetectFastPatternTrainThread_ *fp_train;
+
     /** array of signature pointers we're going to inspect in the detection
      *  loop. */
     Signature **match_array;
@@ -1246,6 +1347,20 @@ enum MpmBuiltinBuffers {
     MPMB_MAX,
 };
 
+/** signature that added a pattern to the mpm_ctx of a MpmStore */
+typedef struct MpmStoreSig_ {
+    uint64_t hash;      /**< hash of the rule and its pattern */
+    SigIntId rule_id;   /**< rule id the mpm_ctx adds for the signature */
+} MpmStoreSig;
+
+/** maps the rule id's a mpm_ctx taken over from a previous detect engine
+ *  adds to the rule id's of the current engine */
+typedef struct MpmRuleIdMap_ {
+    SigIntId base;      /**< lowest rule id of the mpm_ctx */
+    uint32_t len;
+    SigIntId map[];
+} MpmRuleIdMap;
+
 typedef struct MpmStore_ {
     uint8_t *sid_array;
     uint32_t sid_array_size;
@@ -1257,6 +1372,18 @@ typedef struct MpmStore_ {
 
     MpmCtx *mpm_ctx;
 
+    /** hashes of the signatures that added a pattern to mpm_ctx, sorted.
+     *  Used to find an identical store on the next rule reload. */
+    MpmStoreSig *sigs;
+    uint32_t sigs_cnt;
+    uint32_t sigs_hash;
+
+    /** reference count of mpm_ctx if it is shared by the stores of more
+     *  than one detect engine, NULL if it's not shared */
+    uint32_t *ctx_ref_cnt;
+    /** set if mpm_ctx was taken over from the previous detect engine */
+    MpmRuleIdMap *rule_id_map;
+
 } MpmStore;
 
 typedef struct PrefilterEngineList_ {
@@ -1285,6 +1412,10 @@ typedef struct PrefilterEngineList_ {
     const char *name;
     /* global id for this prefilter */
     uint32_t gid;
+
+    /** rule id map of the mpm_ctx used by this engine, if it was taken
+     *  over from the previous detect engine */
+    const MpmRuleIdMap *rule_id_map;
 } PrefilterEngineList;
 
 typedef struct PrefilterEngine_ {
@@ -1310,6 +1441,9 @@ typedef struct PrefilterEngine_ {
     /* global id for this prefilter */
     uint32_t gid;
     int is_last;
+
+    /** if set, the rule id's the engine adds are translated with it */
+    const MpmRuleIdMap *rule_id_map;
 } PrefilterEngine;
 
 typedef struct SigGroupHeadInitData_ {
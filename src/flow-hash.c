@@ -36,6 +36,8 @@
 #include "flow-private.h"
 #include "flow-manager.h"
 #include "flow-storage.h"
+#include "flow-queue.h"
+#include "flow-wheel.h"
 #include "app-layer-parser.h"
 
 #include "util-time.h"
@@ -48,6 +50,8 @@
 #include "output-flow.h"
 #include "log-specific-pcap.h"
 
+#include "util-unittest.h"
+
 #define FLOW_DEFAULT_FLOW_PRUNE 5
 
 SC_ATOMIC_EXTERN(unsigned int, flow_prune_idx);
@@ -55,6 +59,158 @@ SC_ATOMIC_EXTERN(unsigned int, flow_flags);
 
 static Flow *FlowGetUsedFlow(ThreadVars *tv, DecodeThreadVars *dtv);
 
+/** flow hash partitions, registered by the flow workers at thread init */
+static SCMutex flow_partitions_lock = SCMUTEX_INITIALIZER;
+static FlowPartition *flow_partitions[FLOW_PARTITION_MAX];
+static uint32_t flow_partitions_cnt = 0;
+/** number of partitions in use, 0 if the hash is shared */
+static uint32_t flow_partitions_active = 0;
+/** set once the ranges are assigned, no more partitions can be added */
+static int flow_partitions_setup = 0;
+
+/**
+ *  \brief register a flow hash partition for the calling worker
+ *
+ *  The hash range of the partition is only assigned by
+ *  FlowPartitionsSetup() once all threads are initialized.
+ *
+ *  \retval part partition or NULL if the flow hash is shared
+ */
+FlowPartition *FlowPartitionRegister(void)
+{
+    FlowPartition *part = NULL;
+
+    if (!flow_config.partitioned)
+        return NULL;
+
+    SCMutexLock(&flow_partitions_lock);
+    if (flow_partitions_setup || flow_partitions_cnt == FLOW_PARTITION_MAX)
+        goto end;
+
+    part = SCCalloc(1, sizeof(*part));
+    if (unlikely(part == NULL))
+        goto end;
+    SC_ATOMIC_INIT(part->last_sweep);
+    part->id = flow_partitions_cnt;
+    flow_partitions[flow_partitions_cnt++] = part;
+end:
+    SCMutexUnlock(&flow_partitions_lock);
+    return part;
+}
+
+/**
+ *  \brief return the cached spare flows of a partition
+ *
+ *  The partition itself stays around until FlowPartitionsFree() as the
+ *  flow manager may still access it. Its rows are timed out by the flow
+ *  manager from now on as no more sweeps will complete.
+ */
+void FlowPartitionDeregister(FlowPartition *part)
+{
+    if (part == NULL)
+        return;
+
+    while (part->spare_cnt > 0) {
+        FlowMoveToSpare(part->spare[--part->spare_cnt]);
+    }
+}
+
+/**
+ *  \brief assign each registered partition its range of the flow hash
+ *
+ *  Called from the main thread after all threads are initialized but
+ *  before they start processing packets.
+ */
+void FlowPartitionsSetup(void)
+{
+    SCMutexLock(&flow_partitions_lock);
+    flow_partitions_setup = 1;
+
+    const uint32_t cnt = flow_partitions_cnt;
+    if (cnt == 0) {
+        SCMutexUnlock(&flow_partitions_lock);
+        return;
+    }
+    if (flow_config.hash_size < cnt) {
+        SCLogWarning(SC_ERR_INVALID_VALUE, "flow.hash-size %u is smaller "
+                "than the number of flow workers %u, not partitioning "
+                "the flow hash", flow_config.hash_size, cnt);
+        SCMutexUnlock(&flow_partitions_lock);
+        return;
+    }
+
+    const uint32_t rows = flow_config.hash_size / cnt;
+    for (uint32_t u = 0; u < cnt; u++) {
+        FlowPartition *part = flow_partitions[u];
+        part->min = u * rows;
+        part->max = (u == cnt - 1) ? flow_config.hash_size : part->min + rows;
+        /* no sweep in progress */
+        part->sweep_row = part->max;
+    }
+    flow_partitions_active = cnt;
+    SCMutexUnlock(&flow_partitions_lock);
+
+    SCLogConfig("flow hash partitioned over %u workers, %u rows each",
+            cnt, rows);
+}
+
+/** \brief number of partitions in use, 0 if the flow hash is shared */
+uint32_t FlowPartitionsActive(void)
+{
+    return flow_partitions_active;
+}
+
+FlowPartition *FlowPartitionGet(uint32_t id)
+{
+    return id < flow_partitions_active ? flow_partitions[id] : NULL;
+}
+
+/** \brief free all partitions. Only call when no threads are running. */
+void FlowPartitionsFree(void)
+{
+    SCMutexLock(&flow_partitions_lock);
+    for (uint32_t u = 0; u < flow_partitions_cnt; u++) {
+        FlowPartitionDeregister(flow_partitions[u]);
+        SC_ATOMIC_DESTROY(flow_partitions[u]->last_sweep);
+        SCFree(flow_partitions[u]);
+        flow_partitions[u] = NULL;
+    }
+    flow_partitions_cnt = 0;
+    flow_partitions_active = 0;
+    flow_partitions_setup = 0;
+    SCMutexUnlock(&flow_partitions_lock);
+}
+
+/** \internal
+ *  \brief get the hash row for a flow hash
+ *
+ *  Threads owning a partition only use the rows of their partition.
+ */
+static inline FlowBucket *FlowHashGetBucket(const DecodeThreadVars *dtv,
+        const uint32_t hash)
+{
+    if (dtv != NULL && dtv->flow_partition != NULL) {
+        const FlowPartition *part = dtv->flow_partition;
+        if (likely(part->max > part->min))
+            return &flow_hash[part->min + hash % (part->max - part->min)];
+    }
+    return &flow_hash[hash % flow_config.hash_size];
+}
+
+/** \internal
+ *  \brief get a spare flow from the partition's local cache, refilling it
+ *          in bulk from the global spare queue if needed */
+static inline Flow *FlowPartitionGetSpare(FlowPartition *part)
+{
+    if (part->spare_cnt == 0) {
+        part->spare_cnt = FlowDequeueBulk(&flow_spare_q, part->spare,
+                FLOW_PARTITION_SPARE_BATCH);
+        if (part->spare_cnt == 0)
+            return NULL;
+    }
+    return part->spare[--part->spare_cnt];
+}
+
 /** \brief compare two raw ipv6 addrs
  *
  *  \note we don't care about the real ipv6 ip's, this is just
@@ -498,7 +654,10 @@ static Flow *FlowGetNew(ThreadVars *tv, DecodeThreadVars *dtv, const Packet *p)
     }
 
     /* get a flow from the spare queue */
-    f = FlowDequeue(&flow_spare_q);
+    if (dtv != NULL && dtv->flow_partition != NULL)
+        f = FlowPartitionGetSpare(dtv->flow_partition);
+    else
+        f = FlowDequeue(&flow_spare_q);
     if (f == NULL) {
         /* If we reached the max memcap, we get a used flow */
         if (!(FLOW_CHECK_MEMCAP(sizeof(Flow) + FlowStorageSize()))) {
@@ -578,6 +737,7 @@ static Flow *TcpReuseReplace(ThreadVars *tv, DecodeThreadVars *dtv,
     FlowInit(f, p);
     f->flow_hash = hash;
     f->fb = fb;
+    FlowUpdateState(f, FLOW_STATE_NEW);
 
     f->thread_id = thread_id;
     return f;
@@ -606,7 +766,7 @@ Flow *FlowGetFlowFromHash(ThreadVars *tv, DecodeThreadVars *dtv, const Packet *p
 
     /* get our hash bucket and lock it */
     const uint32_t hash = p->flow_hash;
-    FlowBucket *fb = &flow_hash[hash % flow_config.hash_size];
+    FlowBucket *fb = FlowHashGetBucket(dtv, hash);
     FBLOCK_LOCK(fb);
 
     SCLogDebug("fb %p fb->head %p", fb, fb->head);
@@ -800,27 +960,22 @@ Flow *FlowGetFromFlowKey(FlowKey *key, struct timespec *ttime, const uint32_t ha
         f->hprev->hnext = f;
         fb->tail = f;
     }
+    /* make sure the flow manager looks at the new flow */
+    SC_ATOMIC_SET(fb->next_ts, 0);
+    FlowWheelMarkRow((uint32_t)(fb - flow_hash));
     FLOWLOCK_WRLOCK(f);
     FBLOCK_UNLOCK(fb);
 
     return f;
 }
 
-/** \brief Look for existing Flow using a FlowKey
- *
- * Hash retrieval function for flows. Looks up the hash bucket containing the
- * flow pointer. Then compares the packet with the found flow to see if it is
- * the flow we need. If it isn't, walk the list until the right flow is found.
- *
+/** \internal
+ *  \brief Look for existing Flow using a FlowKey in a single hash row
  *
- *  \param key Pointer to FlowKey build using flow to look for
- *  \param hash Value of the flow hash
  *  \retval f *LOCKED* flow or NULL
  */
-Flow *FlowGetExistingFlowFromHash(FlowKey *key, const uint32_t hash)
+static Flow *FlowGetExistingFlowFromBucket(FlowBucket *fb, FlowKey *key)
 {
-    /* get our hash bucket and lock it */
-    FlowBucket *fb = &flow_hash[hash % flow_config.hash_size];
     FBLOCK_LOCK(fb);
 
     SCLogDebug("fb %p fb->head %p", fb, fb->head);
@@ -861,6 +1016,33 @@ Flow *FlowGetExistingFlowFromHash(FlowKey *key, const uint32_t hash)
     return f;
 }
 
+/** \brief Look for existing Flow using a FlowKey
+ *
+ * Hash retrieval function for flows. Looks up the hash bucket containing the
+ * flow pointer. Then compares the packet with the found flow to see if it is
+ * the flow we need. If it isn't, walk the list until the right flow is found.
+ *
+ * If the flow hash is partitioned the flow can be in the row of any of
+ * the partitions, so all of them are checked.
+ *
+ *  \param key Pointer to FlowKey build using flow to look for
+ *  \param hash Value of the flow hash
+ *  \retval f *LOCKED* flow or NULL
+ */
+Flow *FlowGetExistingFlowFromHash(FlowKey *key, const uint32_t hash)
+{
+    const uint32_t partitions = FlowPartitionsActive();
+    for (uint32_t u = 0; u < partitions; u++) {
+        const FlowPartition *part = flow_partitions[u];
+        FlowBucket *fb = &flow_hash[part->min + hash % (part->max - part->min)];
+        Flow *f = FlowGetExistingFlowFromBucket(fb, key);
+        if (f != NULL)
+            return f;
+    }
+
+    return FlowGetExistingFlowFromBucket(&flow_hash[hash % flow_config.hash_size], key);
+}
+
 /** \internal
  *  \brief Get a flow from the hash directly.
  *
@@ -958,3 +1140,63 @@ static Flow *FlowGetUsedFlow(ThreadVars *tv, DecodeThreadVars *dtv)
 
     return NULL;
 }
+
+#ifdef UNITTESTS
+/** \test partition ranges and row selection */
+static int FlowHashPartitionTest01(void)
+{
+    FlowInitConfig(FLOW_QUIET);
+    flow_config.partitioned = 1;
+
+    FlowPartition *parts[3];
+    for (int i = 0; i < 3; i++) {
+        parts[i] = FlowPartitionRegister();
+        FAIL_IF_NULL(parts[i]);
+        FAIL_IF_NOT(parts[i]->id == (uint32_t)i);
+    }
+    FlowPartitionsSetup();
+    FAIL_IF_NOT(FlowPartitionsActive() == 3);
+    /* no more partitions once set up */
+    FAIL_IF_NOT_NULL(FlowPartitionRegister());
+
+    /* ranges are contiguous and cover the whole hash */
+    FAIL_IF_NOT(parts[0]->min == 0);
+    FAIL_IF_NOT(parts[0]->max == parts[1]->min);
+    FAIL_IF_NOT(parts[1]->max == parts[2]->min);
+    FAIL_IF_NOT(parts[2]->max == flow_config.hash_size);
+
+    DecodeThreadVars dtv;
+    memset(&dtv, 0, sizeof(dtv));
+    dtv.flow_partition = parts[1];
+    for (uint32_t hash = 0; hash < 100000; hash += 7) {
+        FlowBucket *fb = FlowHashGetBucket(&dtv, hash);
+        FAIL_IF(fb < &flow_hash[parts[1]->min]);
+        FAIL_IF(fb >= &flow_hash[parts[1]->max]);
+    }
+    dtv.flow_partition = NULL;
+    FAIL_IF_NOT(FlowHashGetBucket(&dtv, 12345) ==
+            &flow_hash[12345 % flow_config.hash_size]);
+
+    /* spare flows are taken from the global queue in bulk */
+    const uint32_t spare = flow_spare_q.len;
+    Flow *f = FlowPartitionGetSpare(parts[1]);
+    FAIL_IF_NULL(f);
+    FAIL_IF_NOT(flow_spare_q.len == spare - FLOW_PARTITION_SPARE_BATCH);
+    FAIL_IF_NOT(parts[1]->spare_cnt == FLOW_PARTITION_SPARE_BATCH - 1);
+    FlowMoveToSpare(f);
+    FlowPartitionDeregister(parts[1]);
+    FAIL_IF_NOT(parts[1]->spare_cnt == 0);
+    FAIL_IF_NOT(flow_spare_q.len == spare);
+
+    FlowShutdown();
+    FAIL_IF_NOT(FlowPartitionsActive() == 0);
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void FlowHashRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("FlowHashPartitionTest01", FlowHashPartitionTest01);
+#endif
+}
@@ -72,8 +72,44 @@ typedef struct FlowBucket_ {
     #error Enable FBLOCK_SPIN or FBLOCK_MUTEX
 #endif
 
+/** max number of flow hash partitions (one per flow worker) */
+#define FLOW_PARTITION_MAX          1024
+/** spare flows a partition takes from the global spare queue at once */
+#define FLOW_PARTITION_SPARE_BATCH  32
+/** hash rows checked for timeouts by a worker per packet */
+#define FLOW_PARTITION_SWEEP_ROWS   32
+/** seconds without a completed sweep after which the flow manager
+ *  times out the partition itself */
+#define FLOW_PARTITION_STALE_SEC    5
+
+/** Range of the flow hash owned by a single flow worker. The worker
+ *  only inserts its flows into these rows and times them out itself,
+ *  so in the normal case the bucket locks are never contended. */
+typedef struct FlowPartition_ {
+    uint32_t id;
+    uint32_t min;           /**< first row owned by the worker */
+    uint32_t max;           /**< one past the last row */
+
+    uint32_t sweep_row;     /**< next row to check for timeouts */
+    int32_t sweep_ts;       /**< packet time the current sweep started */
+    /** packet time of the last completed sweep. Read by the flow
+     *  manager to detect idle workers. */
+    SC_ATOMIC_DECLARE(int32_t, last_sweep);
+
+    /** flows taken from flow_spare_q in bulk, only used by the worker */
+    uint32_t spare_cnt;
+    Flow *spare[FLOW_PARTITION_SPARE_BATCH];
+} FlowPartition;
+
 /* prototypes */
 
+FlowPartition *FlowPartitionRegister(void);
+void FlowPartitionDeregister(FlowPartition *);
+void FlowPartitionsSetup(void);
+uint32_t FlowPartitionsActive(void);
+FlowPartition *FlowPartitionGet(uint32_t);
+void FlowPartitionsFree(void);
+
 Flow *FlowGetFlowFromHash(ThreadVars *tv, DecodeThreadVars *dtv, const Packet *, Flow **);
 
 Flow *FlowGetFromFlowKey(FlowKey *key, struct timespec *ttime, const uint32_t hash);
@@ -81,6 +117,7 @@ Flow *FlowGetExistingFlowFromHash(FlowKey * key, uint32_t hash);
 uint32_t FlowKeyGetHash(FlowKey *flow_key);
 
 void FlowDisableTcpReuseHandling(void);
+void FlowHashRegisterTests(void);
 
 #endif /* __FLOW_HASH_H__ */
 
@@ -42,6 +42,8 @@
 #include "flow-timeout.h"
 #include "flow-manager.h"
 #include "flow-storage.h"
+#include "flow-wheel.h"
+#include "tmqh-packetpool.h"
 
 #include "stream-tcp-private.h"
 #include "stream-tcp-reassemble.h"
@@ -118,12 +120,15 @@ typedef struct FlowTimeoutCounters_ {
     uint32_t flows_timeout;
     uint32_t flows_timeout_inuse;
     uint32_t flows_removed;
+    uint32_t flows_late;
+    uint32_t flows_late_max;
 
     uint32_t rows_checked;
     uint32_t rows_skipped;
     uint32_t rows_empty;
     uint32_t rows_busy;
     uint32_t rows_maxlen;
+    uint32_t rows_dirty;
 
     uint32_t bypassed_count;
     uint64_t bypassed_pkts;
@@ -310,12 +315,16 @@ static inline int FlowBypassedTimeout(Flow *f, struct timeval *ts,
  *
  *  \param f flow
  *  \param ts timestamp
+ *  \param wait_pool wait for the thread's packet pool for the pseudo
+ *                   packets. If false and the pool is empty, the forced
+ *                   reassembly is left for a later pass.
  *
  *  \retval 0 not timed out just yet
  *  \retval 1 fully timed out, lets kill it
  */
 static inline int FlowManagerFlowTimedOut(Flow *f, struct timeval *ts,
-                                   FlowTimeoutCounters *counters)
+                                   FlowTimeoutCounters *counters,
+                                   const bool wait_pool)
 {
     /* never prune a flow that is used by a packet we
      * are currently processing in one of the threads */
@@ -333,7 +342,10 @@ static inline int FlowManagerFlowTimedOut(Flow *f, struct timeval *ts,
             SC_ATOMIC_GET(f->flow_state) != FLOW_STATE_CAPTURE_BYPASSED &&
             SC_ATOMIC_GET(f->flow_state) != FLOW_STATE_LOCAL_BYPASSED &&
             FlowForceReassemblyNeedReassembly(f, &server, &client) == 1) {
-        FlowForceReassemblyForFlow(f, server, client);
+        if (wait_pool)
+            FlowForceReassemblyForFlow(f, server, client);
+        else
+            (void)FlowForceReassemblyForFlowNoWait(f, server, client);
         return 0;
     }
 #ifdef DEBUG
@@ -357,7 +369,8 @@ static inline int FlowManagerFlowTimedOut(Flow *f, struct timeval *ts,
  *  \retval cnt timed out flows
  */
 static uint32_t FlowManagerHashRowTimeout(Flow *f, struct timeval *ts,
-        int emergency, FlowTimeoutCounters *counters, int32_t *next_ts)
+        int emergency, FlowTimeoutCounters *counters, int32_t *next_ts,
+        const bool wait_pool)
 {
     uint32_t cnt = 0;
     uint32_t checked = 0;
@@ -383,7 +396,8 @@ static uint32_t FlowManagerHashRowTimeout(Flow *f, struct timeval *ts,
 
         /* before grabbing the flow lock, make sure we have at least
          * 3 packets in the pool */
-        PacketPoolWaitForN(3);
+        if (wait_pool)
+            PacketPoolWaitForN(3);
 
         FLOWLOCK_WRLOCK(f);
 
@@ -393,7 +407,7 @@ static uint32_t FlowManagerHashRowTimeout(Flow *f, struct timeval *ts,
 
         /* check if the flow is fully timed out and
          * ready to be discarded. */
-        if (FlowManagerFlowTimedOut(f, ts, counters) == 1) {
+        if (FlowManagerFlowTimedOut(f, ts, counters, wait_pool) == 1) {
             /* remove from the hash */
             if (f->hprev != NULL)
                 f->hprev->hnext = f->hnext;
@@ -425,6 +439,15 @@ static uint32_t FlowManagerHashRowTimeout(Flow *f, struct timeval *ts,
                 f->flow_end_flags |= FLOW_END_FLAG_EMERGENCY;
             f->flow_end_flags |= FLOW_END_FLAG_TIMEOUT;
 
+            /* seconds after the first pass that could have timed it out */
+            const int32_t late = (int32_t)(ts->tv_sec - f->lastts.tv_sec) -
+                (int32_t)FlowGetFlowTimeout(f, state) - 1;
+            if (late > 0) {
+                counters->flows_late++;
+                if ((uint32_t)late > counters->flows_late_max)
+                    counters->flows_late_max = (uint32_t)late;
+            }
+
             /* no one is referring to this flow, use_cnt 0, removed from hash
              * so we can unlock it and pass it to the flow recycler */
             FLOWLOCK_UNLOCK(f);
@@ -472,12 +495,17 @@ static uint32_t FlowManagerHashRowTimeout(Flow *f, struct timeval *ts,
  *  \param hash_min min hash index to consider
  *  \param hash_max max hash index to consider
  *  \param counters ptr to FlowTimeoutCounters structure
+ *  \param wait_pool wait for packets in the thread's packet pool before
+ *                   locking rows and for forced reassembly. Workers must
+ *                   not wait for their own pool as they hold packets
+ *                   while doing this: flows that need forced reassembly
+ *                   are left for a later pass if the pool is empty.
  *
  *  \retval cnt number of timed out flow
  */
 static uint32_t FlowTimeoutHash(struct timeval *ts, uint32_t try_cnt,
         uint32_t hash_min, uint32_t hash_max,
-        FlowTimeoutCounters *counters)
+        FlowTimeoutCounters *counters, const bool wait_pool)
 {
     uint32_t idx = 0;
     uint32_t cnt = 0;
@@ -499,7 +527,8 @@ static uint32_t FlowTimeoutHash(struct timeval *ts, uint32_t try_cnt,
 
         /* before grabbing the row lock, make sure we have at least
          * 9 packets in the pool */
-        PacketPoolWaitForN(9);
+        if (wait_pool)
+            PacketPoolWaitForN(9);
 
         if (FBLOCK_TRYLOCK(fb) != 0) {
             counters->rows_busy++;
@@ -517,7 +546,8 @@ static uint32_t FlowTimeoutHash(struct timeval *ts, uint32_t try_cnt,
         int32_t next_ts = 0;
 
         /* we have a flow, or more than one */
-        cnt += FlowManagerHashRowTimeout(fb->tail, ts, emergency, counters, &next_ts);
+        cnt += FlowManagerHashRowTimeout(fb->tail, ts, emergency, counters,
+                &next_ts, wait_pool);
 
         SC_ATOMIC_SET(fb->next_ts, next_ts);
 
@@ -531,6 +561,112 @@ next:
     return cnt;
 }
 
+/**
+ *  \brief time out flows from the hash rows that are due in the wheel
+ *
+ *  Rows that had flows added or that changed state since the last pass
+ *  are checked as well, so they are scheduled for their new time.
+ *
+ *  \param wheel the flow manager's wheel
+ *  \param ts timestamp
+ *  \param counters ptr to FlowTimeoutCounters structure
+ *
+ *  \retval cnt number of timed out flow
+ */
+static uint32_t FlowTimeoutWheel(FlowWheel *wheel, struct timeval *ts,
+        FlowTimeoutCounters *counters)
+{
+    uint32_t idx = 0;
+    uint32_t cnt = 0;
+    int emergency = 0;
+
+    if (SC_ATOMIC_GET(flow_flags) & FLOW_EMERGENCY)
+        emergency = 1;
+
+    counters->rows_dirty += FlowWheelCollectDirty(wheel);
+    FlowWheelAdvance(wheel, (int32_t)ts->tv_sec);
+
+    while ((idx = FlowWheelGetDue(wheel)) != FLOW_WHEEL_NONE) {
+        FlowBucket *fb = &flow_hash[idx];
+
+        counters->rows_checked++;
+
+        /* before grabbing the row lock, make sure we have at least
+         * 9 packets in the pool */
+        PacketPoolWaitForN(9);
+
+        if (FBLOCK_TRYLOCK(fb) != 0) {
+            counters->rows_busy++;
+            /* try again on the next pass */
+            FlowWheelSchedule(wheel, idx, (int32_t)ts->tv_sec + 1);
+            continue;
+        }
+
+        /* flow hash bucket is now locked */
+
+        if (fb->tail == NULL) {
+            SC_ATOMIC_SET(fb->next_ts, INT_MAX);
+            counters->rows_empty++;
+            FBLOCK_UNLOCK(fb);
+            continue;
+        }
+
+        int32_t next_ts = 0;
+
+        /* we have a flow, or more than one */
+        cnt += FlowManagerHashRowTimeout(fb->tail, ts, emergency, counters,
+                &next_ts, true);
+
+        SC_ATOMIC_SET(fb->next_ts, next_ts);
+
+        /* only rows with flows left stay in the wheel. New flows mark
+         * the row dirty, which puts it back. */
+        if (fb->tail != NULL)
+            FlowWheelSchedule(wheel, idx, next_ts);
+
+        FBLOCK_UNLOCK(fb);
+    }
+
+    return cnt;
+}
+
+/**
+ *  \brief time out flows in the hash rows owned by a flow worker
+ *
+ *  Called by the worker for each packet. A new pass over the partition
+ *  is started at most once per second of packet time, each call checks
+ *  the next FLOW_PARTITION_SWEEP_ROWS rows of the pass.
+ *
+ *  \param part the worker's partition
+ *  \param ts packet timestamp
+ *
+ *  \retval cnt number of timed out flows
+ */
+uint32_t FlowPartitionTimeout(FlowPartition *part, const struct timeval *ts)
+{
+    if (part->sweep_row >= part->max) {
+        if ((int32_t)ts->tv_sec == part->sweep_ts)
+            return 0;
+        part->sweep_ts = (int32_t)ts->tv_sec;
+        part->sweep_row = part->min;
+    }
+
+    uint32_t end = part->sweep_row + FLOW_PARTITION_SWEEP_ROWS;
+    if (end > part->max)
+        end = part->max;
+
+    FlowTimeoutCounters counters;
+    memset(&counters, 0, sizeof(counters));
+    struct timeval sweep_ts = *ts;
+    uint32_t cnt = FlowTimeoutHash(&sweep_ts, 0, part->sweep_row, end,
+            &counters, false);
+
+    part->sweep_row = end;
+    if (end == part->max)
+        SC_ATOMIC_SET(part->last_sweep, part->sweep_ts);
+    return cnt;
+}
+
 /**
  *  \internal
  *
@@ -619,6 +755,9 @@ typedef struct FlowManagerThreadData_ {
     uint32_t min;
     uint32_t max;
 
+    /** timing wheel of the rows in min-max, NULL if not in use */
+    FlowWheel *wheel;
+
     uint16_t flow_mgr_cnt_clo;
     uint16_t flow_mgr_cnt_new;
     uint16_t flow_mgr_cnt_est;
@@ -633,17 +772,23 @@ typedef struct FlowManagerThreadData_ {
     uint16_t flow_mgr_flows_timeout;
     uint16_t flow_mgr_flows_timeout_inuse;
     uint16_t flow_mgr_flows_removed;
+    uint16_t flow_mgr_flows_late;
+    uint16_t flow_mgr_flows_late_max;
 
     uint16_t flow_mgr_rows_checked;
     uint16_t flow_mgr_rows_skipped;
     uint16_t flow_mgr_rows_empty;
     uint16_t flow_mgr_rows_busy;
     uint16_t flow_mgr_rows_maxlen;
+    uint16_t flow_mgr_rows_dirty;
+    uint16_t flow_mgr_wheel_rows;
 
     uint16_t flow_bypassed_cnt_clo;
     uint16_t flow_bypassed_pkts;
     uint16_t flow_bypassed_bytes;
 
+    uint16_t flow_mgr_partitions_swept;
+
 } FlowManagerThreadData;
 
 static TmEcode FlowManagerThreadInit(ThreadVars *t, const void *initdata, void **data)
@@ -671,6 +816,14 @@ static TmEcode FlowManagerThreadInit(ThreadVars *t, const void *initdata, void *
 
     SCLogDebug("instance %u hash range %u %u", ftd->instance, ftd->min, ftd->max);
 
+    if (flow_wheel_dirty != NULL && ftd->max > ftd->min) {
+        ftd->wheel = FlowWheelAlloc(ftd->min, ftd->max);
+        if (ftd->wheel == NULL) {
+            SCFree(ftd);
+            return TM_ECODE_FAILED;
+        }
+    }
+
     /* pass thread data back to caller */
     *data = ftd;
 
@@ -688,24 +841,35 @@ static TmEcode FlowManagerThreadInit(ThreadVars *t, const void *initdata, void *
     ftd->flow_mgr_flows_timeout = StatsRegisterCounter("flow_mgr.flows_timeout", t);
     ftd->flow_mgr_flows_timeout_inuse = StatsRegisterCounter("flow_mgr.flows_timeout_inuse", t);
     ftd->flow_mgr_flows_removed = StatsRegisterCounter("flow_mgr.flows_removed", t);
+    ftd->flow_mgr_flows_late = StatsRegisterCounter("flow_mgr.flows_late", t);
+    ftd->flow_mgr_flows_late_max = StatsRegisterMaxCounter("flow_mgr.flows_late_max", t);
 
     ftd->flow_mgr_rows_checked = StatsRegisterCounter("flow_mgr.rows_checked", t);
     ftd->flow_mgr_rows_skipped = StatsRegisterCounter("flow_mgr.rows_skipped", t);
     ftd->flow_mgr_rows_empty = StatsRegisterCounter("flow_mgr.rows_empty", t);
     ftd->flow_mgr_rows_busy = StatsRegisterCounter("flow_mgr.rows_busy", t);
     ftd->flow_mgr_rows_maxlen = StatsRegisterCounter("flow_mgr.rows_maxlen", t);
+    if (ftd->wheel != NULL) {
+        ftd->flow_mgr_rows_dirty = StatsRegisterCounter("flow_mgr.rows_dirty", t);
+        ftd->flow_mgr_wheel_rows = StatsRegisterCounter("flow_mgr.wheel_rows", t);
+    }
 
     ftd->flow_bypassed_cnt_clo = StatsRegisterCounter("flow_bypassed.closed", t);
     ftd->flow_bypassed_pkts = StatsRegisterCounter("flow_bypassed.pkts", t);
     ftd->flow_bypassed_bytes = StatsRegisterCounter("flow_bypassed.bytes", t);
 
+    ftd->flow_mgr_partitions_swept = StatsRegisterCounter("flow_mgr.partitions_swept", t);
+
     PacketPoolInit();
     return TM_ECODE_OK;
 }
 
 static TmEcode FlowManagerThreadDeinit(ThreadVars *t, void *data)
 {
+    FlowManagerThreadData *ftd = data;
+
     PacketPoolDestroy();
+    FlowWheelFree(ftd->wheel);
     SCFree(data);
     return TM_ECODE_OK;
 }
@@ -765,8 +929,32 @@ static TmEcode FlowManager(ThreadVars *th_v, void *thread_data)
             FlowUpdateSpareFlows();
 
         /* try to time out flows */
-        FlowTimeoutCounters counters = { 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-        FlowTimeoutHash(&ts, 0 /* check all */, ftd->min, ftd->max, &counters);
+        FlowTimeoutCounters counters = { 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+        const uint32_t partitions = FlowPartitionsActive();
+        if (partitions == 0) {
+            /* in emergency mode the timeouts are shorter than the times
+             * the rows are scheduled for, so walk the whole range */
+            if (ftd->wheel != NULL && emerg == FALSE) {
+                FlowTimeoutWheel(ftd->wheel, &ts, &counters);
+            } else {
+                FlowTimeoutHash(&ts, 0 /* check all */, ftd->min, ftd->max, &counters, true);
+            }
+        } else {
+            /* the workers time out their own partitions. Only step in
+             * if a worker is idle or in emergency mode. */
+            uint32_t swept = 0;
+            for (uint32_t u = ftd->instance - 1; u < partitions; u += flowmgr_number) {
+                FlowPartition *part = FlowPartitionGet(u);
+                int32_t last_sweep = SC_ATOMIC_GET(part->last_sweep);
+                if (emerg == TRUE ||
+                        last_sweep + FLOW_PARTITION_STALE_SEC < (int32_t)ts.tv_sec) {
+                    FlowTimeoutHash(&ts, 0 /* check all */, part->min, part->max,
+                            &counters, true);
+                    swept++;
+                }
+            }
+            StatsAddUI64(th_v, ftd->flow_mgr_partitions_swept, (uint64_t)swept);
+        }
 
 
         if (ftd->instance == 1) {
@@ -793,12 +981,18 @@ static TmEcode FlowManager(ThreadVars *th_v, void *thread_data)
         StatsSetUI64(th_v, ftd->flow_mgr_flows_timeout, (uint64_t)counters.flows_timeout);
         StatsSetUI64(th_v, ftd->flow_mgr_flows_removed, (uint64_t)counters.flows_removed);
         StatsSetUI64(th_v, ftd->flow_mgr_flows_timeout_inuse, (uint64_t)counters.flows_timeout_inuse);
+        StatsAddUI64(th_v, ftd->flow_mgr_flows_late, (uint64_t)counters.flows_late);
+        StatsSetUI64(th_v, ftd->flow_mgr_flows_late_max, (uint64_t)counters.flows_late_max);
 
         StatsSetUI64(th_v, ftd->flow_mgr_rows_checked, (uint64_t)counters.rows_checked);
         StatsSetUI64(th_v, ftd->flow_mgr_rows_skipped, (uint64_t)counters.rows_skipped);
         StatsSetUI64(th_v, ftd->flow_mgr_rows_maxlen, (uint64_t)counters.rows_maxlen);
         StatsSetUI64(th_v, ftd->flow_mgr_rows_busy, (uint64_t)counters.rows_busy);
         StatsSetUI64(th_v, ftd->flow_mgr_rows_empty, (uint64_t)counters.rows_empty);
+        if (ftd->wheel != NULL) {
+            StatsSetUI64(th_v, ftd->flow_mgr_rows_dirty, (uint64_t)counters.rows_dirty);
+            StatsSetUI64(th_v, ftd->flow_mgr_wheel_rows, (uint64_t)ftd->wheel->cnt);
+        }
 
         StatsAddUI64(th_v, ftd->flow_bypassed_cnt_clo, (uint64_t)counters.bypassed_count);
         StatsAddUI64(th_v, ftd->flow_bypassed_pkts, (uint64_t)counters.bypassed_pkts);
@@ -938,6 +1132,10 @@ static TmEcode FlowRecyclerThreadDeinit(ThreadVars *t, void *data)
     if (ftd->output_thread_data != NULL)
         OutputFlowLogThreadDeinit(t, ftd->output_thread_data);
 
+    /* stream buffer pages released by the flows we freed */
+    StreamingBufferPagePoolCleanup();
+    StreamTcpReassembleReleaseMemuse();
+
     SCFree(data);
     return TM_ECODE_OK;
 }
@@ -1222,8 +1420,8 @@ static int FlowMgrTest01 (void)
 
     int32_t next_ts = 0;
     int state = SC_ATOMIC_GET(f.flow_state);
-    FlowTimeoutCounters counters = { 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-    if (FlowManagerFlowTimeout(&f, state, &ts, &next_ts) != 1 && FlowManagerFlowTimedOut(&f, &ts, &counters) != 1) {
+    FlowTimeoutCounters counters = { 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+    if (FlowManagerFlowTimeout(&f, state, &ts, &next_ts) != 1 && FlowManagerFlowTimedOut(&f, &ts, &counters, true) != 1) {
         FBLOCK_DESTROY(&fb);
         FLOW_DESTROY(&f);
         FlowQueueDestroy(&flow_spare_q);
@@ -1279,8 +1477,8 @@ static int FlowMgrTest02 (void)
 
     int32_t next_ts = 0;
     int state = SC_ATOMIC_GET(f.flow_state);
-    FlowTimeoutCounters counters = { 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-    if (FlowManagerFlowTimeout(&f, state, &ts, &next_ts) != 1 && FlowManagerFlowTimedOut(&f, &ts, &counters) != 1) {
+    FlowTimeoutCounters counters = { 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+    if (FlowManagerFlowTimeout(&f, state, &ts, &next_ts) != 1 && FlowManagerFlowTimedOut(&f, &ts, &counters, true) != 1) {
         FBLOCK_DESTROY(&fb);
         FLOW_DESTROY(&f);
         FlowQueueDestroy(&flow_spare_q);
@@ -1328,8 +1526,8 @@ static int FlowMgrTest03 (void)
 
     int next_ts = 0;
     int state = SC_ATOMIC_GET(f.flow_state);
-    FlowTimeoutCounters counters = { 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-    if (FlowManagerFlowTimeout(&f, state, &ts, &next_ts) != 1 && FlowManagerFlowTimedOut(&f, &ts, &counters) != 1) {
+    FlowTimeoutCounters counters = { 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+    if (FlowManagerFlowTimeout(&f, state, &ts, &next_ts) != 1 && FlowManagerFlowTimedOut(&f, &ts, &counters, true) != 1) {
         FBLOCK_DESTROY(&fb);
         FLOW_DESTROY(&f);
         FlowQueueDestroy(&flow_spare_q);
@@ -1386,8 +1584,8 @@ static int FlowMgrTest04 (void)
 
     int next_ts = 0;
     int state = SC_ATOMIC_GET(f.flow_state);
-    FlowTimeoutCounters counters = { 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-    if (FlowManagerFlowTimeout(&f, state, &ts, &next_ts) != 1 && FlowManagerFlowTimedOut(&f, &ts, &counters) != 1) {
+    FlowTimeoutCounters counters = { 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+    if (FlowManagerFlowTimeout(&f, state, &ts, &next_ts) != 1 && FlowManagerFlowTimedOut(&f, &ts, &counters, true) != 1) {
         FBLOCK_DESTROY(&fb);
         FLOW_DESTROY(&f);
         FlowQueueDestroy(&flow_spare_q);
@@ -1439,8 +1637,8 @@ static int FlowMgrTest05 (void)
     struct timeval ts;
     TimeGet(&ts);
     /* try to time out flows */
-    FlowTimeoutCounters counters = { 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-    FlowTimeoutHash(&ts, 0 /* check all */, 0, flow_config.hash_size, &counters);
+    FlowTimeoutCounters counters = { 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+    FlowTimeoutHash(&ts, 0 /* check all */, 0, flow_config.hash_size, &counters, true);
 
     if (flow_recycle_q.len > 0) {
         result = 1;
@@ -1450,6 +1648,66 @@ static int FlowMgrTest05 (void)
     FlowShutdown();
     return result;
 }
+
+/**
+ *  \test   A partition sweep by a worker must not wait for its own
+ *          packet pool: with the pool exhausted a flow that needs
+ *          forced reassembly is left in the hash for a later pass.
+ */
+static int FlowMgrTest06 (void)
+{
+    TcpSession ssn;
+    Flow f;
+    FlowPartition part;
+    struct timeval ts;
+
+    FlowInitConfig(FLOW_QUIET);
+
+    memset(&ssn, 0, sizeof(TcpSession));
+    memset(&f, 0, sizeof(Flow));
+    memset(&part, 0, sizeof(part));
+
+    FLOW_INITIALIZE(&f);
+    TimeGet(&ts);
+    ssn.state = TCP_ESTABLISHED;
+    f.lastts.tv_sec = ts.tv_sec - 5000;
+    f.protoctx = &ssn;
+    f.proto = IPPROTO_TCP;
+
+    FlowBucket *fb = &flow_hash[0];
+    fb->head = fb->tail = &f;
+    f.fb = fb;
+    SC_ATOMIC_SET(fb->next_ts, 0);
+
+    part.min = 0;
+    part.max = 1;
+    part.sweep_row = part.max;
+
+    /* exhaust the packet pool of this thread */
+    Packet *taken = NULL;
+    Packet *p;
+    while ((p = PacketPoolGetPacket()) != NULL) {
+        p->next = taken;
+        taken = p;
+    }
+
+    FAIL_IF(FlowPartitionTimeout(&part, &ts) != 0);
+    FAIL_IF(fb->tail != &f);
+    FAIL_IF(f.flags & FLOW_TIMEOUT_REASSEMBLY_DONE);
+    FAIL_IF(SC_ATOMIC_GET(f.use_cnt) != 0);
+
+    while (taken != NULL) {
+        p = taken;
+        taken = p->next;
+        p->next = NULL;
+        PacketPoolReturnPacket(p);
+    }
+
+    fb->head = fb->tail = NULL;
+    FLOW_DESTROY(&f);
+    FlowShutdown();
+    PASS;
+}
 #endif /* UNITTESTS */
 
 /**
@@ -1468,5 +1726,7 @@ void FlowMgrRegisterTests (void)
                    FlowMgrTest04);
     UtRegisterTest("FlowMgrTest05 -- Test flow Allocations when it reach memcap",
                    FlowMgrTest05);
+    UtRegisterTest("FlowMgrTest06 -- Worker sweep with an exhausted packet pool",
+                   FlowMgrTest06);
 #endif /* UNITTESTS */
 }
@@ -135,6 +135,41 @@ Flow *FlowDequeue (FlowQueue *q)
     return f;
 }
 
+/**
+ *  \brief remove up to 'max' flows from the queue under a single lock
+ *
+ *  \param q queue
+ *  \param flows array to store the flows in
+ *  \param max size of the array
+ *
+ *  \retval cnt number of flows stored in 'flows'
+ */
+uint32_t FlowDequeueBulk(FlowQueue *q, Flow **flows, uint32_t max)
+{
+    uint32_t cnt = 0;
+
+    FQLOCK_LOCK(q);
+    while (cnt < max && q->bot != NULL) {
+        Flow *f = q->bot;
+
+        q->bot = f->lprev;
+        if (q->bot != NULL)
+            q->bot->lnext = NULL;
+        else
+            q->top = NULL;
+
+        f->lnext = NULL;
+        f->lprev = NULL;
+        flows[cnt++] = f;
+    }
+#ifdef DEBUG
+    BUG_ON(q->len < cnt);
+#endif
+    q->len -= cnt;
+    FQLOCK_UNLOCK(q);
+    return cnt;
+}
+
 /**
  *  \brief Transfer a flow from a queue to the spare queue
  *
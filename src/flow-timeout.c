@@ -257,19 +257,17 @@ error:
     return NULL;
 }
 
-static inline Packet *FlowForceReassemblyPseudoPacketGet(int direction,
-                                                         Flow *f,
-                                                         TcpSession *ssn)
+static inline Packet *FlowForceReassemblyPseudoPacketGet(const bool wait)
 {
-    PacketPoolWait();
+    if (wait)
+        PacketPoolWait();
     Packet *p = PacketPoolGetPacket();
     if (p == NULL) {
         return NULL;
     }
 
     PACKET_PROFILING_START(p);
-
-    return FlowForceReassemblyPseudoPacketSetup(p, direction, f, ssn);
+    return p;
 }
 
 /**
@@ -324,19 +322,8 @@ int FlowForceReassemblyNeedReassembly(Flow *f, int *server, int *client)
     SCReturnInt(1);
 }
 
-/**
- * \internal
- * \brief Forces reassembly for flow if it needs it.
- *
- *        The function requires flow to be locked beforehand.
- *
- * \param f Pointer to the flow.
- * \param server action required for server: 1 or 2
- * \param client action required for client: 1 or 2
- *
- * \retval 0 This flow doesn't need any reassembly processing; 1 otherwise.
- */
-int FlowForceReassemblyForFlow(Flow *f, int server, int client)
+static int FlowForceReassemblyForFlowInternal(Flow *f, int server, int client,
+        const bool wait)
 {
     Packet *p1 = NULL, *p2 = NULL;
 
@@ -355,35 +342,45 @@ int FlowForceReassemblyForFlow(Flow *f, int server, int client)
      * seq/ack, and if we have server segments p2 has to carry out reassembly
      * for server segment as well, in which case we will also need a p3 in the
      * toclient which is now dummy since all we need it for is detection */
-
-    /* insert a pseudo packet in the toserver direction */
+    int p1_dir = 0;
+    bool need_p2 = false;
     if (client == STREAM_HAS_UNPROCESSED_SEGMENTS_NEED_ONLY_DETECTION) {
-        p1 = FlowForceReassemblyPseudoPacketGet(0, f, ssn);
-        if (p1 == NULL) {
-            goto done;
-        }
-        PKT_SET_SRC(p1, PKT_SRC_FFR);
-
-        if (server == STREAM_HAS_UNPROCESSED_SEGMENTS_NEED_ONLY_DETECTION) {
-            p2 = FlowForceReassemblyPseudoPacketGet(1, f, ssn);
-            if (p2 == NULL) {
-                FlowDeReference(&p1->flow);
-                TmqhOutputPacketpool(NULL, p1);
-                goto done;
-            }
-            PKT_SET_SRC(p2, PKT_SRC_FFR);
-        }
+        p1_dir = 0;
+        need_p2 = (server == STREAM_HAS_UNPROCESSED_SEGMENTS_NEED_ONLY_DETECTION);
+    } else if (server == STREAM_HAS_UNPROCESSED_SEGMENTS_NEED_ONLY_DETECTION) {
+        p1_dir = 1;
     } else {
-        if (server == STREAM_HAS_UNPROCESSED_SEGMENTS_NEED_ONLY_DETECTION) {
-            p1 = FlowForceReassemblyPseudoPacketGet(1, f, ssn);
-            if (p1 == NULL) {
-                goto done;
-            }
-            PKT_SET_SRC(p1, PKT_SRC_FFR);
-        } else {
-            /* impossible */
-            BUG_ON(1);
+        /* impossible */
+        BUG_ON(1);
+    }
+
+    /* get the packets before the flow is touched, so that it's left as
+     * it is if we can't get them */
+    p1 = FlowForceReassemblyPseudoPacketGet(wait);
+    if (p1 == NULL)
+        goto nopackets;
+    if (need_p2) {
+        p2 = FlowForceReassemblyPseudoPacketGet(wait);
+        if (p2 == NULL)
+            goto nopackets;
+    }
+
+    /* turn them into pseudo packets for the flow */
+    if (FlowForceReassemblyPseudoPacketSetup(p1, p1_dir, f, ssn) == NULL) {
+        TmqhOutputPacketpool(NULL, p1);
+        if (p2 != NULL)
+            TmqhOutputPacketpool(NULL, p2);
+        goto done;
+    }
+    PKT_SET_SRC(p1, PKT_SRC_FFR);
+    if (p2 != NULL) {
+        if (FlowForceReassemblyPseudoPacketSetup(p2, 1, f, ssn) == NULL) {
+            FlowDeReference(&p1->flow);
+            TmqhOutputPacketpool(NULL, p1);
+            TmqhOutputPacketpool(NULL, p2);
+            goto done;
         }
+        PKT_SET_SRC(p2, PKT_SRC_FFR);
     }
 
     /* inject the packet(s) into the appropriate thread */
@@ -403,6 +400,45 @@ int FlowForceReassemblyForFlow(Flow *f, int server, int client)
 done:
     f->flags |= FLOW_TIMEOUT_REASSEMBLY_DONE;
     return 1;
+
+nopackets:
+    if (p1 != NULL)
+        TmqhOutputPacketpool(NULL, p1);
+    if (!wait)
+        return -1;
+    goto done;
+}
+
+/**
+ * \internal
+ * \brief Forces reassembly for flow if it needs it.
+ *
+ *        The function requires flow to be locked beforehand.
+ *
+ * \param f Pointer to the flow.
+ * \param server action required for server: 1 or 2
+ * \param client action required for client: 1 or 2
+ *
+ * \retval 0 This flow doesn't need any reassembly processing; 1 otherwise.
+ */
+int FlowForceReassemblyForFlow(Flow *f, int server, int client)
+{
+    return FlowForceReassemblyForFlowInternal(f, server, client, true);
+}
+
+/**
+ * \brief Forces reassembly for flow if it needs it, without waiting
+ *        for the thread's packet pool.
+ *
+ *        For use by flow workers, which would wait for their own pool.
+ *        The function requires flow to be locked beforehand.
+ *
+ * \retval -1 no packets available, the flow is left untouched
+ * \retval 0 This flow doesn't need any reassembly processing; 1 otherwise.
+ */
+int FlowForceReassemblyForFlowNoWait(Flow *f, int server, int client)
+{
+    return FlowForceReassemblyForFlowInternal(f, server, client, false);
 }
 
 /**
@@ -0,0 +1,496 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Timing wheel of flow hash rows, used by the flow manager to find the
+ * rows that have flows timing out.
+ */
+
+#include "suricata-common.h"
+#include "flow.h"
+#include "flow-hash.h"
+#include "flow-util.h"
+#include "flow-private.h"
+#include "flow-wheel.h"
+
+#include "util-unittest.h"
+
+uint64_t *flow_wheel_dirty = NULL;
+uint64_t *flow_wheel_dirty_summary = NULL;
+
+/** memory used per hash row by the managers' wheels */
+#define FLOW_WHEEL_ROW_SIZE \
+    (2 * sizeof(uint32_t) + sizeof(int32_t) + sizeof(uint16_t))
+
+static uint32_t FlowWheelDirtyWords(void)
+{
+    return (flow_config.hash_size + 63) / 64;
+}
+
+static uint32_t FlowWheelSummaryWords(void)
+{
+    return (FlowWheelDirtyWords() + 63) / 64;
+}
+
+static uint64_t FlowWheelMemuse(void)
+{
+    return (uint64_t)(FlowWheelDirtyWords() + FlowWheelSummaryWords()) * sizeof(uint64_t) +
+        (uint64_t)flow_config.hash_size * FLOW_WHEEL_ROW_SIZE;
+}
+
+/**
+ *  \brief setup the dirty row bitmaps for the flow hash
+ *
+ *  Must be called after the flow hash is allocated. The flow managers
+ *  only use a wheel if the bitmaps exist.
+ */
+void FlowWheelInitConfig(void)
+{
+    const uint64_t size = FlowWheelMemuse();
+    if (!(FLOW_CHECK_MEMCAP(size))) {
+        SCLogError(SC_ERR_FLOW_INIT, "allocating flow timeout wheel failed: "
+                "max flow memcap reached. Memcap %"PRIu64", "
+                "Memuse %"PRIu64".", SC_ATOMIC_GET(flow_config.memcap),
+                (uint64_t)SC_ATOMIC_GET(flow_memuse) + size);
+        exit(EXIT_FAILURE);
+    }
+
+    flow_wheel_dirty = SCCalloc(FlowWheelDirtyWords(), sizeof(uint64_t));
+    flow_wheel_dirty_summary = SCCalloc(FlowWheelSummaryWords(), sizeof(uint64_t));
+    if (unlikely(flow_wheel_dirty == NULL || flow_wheel_dirty_summary == NULL)) {
+        SCLogError(SC_ERR_FATAL, "Fatal error encountered in FlowWheelInitConfig. Exiting...");
+        exit(EXIT_FAILURE);
+    }
+    (void) SC_ATOMIC_ADD(flow_memuse, size);
+
+    SCLogConfig("using flow timeout wheel, %"PRIu64" bytes", size);
+}
+
+void FlowWheelShutdown(void)
+{
+    if (flow_wheel_dirty == NULL)
+        return;
+
+    (void) SC_ATOMIC_SUB(flow_memuse, FlowWheelMemuse());
+    SCFree(flow_wheel_dirty);
+    flow_wheel_dirty = NULL;
+    SCFree(flow_wheel_dirty_summary);
+    flow_wheel_dirty_summary = NULL;
+}
+
+static inline void FlowWheelLink(FlowWheel *w, uint32_t r, uint16_t slot)
+{
+    w->next[r] = w->head[slot];
+    w->prev[r] = FLOW_WHEEL_NONE;
+    if (w->head[slot] != FLOW_WHEEL_NONE)
+        w->prev[w->head[slot]] = r;
+    w->head[slot] = r;
+    w->slot[r] = slot;
+}
+
+static inline void FlowWheelUnlink(FlowWheel *w, uint32_t r)
+{
+    if (w->prev[r] != FLOW_WHEEL_NONE)
+        w->next[w->prev[r]] = w->next[r];
+    else
+        w->head[w->slot[r]] = w->next[r];
+    if (w->next[r] != FLOW_WHEEL_NONE)
+        w->prev[w->next[r]] = w->prev[r];
+    w->slot[r] = FLOW_WHEEL_SLOT_NONE;
+}
+
+/** \internal
+ *  \brief put a row that is not linked in the slot for its time */
+static void FlowWheelPlace(FlowWheel *w, uint32_t r, int32_t ts)
+{
+    if (ts < w->cur)
+        ts = w->cur;
+    w->ts[r] = ts;
+
+    uint16_t slot;
+    if ((int64_t)ts - w->cur < FLOW_WHEEL_L0_SIZE) {
+        slot = (uint16_t)(ts & (FLOW_WHEEL_L0_SIZE - 1));
+    } else {
+        int32_t blk = ts >> FLOW_WHEEL_L0_BITS;
+        const int32_t cur_blk = w->cur >> FLOW_WHEEL_L0_BITS;
+        /* too far away: park it in the last slot, it is placed
+         * again when that slot is cascaded */
+        if (blk - cur_blk >= FLOW_WHEEL_L1_SIZE)
+            blk = cur_blk + FLOW_WHEEL_L1_SIZE - 1;
+        slot = (uint16_t)(FLOW_WHEEL_L0_SIZE + (blk & (FLOW_WHEEL_L1_SIZE - 1)));
+    }
+    FlowWheelLink(w, r, slot);
+}
+
+/**
+ *  \brief allocate a wheel for a range of the flow hash
+ *
+ *  All rows start out due, so the first pass checks the whole range.
+ *
+ *  \param min first row
+ *  \param max one past the last row
+ *
+ *  \retval w wheel or NULL on error
+ */
+FlowWheel *FlowWheelAlloc(uint32_t min, uint32_t max)
+{
+    if (max <= min)
+        return NULL;
+
+    FlowWheel *w = SCCalloc(1, sizeof(*w));
+    if (unlikely(w == NULL))
+        return NULL;
+
+    const uint32_t rows = max - min;
+    w->min = min;
+    w->max = max;
+    w->next = SCCalloc(rows, sizeof(uint32_t));
+    w->prev = SCCalloc(rows, sizeof(uint32_t));
+    w->ts = SCCalloc(rows, sizeof(int32_t));
+    w->slot = SCCalloc(rows, sizeof(uint16_t));
+    if (w->next == NULL || w->prev == NULL || w->ts == NULL || w->slot == NULL) {
+        FlowWheelFree(w);
+        return NULL;
+    }
+
+    for (uint32_t s = 0; s < FLOW_WHEEL_SLOTS; s++)
+        w->head[s] = FLOW_WHEEL_NONE;
+    for (uint32_t r = rows; r > 0; r--)
+        FlowWheelLink(w, r - 1, FLOW_WHEEL_SLOT_DUE);
+    w->cnt = rows;
+    return w;
+}
+
+void FlowWheelFree(FlowWheel *w)
+{
+    if (w == NULL)
+        return;
+    SCFree(w->next);
+    SCFree(w->prev);
+    SCFree(w->ts);
+    SCFree(w->slot);
+    SCFree(w);
+}
+
+/**
+ *  \brief (re)schedule a row
+ *
+ *  \param row index of the row in the flow hash
+ *  \param ts second the first flow in the row times out. Times
+ *            that already passed are handled on the next advance.
+ */
+void FlowWheelSchedule(FlowWheel *w, uint32_t row, int32_t ts)
+{
+    const uint32_t r = row - w->min;
+    if (w->slot[r] != FLOW_WHEEL_SLOT_NONE)
+        FlowWheelUnlink(w, r);
+    else
+        w->cnt++;
+    FlowWheelPlace(w, r, ts);
+}
+
+/** \internal
+ *  \brief move all rows of a slot to the due list */
+static void FlowWheelSlotToDue(FlowWheel *w, uint16_t slot)
+{
+    uint32_t r = w->head[slot];
+    w->head[slot] = FLOW_WHEEL_NONE;
+    while (r != FLOW_WHEEL_NONE) {
+        uint32_t next = w->next[r];
+        FlowWheelLink(w, r, FLOW_WHEEL_SLOT_DUE);
+        r = next;
+    }
+}
+
+/** \internal
+ *  \brief spread the rows of a second level slot over the first level */
+static void FlowWheelCascade(FlowWheel *w, uint16_t slot)
+{
+    uint32_t r = w->head[slot];
+    w->head[slot] = FLOW_WHEEL_NONE;
+    while (r != FLOW_WHEEL_NONE) {
+        uint32_t next = w->next[r];
+        FlowWheelPlace(w, r, w->ts[r]);
+        r = next;
+    }
+}
+
+/**
+ *  \brief move the rows of all slots up to and including 'now' to
+ *         the due list
+ *
+ *  If time jumped further than the wheel covers, e.g. a gap in a pcap,
+ *  all rows are made due.
+ */
+void FlowWheelAdvance(FlowWheel *w, int32_t now)
+{
+    if (now < w->cur)
+        return;
+
+    if ((int64_t)now - w->cur >= FLOW_WHEEL_SPAN) {
+        for (uint16_t s = 0; s < FLOW_WHEEL_SLOT_DUE; s++)
+            FlowWheelSlotToDue(w, s);
+        w->cur = now + 1;
+        return;
+    }
+
+    while (w->cur <= now) {
+        if ((w->cur & (FLOW_WHEEL_L0_SIZE - 1)) == 0) {
+            FlowWheelCascade(w, (uint16_t)(FLOW_WHEEL_L0_SIZE +
+                        ((w->cur >> FLOW_WHEEL_L0_BITS) & (FLOW_WHEEL_L1_SIZE - 1))));
+        }
+        FlowWheelSlotToDue(w, (uint16_t)(w->cur & (FLOW_WHEEL_L0_SIZE - 1)));
+        w->cur++;
+    }
+}
+
+/**
+ *  \brief take a row from the due list
+ *
+ *  The row is no longer in the wheel. The caller has to schedule it
+ *  again if it still has flows.
+ *
+ *  \retval row index of the row in the flow hash or FLOW_WHEEL_NONE
+ */
+uint32_t FlowWheelGetDue(FlowWheel *w)
+{
+    const uint32_t r = w->head[FLOW_WHEEL_SLOT_DUE];
+    if (r == FLOW_WHEEL_NONE)
+        return FLOW_WHEEL_NONE;
+
+    FlowWheelUnlink(w, r);
+    w->cnt--;
+    return w->min + r;
+}
+
+/** \internal
+ *  \brief bits of a 64 bit word starting at 'base' that are in [lo, hi) */
+static inline uint64_t FlowWheelRangeMask(uint32_t base, uint32_t lo, uint32_t hi)
+{
+    const uint32_t s = lo > base ? lo - base : 0;
+    const uint32_t e = hi < base + 64 ? hi - base : 64;
+    if (s >= e)
+        return 0;
+    const uint64_t m = (e == 64) ? UINT64_MAX : (((uint64_t)1 << e) - 1);
+    return m & ~(((uint64_t)1 << s) - 1);
+}
+
+/**
+ *  \brief move the rows of the wheel's range that were marked by
+ *         FlowWheelMarkRow() to the due list
+ *
+ *  \retval cnt number of dirty rows
+ */
+uint32_t FlowWheelCollectDirty(FlowWheel *w)
+{
+    if (flow_wheel_dirty == NULL)
+        return 0;
+
+    uint32_t cnt = 0;
+    const uint32_t word_min = w->min / 64;
+    const uint32_t word_max = (w->max + 63) / 64;
+
+    for (uint32_t s = word_min / 64; s <= (word_max - 1) / 64; s++) {
+        const uint64_t smask = FlowWheelRangeMask(s * 64, word_min, word_max);
+        uint64_t sbits = SCAtomicFetchAndAnd(&flow_wheel_dirty_summary[s], ~smask) & smask;
+
+        while (sbits) {
+            const uint32_t word = s * 64 + (uint32_t)__builtin_ctzll(sbits);
+            sbits &= sbits - 1;
+
+            const uint64_t mask = FlowWheelRangeMask(word * 64, w->min, w->max);
+            const uint64_t old = SCAtomicFetchAndAnd(&flow_wheel_dirty[word], ~mask);
+            /* the word is shared with the next manager's range, leave
+             * the summary bit set for it */
+            if (old & ~mask) {
+                (void)SCAtomicFetchAndOr(&flow_wheel_dirty_summary[s],
+                        (uint64_t)1 << (word % 64));
+            }
+
+            uint64_t bits = old & mask;
+            while (bits) {
+                const uint32_t r = word * 64 + (uint32_t)__builtin_ctzll(bits) - w->min;
+                bits &= bits - 1;
+
+                if (w->slot[r] != FLOW_WHEEL_SLOT_NONE)
+                    FlowWheelUnlink(w, r);
+                else
+                    w->cnt++;
+                FlowWheelLink(w, r, FLOW_WHEEL_SLOT_DUE);
+                cnt++;
+            }
+        }
+    }
+    return cnt;
+}
+
+#ifdef UNITTESTS
+static int FlowWheelDrain(FlowWheel *w)
+{
+    int cnt = 0;
+    while (FlowWheelGetDue(w) != FLOW_WHEEL_NONE)
+        cnt++;
+    return cnt;
+}
+
+/** \test rows become due in their second, not before */
+static int FlowWheelTest01(void)
+{
+    FlowWheel *w = FlowWheelAlloc(100, 110);
+    FAIL_IF_NULL(w);
+    FAIL_IF_NOT(w->cnt == 10);
+    FAIL_IF_NOT(FlowWheelDrain(w) == 10);
+    FAIL_IF_NOT(w->cnt == 0);
+
+    FlowWheelAdvance(w, 1000);
+    FlowWheelSchedule(w, 100, 1005);
+    FlowWheelSchedule(w, 105, 1003);
+    FlowWheelSchedule(w, 109, 1003);
+    /* reschedule moves the row */
+    FlowWheelSchedule(w, 109, 1010);
+    FAIL_IF_NOT(w->cnt == 3);
+
+    FlowWheelAdvance(w, 1002);
+    FAIL_IF_NOT(FlowWheelGetDue(w) == FLOW_WHEEL_NONE);
+    FlowWheelAdvance(w, 1004);
+    FAIL_IF_NOT(FlowWheelGetDue(w) == 105);
+    FAIL_IF_NOT(FlowWheelGetDue(w) == FLOW_WHEEL_NONE);
+    FlowWheelAdvance(w, 1009);
+    FAIL_IF_NOT(FlowWheelGetDue(w) == 100);
+    FAIL_IF_NOT(FlowWheelGetDue(w) == FLOW_WHEEL_NONE);
+    /* times in the past are due on the next advance */
+    FlowWheelSchedule(w, 101, 900);
+    FlowWheelAdvance(w, 1010);
+    FAIL_IF_NOT(FlowWheelDrain(w) == 2);
+    FAIL_IF_NOT(w->cnt == 0);
+
+    FlowWheelFree(w);
+    PASS;
+}
+
+/** \test rows far away are cascaded from the second level */
+static int FlowWheelTest02(void)
+{
+    FlowWheel *w = FlowWheelAlloc(0, 4);
+    FAIL_IF_NULL(w);
+    FlowWheelDrain(w);
+
+    FlowWheelAdvance(w, 10000);
+    FlowWheelSchedule(w, 0, 10000 + 300);
+    FlowWheelSchedule(w, 1, 10000 + 3600);
+    /* beyond the span of the wheel */
+    FlowWheelSchedule(w, 2, 10000 + 2 * FLOW_WHEEL_SPAN);
+
+    for (int32_t t = 10001; t < 10000 + 300; t++) {
+        FlowWheelAdvance(w, t);
+        FAIL_IF_NOT(FlowWheelGetDue(w) == FLOW_WHEEL_NONE);
+    }
+    FlowWheelAdvance(w, 10000 + 300);
+    FAIL_IF_NOT(FlowWheelGetDue(w) == 0);
+
+    for (int32_t t = 10000 + 301; t < 10000 + 3600; t++) {
+        FlowWheelAdvance(w, t);
+        FAIL_IF_NOT(FlowWheelGetDue(w) == FLOW_WHEEL_NONE);
+    }
+    FlowWheelAdvance(w, 10000 + 3600);
+    FAIL_IF_NOT(FlowWheelGetDue(w) == 1);
+
+    for (int32_t t = 10000 + 3601; t < 10000 + 2 * FLOW_WHEEL_SPAN; t += 7) {
+        FlowWheelAdvance(w, t);
+        FAIL_IF_NOT(FlowWheelGetDue(w) == FLOW_WHEEL_NONE);
+    }
+    FlowWheelAdvance(w, 10000 + 2 * FLOW_WHEEL_SPAN);
+    FAIL_IF_NOT(FlowWheelGetDue(w) == 2);
+    FAIL_IF_NOT(w->cnt == 0);
+
+    FlowWheelFree(w);
+    PASS;
+}
+
+/** \test a time jump makes everything due */
+static int FlowWheelTest03(void)
+{
+    FlowWheel *w = FlowWheelAlloc(0, 4);
+    FAIL_IF_NULL(w);
+    FlowWheelDrain(w);
+
+    FlowWheelAdvance(w, 100);
+    FlowWheelSchedule(w, 0, 200);
+    FlowWheelSchedule(w, 3, 100000);
+    FlowWheelAdvance(w, 100 + 2 * FLOW_WHEEL_SPAN);
+    FAIL_IF_NOT(FlowWheelDrain(w) == 2);
+    FAIL_IF_NOT(w->cur == 101 + 2 * FLOW_WHEEL_SPAN);
+
+    FlowWheelFree(w);
+    PASS;
+}
+
+/** \test dirty rows are only collected by the wheel owning them */
+static int FlowWheelTest04(void)
+{
+    uint64_t dirty[4] = { 0, 0, 0, 0 };
+    uint64_t summary[1] = { 0 };
+    flow_wheel_dirty = dirty;
+    flow_wheel_dirty_summary = summary;
+
+    FlowWheel *w1 = FlowWheelAlloc(0, 100);
+    FAIL_IF_NULL(w1);
+    FlowWheel *w2 = FlowWheelAlloc(100, 256);
+    FAIL_IF_NULL(w2);
+    FlowWheelDrain(w1);
+    FlowWheelDrain(w2);
+
+    FlowWheelMarkRow(5);
+    FlowWheelMarkRow(99);
+    FlowWheelMarkRow(100);
+    FlowWheelMarkRow(200);
+
+    FAIL_IF_NOT(FlowWheelCollectDirty(w1) == 2);
+    FAIL_IF_NOT(FlowWheelCollectDirty(w1) == 0);
+    FAIL_IF_NOT(FlowWheelGetDue(w1) == 99);
+    FAIL_IF_NOT(FlowWheelGetDue(w1) == 5);
+    FAIL_IF_NOT(FlowWheelCollectDirty(w2) == 2);
+    FAIL_IF_NOT(FlowWheelDrain(w2) == 2);
+    FAIL_IF_NOT(dirty[1] == 0 && dirty[3] == 0);
+
+    /* a dirty row that is already in the wheel is made due */
+    FlowWheelAdvance(w2, 1000);
+    FlowWheelSchedule(w2, 150, 2000);
+    FlowWheelMarkRow(150);
+    FAIL_IF_NOT(FlowWheelCollectDirty(w2) == 1);
+    FAIL_IF_NOT(w2->cnt == 1);
+    FAIL_IF_NOT(FlowWheelGetDue(w2) == 150);
+
+    FlowWheelFree(w1);
+    FlowWheelFree(w2);
+    flow_wheel_dirty = NULL;
+    flow_wheel_dirty_summary = NULL;
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void FlowWheelRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("FlowWheelTest01", FlowWheelTest01);
+    UtRegisterTest("FlowWheelTest02", FlowWheelTest02);
+    UtRegisterTest("FlowWheelTest03", FlowWheelTest03);
+    UtRegisterTest("FlowWheelTest04", FlowWheelTest04);
+#endif
+}
@@ -0,0 +1,113 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Timing wheel of flow hash rows.
+ *
+ * Each flow manager keeps a two level wheel of the hash rows it owns,
+ * keyed by the time the first flow in the row times out. The first level
+ * has a slot per second, the second level a slot per 256 seconds. Rows
+ * are only looked at when their slot expires, so a timeout pass costs
+ * O(expired rows) instead of O(hash size).
+ *
+ * Rows are scheduled lazily: a packet only moving 'lastts' forward makes
+ * the row's time early, which is safe. The row is rescheduled when the
+ * manager finds nothing to time out. Adding a flow or changing its state
+ * can make a row time out earlier, so those mark the row in a global
+ * dirty bitmap that the managers drain on each pass.
+ */
+
+#ifndef __FLOW_WHEEL_H__
+#define __FLOW_WHEEL_H__
+
+#define FLOW_WHEEL_L0_BITS  8
+#define FLOW_WHEEL_L0_SIZE  (1 << FLOW_WHEEL_L0_BITS)   /**< 1 second slots */
+#define FLOW_WHEEL_L1_BITS  8
+#define FLOW_WHEEL_L1_SIZE  (1 << FLOW_WHEEL_L1_BITS)   /**< 256 second slots */
+/** time covered by the wheel, rows further away are cascaded again */
+#define FLOW_WHEEL_SPAN     (FLOW_WHEEL_L0_SIZE * FLOW_WHEEL_L1_SIZE)
+
+/** list of rows whose slot expired, drained by FlowWheelGetDue() */
+#define FLOW_WHEEL_SLOT_DUE     (FLOW_WHEEL_L0_SIZE + FLOW_WHEEL_L1_SIZE)
+#define FLOW_WHEEL_SLOTS        (FLOW_WHEEL_SLOT_DUE + 1)
+#define FLOW_WHEEL_SLOT_NONE    UINT16_MAX
+
+#define FLOW_WHEEL_NONE     UINT32_MAX
+
+/** Wheel of a range of the flow hash. Only used by the owning flow
+ *  manager, so it needs no locking. */
+typedef struct FlowWheel_ {
+    uint32_t min;           /**< first row of the range */
+    uint32_t max;           /**< one past the last row */
+    uint32_t cnt;           /**< rows in the wheel */
+    int32_t cur;            /**< next second to expire */
+
+    /* per row state, indexed by row - min */
+    uint32_t *next;
+    uint32_t *prev;
+    int32_t *ts;            /**< second the row is scheduled for */
+    uint16_t *slot;         /**< slot the row is in or FLOW_WHEEL_SLOT_NONE */
+
+    uint32_t head[FLOW_WHEEL_SLOTS];
+} FlowWheel;
+
+/** one bit per hash row that had flows added or changed state */
+extern uint64_t *flow_wheel_dirty;
+/** one bit per word of flow_wheel_dirty that has bits set */
+extern uint64_t *flow_wheel_dirty_summary;
+
+void FlowWheelInitConfig(void);
+void FlowWheelShutdown(void);
+
+FlowWheel *FlowWheelAlloc(uint32_t min, uint32_t max);
+void FlowWheelFree(FlowWheel *);
+void FlowWheelSchedule(FlowWheel *, uint32_t row, int32_t ts);
+uint32_t FlowWheelCollectDirty(FlowWheel *);
+void FlowWheelAdvance(FlowWheel *, int32_t now);
+uint32_t FlowWheelGetDue(FlowWheel *);
+
+void FlowWheelRegisterTests(void);
+
+/**
+ *  \brief tell the flow manager a hash row needs to be checked again
+ *
+ *  Called after a flow was added to the row or changed state, as it
+ *  may now time out before the time the row is scheduled for.
+ *
+ *  \param row index of the row in the flow hash
+ */
+static inline void FlowWheelMarkRow(const uint32_t row)
+{
+    if (flow_wheel_dirty != NULL) {
+        const uint32_t word = row / 64;
+        const uint64_t row_bit = (uint64_t)1 << (row % 64);
+        const uint64_t word_bit = (uint64_t)1 << (word % 64);
+        /* set the row bit before the summary bit, the manager clears
+         * them in the reverse order. Only write when a bit is clear, so
+         * the words stay shared in the caches of all workers while the
+         * manager hasn't drained them. A bit that is seen set but then
+         * cleared by the manager is drained by that same pass. */
+        if (!(__atomic_load_n(&flow_wheel_dirty[word], __ATOMIC_RELAXED) & row_bit))
+            (void)SCAtomicFetchAndOr(&flow_wheel_dirty[word], row_bit);
+        if (!(__atomic_load_n(&flow_wheel_dirty_summary[word / 64], __ATOMIC_RELAXED) & word_bit))
+            (void)SCAtomicFetchAndOr(&flow_wheel_dirty_summary[word / 64], word_bit);
+    }
+}
+
+#endif /* __FLOW_WHEEL_H__ */
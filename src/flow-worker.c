@@ -44,6 +44,8 @@
 #include "util-validate.h"
 
 #include "flow-util.h"
+#include "flow-hash.h"
+#include "flow-manager.h"
 
 typedef DetectEngineThreadCtx *DetectEngineThreadCtxPtr;
 
@@ -64,6 +66,8 @@ typedef struct FlowWorkerThreadData_ {
     uint16_t both_bypass_pkts;
     uint16_t both_bypass_bytes;
 
+    uint16_t partition_flows_removed;
+
     PacketQueue pq;
 
 } FlowWorkerThreadData;
@@ -113,6 +117,12 @@ static TmEcode FlowWorkerThreadInit(ThreadVars *tv, const void *initdata, void *
         return TM_ECODE_FAILED;
     }
 
+    /* the partition's hash range is assigned once all threads are up */
+    fw->dtv->flow_partition = FlowPartitionRegister();
+    if (fw->dtv->flow_partition != NULL) {
+        fw->partition_flows_removed = StatsRegisterCounter("flow.partition_timeout", tv);
+    }
+
     /* setup TCP */
     if (StreamTcpThreadInit(tv, NULL, &fw->stream_thread_ptr) != TM_ECODE_OK) {
         FlowWorkerThreadDeinit(tv, fw);
@@ -150,6 +160,8 @@ static TmEcode FlowWorkerThreadDeinit(ThreadVars *tv, void *data)
 {
     FlowWorkerThreadData *fw = data;
 
+    if (fw->dtv != NULL)
+        FlowPartitionDeregister(fw->dtv->flow_partition);
     DecodeThreadVarsFree(tv, fw->dtv);
 
     /* free TCP */
@@ -187,6 +199,14 @@ static TmEcode FlowWorker(ThreadVars *tv, Packet *p, void *data, PacketQueue *pr
     /* update time */
     if (!(PKT_IS_PSEUDOPKT(p))) {
         TimeSetByThread(tv->id, &p->ts);
+
+        /* time out flows in our own part of the flow hash */
+        FlowPartition *part = fw->dtv->flow_partition;
+        if (part != NULL && part->max > part->min) {
+            uint32_t cnt = FlowPartitionTimeout(part, &p->ts);
+            if (cnt > 0)
+                StatsAddUI64(tv, fw->partition_flows_removed, (uint64_t)cnt);
+        }
     }
 
     /* handle Flow */
@@ -334,6 +354,7 @@ const char *ProfileFlowWorkerIdToString(enum ProfileFlowWorkerId fwi)
 static void FlowWorkerExitPrintStats(ThreadVars *tv, void *data)
 {
     FlowWorkerThreadData *fw = data;
+    StreamTcpExitPrintStats(tv, fw->stream_thread);
     OutputLoggerExitPrintStats(tv, fw->output_thread);
 }
 
@@ -44,6 +44,7 @@
 #include "flow-manager.h"
 #include "flow-storage.h"
 #include "flow-bypass.h"
+#include "flow-wheel.h"
 
 #include "stream-tcp-private.h"
 #include "stream-tcp-reassemble.h"
@@ -588,6 +589,19 @@ void FlowInitConfig(char quiet)
             flow_config.prealloc = configval;
         }
     }
+    int partitioned = 0;
+    if (ConfGetBool("flow.partitioned", &partitioned) == 1 && partitioned) {
+        flow_config.partitioned = 1;
+    }
+    int timeout_wheel = 0;
+    if (ConfGetBool("flow.timeout-wheel", &timeout_wheel) == 1 && timeout_wheel) {
+        if (flow_config.partitioned) {
+            SCLogWarning(SC_ERR_INVALID_ARGUMENT, "flow.timeout-wheel is not "
+                    "supported with flow.partitioned, ignoring it");
+        } else {
+            flow_config.timeout_wheel = 1;
+        }
+    }
     SCLogDebug("Flow config from suricata.yaml: memcap: %"PRIu64", hash-size: "
                "%"PRIu32", prealloc: %"PRIu32, SC_ATOMIC_GET(flow_config.memcap),
                flow_config.hash_size, flow_config.prealloc);
@@ -624,6 +638,10 @@ void FlowInitConfig(char quiet)
                   (uintmax_t)sizeof(FlowBucket));
     }
 
+    if (flow_config.timeout_wheel) {
+        FlowWheelInitConfig();
+    }
+
     /* pre allocate flows */
     for (i = 0; i < flow_config.prealloc; i++) {
         if (!(FLOW_CHECK_MEMCAP(sizeof(Flow) + FlowStorageSize()))) {
@@ -671,6 +689,9 @@ void FlowShutdown(void)
 
     FlowPrintStats();
 
+    /* return the partitions' cached spare flows */
+    FlowPartitionsFree();
+
     /* free queues */
     while((f = FlowDequeue(&flow_spare_q))) {
         FlowFree(f);
@@ -702,6 +723,7 @@ void FlowShutdown(void)
         flow_hash = NULL;
     }
     (void) SC_ATOMIC_SUB(flow_memuse, flow_config.hash_size * sizeof(FlowBucket));
+    FlowWheelShutdown();
     FlowQueueDestroy(&flow_spare_q);
     FlowQueueDestroy(&flow_recycle_q);
 
@@ -1107,6 +1129,7 @@ void FlowUpdateState(Flow *f, enum FlowState s)
         /* and reset the flow buckup next_ts value so that the flow manager
          * has to revisit this row */
         SC_ATOMIC_SET(f->fb->next_ts, 0);
+        FlowWheelMarkRow((uint32_t)(f->fb - flow_hash));
     }
 }
 
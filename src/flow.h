@@ -272,6 +272,11 @@ typedef struct FlowCnf_
     uint32_t emerg_timeout_est;
     uint32_t emergency_recovery;
 
+    /** give each flow worker its own range of the flow hash */
+    int partitioned;
+    /** find timed out flows through a timing wheel of hash rows */
+    int timeout_wheel;
+
     SC_ATOMIC_DECLARE(uint64_t, memcap);
 } FlowConfig;
 
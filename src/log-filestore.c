@@ -613,6 +613,9 @@ static OutputInitResult LogFilestoreLogInitCtx(ConfNode *conf)
     output_ctx->data = NULL;
     output_ctx->DeInit = LogFilestoreLogDeInitCtx;
 
+    /* the meta files have the normalized uri */
+    AppLayerHtpNeedNormalizedUri();
+
     const char *s_default_log_dir = NULL;
     s_default_log_dir = ConfigGetLogDirectory();
 
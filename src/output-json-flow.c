@@ -64,16 +64,13 @@ typedef struct JsonFlowLogThread_ {
     MemBuffer *buffer;
 } JsonFlowLogThread;
 
-static json_t *CreateJSONHeaderFromFlow(const Flow *f, const char *event_type)
+static void CreateJBHeaderFromFlow(JsonBuilder *jb, const Flow *f,
+        const char *event_type)
 {
     char timebuf[64];
     char srcip[46] = {0}, dstip[46] = {0};
     Port sp, dp;
 
-    json_t *js = json_object();
-    if (unlikely(js == NULL))
-        return NULL;
-
     struct timeval tv;
     memset(&tv, 0x00, sizeof(tv));
     TimeGet(&tv);
@@ -110,73 +107,68 @@ static json_t *CreateJSONHeaderFromFlow(const Flow *f, const char *event_type)
     }
 
     /* time */
-    json_object_set_new(js, "timestamp", json_string(timebuf));
+    JsonBuilderSetString(jb, "timestamp", timebuf);
 
-    CreateJSONFlowId(js, (const Flow *)f);
+    CreateJBFlowId(jb, (const Flow *)f);
 
 #if 0 // TODO
     /* sensor id */
     if (sensor_id >= 0)
-        json_object_set_new(js, "sensor_id", json_integer(sensor_id));
+        JsonBuilderSetInt(jb, "sensor_id", sensor_id);
 #endif
 
     /* input interface */
     if (f->livedev) {
-        json_object_set_new(js, "in_iface", json_string(f->livedev->dev));
+        JsonBuilderSetString(jb, "in_iface", f->livedev->dev);
     }
 
     if (event_type) {
-        json_object_set_new(js, "event_type", json_string(event_type));
+        JsonBuilderSetString(jb, "event_type", event_type);
     }
 
     /* vlan */
     if (f->vlan_idx > 0) {
-        json_t *js_vlan = json_array();
-        json_array_append_new(js_vlan, json_integer(f->vlan_id[0]));
+        JsonBuilderOpenArray(jb, "vlan");
+        JsonBuilderSetUint(jb, NULL, f->vlan_id[0]);
         if (f->vlan_idx > 1) {
-            json_array_append_new(js_vlan, json_integer(f->vlan_id[1]));
+            JsonBuilderSetUint(jb, NULL, f->vlan_id[1]);
         }
-        json_object_set_new(js, "vlan", js_vlan);
+        JsonBuilderCloseArray(jb);
     }
 
     /* tuple */
-    json_object_set_new(js, "src_ip", json_string(srcip));
+    JsonBuilderSetString(jb, "src_ip", srcip);
     switch(f->proto) {
         case IPPROTO_ICMP:
             break;
         case IPPROTO_UDP:
         case IPPROTO_TCP:
         case IPPROTO_SCTP:
-            json_object_set_new(js, "src_port", json_integer(sp));
+            JsonBuilderSetUint(jb, "src_port", sp);
             break;
     }
-    json_object_set_new(js, "dest_ip", json_string(dstip));
+    JsonBuilderSetString(jb, "dest_ip", dstip);
     switch(f->proto) {
         case IPPROTO_ICMP:
             break;
         case IPPROTO_UDP:
         case IPPROTO_TCP:
         case IPPROTO_SCTP:
-            json_object_set_new(js, "dest_port", json_integer(dp));
+            JsonBuilderSetUint(jb, "dest_port", dp);
             break;
     }
-    json_object_set_new(js, "proto", json_string(proto));
+    JsonBuilderSetString(jb, "proto", proto);
     switch (f->proto) {
         case IPPROTO_ICMP:
         case IPPROTO_ICMPV6:
-            json_object_set_new(js, "icmp_type",
-                    json_integer(f->icmp_s.type));
-            json_object_set_new(js, "icmp_code",
-                    json_integer(f->icmp_s.code));
+            JsonBuilderSetUint(jb, "icmp_type", f->icmp_s.type);
+            JsonBuilderSetUint(jb, "icmp_code", f->icmp_s.code);
             if (f->tosrcpktcnt) {
-                json_object_set_new(js, "response_icmp_type",
-                        json_integer(f->icmp_d.type));
-                json_object_set_new(js, "response_icmp_code",
-                        json_integer(f->icmp_d.code));
+                JsonBuilderSetUint(jb, "response_icmp_type", f->icmp_d.type);
+                JsonBuilderSetUint(jb, "response_icmp_code", f->icmp_d.code);
             }
             break;
     }
-    return js;
 }
 
 void JsonAddFlow(Flow *f, json_t *js, json_t *hjs)
@@ -238,27 +230,105 @@ void JsonAddFlow(Flow *f, json_t *js, json_t *hjs)
     json_object_set_new(hjs, "start", json_string(timebuf1));
 }
 
-/* JSON format logging */
-static void JsonFlowLogJSON(JsonFlowLogThread *aft, json_t *js, Flow *f)
+/** \internal
+ *  \brief JSON builder version of the app_proto part of JsonAddFlow() */
+static void JBAddFlowAppProto(const Flow *f, JsonBuilder *jb)
+{
+    JsonBuilderSetString(jb, "app_proto", AppProtoToString(f->alproto));
+    if (f->alproto_ts != f->alproto) {
+        JsonBuilderSetString(jb, "app_proto_ts", AppProtoToString(f->alproto_ts));
+    }
+    if (f->alproto_tc != f->alproto) {
+        JsonBuilderSetString(jb, "app_proto_tc", AppProtoToString(f->alproto_tc));
+    }
+    if (f->alproto_orig != f->alproto && f->alproto_orig != ALPROTO_UNKNOWN) {
+        JsonBuilderSetString(jb, "app_proto_orig", AppProtoToString(f->alproto_orig));
+    }
+    if (f->alproto_expect != f->alproto && f->alproto_expect != ALPROTO_UNKNOWN) {
+        JsonBuilderSetString(jb, "app_proto_expected", AppProtoToString(f->alproto_expect));
+    }
+}
+
+/** \internal
+ *  \brief JSON builder version of the "flow" object part of JsonAddFlow() */
+static void JBAddFlowCounters(Flow *f, JsonBuilder *jb)
 {
-    LogJsonFileCtx *flow_ctx = aft->flowlog_ctx;
-    json_t *hjs = json_object();
-    if (hjs == NULL) {
-        return;
+    /* storage is not registered in all setups, e.g. unittests */
+    const int bypass_id = GetFlowBypassInfoID();
+    FlowBypassInfo *fc = bypass_id >= 0 ? FlowGetStorageById(f, bypass_id) : NULL;
+    if (fc) {
+        JsonBuilderSetUint(jb, "pkts_toserver", f->todstpktcnt + fc->todstpktcnt);
+        JsonBuilderSetUint(jb, "pkts_toclient", f->tosrcpktcnt + fc->tosrcpktcnt);
+        JsonBuilderSetUint(jb, "bytes_toserver", f->todstbytecnt + fc->todstbytecnt);
+        JsonBuilderSetUint(jb, "bytes_toclient", f->tosrcbytecnt + fc->tosrcbytecnt);
+        JsonBuilderOpenObject(jb, "bypassed");
+        JsonBuilderSetUint(jb, "pkts_toserver", fc->todstpktcnt);
+        JsonBuilderSetUint(jb, "pkts_toclient", fc->tosrcpktcnt);
+        JsonBuilderSetUint(jb, "bytes_toserver", fc->todstbytecnt);
+        JsonBuilderSetUint(jb, "bytes_toclient", fc->tosrcbytecnt);
+        JsonBuilderCloseObject(jb);
+    } else {
+        JsonBuilderSetUint(jb, "pkts_toserver", f->todstpktcnt);
+        JsonBuilderSetUint(jb, "pkts_toclient", f->tosrcpktcnt);
+        JsonBuilderSetUint(jb, "bytes_toserver", f->todstbytecnt);
+        JsonBuilderSetUint(jb, "bytes_toclient", f->tosrcbytecnt);
     }
 
-    JsonAddFlow(f, js, hjs);
+    char timebuf1[64];
+    CreateIsoTimeString(&f->startts, timebuf1, sizeof(timebuf1));
+    JsonBuilderSetString(jb, "start", timebuf1);
+}
+
+static const char *TcpStateToString(const uint8_t state)
+{
+    switch (state) {
+        case TCP_NONE:
+            return "none";
+        case TCP_LISTEN:
+            return "listen";
+        case TCP_SYN_SENT:
+            return "syn_sent";
+        case TCP_SYN_RECV:
+            return "syn_recv";
+        case TCP_ESTABLISHED:
+            return "established";
+        case TCP_FIN_WAIT1:
+            return "fin_wait1";
+        case TCP_FIN_WAIT2:
+            return "fin_wait2";
+        case TCP_TIME_WAIT:
+            return "time_wait";
+        case TCP_LAST_ACK:
+            return "last_ack";
+        case TCP_CLOSE_WAIT:
+            return "close_wait";
+        case TCP_CLOSING:
+            return "closing";
+        case TCP_CLOSED:
+            return "closed";
+    }
+    return NULL;
+}
+
+/* JSON format logging */
+static void JsonFlowLogJSON(const LogJsonFileCtx *flow_ctx, JsonBuilder *jb, Flow *f)
+{
+    CreateJBHeaderFromFlow(jb, f, "flow");
+
+    JBAddFlowAppProto(f, jb);
+
+    JsonBuilderOpenObject(jb, "flow");
+    JBAddFlowCounters(f, jb);
 
     char timebuf2[64];
     CreateIsoTimeString(&f->lastts, timebuf2, sizeof(timebuf2));
-    json_object_set_new(hjs, "end", json_string(timebuf2));
+    JsonBuilderSetString(jb, "end", timebuf2);
 
     int32_t age = f->lastts.tv_sec - f->startts.tv_sec;
-    json_object_set_new(hjs, "age",
-            json_integer(age));
+    JsonBuilderSetInt(jb, "age", age);
 
     if (f->flow_end_flags & FLOW_END_FLAG_EMERGENCY)
-        json_object_set_new(hjs, "emergency", json_true());
+        JsonBuilderSetBool(jb, "emergency", true);
     const char *state = NULL;
     if (f->flow_end_flags & FLOW_END_FLAG_STATE_NEW)
         state = "new";
@@ -271,12 +341,10 @@ static void JsonFlowLogJSON(JsonFlowLogThread *aft, json_t *js, Flow *f)
         int flow_state = SC_ATOMIC_GET(f->flow_state);
         switch (flow_state) {
             case FLOW_STATE_LOCAL_BYPASSED:
-                json_object_set_new(hjs, "bypass",
-                        json_string("local"));
+                JsonBuilderSetString(jb, "bypass", "local");
                 break;
             case FLOW_STATE_CAPTURE_BYPASSED:
-                json_object_set_new(hjs, "bypass",
-                        json_string("capture"));
+                JsonBuilderSetString(jb, "bypass", "capture");
                 break;
             default:
                 SCLogError(SC_ERR_INVALID_VALUE,
@@ -285,8 +353,8 @@ static void JsonFlowLogJSON(JsonFlowLogThread *aft, json_t *js, Flow *f)
         }
     }
 
-    json_object_set_new(hjs, "state",
-            json_string(state));
+    if (state != NULL)
+        JsonBuilderSetString(jb, "state", state);
 
     const char *reason = NULL;
     if (f->flow_end_flags & FLOW_END_FLAG_TIMEOUT)
@@ -296,89 +364,49 @@ static void JsonFlowLogJSON(JsonFlowLogThread *aft, json_t *js, Flow *f)
     else if (f->flow_end_flags & FLOW_END_FLAG_SHUTDOWN)
         reason = "shutdown";
 
-    json_object_set_new(hjs, "reason",
-            json_string(reason));
+    if (reason != NULL)
+        JsonBuilderSetString(jb, "reason", reason);
 
-    json_object_set_new(hjs, "alerted", json_boolean(FlowHasAlerts(f)));
+    JsonBuilderSetBool(jb, "alerted", FlowHasAlerts(f));
     if (f->flags & FLOW_WRONG_THREAD)
-        json_object_set_new(hjs, "wrong_thread", json_true());
+        JsonBuilderSetBool(jb, "wrong_thread", true);
 
-    json_object_set_new(js, "flow", hjs);
+    JsonBuilderCloseObject(jb);
 
-    JsonAddCommonOptions(&flow_ctx->cfg, NULL, f, js);
+    JBAddCommonOptions(&flow_ctx->cfg, NULL, f, jb);
 
     /* TCP */
     if (f->proto == IPPROTO_TCP) {
-        json_t *tjs = json_object();
-        if (tjs == NULL) {
-            return;
-        }
+        JsonBuilderOpenObject(jb, "tcp");
 
         TcpSession *ssn = f->protoctx;
 
         char hexflags[3];
         snprintf(hexflags, sizeof(hexflags), "%02x",
                 ssn ? ssn->tcp_packet_flags : 0);
-        json_object_set_new(tjs, "tcp_flags", json_string(hexflags));
+        JsonBuilderSetString(jb, "tcp_flags", hexflags);
 
         snprintf(hexflags, sizeof(hexflags), "%02x",
                 ssn ? ssn->client.tcp_flags : 0);
-        json_object_set_new(tjs, "tcp_flags_ts", json_string(hexflags));
+        JsonBuilderSetString(jb, "tcp_flags_ts", hexflags);
 
         snprintf(hexflags, sizeof(hexflags), "%02x",
                 ssn ? ssn->server.tcp_flags : 0);
-        json_object_set_new(tjs, "tcp_flags_tc", json_string(hexflags));
+        JsonBuilderSetString(jb, "tcp_flags_tc", hexflags);
 
-        JsonTcpFlags(ssn ? ssn->tcp_packet_flags : 0, tjs);
+        JBTcpFlags(ssn ? ssn->tcp_packet_flags : 0, jb);
 
         if (ssn) {
-            const char *tcp_state = NULL;
-            switch (ssn->state) {
-                case TCP_NONE:
-                    tcp_state = "none";
-                    break;
-                case TCP_LISTEN:
-                    tcp_state = "listen";
-                    break;
-                case TCP_SYN_SENT:
-                    tcp_state = "syn_sent";
-                    break;
-                case TCP_SYN_RECV:
-                    tcp_state = "syn_recv";
-                    break;
-                case TCP_ESTABLISHED:
-                    tcp_state = "established";
-                    break;
-                case TCP_FIN_WAIT1:
-                    tcp_state = "fin_wait1";
-                    break;
-                case TCP_FIN_WAIT2:
-                    tcp_state = "fin_wait2";
-                    break;
-                case TCP_TIME_WAIT:
-                    tcp_state = "time_wait";
-                    break;
-                case TCP_LAST_ACK:
-                    tcp_state = "last_ack";
-                    break;
-                case TCP_CLOSE_WAIT:
-                    tcp_state = "close_wait";
-                    break;
-                case TCP_CLOSING:
-                    tcp_state = "closing";
-                    break;
-                case TCP_CLOSED:
-                    tcp_state = "closed";
-                    break;
-            }
-            json_object_set_new(tjs, "state", json_string(tcp_state));
+            const char *tcp_state = TcpStateToString(ssn->state);
+            if (tcp_state != NULL)
+                JsonBuilderSetString(jb, "state", tcp_state);
             if (ssn->client.flags & STREAMTCP_STREAM_FLAG_GAP)
-                json_object_set_new(tjs, "gap_ts", json_true());
+                JsonBuilderSetBool(jb, "gap_ts", true);
             if (ssn->server.flags & STREAMTCP_STREAM_FLAG_GAP)
-                json_object_set_new(tjs, "gap_tc", json_true());
+                JsonBuilderSetBool(jb, "gap_tc", true);
         }
 
-        json_object_set_new(js, "tcp", tjs);
+        JsonBuilderCloseObject(jb);
     }
 }
 
@@ -386,21 +414,12 @@ static int JsonFlowLogger(ThreadVars *tv, void *thread_data, Flow *f)
 {
     SCEnter();
     JsonFlowLogThread *jhl = (JsonFlowLogThread *)thread_data;
+    LogJsonFileCtx *flow_ctx = jhl->flowlog_ctx;
+    JsonBuilder jb;
 
-    /* reset */
-    MemBufferReset(jhl->buffer);
-
-    json_t *js = CreateJSONHeaderFromFlow(f, "flow");
-    if (unlikely(js == NULL))
-        return TM_ECODE_OK;
-
-    JsonFlowLogJSON(jhl, js, f);
-
-    OutputJSONBuffer(js, jhl->flowlog_ctx->file_ctx, &jhl->buffer);
-    json_object_del(js, "http");
-
-    json_object_clear(js);
-    json_decref(js);
+    OutputJsonBuilderStart(&jb, flow_ctx->file_ctx, &jhl->buffer);
+    JsonFlowLogJSON(flow_ctx, &jb, f);
+    OutputJsonBuilderBuffer(&jb, flow_ctx->file_ctx);
 
     SCReturnInt(TM_ECODE_OK);
 }
@@ -539,6 +558,123 @@ void JsonFlowLogRegister (void)
         JsonFlowLogThreadInit, JsonFlowLogThreadDeinit, NULL);
 }
 
+#ifdef UNITTESTS
+#include "util-unittest-helper.h"
+
+/** \test flow record built with the JSON builder is valid JSON with the
+ *        fields in the expected order */
+static int JsonFlowLogTest01(void)
+{
+    struct timeval tv = { .tv_sec = 1546300900, .tv_usec = 0 };
+    TimeSet(&tv);
+
+    Flow *f = UTHBuildFlow(AF_INET, "192.168.1.5", "10.0.0.1", 41424, 80);
+    FAIL_IF_NULL(f);
+    f->proto = IPPROTO_TCP;
+    f->todstpktcnt = 3;
+    f->tosrcpktcnt = 2;
+    f->todstbytecnt = 300;
+    f->tosrcbytecnt = 200;
+    f->startts.tv_sec = 1546300800;
+    f->lastts.tv_sec = 1546300860;
+    f->flow_end_flags = FLOW_END_FLAG_TIMEOUT|FLOW_END_FLAG_STATE_ESTABLISHED;
+
+    LogJsonFileCtx flow_ctx;
+    memset(&flow_ctx, 0, sizeof(flow_ctx));
+
+    MemBuffer *buffer = MemBufferCreateNew(JSON_OUTPUT_BUFFER_SIZE);
+    FAIL_IF_NULL(buffer);
+    JsonBuilder jb;
+    JsonBuilderInit(&jb, &buffer);
+    JsonFlowLogJSON(&flow_ctx, &jb, f);
+    FAIL_IF(JsonBuilderFinish(&jb) != 0);
+
+    json_error_t error;
+    json_t *js = json_loadb((const char *)MEMBUFFER_BUFFER(buffer),
+            MEMBUFFER_OFFSET(buffer), 0, &error);
+    FAIL_IF_NULL(js);
+
+    FAIL_IF(strcmp(json_string_value(json_object_get(js, "event_type")), "flow") != 0);
+    FAIL_IF(strcmp(json_string_value(json_object_get(js, "src_ip")), "192.168.1.5") != 0);
+    FAIL_IF(json_integer_value(json_object_get(js, "dest_port")) != 80);
+    FAIL_IF(strcmp(json_string_value(json_object_get(js, "proto")), "TCP") != 0);
+    json_t *hjs = json_object_get(js, "flow");
+    FAIL_IF_NULL(hjs);
+    FAIL_IF(json_integer_value(json_object_get(hjs, "pkts_toserver")) != 3);
+    FAIL_IF(json_integer_value(json_object_get(hjs, "bytes_toclient")) != 200);
+    FAIL_IF(json_integer_value(json_object_get(hjs, "age")) != 60);
+    FAIL_IF(strcmp(json_string_value(json_object_get(hjs, "state")), "established") != 0);
+    FAIL_IF(strcmp(json_string_value(json_object_get(hjs, "reason")), "timeout") != 0);
+    FAIL_IF(!json_is_false(json_object_get(hjs, "alerted")));
+    json_t *tjs = json_object_get(js, "tcp");
+    FAIL_IF_NULL(tjs);
+    FAIL_IF(strcmp(json_string_value(json_object_get(tjs, "tcp_flags")), "00") != 0);
+    json_decref(js);
+
+    /* same key order as the jansson based logger used */
+    const char *out = (const char *)MEMBUFFER_BUFFER(buffer);
+    FAIL_IF(strncmp(out, "{\"timestamp\":", 13) != 0);
+    const char *order[] = { "\"flow_id\":", "\"event_type\":", "\"src_ip\":",
+        "\"src_port\":", "\"dest_ip\":", "\"dest_port\":", "\"proto\":",
+        "\"app_proto\":", "\"flow\":", "\"tcp\":", NULL };
+    const char *prev = out;
+    for (int i = 0; order[i] != NULL; i++) {
+        const char *cur = strstr(out, order[i]);
+        FAIL_IF_NULL(cur);
+        FAIL_IF(cur < prev);
+        prev = cur;
+    }
+
+    MemBufferFree(buffer);
+    UTHFreeFlow(f);
+    PASS;
+}
+
+/** \test flow record honours the eve-log 'json' flags */
+static int JsonFlowLogTest02(void)
+{
+    Flow *f = UTHBuildFlow(AF_INET, "192.168.1.5", "10.0.0.1", 41424, 80);
+    FAIL_IF_NULL(f);
+    f->proto = IPPROTO_UDP;
+
+    /* json: compact: no */
+    LogFileCtx file_ctx;
+    memset(&file_ctx, 0, sizeof(file_ctx));
+    file_ctx.json_flags = JSON_PRESERVE_ORDER|JSON_ENSURE_ASCII|JSON_ESCAPE_SLASH;
+
+    LogJsonFileCtx flow_ctx;
+    memset(&flow_ctx, 0, sizeof(flow_ctx));
+    flow_ctx.file_ctx = &file_ctx;
+
+    MemBuffer *buffer = MemBufferCreateNew(JSON_OUTPUT_BUFFER_SIZE);
+    FAIL_IF_NULL(buffer);
+    JsonBuilder jb;
+    OutputJsonBuilderStart(&jb, &file_ctx, &buffer);
+    JsonFlowLogJSON(&flow_ctx, &jb, f);
+    FAIL_IF(JsonBuilderFinish(&jb) != 0);
+
+    const char *out = (const char *)MEMBUFFER_BUFFER(buffer);
+    FAIL_IF(strncmp(out, "{\"timestamp\": \"", 15) != 0);
+    FAIL_IF_NULL(strstr(out, ", \"src_ip\": \"192.168.1.5\", \"src_port\": 41424, "));
+    FAIL_IF_NULL(strstr(out, ", \"flow\": {\"pkts_toserver\": 0, "));
+    FAIL_IF_NOT_NULL(strstr(out, "\":\""));
+
+    /* same record as jansson writes with these flags */
+    json_error_t error;
+    json_t *js = json_loadb(out, MEMBUFFER_OFFSET(buffer), 0, &error);
+    FAIL_IF_NULL(js);
+    char *expected = json_dumps(js, file_ctx.json_flags);
+    FAIL_IF_NULL(expected);
+    FAIL_IF(strcmp(expected, out) != 0);
+    free(expected);
+    json_decref(js);
+
+    MemBufferFree(buffer);
+    UTHFreeFlow(f);
+    PASS;
+}
+#endif /* UNITTESTS */
+
 #else
 
 void JsonFlowLogRegister (void)
@@ -546,3 +682,11 @@ void JsonFlowLogRegister (void)
 }
 
 #endif
+
+void JsonFlowLogRegisterTests(void)
+{
+#if defined(UNITTESTS) && defined(HAVE_LIBJANSSON)
+    UtRegisterTest("JsonFlowLogTest01", JsonFlowLogTest01);
+    UtRegisterTest("JsonFlowLogTest02", JsonFlowLogTest02);
+#endif
+}
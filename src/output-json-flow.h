@@ -25,6 +25,7 @@
 #define __OUTPUT_JSON_FLOW_H__
 
 void JsonFlowLogRegister(void);
+void JsonFlowLogRegisterTests(void);
 #ifdef HAVE_LIBJANSSON
 void JsonAddFlow(Flow *f, json_t *js, json_t *hjs);
 #endif /* HAVE_LIBJANSSON */
@@ -91,6 +91,19 @@ static json_t *EngineStats2Json(const DetectEngineCtx *de_ctx,
         last_reload = de_ctx->last_reload;
         CreateIsoTimeString(&last_reload, timebuf, sizeof(timebuf));
         json_object_set_new(jdata, "last_reload", json_string(timebuf));
+
+        const DetectEngineReloadStats *rs = &de_ctx->reload_stats;
+        json_object_set_new(jdata, "reload_time_ms", json_integer(rs->time_ms));
+        json_object_set_new(jdata, "mpm_contexts_reused",
+                            json_integer(rs->mpm_reused));
+        json_object_set_new(jdata, "mpm_contexts_built",
+                            json_integer(rs->mpm_built));
+        json_object_set_new(jdata, "mpm_memory_reused",
+                            json_integer(rs->mpm_memory_reused));
+        json_object_set_new(jdata, "mpm_memory_built",
+                            json_integer(rs->mpm_memory_built));
+        json_object_set_new(jdata, "mpm_memory_delta",
+                            json_integer(rs->mpm_memory_delta));
     }
 
     sig_stat = &de_ctx->sig_stat;
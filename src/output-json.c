@@ -55,6 +55,7 @@
 #include "util-proto-name.h"
 #include "util-optimize.h"
 #include "util-buffer.h"
+#include "util-json-builder.h"
 #include "util-logopenfile.h"
 #include "util-log-redis.h"
 #include "util-device.h"
@@ -460,137 +461,205 @@ void JsonTcpFlags(uint8_t flags, json_t *js)
         json_object_set_new(js, "cwr", json_true());
 }
 
+/** \brief add tcp flags to a JSON builder
+ *  Only add 'true' fields in an attempt to keep things reasonably compact.
+ */
+void JBTcpFlags(uint8_t flags, JsonBuilder *jb)
+{
+    if (flags & TH_SYN)
+        JsonBuilderSetBool(jb, "syn", true);
+    if (flags & TH_FIN)
+        JsonBuilderSetBool(jb, "fin", true);
+    if (flags & TH_RST)
+        JsonBuilderSetBool(jb, "rst", true);
+    if (flags & TH_PUSH)
+        JsonBuilderSetBool(jb, "psh", true);
+    if (flags & TH_ACK)
+        JsonBuilderSetBool(jb, "ack", true);
+    if (flags & TH_URG)
+        JsonBuilderSetBool(jb, "urg", true);
+    if (flags & TH_ECN)
+        JsonBuilderSetBool(jb, "ecn", true);
+    if (flags & TH_CWR)
+        JsonBuilderSetBool(jb, "cwr", true);
+}
+
+/** five tuple as it is logged */
+typedef struct JsonFiveTupleData_ {
+    char srcip[46];
+    char dstip[46];
+    Port sp;
+    Port dp;
+    char proto[16];
+} JsonFiveTupleData;
+
 /**
- * \brief Add five tuple from packet to JSON object
+ * \brief Get the five tuple of a packet in log direction
  *
  * \param p Packet
  * \param dir log direction (packet or flow)
- * \param js JSON object
+ * \param t five tuple to fill
+ *
+ * \retval true if the five tuple should be logged
  */
-void JsonFiveTuple(const Packet *p, enum OutputJsonLogDirection dir, json_t *js)
+static bool JsonGetFiveTuple(const Packet *p, enum OutputJsonLogDirection dir,
+        JsonFiveTupleData *t)
 {
-    char srcip[46] = {0}, dstip[46] = {0};
-    Port sp, dp;
-    char proto[16];
+    memset(t->srcip, 0, sizeof(t->srcip));
+    memset(t->dstip, 0, sizeof(t->dstip));
 
     switch (dir) {
         case LOG_DIR_PACKET:
             if (PKT_IS_IPV4(p)) {
                 PrintInet(AF_INET, (const void *)GET_IPV4_SRC_ADDR_PTR(p),
-                        srcip, sizeof(srcip));
+                        t->srcip, sizeof(t->srcip));
                 PrintInet(AF_INET, (const void *)GET_IPV4_DST_ADDR_PTR(p),
-                        dstip, sizeof(dstip));
+                        t->dstip, sizeof(t->dstip));
             } else if (PKT_IS_IPV6(p)) {
                 PrintInet(AF_INET6, (const void *)GET_IPV6_SRC_ADDR(p),
-                        srcip, sizeof(srcip));
+                        t->srcip, sizeof(t->srcip));
                 PrintInet(AF_INET6, (const void *)GET_IPV6_DST_ADDR(p),
-                        dstip, sizeof(dstip));
+                        t->dstip, sizeof(t->dstip));
             } else {
                 /* Not an IP packet so don't do anything */
-                return;
+                return false;
             }
-            sp = p->sp;
-            dp = p->dp;
+            t->sp = p->sp;
+            t->dp = p->dp;
             break;
         case LOG_DIR_FLOW:
         case LOG_DIR_FLOW_TOSERVER:
             if ((PKT_IS_TOSERVER(p))) {
                 if (PKT_IS_IPV4(p)) {
                     PrintInet(AF_INET, (const void *)GET_IPV4_SRC_ADDR_PTR(p),
-                            srcip, sizeof(srcip));
+                            t->srcip, sizeof(t->srcip));
                     PrintInet(AF_INET, (const void *)GET_IPV4_DST_ADDR_PTR(p),
-                            dstip, sizeof(dstip));
+                            t->dstip, sizeof(t->dstip));
                 } else if (PKT_IS_IPV6(p)) {
                     PrintInet(AF_INET6, (const void *)GET_IPV6_SRC_ADDR(p),
-                            srcip, sizeof(srcip));
+                            t->srcip, sizeof(t->srcip));
                     PrintInet(AF_INET6, (const void *)GET_IPV6_DST_ADDR(p),
-                            dstip, sizeof(dstip));
+                            t->dstip, sizeof(t->dstip));
                 }
-                sp = p->sp;
-                dp = p->dp;
+                t->sp = p->sp;
+                t->dp = p->dp;
             } else {
                 if (PKT_IS_IPV4(p)) {
                     PrintInet(AF_INET, (const void *)GET_IPV4_DST_ADDR_PTR(p),
-                            srcip, sizeof(srcip));
+                            t->srcip, sizeof(t->srcip));
                     PrintInet(AF_INET, (const void *)GET_IPV4_SRC_ADDR_PTR(p),
-                            dstip, sizeof(dstip));
+                            t->dstip, sizeof(t->dstip));
                 } else if (PKT_IS_IPV6(p)) {
                     PrintInet(AF_INET6, (const void *)GET_IPV6_DST_ADDR(p),
-                            srcip, sizeof(srcip));
+                            t->srcip, sizeof(t->srcip));
                     PrintInet(AF_INET6, (const void *)GET_IPV6_SRC_ADDR(p),
-                            dstip, sizeof(dstip));
+                            t->dstip, sizeof(t->dstip));
                 }
-                sp = p->dp;
-                dp = p->sp;
+                t->sp = p->dp;
+                t->dp = p->sp;
             }
             break;
         case LOG_DIR_FLOW_TOCLIENT:
             if ((PKT_IS_TOCLIENT(p))) {
                 if (PKT_IS_IPV4(p)) {
                     PrintInet(AF_INET, (const void *)GET_IPV4_SRC_ADDR_PTR(p),
-                            srcip, sizeof(srcip));
+                            t->srcip, sizeof(t->srcip));
                     PrintInet(AF_INET, (const void *)GET_IPV4_DST_ADDR_PTR(p),
-                            dstip, sizeof(dstip));
+                            t->dstip, sizeof(t->dstip));
                 } else if (PKT_IS_IPV6(p)) {
                     PrintInet(AF_INET6, (const void *)GET_IPV6_SRC_ADDR(p),
-                            srcip, sizeof(srcip));
+                            t->srcip, sizeof(t->srcip));
                     PrintInet(AF_INET6, (const void *)GET_IPV6_DST_ADDR(p),
-                            dstip, sizeof(dstip));
+                            t->dstip, sizeof(t->dstip));
                 }
-                sp = p->sp;
-                dp = p->dp;
+                t->sp = p->sp;
+                t->dp = p->dp;
             } else {
                 if (PKT_IS_IPV4(p)) {
                     PrintInet(AF_INET, (const void *)GET_IPV4_DST_ADDR_PTR(p),
-                            srcip, sizeof(srcip));
+                            t->srcip, sizeof(t->srcip));
                     PrintInet(AF_INET, (const void *)GET_IPV4_SRC_ADDR_PTR(p),
-                            dstip, sizeof(dstip));
+                            t->dstip, sizeof(t->dstip));
                 } else if (PKT_IS_IPV6(p)) {
                     PrintInet(AF_INET6, (const void *)GET_IPV6_DST_ADDR(p),
-                            srcip, sizeof(srcip));
+                            t->srcip, sizeof(t->srcip));
                     PrintInet(AF_INET6, (const void *)GET_IPV6_SRC_ADDR(p),
-                            dstip, sizeof(dstip));
+                            t->dstip, sizeof(t->dstip));
                 }
-                sp = p->dp;
-                dp = p->sp;
+                t->sp = p->dp;
+                t->dp = p->sp;
             }
             break;
         default:
             DEBUG_VALIDATE_BUG_ON(1);
-            return;
+            return false;
     }
 
     if (SCProtoNameValid(IP_GET_IPPROTO(p)) == TRUE) {
-        strlcpy(proto, known_proto[IP_GET_IPPROTO(p)], sizeof(proto));
+        strlcpy(t->proto, known_proto[IP_GET_IPPROTO(p)], sizeof(t->proto));
     } else {
-        snprintf(proto, sizeof(proto), "%03" PRIu32, IP_GET_IPPROTO(p));
+        snprintf(t->proto, sizeof(t->proto), "%03" PRIu32, IP_GET_IPPROTO(p));
     }
 
-    json_object_set_new(js, "src_ip", json_string(srcip));
+    return true;
+}
 
+/** \brief check if the ports of a packet's protocol are logged */
+static inline bool JsonProtoHasPorts(const Packet *p)
+{
     switch(p->proto) {
-        case IPPROTO_ICMP:
-            break;
         case IPPROTO_UDP:
         case IPPROTO_TCP:
         case IPPROTO_SCTP:
-            json_object_set_new(js, "src_port", json_integer(sp));
-            break;
+            return true;
     }
+    return false;
+}
 
-    json_object_set_new(js, "dest_ip", json_string(dstip));
+/**
+ * \brief Add five tuple from packet to JSON object
+ *
+ * \param p Packet
+ * \param dir log direction (packet or flow)
+ * \param js JSON object
+ */
+void JsonFiveTuple(const Packet *p, enum OutputJsonLogDirection dir, json_t *js)
+{
+    JsonFiveTupleData t;
 
-    switch(p->proto) {
-        case IPPROTO_ICMP:
-            break;
-        case IPPROTO_UDP:
-        case IPPROTO_TCP:
-        case IPPROTO_SCTP:
-            json_object_set_new(js, "dest_port", json_integer(dp));
-            break;
-    }
+    if (!JsonGetFiveTuple(p, dir, &t))
+        return;
+
+    json_object_set_new(js, "src_ip", json_string(t.srcip));
+    if (JsonProtoHasPorts(p))
+        json_object_set_new(js, "src_port", json_integer(t.sp));
+    json_object_set_new(js, "dest_ip", json_string(t.dstip));
+    if (JsonProtoHasPorts(p))
+        json_object_set_new(js, "dest_port", json_integer(t.dp));
+    json_object_set_new(js, "proto", json_string(t.proto));
+}
+
+/**
+ * \brief Add five tuple from packet to a JSON builder
+ *
+ * \param p Packet
+ * \param dir log direction (packet or flow)
+ * \param jb JSON builder with an open object
+ */
+void JBFiveTuple(const Packet *p, enum OutputJsonLogDirection dir, JsonBuilder *jb)
+{
+    JsonFiveTupleData t;
+
+    if (!JsonGetFiveTuple(p, dir, &t))
+        return;
 
-    json_object_set_new(js, "proto", json_string(proto));
+    JsonBuilderSetString(jb, "src_ip", t.srcip);
+    if (JsonProtoHasPorts(p))
+        JsonBuilderSetUint(jb, "src_port", t.sp);
+    JsonBuilderSetString(jb, "dest_ip", t.dstip);
+    if (JsonProtoHasPorts(p))
+        JsonBuilderSetUint(jb, "dest_port", t.dp);
+    JsonBuilderSetString(jb, "proto", t.proto);
 }
 
 static void CreateJSONCommunityFlowIdv4(json_t *js, const Flow *f,
@@ -808,6 +877,139 @@ json_t *CreateJSONHeaderWithTxId(const Packet *p, enum OutputJsonLogDirection di
     return js;
 }
 
+void CreateJBFlowId(JsonBuilder *jb, const Flow *f)
+{
+    if (f == NULL)
+        return;
+    JsonBuilderSetInt(jb, "flow_id", FlowGetId(f));
+    if (f->parent_id) {
+        JsonBuilderSetInt(jb, "parent_id", f->parent_id);
+    }
+}
+
+/**
+ * \brief Add the common header of an event to a JSON builder
+ *
+ * Same fields and order as CreateJSONHeader().
+ *
+ * \param jb JSON builder, as set up by OutputJsonBuilderStart()
+ */
+void CreateJBHeader(JsonBuilder *jb, const Packet *p,
+        enum OutputJsonLogDirection dir, const char *event_type)
+{
+    char timebuf[64];
+    const Flow *f = (const Flow *)p->flow;
+
+    CreateIsoTimeString(&p->ts, timebuf, sizeof(timebuf));
+
+    /* time & tx */
+    JsonBuilderSetString(jb, "timestamp", timebuf);
+
+    CreateJBFlowId(jb, f);
+
+    /* sensor id */
+    if (sensor_id >= 0)
+        JsonBuilderSetInt(jb, "sensor_id", sensor_id);
+
+    /* input interface */
+    if (p->livedev) {
+        JsonBuilderSetString(jb, "in_iface", p->livedev->dev);
+    }
+
+    /* pcap_cnt */
+    if (p->pcap_cnt != 0) {
+        JsonBuilderSetUint(jb, "pcap_cnt", p->pcap_cnt);
+    }
+
+    if (event_type) {
+        JsonBuilderSetString(jb, "event_type", event_type);
+    }
+
+    /* vlan */
+    if (p->vlan_idx > 0) {
+        JsonBuilderOpenArray(jb, "vlan");
+        JsonBuilderSetUint(jb, NULL, p->vlan_id[0]);
+        if (p->vlan_idx > 1) {
+            JsonBuilderSetUint(jb, NULL, p->vlan_id[1]);
+        }
+        JsonBuilderCloseArray(jb);
+    }
+
+    /* 5-tuple */
+    JBFiveTuple(p, dir, jb);
+
+    /* icmp */
+    switch (p->proto) {
+        case IPPROTO_ICMP:
+            if (p->icmpv4h) {
+                JsonBuilderSetUint(jb, "icmp_type", p->icmpv4h->type);
+                JsonBuilderSetUint(jb, "icmp_code", p->icmpv4h->code);
+            }
+            break;
+        case IPPROTO_ICMPV6:
+            if (p->icmpv6h) {
+                JsonBuilderSetUint(jb, "icmp_type", p->icmpv6h->type);
+                JsonBuilderSetUint(jb, "icmp_code", p->icmpv6h->code);
+            }
+            break;
+    }
+}
+
+void CreateJBHeaderWithTxId(JsonBuilder *jb, const Packet *p,
+        enum OutputJsonLogDirection dir, const char *event_type, uint64_t tx_id)
+{
+    CreateJBHeader(jb, p, dir, event_type);
+
+    /* tx id for correlation with other events */
+    JsonBuilderSetUint(jb, "tx_id", tx_id);
+}
+
+/** \internal
+ *  \brief jansson encoding flags for the output options of a builder */
+static size_t JsonBuilderJanssonFlags(const JsonBuilder *jb)
+{
+    size_t flags = JSON_PRESERVE_ORDER;
+    if (jb->flags & JSON_BUILDER_COMPACT)
+        flags |= JSON_COMPACT;
+    if (jb->flags & JSON_BUILDER_ENSURE_ASCII)
+        flags |= JSON_ENSURE_ASCII;
+    if (jb->flags & JSON_BUILDER_ESCAPE_SLASH)
+        flags |= JSON_ESCAPE_SLASH;
+    return flags;
+}
+
+/**
+ * \brief Add the metadata and community id options to a JSON builder
+ *
+ * Same fields and order as JsonAddCommonOptions(). They are still built
+ * with jansson and added as encoded JSON, so this allocates only when
+ * the options are enabled.
+ */
+void JBAddCommonOptions(const OutputJsonCommonSettings *cfg,
+        const Packet *p, const Flow *f, JsonBuilder *jb)
+{
+    if (!cfg->include_metadata && !(cfg->include_community_id && f != NULL))
+        return;
+
+    json_t *js = json_object();
+    if (unlikely(js == NULL))
+        return;
+    JsonAddCommonOptions(cfg, p, f, js);
+
+    static const char *keys[] = { "traffic", "metadata", "community_id", NULL };
+    for (int i = 0; keys[i] != NULL; i++) {
+        json_t *value = json_object_get(js, keys[i]);
+        if (value == NULL)
+            continue;
+        char *str = json_dumps(value, JsonBuilderJanssonFlags(jb)|JSON_ENCODE_ANY);
+        if (str != NULL) {
+            JsonBuilderSetRaw(jb, keys[i], str, (uint32_t)strlen(str));
+            free(str);
+        }
+    }
+    json_decref(js);
+}
+
 int OutputJSONMemBufferCallback(const char *str, size_t size, void *data)
 {
     OutputJSONMemBufferWrapper *wrapper = data;
@@ -850,6 +1052,62 @@ int OutputJSONBuffer(json_t *js, LogFileCtx *file_ctx, MemBuffer **buffer)
     return 0;
 }
 
+/**
+ * \brief Start a record built with a JSON builder
+ *
+ * The buffer is reset and the file's prefix is written to it, so
+ * the record is built in place and written as is by
+ * OutputJsonBuilderBuffer(). The file's 'json' options apply like
+ * they do for records built with jansson.
+ *
+ * \param jb JSON builder to set up
+ * \param buffer thread's output buffer, kept for the next record
+ */
+void OutputJsonBuilderStart(JsonBuilder *jb, LogFileCtx *file_ctx, MemBuffer **buffer)
+{
+    MemBufferReset(*buffer);
+
+    if (file_ctx->prefix) {
+        MemBufferWriteRaw((*buffer), file_ctx->prefix, file_ctx->prefix_len);
+    }
+
+    uint8_t flags = 0;
+    if (file_ctx->json_flags & JSON_COMPACT)
+        flags |= JSON_BUILDER_COMPACT;
+    if (file_ctx->json_flags & JSON_ENSURE_ASCII)
+        flags |= JSON_BUILDER_ENSURE_ASCII;
+    if (file_ctx->json_flags & JSON_ESCAPE_SLASH)
+        flags |= JSON_BUILDER_ESCAPE_SLASH;
+    JsonBuilderInitFlags(jb, buffer, flags);
+}
+
+/**
+ * \brief Finish a record started with OutputJsonBuilderStart() and
+ *        write it out
+ *
+ * Objects and arrays opened by the logger must be closed. Fields are
+ * written in the order they were added.
+ *
+ * \retval TM_ECODE_OK record written
+ * \retval TM_ECODE_FAILED record was not valid JSON and is dropped
+ */
+int OutputJsonBuilderBuffer(JsonBuilder *jb, LogFileCtx *file_ctx)
+{
+    if (file_ctx->sensor_name) {
+        JsonBuilderSetString(jb, "host", file_ctx->sensor_name);
+    }
+
+    if (file_ctx->is_pcap_offline) {
+        JsonBuilderSetString(jb, "pcap_filename", PcapFileGetFilename());
+    }
+
+    if (JsonBuilderFinish(jb) != 0)
+        return TM_ECODE_FAILED;
+
+    LogFileWrite(file_ctx, *jb->buffer);
+    return TM_ECODE_OK;
+}
+
 /**
  * \brief Create a new LogFileCtx for "fast" output style.
  * \param conf The configuration node for this output.
@@ -1010,7 +1268,13 @@ OutputInitResult OutputJsonInitCtx(ConfNode *conf)
                 return result;
             }
 
-            if (SCConfLogOpenRedis(redis_node, json_ctx->file_ctx) < 0) {
+            /* threaded: a connection per thread, see SCConfLogOpenGeneric */
+            int threaded = 0;
+            (void)ConfGetChildValueBool(conf, "threaded", &threaded);
+            int r = threaded ?
+                SCConfLogOpenGeneric(conf, json_ctx->file_ctx, DEFAULT_LOG_FILENAME, 1) :
+                SCConfLogOpenRedis(redis_node, json_ctx->file_ctx);
+            if (r < 0) {
                 LogFileFreeCtx(json_ctx->file_ctx);
                 SCFree(json_ctx);
                 SCFree(output_ctx);
@@ -1088,10 +1352,14 @@ static void OutputJsonDeInitCtx(OutputCtx *output_ctx)
 {
     OutputJsonCtx *json_ctx = (OutputJsonCtx *)output_ctx->data;
     LogFileCtx *logfile_ctx = json_ctx->file_ctx;
-    if (logfile_ctx->dropped) {
+    uint64_t dropped = logfile_ctx->dropped;
+    for (LogFileCtx *t = logfile_ctx->threads; t != NULL; t = t->threads_next) {
+        dropped += t->dropped;
+    }
+    if (dropped) {
         SCLogWarning(SC_WARN_EVENT_DROPPED,
                 "%"PRIu64" events were dropped due to slow or "
-                "disconnected socket", logfile_ctx->dropped);
+                "disconnected socket", dropped);
     }
     if (json_ctx->xff_cfg != NULL) {
         SCFree(json_ctx->xff_cfg);
@@ -1101,4 +1369,246 @@ static void OutputJsonDeInitCtx(OutputCtx *output_ctx)
     SCFree(output_ctx);
 }
 
+#ifdef UNITTESTS
+#include "util-cpu.h"
+
+#define JSON_BENCH_RUNS 100000
+#define JSON_BENCH_FLAGS JSON_BUILDER_FLAGS
+
+typedef int (*JsonBenchFunc)(const Packet *, MemBuffer **);
+
+static int JsonBenchDump(json_t *js, MemBuffer **buffer)
+{
+    OutputJSONMemBufferWrapper wrapper = {
+        .buffer = buffer,
+        .expand_by = JSON_OUTPUT_BUFFER_SIZE
+    };
+
+    MemBufferReset(*buffer);
+    int r = json_dump_callback(js, OutputJSONMemBufferCallback, &wrapper,
+            JSON_BENCH_FLAGS);
+    json_decref(js);
+    return r;
+}
+
+static int JsonBenchAlertJansson(const Packet *p, MemBuffer **buffer)
+{
+    json_t *js = CreateJSONHeader(p, LOG_DIR_PACKET, "alert");
+    if (js == NULL)
+        return -1;
+    json_object_set_new(js, "tx_id", json_integer(3));
+
+    json_t *ajs = json_object();
+    if (ajs == NULL) {
+        json_decref(js);
+        return -1;
+    }
+    json_object_set_new(ajs, "action", json_string("allowed"));
+    json_object_set_new(ajs, "gid", json_integer(1));
+    json_object_set_new(ajs, "signature_id", json_integer(2013028));
+    json_object_set_new(ajs, "rev", json_integer(4));
+    json_object_set_new(ajs, "signature",
+            SCJsonString("ET POLICY curl User-Agent Outbound \"/admin\""));
+    json_object_set_new(ajs, "category",
+            SCJsonString("Attempted Information Leak"));
+    json_object_set_new(ajs, "severity", json_integer(2));
+    json_object_set_new(js, "alert", ajs);
+
+    json_object_set_new(js, "app_proto", json_string("http"));
+    return JsonBenchDump(js, buffer);
+}
+
+static int JsonBenchAlertBuilder(const Packet *p, MemBuffer **buffer)
+{
+    JsonBuilder jb;
+
+    MemBufferReset(*buffer);
+    JsonBuilderInit(&jb, buffer);
+    CreateJBHeader(&jb, p, LOG_DIR_PACKET, "alert");
+    JsonBuilderSetUint(&jb, "tx_id", 3);
+
+    JsonBuilderOpenObject(&jb, "alert");
+    JsonBuilderSetString(&jb, "action", "allowed");
+    JsonBuilderSetUint(&jb, "gid", 1);
+    JsonBuilderSetUint(&jb, "signature_id", 2013028);
+    JsonBuilderSetUint(&jb, "rev", 4);
+    JsonBuilderSetString(&jb, "signature",
+            "ET POLICY curl User-Agent Outbound \"/admin\"");
+    JsonBuilderSetString(&jb, "category", "Attempted Information Leak");
+    JsonBuilderSetUint(&jb, "severity", 2);
+    JsonBuilderCloseObject(&jb);
+
+    JsonBuilderSetString(&jb, "app_proto", "http");
+    return JsonBuilderFinish(&jb);
+}
+
+static const char *json_bench_headers[][2] = {
+    { "Host", "www.example.com" },
+    { "User-Agent", "Mozilla/5.0 (X11; Linux x86_64; rv:64.0) Gecko/20100101 Firefox/64.0" },
+    { "Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8" },
+    { "Accept-Language", "en-US,en;q=0.5" },
+    { "Cookie", "session=\xc3\xa9t\xc3\xa9; theme=dark" },
+    { NULL, NULL },
+};
+
+static int JsonBenchHttpJansson(const Packet *p, MemBuffer **buffer)
+{
+    json_t *js = CreateJSONHeaderWithTxId(p, LOG_DIR_FLOW, "http", 0);
+    if (js == NULL)
+        return -1;
+
+    json_t *hjs = json_object();
+    if (hjs == NULL) {
+        json_decref(js);
+        return -1;
+    }
+    json_object_set_new(hjs, "hostname", SCJsonString("www.example.com"));
+    json_object_set_new(hjs, "url",
+            SCJsonString("/index.php?page=search&q=suricata%20json"));
+    json_object_set_new(hjs, "http_user_agent",
+            SCJsonString(json_bench_headers[1][1]));
+    json_object_set_new(hjs, "http_content_type", SCJsonString("text/html"));
+    json_object_set_new(hjs, "http_refer",
+            SCJsonString("http://www.example.com/"));
+    json_object_set_new(hjs, "http_method", SCJsonString("GET"));
+    json_object_set_new(hjs, "protocol", SCJsonString("HTTP/1.1"));
+    json_object_set_new(hjs, "status", json_integer(200));
+    json_object_set_new(hjs, "length", json_integer(45213));
+
+    json_t *headers = json_array();
+    if (headers == NULL) {
+        json_decref(hjs);
+        json_decref(js);
+        return -1;
+    }
+    for (int i = 0; json_bench_headers[i][0] != NULL; i++) {
+        json_t *obj = json_object();
+        if (obj == NULL)
+            continue;
+        json_object_set_new(obj, "name", SCJsonString(json_bench_headers[i][0]));
+        json_object_set_new(obj, "value", SCJsonString(json_bench_headers[i][1]));
+        json_array_append_new(headers, obj);
+    }
+    json_object_set_new(hjs, "request_headers", headers);
+    json_object_set_new(js, "http", hjs);
+
+    return JsonBenchDump(js, buffer);
+}
+
+static int JsonBenchHttpBuilder(const Packet *p, MemBuffer **buffer)
+{
+    JsonBuilder jb;
+
+    MemBufferReset(*buffer);
+    JsonBuilderInit(&jb, buffer);
+    CreateJBHeaderWithTxId(&jb, p, LOG_DIR_FLOW, "http", 0);
+
+    JsonBuilderOpenObject(&jb, "http");
+    JsonBuilderSetString(&jb, "hostname", "www.example.com");
+    JsonBuilderSetString(&jb, "url", "/index.php?page=search&q=suricata%20json");
+    JsonBuilderSetString(&jb, "http_user_agent", json_bench_headers[1][1]);
+    JsonBuilderSetString(&jb, "http_content_type", "text/html");
+    JsonBuilderSetString(&jb, "http_refer", "http://www.example.com/");
+    JsonBuilderSetString(&jb, "http_method", "GET");
+    JsonBuilderSetString(&jb, "protocol", "HTTP/1.1");
+    JsonBuilderSetUint(&jb, "status", 200);
+    JsonBuilderSetUint(&jb, "length", 45213);
+
+    JsonBuilderOpenArray(&jb, "request_headers");
+    for (int i = 0; json_bench_headers[i][0] != NULL; i++) {
+        JsonBuilderOpenObject(&jb, NULL);
+        JsonBuilderSetString(&jb, "name", json_bench_headers[i][0]);
+        JsonBuilderSetString(&jb, "value", json_bench_headers[i][1]);
+        JsonBuilderCloseObject(&jb);
+    }
+    JsonBuilderCloseArray(&jb);
+    JsonBuilderCloseObject(&jb);
+
+    return JsonBuilderFinish(&jb);
+}
+
+/** \internal
+ *  \brief build a record both ways and check the output is the same
+ *
+ *  With profiling enabled, also print the cost of building and
+ *  serializing the record both ways. */
+static int JsonBenchCompare(const char *name, JsonBenchFunc jansson_func,
+        JsonBenchFunc builder_func)
+{
+    Flow f;
+    memset(&f, 0, sizeof(f));
+    f.flow_hash = 0x2a3b4c5d;
+    f.startts.tv_sec = 1546300800;
+    f.startts.tv_usec = 1234;
+
+    Packet *p = UTHBuildPacketReal(NULL, 0, IPPROTO_TCP,
+            "192.168.1.5", "10.0.0.1", 41424, 80);
+    FAIL_IF_NULL(p);
+    p->ts.tv_sec = 1546300800;
+    p->ts.tv_usec = 4321;
+    p->pcap_cnt = 42;
+    p->vlan_id[0] = 10;
+    p->vlan_idx = 1;
+    p->flow = &f;
+    p->flowflags |= FLOW_PKT_TOSERVER;
+
+    MemBuffer *a = MemBufferCreateNew(JSON_OUTPUT_BUFFER_SIZE);
+    FAIL_IF_NULL(a);
+    MemBuffer *b = MemBufferCreateNew(JSON_OUTPUT_BUFFER_SIZE);
+    FAIL_IF_NULL(b);
+
+    FAIL_IF(jansson_func(p, &a) != 0);
+    FAIL_IF(builder_func(p, &b) != 0);
+    FAIL_IF(MEMBUFFER_OFFSET(a) != MEMBUFFER_OFFSET(b));
+    FAIL_IF(memcmp(MEMBUFFER_BUFFER(a), MEMBUFFER_BUFFER(b), MEMBUFFER_OFFSET(a)) != 0);
+
+#ifdef PROFILING
+    uint64_t ticks_start = UtilCpuGetTicks();
+    for (int i = 0; i < JSON_BENCH_RUNS; i++) {
+        (void)jansson_func(p, &a);
+    }
+    uint64_t jansson_ticks = UtilCpuGetTicks() - ticks_start;
+
+    ticks_start = UtilCpuGetTicks();
+    for (int i = 0; i < JSON_BENCH_RUNS; i++) {
+        (void)builder_func(p, &b);
+    }
+    uint64_t builder_ticks = UtilCpuGetTicks() - ticks_start;
+
+    printf("\n%s record (%"PRIu32" bytes, %d runs): jansson %"PRIu64
+            " ticks/record, builder %"PRIu64" ticks/record\n",
+            name, MEMBUFFER_OFFSET(b), JSON_BENCH_RUNS,
+            jansson_ticks / JSON_BENCH_RUNS, builder_ticks / JSON_BENCH_RUNS);
+#else
+    (void)name;
 #endif
+
+    MemBufferFree(a);
+    MemBufferFree(b);
+    p->flow = NULL;
+    UTHFreePacket(p);
+    PASS;
+}
+
+/** \test alert record: JSON builder output matches jansson */
+static int OutputJsonBuilderTest01(void)
+{
+    return JsonBenchCompare("alert", JsonBenchAlertJansson, JsonBenchAlertBuilder);
+}
+
+/** \test http record: JSON builder output matches jansson */
+static int OutputJsonBuilderTest02(void)
+{
+    return JsonBenchCompare("http", JsonBenchHttpJansson, JsonBenchHttpBuilder);
+}
+#endif /* UNITTESTS */
+
+#endif /* HAVE_LIBJANSSON */
+
+void OutputJsonRegisterTests(void)
+{
+#if defined(UNITTESTS) && defined(HAVE_LIBJANSSON)
+    UtRegisterTest("OutputJsonBuilderTest01", OutputJsonBuilderTest01);
+    UtRegisterTest("OutputJsonBuilderTest02", OutputJsonBuilderTest02);
+#endif
+}
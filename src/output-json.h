@@ -26,12 +26,14 @@
 
 #include "suricata-common.h"
 #include "util-buffer.h"
+#include "util-json-builder.h"
 #include "util-logopenfile.h"
 #include "output.h"
 
 #include "app-layer-htp-xff.h"
 
 void OutputJsonRegister(void);
+void OutputJsonRegisterTests(void);
 
 #ifdef HAVE_LIBJANSSON
 
@@ -45,6 +47,11 @@ enum OutputJsonLogDirection {
 /* Suggested output buffer size */
 #define JSON_OUTPUT_BUFFER_SIZE 65535
 
+/* jansson encoding flags that produce the same output as the JSON builder
+ * with its default options */
+#define JSON_BUILDER_FLAGS \
+    (JSON_PRESERVE_ORDER|JSON_COMPACT|JSON_ENSURE_ASCII|JSON_ESCAPE_SLASH)
+
 /* helper struct for OutputJSONMemBufferCallback */
 typedef struct OutputJSONMemBufferWrapper_ {
     MemBuffer **buffer; /**< buffer to use & expand as needed */
@@ -62,6 +69,16 @@ json_t *CreateJSONHeader(const Packet *p,
 json_t *CreateJSONHeaderWithTxId(const Packet *p,
         enum OutputJsonLogDirection dir, const char *event_type, uint64_t tx_id);
 int OutputJSONBuffer(json_t *js, LogFileCtx *file_ctx, MemBuffer **buffer);
+
+void CreateJBFlowId(JsonBuilder *jb, const Flow *f);
+void JBTcpFlags(uint8_t flags, JsonBuilder *jb);
+void JBFiveTuple(const Packet *, enum OutputJsonLogDirection, JsonBuilder *);
+void CreateJBHeader(JsonBuilder *jb, const Packet *p,
+        enum OutputJsonLogDirection dir, const char *event_type);
+void CreateJBHeaderWithTxId(JsonBuilder *jb, const Packet *p,
+        enum OutputJsonLogDirection dir, const char *event_type, uint64_t tx_id);
+void OutputJsonBuilderStart(JsonBuilder *jb, LogFileCtx *file_ctx, MemBuffer **buffer);
+int OutputJsonBuilderBuffer(JsonBuilder *jb, LogFileCtx *file_ctx);
 OutputInitResult OutputJsonInitCtx(ConfNode *);
 
 OutputInitResult OutputJsonLogInitSub(ConfNode *conf, OutputCtx *parent_ctx);
@@ -96,6 +113,8 @@ void SCJsonDecref(json_t *js);
 
 void JsonAddCommonOptions(const OutputJsonCommonSettings *cfg,
         const Packet *p, const Flow *f, json_t *js);
+void JBAddCommonOptions(const OutputJsonCommonSettings *cfg,
+        const Packet *p, const Flow *f, JsonBuilder *jb);
 
 #endif /* HAVE_LIBJANSSON */
 
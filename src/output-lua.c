@@ -807,6 +807,8 @@ static OutputInitResult OutputLuaLogInit(ConfNode *conf)
             om->ts_log_progress = -1;
             om->tc_log_progress = -1;
             AppLayerParserRegisterLogger(IPPROTO_TCP, ALPROTO_HTTP);
+            AppLayerHtpNeedNormalizedUri();
+            AppLayerHtpNeedRawHeaders();
         } else if (opts.alproto == ALPROTO_TLS) {
             om->TxLogFunc = LuaTxLogger;
             om->alproto = ALPROTO_TLS;
@@ -30,6 +30,7 @@
 #include "util-debug.h"
 #include "util-ip.h"
 #include "util-radix-tree.h"
+#include "util-poptrie.h"
 #include "util-unittest.h"
 #include "threads.h"
 #include "util-print.h"
@@ -97,6 +98,9 @@ static void SRepCIDRAddNetblock(SRepCIDRTree *cidr_ctx, char *ip, int cat, int v
             SCLogDebug("Reputation IPV6 with CIDR module for cat %d initialized", cat);
         }
 
+        SCPoptrieFree(cidr_ctx->srepIPV6_lpm[cat]);
+        cidr_ctx->srepIPV6_lpm[cat] = NULL;
+
         SCLogDebug("adding ipv6 host %s", ip);
         if (SCRadixAddKeyIPV6String(ip, cidr_ctx->srepIPV6_tree[cat], (void *)user_data) == NULL) {
             SCLogWarning(SC_ERR_INVALID_VALUE,
@@ -113,6 +117,9 @@ static void SRepCIDRAddNetblock(SRepCIDRTree *cidr_ctx, char *ip, int cat, int v
             SCLogDebug("Reputation IPV4 with CIDR module for cat %d initialized", cat);
         }
 
+        SCPoptrieFree(cidr_ctx->srepIPV4_lpm[cat]);
+        cidr_ctx->srepIPV4_lpm[cat] = NULL;
+
         SCLogDebug("adding ipv4 host %s", ip);
         if (SCRadixAddKeyIPV4String(ip, cidr_ctx->srepIPV4_tree[cat], (void *)user_data) == NULL) {
             SCLogWarning(SC_ERR_INVALID_VALUE,
@@ -121,10 +128,26 @@ static void SRepCIDRAddNetblock(SRepCIDRTree *cidr_ctx, char *ip, int cat, int v
     }
 }
 
+/** \brief compile the trees that changed for the lookups. Categories
+ *         that fail to compile keep using their tree. */
+static void SRepCIDRCompile(SRepCIDRTree *cidr_ctx)
+{
+    int cat;
+    for (cat = 0; cat < SREP_MAX_CATS; cat++) {
+        if (cidr_ctx->srepIPV4_tree[cat] != NULL && cidr_ctx->srepIPV4_lpm[cat] == NULL)
+            cidr_ctx->srepIPV4_lpm[cat] = SCPoptrieFromRadixTree(cidr_ctx->srepIPV4_tree[cat], 32);
+        if (cidr_ctx->srepIPV6_tree[cat] != NULL && cidr_ctx->srepIPV6_lpm[cat] == NULL)
+            cidr_ctx->srepIPV6_lpm[cat] = SCPoptrieFromRadixTree(cidr_ctx->srepIPV6_tree[cat], 128);
+    }
+}
+
 static uint8_t SRepCIDRGetIPv4IPRep(SRepCIDRTree *cidr_ctx, uint8_t *ipv4_addr, uint8_t cat)
 {
     void *user_data = NULL;
-    (void)SCRadixFindKeyIPV4BestMatch(ipv4_addr, cidr_ctx->srepIPV4_tree[cat], &user_data);
+    if (cidr_ctx->srepIPV4_lpm[cat] != NULL)
+        user_data = SCPoptrieLookupIPV4(cidr_ctx->srepIPV4_lpm[cat], ipv4_addr);
+    else
+        (void)SCRadixFindKeyIPV4BestMatch(ipv4_addr, cidr_ctx->srepIPV4_tree[cat], &user_data);
     if (user_data == NULL)
         return 0;
 
@@ -135,7 +158,10 @@ static uint8_t SRepCIDRGetIPv4IPRep(SRepCIDRTree *cidr_ctx, uint8_t *ipv4_addr,
 static uint8_t SRepCIDRGetIPv6IPRep(SRepCIDRTree *cidr_ctx, uint8_t *ipv6_addr, uint8_t cat)
 {
     void *user_data = NULL;
-    (void)SCRadixFindKeyIPV6BestMatch(ipv6_addr, cidr_ctx->srepIPV6_tree[cat], &user_data);
+    if (cidr_ctx->srepIPV6_lpm[cat] != NULL)
+        user_data = SCPoptrieLookupIPV6(cidr_ctx->srepIPV6_lpm[cat], ipv6_addr);
+    else
+        (void)SCRadixFindKeyIPV6BestMatch(ipv6_addr, cidr_ctx->srepIPV6_tree[cat], &user_data);
     if (user_data == NULL)
         return 0;
 
@@ -522,6 +548,8 @@ int SRepLoadFileFromFD(SRepCIDRTree *cidr_ctx, FILE *fp)
         }
     }
 
+    if (cidr_ctx != NULL)
+        SRepCIDRCompile(cidr_ctx);
     return 0;
 }
 
@@ -663,6 +691,9 @@ void SRepDestroy(DetectEngineCtx *de_ctx) {
     if (de_ctx->srepCIDR_ctx != NULL) {
         int i;
         for (i = 0; i < SREP_MAX_CATS; i++) {
+            SCPoptrieFree(de_ctx->srepCIDR_ctx->srepIPV4_lpm[i]);
+            SCPoptrieFree(de_ctx->srepCIDR_ctx->srepIPV6_lpm[i]);
+
             if (de_ctx->srepCIDR_ctx->srepIPV4_tree[i] != NULL) {
                 SCRadixReleaseRadixTree(de_ctx->srepCIDR_ctx->srepIPV4_tree[i]);
                 de_ctx->srepCIDR_ctx->srepIPV4_tree[i] = NULL;
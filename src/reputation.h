@@ -27,6 +27,7 @@
 #define __REPUTATION_H__
 
 #include "host.h"
+#include "util-poptrie.h"
 
 #define SREP_MAX_CATS 60
 #define SREP_MAX_VAL 127
@@ -34,6 +35,10 @@
 typedef struct SRepCIDRTree_ {
     SCRadixTree *srepIPV4_tree[SREP_MAX_CATS];
     SCRadixTree *srepIPV6_tree[SREP_MAX_CATS];
+    /* compiled from the trees after loading, NULL if the tree changed
+     * since */
+    SCPoptrie *srepIPV4_lpm[SREP_MAX_CATS];
+    SCPoptrie *srepIPV6_lpm[SREP_MAX_CATS];
 } SRepCIDRTree;
 
 typedef struct SReputation_ {
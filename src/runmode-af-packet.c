@@ -153,6 +153,7 @@ static void *ParseAFPConfig(const char *iface)
     aconf->copy_mode = AFP_COPY_MODE_NONE;
     aconf->block_timeout = 10;
     aconf->block_size = getpagesize() << AFP_BLOCK_SIZE_DEFAULT_ORDER;
+    aconf->burst_size = 1;
 #ifdef HAVE_PACKET_EBPF
     aconf->ebpf_t_config.cpus_count = UtilCpuGetNumProcessorsConfigured();
 #endif
@@ -587,6 +588,15 @@ static void *ParseAFPConfig(const char *iface)
         aconf->block_timeout = 10;
     }
 
+    if ((ConfGetChildValueIntWithDefault(if_root, if_default, "burst-size", &value)) == 1) {
+        if (value < 1 || value > TM_BURST_MAX) {
+            SCLogError(SC_ERR_INVALID_VALUE, "burst-size must be between 1 and %u",
+                    TM_BURST_MAX);
+        } else {
+            aconf->burst_size = value;
+        }
+    }
+
     (void)ConfGetChildValueBoolWithDefault(if_root, if_default, "disable-promisc", (int *)&boolval);
     if (boolval) {
         SCLogConfig("Disabling promiscuous mode on iface %s",
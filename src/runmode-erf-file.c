@@ -149,12 +149,13 @@ int RunModeErfFileAutoFp(void)
         SCLogError(SC_ERR_RUNMODE, "RunmodeAutoFpCreatePickupQueuesString failed");
         exit(EXIT_FAILURE);
     }
+    const char *qhandler = RunmodeAutoFpGetQueueHandler();
 
     /* create the threads */
     ThreadVars *tv =
         TmThreadCreatePacketHandler(thread_name_autofp,
                                     "packetpool", "packetpool",
-                                    queues, "flow",
+                                    queues, qhandler,
                                     "pktacqloop");
     SCFree(queues);
 
@@ -197,7 +198,7 @@ int RunModeErfFileAutoFp(void)
 
         ThreadVars *tv_detect_ncpu =
             TmThreadCreatePacketHandler(tname,
-                                        qname, "flow",
+                                        qname, qhandler,
                                         "packetpool", "packetpool",
                                         "varslot");
         if (tv_detect_ncpu == NULL) {
@@ -185,6 +185,7 @@ int RunModeFilePcapAutoFp(void)
         SCLogError(SC_ERR_RUNMODE, "RunmodeAutoFpCreatePickupQueuesString failed");
         exit(EXIT_FAILURE);
     }
+    const char *qhandler = RunmodeAutoFpGetQueueHandler();
 
     snprintf(tname, sizeof(tname), "%s#01", thread_name_autofp);
 
@@ -192,7 +193,7 @@ int RunModeFilePcapAutoFp(void)
     ThreadVars *tv_receivepcap =
         TmThreadCreatePacketHandler(tname,
                                     "packetpool", "packetpool",
-                                    queues, "flow",
+                                    queues, qhandler,
                                     "pktacqloop");
     SCFree(queues);
 
@@ -230,7 +231,7 @@ int RunModeFilePcapAutoFp(void)
 
         ThreadVars *tv_detect_ncpu =
             TmThreadCreatePacketHandler(tname,
-                                        qname, "flow",
+                                        qname, qhandler,
                                         "packetpool", "packetpool",
                                         "varslot");
         if (tv_detect_ncpu == NULL) {
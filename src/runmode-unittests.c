@@ -39,11 +39,15 @@
 #include "detect-engine-state.h"
 #include "detect-engine-tag.h"
 #include "detect-engine-modbus.h"
+#include "detect-engine-fp-profile.h"
 #include "detect-fast-pattern.h"
+#include "datasets.h"
 #include "flow.h"
+#include "flow-hash.h"
 #include "flow-timeout.h"
 #include "flow-manager.h"
 #include "flow-var.h"
+#include "flow-wheel.h"
 #include "flow-bit.h"
 #include "pkt-var.h"
 
@@ -68,6 +72,7 @@
 
 #include "util-action.h"
 #include "util-radix-tree.h"
+#include "util-poptrie.h"
 #include "util-host-os-info.h"
 #include "util-cidr.h"
 #include "util-unittest-helper.h"
@@ -90,6 +95,7 @@
 #include "util-bloomfilter.h"
 #include "util-bloomfilter-counting.h"
 #include "util-pool.h"
+#include "util-spsc-ring.h"
 #include "util-byte.h"
 #include "util-proto-name.h"
 #include "util-memrchr.h"
@@ -106,6 +112,12 @@
 #include "detect-engine-siggroup.h"
 
 #include "util-streaming-buffer.h"
+#include "util-json-builder.h"
+#include "util-log-writer.h"
+#include "util-logopenfile.h"
+#include "util-log-redis.h"
+#include "output-json.h"
+#include "output-json-flow.h"
 #include "util-lua.h"
 
 #ifdef OS_WIN32
@@ -139,6 +151,7 @@ static void RegisterUnittests(void)
     BloomFilterRegisterTests();
     BloomFilterCountingRegisterTests();
     PoolRegisterTests();
+    SpscRingRegisterTests();
     ByteRegisterTests();
     MpmRegisterTests();
     FlowBitRegisterTests();
@@ -165,10 +178,13 @@ static void RegisterUnittests(void)
     ConfYamlRegisterTests();
     TmqhFlowRegisterTests();
     FlowRegisterTests();
+    FlowHashRegisterTests();
+    FlowWheelRegisterTests();
     HostRegisterUnittests();
     IPPairRegisterUnittests();
     SCSigRegisterSignatureOrderingTests();
     SCRadixRegisterTests();
+    SCPoptrieRegisterTests();
     DefragRegisterTests();
     SigGroupHeadRegisterTests();
     SCHInfoRegisterTests();
@@ -189,6 +205,8 @@ static void RegisterUnittests(void)
     MemcmpRegisterTests();
     DetectEngineInspectModbusRegisterTests();
     DetectEngineRegisterTests();
+    DetectFastPatternProfileRegisterTests();
+    DatasetRegisterTests();
     SCLogRegisterTests();
     MagicRegisterTests();
     UtilMiscRegisterTests();
@@ -200,6 +218,12 @@ static void RegisterUnittests(void)
     AppLayerUnittestsRegister();
     MimeDecRegisterTests();
     StreamingBufferRegisterTests();
+    JsonBuilderRegisterTests();
+    OutputJsonRegisterTests();
+    JsonFlowLogRegisterTests();
+    LogWriterRegisterTests();
+    LogFileRegisterTests();
+    SCLogRedisRegisterTests();
 #ifdef OS_WIN32
     Win32SyscallRegisterTests();
 #endif
@@ -275,6 +299,8 @@ void RunUnittests(int list_unittests, const char *regex_arg)
 
     AppLayerHtpEnableRequestBodyCallback();
     AppLayerHtpNeedFileInspection();
+    AppLayerHtpNeedNormalizedUri();
+    AppLayerHtpNeedRawHeaders();
 
     RegisterUnittests();
 
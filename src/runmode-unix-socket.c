@@ -43,6 +43,7 @@
 #include "app-layer.h"
 #include "app-layer-htp-mem.h"
 #include "host-bit.h"
+#include "datasets.h"
 
 #include "util-misc.h"
 #include "util-profiling.h"
@@ -1408,6 +1409,95 @@ TmEcode UnixSocketShowAllMemcap(json_t *cmd, json_t *answer, void *data)
     json_object_set_new(answer, "message", jmemcaps);
     SCReturnInt(TM_ECODE_OK);
 }
+
+static TmEcode UnixSocketDatasetUpdate(json_t *cmd, json_t *answer, const bool add)
+{
+    json_t *jarg = json_object_get(cmd, "setname");
+    if (!json_is_string(jarg)) {
+        json_object_set_new(answer, "message", json_string("setname is not a string"));
+        return TM_ECODE_FAILED;
+    }
+    const char *setname = json_string_value(jarg);
+
+    jarg = json_object_get(cmd, "datavalue");
+    if (!json_is_string(jarg)) {
+        json_object_set_new(answer, "message", json_string("datavalue is not a string"));
+        return TM_ECODE_FAILED;
+    }
+    const char *value = json_string_value(jarg);
+
+    SCLogInfo("%s: set %s value %s", add ? "dataset-add" : "dataset-remove",
+            setname, value);
+
+    int r = add ? DatasetAdd(setname, value) : DatasetRemove(setname, value);
+    if (r != 0) {
+        json_object_set_new(answer, "message",
+                json_string("set not loaded or invalid value for the set"));
+        return TM_ECODE_FAILED;
+    }
+    json_object_set_new(answer, "message",
+            json_string(add ? "data added" : "data removed"));
+    return TM_ECODE_OK;
+}
+
+/**
+ * \brief Command to add a value to a dataset
+ *
+ * \param cmd the content of command Arguments as a json_t object
+ * \param answer the json_t object that has to be used to answer
+ * \param data unused
+ */
+TmEcode UnixSocketDatasetAdd(json_t *cmd, json_t *answer, void *data)
+{
+    return UnixSocketDatasetUpdate(cmd, answer, true);
+}
+
+/**
+ * \brief Command to remove a value from a dataset
+ *
+ * \param cmd the content of command Arguments as a json_t object
+ * \param answer the json_t object that has to be used to answer
+ * \param data unused
+ */
+TmEcode UnixSocketDatasetRemove(json_t *cmd, json_t *answer, void *data)
+{
+    return UnixSocketDatasetUpdate(cmd, answer, false);
+}
+
+static void UnixSocketDatasetListOne(const Dataset *set, void *data)
+{
+    json_t *jsets = data;
+    json_t *jobj = json_object();
+    if (jobj == NULL)
+        return;
+
+    json_object_set_new(jobj, "name", json_string(set->name));
+    json_object_set_new(jobj, "type", json_string(DatasetTypeToString(set->type)));
+    json_object_set_new(jobj, "values", json_integer(set->count));
+    json_object_set_new(jobj, "runtime-changes",
+            json_integer(SC_ATOMIC_GET(set->overlay_cnt)));
+    json_object_set_new(jobj, "memory", json_integer(DatasetMemoryUse(set)));
+    json_object_set_new(jobj, "mapped", json_boolean(set->mapped));
+    json_array_append_new(jsets, jobj);
+}
+
+/**
+ * \brief Command to list the loaded datasets and their counters
+ */
+TmEcode UnixSocketDatasetList(json_t *cmd, json_t *answer, void *data)
+{
+    json_t *jsets = json_array();
+    if (jsets == NULL) {
+        json_object_set_new(answer, "message",
+                            json_string("internal error at json array creation"));
+        return TM_ECODE_FAILED;
+    }
+
+    DatasetListAll(UnixSocketDatasetListOne, jsets);
+
+    json_object_set_new(answer, "message", jsets);
+    SCReturnInt(TM_ECODE_OK);
+}
 #endif /* BUILD_UNIX_SOCKET */
 
 #ifdef BUILD_UNIX_SOCKET
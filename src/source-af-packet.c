@@ -260,6 +260,8 @@ typedef struct AFPThreadVars_
     int ring_size;
     int block_size;
     int block_timeout;
+    /* packets of the current block not yet run through the slots */
+    TmPacketBurst burst;
     /* socket buffer size */
     int buffer_size;
     /* Filter */
@@ -1123,7 +1125,11 @@ static inline int AFPParsePacketV3(AFPThreadVars *ptv, struct tpacket_block_desc
         }
     }
 
-    if (TmThreadsSlotProcessPkt(ptv->tv, ptv->slot, p) != TM_ECODE_OK) {
+    if (ptv->burst.size > 1) {
+        if (TmPacketBurstAdd(ptv->tv, ptv->slot, &ptv->burst, p) != TM_ECODE_OK) {
+            SCReturnInt(AFP_SURI_FAILURE);
+        }
+    } else if (TmThreadsSlotProcessPkt(ptv->tv, ptv->slot, p) != TM_ECODE_OK) {
         TmqhOutputPacketpool(ptv->tv, p);
         SCReturnInt(AFP_SURI_FAILURE);
     }
@@ -1149,13 +1155,23 @@ static inline int AFPWalkBlock(AFPThreadVars *ptv, struct tpacket_block_desc *pb
                  * treat thenext packet */
                 break;
             case AFP_READ_FAILURE:
+                /* packets may point into the block, so they have
+                 * to be processed before it's handed back */
+                TmPacketBurstFlush(ptv->tv, ptv->slot, &ptv->burst);
                 SCReturnInt(AFP_READ_FAILURE);
             default:
+                TmPacketBurstFlush(ptv->tv, ptv->slot, &ptv->burst);
                 SCReturnInt(ret);
         }
         ppd = ppd + ((struct tpacket3_hdr *)ppd)->tp_next_offset;
     }
 
+    /* packets may point into the block, so they have to be
+     * processed before it's handed back to the kernel */
+    if (TmPacketBurstFlush(ptv->tv, ptv->slot, &ptv->burst) != TM_ECODE_OK) {
+        SCReturnInt(AFP_SURI_FAILURE);
+    }
+
     SCReturnInt(AFP_READ_OK);
 }
 #endif /* HAVE_TPACKET_V3 */
@@ -2766,6 +2782,10 @@ TmEcode ReceiveAFPThreadInit(ThreadVars *tv, const void *initdata, void **data)
     ptv->ebpf_t_config = afpconfig->ebpf_t_config;
 #endif
 
+    /* bursts are taken from a single tpacket_v3 block */
+    TmPacketBurstInit(ptv->tv, &ptv->burst,
+            (ptv->flags & AFP_TPACKET_V3) ? afpconfig->burst_size : 1);
+
 #ifdef PACKET_STATISTICS
     ptv->capture_kernel_packets = StatsRegisterCounter("capture.kernel_packets",
             ptv->tv);
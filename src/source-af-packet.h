@@ -91,6 +91,8 @@ typedef struct AFPIfaceConfig_
     int block_size;
     /* block timeout for tpacket_v3 in milliseconds */
     int block_timeout;
+    /* max packets run through the slots as one burst (tpacket_v3) */
+    int burst_size;
     /* cluster param */
     int cluster_id;
     int cluster_type;
@@ -98,7 +98,8 @@ void PcapFileCallbackLoop(char *user, struct pcap_pkthdr *h, u_char *pkt)
 
     PACKET_PROFILING_TMM_END(p, TMM_RECEIVEPCAPFILE);
 
-    if (TmThreadsSlotProcessPkt(ptv->shared->tv, ptv->shared->slot, p) != TM_ECODE_OK) {
+    if (TmPacketBurstAdd(ptv->shared->tv, ptv->shared->slot,
+                &ptv->shared->burst, p) != TM_ECODE_OK) {
         pcap_breakloop(ptv->pcap_handle);
         ptv->shared->cb_result = TM_ECODE_FAILED;
     }
@@ -137,6 +138,11 @@ TmEcode PcapFileDispatch(PcapFileFileVars *ptv)
         /* Right now we just support reading packets one at a time. */
         r = pcap_dispatch(ptv->pcap_handle, packet_q_len,
                           (pcap_handler)PcapFileCallbackLoop, (u_char *)ptv);
+        /* run the last, partial, burst of this dispatch */
+        if (TmPacketBurstFlush(ptv->shared->tv, ptv->shared->slot,
+                    &ptv->shared->burst) != TM_ECODE_OK) {
+            ptv->shared->cb_result = TM_ECODE_FAILED;
+        }
         if (unlikely(r == -1)) {
             SCLogError(SC_ERR_PCAP_DISPATCH, "error code %" PRId32 " %s for %s",
                        r, pcap_geterr(ptv->pcap_handle), ptv->filename);
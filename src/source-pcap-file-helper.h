@@ -50,6 +50,9 @@ typedef struct PcapFileSharedVars_
     ThreadVars *tv;
     TmSlot *slot;
 
+    /** packets read but not yet run through the slots */
+    TmPacketBurst burst;
+
     /* counters */
     uint64_t pkts;
     uint64_t bytes;
@@ -232,6 +232,16 @@ TmEcode ReceivePcapFileThreadInit(ThreadVars *tv, const void *initdata, void **d
         }
     }
 
+    intmax_t burst_size = 1;
+    if (ConfGetInt("pcap-file.burst-size", &burst_size) == 1) {
+        if (burst_size < 1 || burst_size > TM_BURST_MAX) {
+            SCLogError(SC_ERR_INVALID_ARGUMENT, "pcap-file.burst-size out of "
+                    "range, should be 1-%u", TM_BURST_MAX);
+            burst_size = 1;
+        }
+    }
+    TmPacketBurstInit(tv, &ptv->shared.burst, (uint32_t)burst_size);
+
     int should_delete = 0;
     ptv->shared.should_delete = false;
     if (ConfGetBool("pcap-file.delete-when-done", &should_delete) == 1) {
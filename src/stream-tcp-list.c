@@ -149,6 +149,21 @@ static inline bool CheckOverlap(struct TCPSEG *tree, TcpSegment *seg)
     return false;
 }
 
+/** \internal
+ *  \brief add a segment after the last segment of the tree
+ *
+ *  Links the segment in as the right child of the tail, so no compares
+ *  are needed to find its place. Only valid if the segment sorts after
+ *  all segments in the tree.
+ */
+static inline void TcpSegmentTreeAppend(struct TCPSEG *tree, TcpSegment *tail, TcpSegment *seg)
+{
+    DEBUG_VALIDATE_BUG_ON(RB_RIGHT(tail, rb) != NULL);
+    RB_SET(seg, tail, rb);
+    RB_RIGHT(tail, rb) = seg;
+    TCPSEG_RB_INSERT_COLOR(tree, seg);
+}
+
 /** \internal
  *  \brief insert the segment into the proper place in the tree
  *         don't worry about the data or overlaps
@@ -179,6 +194,18 @@ static int DoInsertSegment (TcpStream *stream, TcpSegment *seg, TcpSegment **dup
         return 0;
     }
 
+    /* fast track for in order data: segs_right_edge is the right edge
+     * of all segments in the tree, so starting at or after it the
+     * segment goes after the tail and can't overlap */
+    if (SEQ_GEQ(seg->seq, stream->segs_right_edge)) {
+        SCLogDebug("in order, appending seg %p seq %" PRIu32 ", "
+                   "len %" PRIu32 "", seg, seg->seq, TCP_SEG_LEN(seg));
+        TcpSegment *tail = RB_MAX(TCPSEG, &stream->seg_tree);
+        TcpSegmentTreeAppend(&stream->seg_tree, tail, seg);
+        stream->segs_right_edge = SEG_SEQ_RIGHT_EDGE(seg);
+        return 0;
+    }
+
     /* insert and then check if there was any overlap with other segments */
     TcpSegment *res = TCPSEG_RB_INSERT(&stream->seg_tree, seg);
     if (res) {
@@ -580,6 +607,7 @@ int StreamTcpReassembleInsertSegment(ThreadVars *tv, TcpReassemblyThreadCtx *ra_
             StreamTcpSegmentReturntoPool(seg);
             SCReturnInt(-1);
         }
+        StatsAddUI64(tv, ra_ctx->counter_tcp_reass_copied_bytes, TCP_SEG_LEN(seg));
 
     } else if (r == 1 || r == 2) {
         SCLogDebug("overlap (%s%s)", r == 1 ? "normal" : "", r == 2 ? "duplicate" : "");
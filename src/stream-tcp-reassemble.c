@@ -45,6 +45,7 @@
 #include "util-host-os-info.h"
 #include "util-unittest-helper.h"
 #include "util-byte.h"
+#include "util-misc.h"
 #include "util-device.h"
 
 #include "stream-tcp.h"
@@ -79,6 +80,15 @@ static SCMutex segment_thread_pool_mutex = SCMUTEX_INITIALIZER;
 /* Memory use counter */
 SC_ATOMIC_DECLARE(uint64_t, ra_memuse);
 
+/** Threads reserve memory use in ra_memuse in blocks of this size, so
+ *  that they don't update the global counter for every allocation. The
+ *  counter includes up to 2 blocks per thread that are reserved but not
+ *  used yet. */
+#define RA_MEMUSE_BLOCK (256 * 1024)
+static uint64_t ra_memuse_block = RA_MEMUSE_BLOCK;
+/** part of ra_memuse reserved by this thread, but not used */
+static __thread uint64_t ra_memuse_reserved = 0;
+
 /* prototypes */
 TcpSegment *StreamTcpGetSegment(ThreadVars *tv, TcpReassemblyThreadCtx *);
 void StreamTcpCreateTestPacket(uint8_t *, uint8_t, uint8_t, uint8_t);
@@ -87,6 +97,11 @@ void StreamTcpReassemblePseudoPacketCreate(TcpStream *, Packet *, PacketQueue *)
 void StreamTcpReassembleInitMemuse(void)
 {
     SC_ATOMIC_INIT(ra_memuse);
+#ifdef UNITTESTS
+    /* tests check the exact memory use */
+    if (RunmodeIsUnittests())
+        ra_memuse_block = 0;
+#endif
 }
 
 /**
@@ -97,7 +112,18 @@ void StreamTcpReassembleInitMemuse(void)
  */
 void StreamTcpReassembleIncrMemuse(uint64_t size)
 {
-    (void) SC_ATOMIC_ADD(ra_memuse, size);
+    if (ra_memuse_reserved >= size) {
+        ra_memuse_reserved -= size;
+    } else {
+        /* reserve what we miss, plus a block if the memcap allows it */
+        const uint64_t need = size - ra_memuse_reserved;
+        const uint64_t memcapcopy = SC_ATOMIC_GET(stream_config.reassembly_memcap);
+        uint64_t block = ra_memuse_block;
+        if (memcapcopy != 0 && SC_ATOMIC_GET(ra_memuse) + need + block > memcapcopy)
+            block = 0;
+        (void) SC_ATOMIC_ADD(ra_memuse, need + block);
+        ra_memuse_reserved = block;
+    }
     SCLogDebug("REASSEMBLY %"PRIu64", incr %"PRIu64, StreamTcpReassembleMemuseGlobalCounter(), size);
     return;
 }
@@ -110,6 +136,14 @@ void StreamTcpReassembleIncrMemuse(uint64_t size)
  */
 void StreamTcpReassembleDecrMemuse(uint64_t size)
 {
+    ra_memuse_reserved += size;
+    if (ra_memuse_reserved <= 2 * ra_memuse_block)
+        return;
+
+    /* give back all but a block */
+    size = ra_memuse_reserved - ra_memuse_block;
+    ra_memuse_reserved = ra_memuse_block;
+
 #ifdef UNITTESTS
     uint64_t presize = SC_ATOMIC_GET(ra_memuse);
     if (RunmodeIsUnittests()) {
@@ -129,6 +163,19 @@ void StreamTcpReassembleDecrMemuse(uint64_t size)
     return;
 }
 
+/**
+ *  \brief give back the memory use reserved by this thread
+ *
+ *  Called by threads that free reassembly memory when they exit.
+ */
+void StreamTcpReassembleReleaseMemuse(void)
+{
+    if (ra_memuse_reserved > 0) {
+        (void) SC_ATOMIC_SUB(ra_memuse, ra_memuse_reserved);
+        ra_memuse_reserved = 0;
+    }
+}
+
 uint64_t StreamTcpReassembleMemuseGlobalCounter(void)
 {
     uint64_t smemuse = SC_ATOMIC_GET(ra_memuse);
@@ -146,8 +193,8 @@ uint64_t StreamTcpReassembleMemuseGlobalCounter(void)
 int StreamTcpReassembleCheckMemcap(uint64_t size)
 {
     uint64_t memcapcopy = SC_ATOMIC_GET(stream_config.reassembly_memcap);
-    if (memcapcopy == 0 ||
-        (uint64_t)((uint64_t)size + SC_ATOMIC_GET(ra_memuse)) <= memcapcopy)
+    if (memcapcopy == 0 || size <= ra_memuse_reserved ||
+        (uint64_t)((uint64_t)size - ra_memuse_reserved + SC_ATOMIC_GET(ra_memuse)) <= memcapcopy)
         return 1;
     return 0;
 }
@@ -389,6 +436,34 @@ static int StreamTcpReassemblyConfig(char quiet)
     stream_config.sbcnf.Realloc = ReassembleRealloc;
     stream_config.sbcnf.Free = ReassembleFree;
 
+    /* keep the stream data in pages so that sliding doesn't move data */
+    uint32_t page_size = 0;
+    const char *page_size_str = NULL;
+    if (ConfGetValue("stream.reassembly.page-size", &page_size_str) == 1) {
+        if (ParseSizeStringU32(page_size_str, &page_size) < 0 ||
+                (page_size != 0 && page_size < STREAMING_BUFFER_PAGE_SIZE_MIN)) {
+            SCLogError(SC_ERR_SIZE_PARSE, "invalid stream.reassembly.page-size "
+                    "%s: should be 0 or at least %u", page_size_str,
+                    STREAMING_BUFFER_PAGE_SIZE_MIN);
+            return -1;
+        }
+    }
+    if (page_size > 0) {
+        stream_config.sbcnf.flags |= STREAMING_BUFFER_PAGED;
+        stream_config.sbcnf.page_size = page_size;
+    }
+    if (!quiet)
+        SCLogConfig("stream.reassembly \"page-size\": %u", page_size);
+
+    /* let the app-layer parse in order, acked data from the packet */
+    int zero_copy = 0;
+    if (ConfGetBool("stream.reassembly.zero-copy", &zero_copy) == 1 && zero_copy) {
+        stream_config.flags |= STREAMTCP_INIT_FLAG_ZERO_COPY;
+    }
+    if (!quiet)
+        SCLogConfig("stream.reassembly \"zero-copy\": %s",
+                zero_copy ? "enabled" : "disabled");
+
     return 0;
 }
 
@@ -418,6 +493,9 @@ void StreamTcpReassembleFree(char quiet)
     SCMutexUnlock(&segment_thread_pool_mutex);
     SCMutexDestroy(&segment_thread_pool_mutex);
 
+    StreamingBufferPagePoolCleanup();
+    StreamTcpReassembleReleaseMemuse();
+
 #ifdef DEBUG
     if (segment_pool_memuse > 0)
         SCLogInfo("segment_pool_memuse %"PRIu64"", segment_pool_memuse);
@@ -473,6 +551,9 @@ void StreamTcpReassembleFreeThreadCtx(TcpReassemblyThreadCtx *ra_ctx)
     SCEnter();
     AppLayerDestroyCtxThread(ra_ctx->app_tctx);
     SCFree(ra_ctx);
+    /* stream buffer pages this thread released */
+    StreamingBufferPagePoolCleanup();
+    StreamTcpReassembleReleaseMemuse();
     SCReturn;
 }
 
@@ -879,14 +960,32 @@ static void GetSessionSize(TcpSession *ssn, Packet *p)
  *
  *  Get buffer, or first part of the buffer if data gaps exist.
  *
+ *  Once protocol detection is done the data is taken from the buffer
+ *  without copying. For a paged buffer that is the data up to the end of
+ *  the page, and 'more' is set if the rest has to be fetched after that.
+ *
  *  \brief get stream data from offset
- *  \param offset stream offset */
-static void GetAppBuffer(TcpStream *stream, const uint8_t **data, uint32_t *data_len, uint64_t offset)
+ *  \param offset stream offset
+ *  \param more set to true if there is more data right after this */
+static void GetAppBuffer(TcpStream *stream, const uint8_t **data, uint32_t *data_len,
+        uint64_t offset, bool *more)
 {
     const uint8_t *mydata;
     uint32_t mydata_len;
 
-    if (RB_EMPTY(&stream->sb.sbb_tree)) {
+    *more = false;
+    if (RB_EMPTY(&stream->sb.sbb_tree) &&
+            (stream->flags & STREAMTCP_STREAM_FLAG_APPPROTO_DETECTION_COMPLETED)) {
+        StreamingBufferIov iov;
+        if (StreamingBufferGetIov(&stream->sb, offset, UINT32_MAX, &iov, 1) == 1) {
+            *data = iov.data;
+            *data_len = iov.len;
+            *more = (offset + iov.len < STREAM_BASE_OFFSET(stream) + stream->sb.buf_offset);
+        } else {
+            *data = NULL;
+            *data_len = 0;
+        }
+    } else if (RB_EMPTY(&stream->sb.sbb_tree)) {
         SCLogDebug("getting one blob");
 
         StreamingBufferGetDataAtOffset(&stream->sb, &mydata, &mydata_len, offset);
@@ -989,9 +1088,10 @@ static inline bool CheckGap(TcpSession *ssn, TcpStream *stream, Packet *p)
 /** \internal
  *  \brief get stream buffer and update the app-layer
  *  \param stream pointer to pointer as app-layer can switch flow dir
- *  \retval 0 success
+ *  \retval 1 app-layer took all data it got and there is more
+ *  \retval 0 done
  */
-static int ReassembleUpdateAppLayer (ThreadVars *tv,
+static int ReassembleUpdateAppLayerChunk(ThreadVars *tv,
         TcpReassemblyThreadCtx *ra_ctx,
         TcpSession *ssn, TcpStream **stream,
         Packet *p, enum StreamUpdateDir dir)
@@ -1003,9 +1103,10 @@ static int ReassembleUpdateAppLayer (ThreadVars *tv,
 
     const uint8_t *mydata;
     uint32_t mydata_len;
+    bool more = false;
 
     while (1) {
-        GetAppBuffer(*stream, &mydata, &mydata_len, app_progress);
+        GetAppBuffer(*stream, &mydata, &mydata_len, app_progress, &more);
         if (mydata == NULL && mydata_len > 0 && CheckGap(ssn, *stream, p)) {
             SCLogDebug("sending GAP to app-layer (size: %u)", mydata_len);
 
@@ -1059,15 +1160,42 @@ static int ReassembleUpdateAppLayer (ThreadVars *tv,
                 SCLogDebug("data len adjusted to %u to make sure only ACK'd "
                         "data is considered", mydata_len);
             }
+            if (app_progress + mydata_len >= last_ack_abs)
+                more = false;
         }
     }
 
+    uint8_t flags = StreamGetAppLayerFlags(ssn, *stream, p, dir);
+    if (more)
+        flags &= ~STREAM_EOF;
+
     /* update the app-layer */
     (void)AppLayerHandleTCPData(tv, ra_ctx, p, p->flow, ssn, stream,
-            (uint8_t *)mydata, mydata_len,
-            StreamGetAppLayerFlags(ssn, *stream, p, dir));
+            (uint8_t *)mydata, mydata_len, flags);
     AppLayerProfilingStore(ra_ctx->app_tctx, p);
 
+    if (more && !(ssn->flags & STREAMTCP_FLAG_APP_LAYER_DISABLED) &&
+            STREAM_APP_PROGRESS(*stream) == app_progress + mydata_len) {
+        SCReturnInt(1);
+    }
+    SCReturnInt(0);
+}
+
+/** \internal
+ *  \brief update the app-layer with the stream data
+ *
+ *  A paged stream buffer gives the data a page at a time.
+ *
+ *  \param stream pointer to pointer as app-layer can switch flow dir
+ *  \retval 0 success
+ */
+static int ReassembleUpdateAppLayer (ThreadVars *tv,
+        TcpReassemblyThreadCtx *ra_ctx,
+        TcpSession *ssn, TcpStream **stream,
+        Packet *p, enum StreamUpdateDir dir)
+{
+    while (ReassembleUpdateAppLayerChunk(tv, ra_ctx, ssn, stream, p, dir) == 1)
+        ;
     SCReturnInt(0);
 }
 
@@ -1692,6 +1820,75 @@ static int StreamTcpReassembleHandleSegmentUpdateACK (ThreadVars *tv,
     SCReturnInt(0);
 }
 
+/** \internal
+ *  \brief give the app-layer the packet data without adding it to the stream
+ *
+ *  Only for data that the app-layer would get from the stream buffer
+ *  right away and that nothing else needs: in order, already acked, after
+ *  protocol detection and with raw reassembly and streaming loggers off.
+ *  Anything else is copied into the stream buffer as usual.
+ *
+ *  \retval true data was consumed by the app-layer
+ *  \retval false data needs to be added to the stream
+ */
+static bool StreamTcpReassembleZeroCopy(ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
+        TcpSession *ssn, TcpStream *stream, Packet *p)
+{
+    if (!(stream_config.flags & STREAMTCP_INIT_FLAG_ZERO_COPY) ||
+        StreamTcpInlineMode() || stream_config.streaming_log_api ||
+        (p->flags & PKT_PSEUDO_STREAM_END))
+        return false;
+
+    if ((ssn->flags & STREAMTCP_FLAG_APP_LAYER_DISABLED) ||
+        !(stream->flags & STREAMTCP_STREAM_FLAG_DISABLE_RAW) ||
+        (stream->flags & (STREAMTCP_STREAM_FLAG_GAP|STREAMTCP_STREAM_FLAG_DEPTH_REACHED)) ||
+        !StreamTcpIsSetStreamFlagAppProtoDetectionCompleted(stream) ||
+        p->flow->alproto == ALPROTO_UNKNOWN || FlowChangeProto(p->flow))
+        return false;
+
+    /* the app-layer has to be at the end of the data, with no
+     * out of order data waiting */
+    const uint32_t seq = TCP_GET_SEQ(p);
+    const uint32_t len = p->payload_len;
+    if (!RB_EMPTY(&stream->sb.sbb_tree) ||
+        stream->app_progress_rel != stream->sb.buf_offset ||
+        seq != stream->base_seq + stream->sb.buf_offset)
+        return false;
+
+    /* in IDS mode data is only given to the app-layer once acked */
+    if (SEQ_GT(seq + len, stream->last_ack))
+        return false;
+
+    if (StreamTcpReassembleCheckDepth(ssn, stream, seq, len) != len)
+        return false;
+
+    const uint64_t app_progress = STREAM_APP_PROGRESS(stream);
+    TcpStream *s = stream;
+    (void)AppLayerHandleTCPData(tv, ra_ctx, p, p->flow, ssn, &s,
+            p->payload, len, StreamGetAppLayerFlags(ssn, stream, p, UPDATE_DIR_PACKET));
+    AppLayerProfilingStore(ra_ctx->app_tctx, p);
+
+    /* not consumed, e.g. on a parser error: store it like any other data */
+    if (STREAM_APP_PROGRESS(stream) != app_progress + len)
+        return false;
+
+    /* consumed: move the stream past it, dropping what the buffer held */
+    const uint32_t slide = stream->app_progress_rel;
+    if (StreamingBufferSkipToOffset(&stream->sb, app_progress + len) != 0)
+        return false;
+    stream->base_seq += slide;
+    stream->app_progress_rel = 0;
+    stream->raw_progress_rel = 0;
+    stream->log_progress_rel = 0;
+    if (SEQ_GT(seq + len, stream->segs_right_edge))
+        stream->segs_right_edge = seq + len;
+
+    SCLogDebug("ssn %p: %u bytes zero copy, base_seq %u at stream offset %"PRIu64,
+            ssn, len, stream->base_seq, STREAM_BASE_OFFSET(stream));
+    StatsAddUI64(tv, ra_ctx->counter_tcp_reass_zero_copy_bytes, len);
+    return true;
+}
+
 int StreamTcpReassembleHandleSegment(ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
                                      TcpSession *ssn, TcpStream *stream,
                                      Packet *p, PacketQueue *pq)
@@ -1739,7 +1936,9 @@ int StreamTcpReassembleHandleSegment(ThreadVars *tv, TcpReassemblyThreadCtx *ra_
     if (p->payload_len > 0 && !(stream->flags & STREAMTCP_STREAM_FLAG_NOREASSEMBLY)) {
         SCLogDebug("calling StreamTcpReassembleHandleSegmentHandleData");
 
-        if (StreamTcpReassembleHandleSegmentHandleData(tv, ra_ctx, ssn, stream, p) != 0) {
+        if (StreamTcpReassembleZeroCopy(tv, ra_ctx, ssn, stream, p)) {
+            SCLogDebug("packet %"PRIu64" data given to the app-layer directly", p->pcap_cnt);
+        } else if (StreamTcpReassembleHandleSegmentHandleData(tv, ra_ctx, ssn, stream, p) != 0) {
             SCLogDebug("StreamTcpReassembleHandleSegmentHandleData error");
             SCReturnInt(-1);
         }
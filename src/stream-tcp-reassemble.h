@@ -77,6 +77,11 @@ typedef struct TcpReassemblyThreadCtx_ {
     uint16_t counter_tcp_reass_data_normal_fail;
     uint16_t counter_tcp_reass_data_overlap_fail;
     uint16_t counter_tcp_reass_list_fail;
+
+    /** bytes given to the app-layer straight from the packet */
+    uint16_t counter_tcp_reass_zero_copy_bytes;
+    /** bytes copied into the stream buffer */
+    uint16_t counter_tcp_reass_copied_bytes;
 } TcpReassemblyThreadCtx;
 
 #define OS_POLICY_DEFAULT   OS_POLICY_BSD
@@ -115,6 +120,7 @@ int StreamTcpReassembleDepthReached(Packet *p);
 
 void StreamTcpReassembleIncrMemuse(uint64_t size);
 void StreamTcpReassembleDecrMemuse(uint64_t size);
+void StreamTcpReassembleReleaseMemuse(void);
 int StreamTcpReassembleSetMemcap(uint64_t size);
 uint64_t StreamTcpReassembleGetMemcap(void);
 int StreamTcpReassembleCheckMemcap(uint64_t size);
@@ -5173,6 +5173,8 @@ TmEcode StreamTcpThreadInit(ThreadVars *tv, void *initdata, void **data)
     stt->ra_ctx->counter_tcp_reass_data_normal_fail = StatsRegisterCounter("tcp.insert_data_normal_fail", tv);
     stt->ra_ctx->counter_tcp_reass_data_overlap_fail = StatsRegisterCounter("tcp.insert_data_overlap_fail", tv);
     stt->ra_ctx->counter_tcp_reass_list_fail = StatsRegisterCounter("tcp.insert_list_fail", tv);
+    stt->ra_ctx->counter_tcp_reass_zero_copy_bytes = StatsRegisterCounter("tcp.reassembly_zero_copy_bytes", tv);
+    stt->ra_ctx->counter_tcp_reass_copied_bytes = StatsRegisterCounter("tcp.reassembly_copied_bytes", tv);
 
 
     SCLogDebug("StreamTcp thread specific ctx online at %p, reassembly ctx %p",
@@ -5203,6 +5205,30 @@ TmEcode StreamTcpThreadInit(ThreadVars *tv, void *initdata, void **data)
     SCReturnInt(TM_ECODE_OK);
 }
 
+/**
+ *  \brief print how much data the zero-copy path handled
+ *
+ *  With zero-copy on, this gives the ratio of the
+ *  tcp.reassembly_zero_copy_bytes and tcp.reassembly_copied_bytes
+ *  counters of the thread, to see how much a capture benefits.
+ */
+void StreamTcpExitPrintStats(ThreadVars *tv, void *data)
+{
+    StreamTcpThread *stt = (StreamTcpThread *)data;
+    if (stt == NULL || stt->ra_ctx == NULL ||
+        !(stream_config.flags & STREAMTCP_INIT_FLAG_ZERO_COPY))
+        return;
+
+    const uint64_t zero_copy = StatsGetLocalCounterValue(tv,
+            stt->ra_ctx->counter_tcp_reass_zero_copy_bytes);
+    const uint64_t copied = StatsGetLocalCounterValue(tv,
+            stt->ra_ctx->counter_tcp_reass_copied_bytes);
+    const uint64_t total = zero_copy + copied;
+    SCLogPerf("(%s) reassembly zero-copy: %"PRIu64" bytes, copied: %"PRIu64
+            " bytes (%.2f%% zero-copy)", tv->name, zero_copy, copied,
+            total ? (double)zero_copy * 100.0 / (double)total : 0.0);
+}
+
 TmEcode StreamTcpThreadDeinit(ThreadVars *tv, void *data)
 {
     SCEnter();
@@ -63,6 +63,7 @@
 #include "detect-engine-address.h"
 #include "detect-engine-port.h"
 #include "detect-engine-mpm.h"
+#include "datasets.h"
 
 #include "tm-queuehandlers.h"
 #include "tm-queues.h"
@@ -100,6 +101,7 @@
 #include "respond-reject.h"
 
 #include "flow.h"
+#include "flow-hash.h"
 #include "flow-timeout.h"
 #include "flow-manager.h"
 #include "flow-bypass.h"
@@ -369,6 +371,7 @@ static void GlobalsDestroy(SCInstance *suri)
         DetectEngineDeReference(&de_ctx);
     }
     DetectEnginePruneFreeList();
+    DatasetsDestroy();
 
     AppLayerDeSetup();
 
@@ -591,6 +594,7 @@ static void PrintUsage(const char *progname)
     printf("\t-i <dev or ip>                       : run in pcap live mode\n");
     printf("\t-F <bpf filter file>                 : bpf filter file\n");
     printf("\t-r <path>                            : run in pcap file/offline mode\n");
+    printf("\t--fp-train <path>                    : run in pcap file/offline mode and write a fast pattern profile\n");
 #ifdef NFQ
     printf("\t-q <qid[:qid]>                       : run in inline nfqueue mode (use colon to specify a range of queues)\n");
 #endif /* NFQ */
@@ -1448,6 +1452,7 @@ static TmEcode ParseCommandLine(int argc, char** argv, SCInstance *suri)
         {"pcap", optional_argument, 0, 0},
         {"pcap-file-continuous", 0, 0, 0},
         {"pcap-file-delete", 0, 0, 0},
+        {"fp-train", required_argument, 0, 0},
         {"simulate-ips", 0, 0 , 0},
         {"no-random", 0, &g_disable_randomness, 1},
 
@@ -1852,6 +1857,32 @@ static TmEcode ParseCommandLine(int argc, char** argv, SCInstance *suri)
                     return TM_ECODE_FAILED;
                 }
             }
+            else if (strcmp((long_opts[option_index]).name, "fp-train") == 0) {
+                /* -r that also measures the fast pattern candidates */
+                if (suri->run_mode == RUNMODE_UNKNOWN) {
+                    suri->run_mode = RUNMODE_PCAP_FILE;
+                } else {
+                    SCLogError(SC_ERR_MULTIPLE_RUN_MODE, "more than one run mode "
+                                                         "has been specified");
+                    PrintUsage(argv[0]);
+                    return TM_ECODE_FAILED;
+                }
+#ifdef OS_WIN32
+                struct _stat buf;
+                if (_stat(optarg, &buf) != 0) {
+#else
+                struct stat buf;
+                if (stat(optarg, &buf) != 0) {
+#endif /* OS_WIN32 */
+                    SCLogError(SC_ERR_INITIALIZATION, "ERROR: Pcap file does not exist\n");
+                    return TM_ECODE_FAILED;
+                }
+                if (ConfSetFinal("pcap-file.file", optarg) != 1 ||
+                        ConfSetFinal("detect.fast-pattern-train", "yes") != 1) {
+                    SCLogError(SC_ERR_CMD_LINE, "Failed to set up fast pattern training");
+                    return TM_ECODE_FAILED;
+                }
+            }
             break;
         case 'c':
             suri->conf_filename = optarg;
@@ -2313,6 +2344,7 @@ void PostRunDeinit(const int runmode, struct timeval *start_time)
     StreamTcpFreeConfig(STREAM_VERBOSE);
     DefragDestroy();
 
+    TmqhFlowRingCleanup();
     TmqResetQueues();
 #ifdef PROFILING
     if (profiling_rules_enabled)
@@ -3019,6 +3051,9 @@ int main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
+    /* all flow workers are known now, split the flow hash between them */
+    FlowPartitionsSetup();
+
     (void) SC_ATOMIC_CAS(&engine_stage, SURICATA_INIT, SURICATA_RUNTIME);
     PacketPoolPostRunmodes();
 
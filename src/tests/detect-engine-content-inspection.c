@@ -263,6 +263,111 @@ static int DetectEngineContentInspectionTest13(void) {
     TEST_FOOTER;
 }
 
+#define TEST_PATH(sig, path)                                                                \
+{                                                                                           \
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();                                        \
+    FAIL_IF_NULL(de_ctx);                                                                   \
+    char rule[2048];                                                                        \
+    snprintf(rule, sizeof(rule), "alert tcp any any -> any any (%s sid:1; rev:1;)", (sig)); \
+    Signature *s = DetectEngineAppendSig(de_ctx, rule);                                     \
+    FAIL_IF_NULL(s);                                                                        \
+    SigGroupBuild(de_ctx);                                                                  \
+    FAIL_IF_NOT(strcmp(DetectEngineContentInspectionPath(s), (path)) == 0);                 \
+    DetectEngineCtxFree(de_ctx);                                                            \
+}
+
+/** \test selection of the specialized content matchers */
+static int DetectEngineContentInspectionTest14(void) {
+    TEST_HEADER;
+    TEST_PATH("content:\"a\";", "fast");
+    TEST_PATH("content:\"a\"; content:\"b\"; distance:0; content:\"c\"; within:4;", "fast");
+    TEST_PATH("content:\"a\"; content:\"b\"; content:\"c\"; content:\"d\";", "generic");
+    TEST_PATH("content:\"a\"; content:!\"b\";", "generic");
+    TEST_PATH("content:\"a\"; pcre:\"/b/R\";", "generic");
+    TEST_PATH("dsize:>1;", "-");
+    /* same results for the specialized matchers, including the
+     * recursion steps */
+    TEST_RUN("ababc", 5, "content:\"ab\"; content:\"c\"; distance:0; within:1;", true, 3);
+    TEST_RUN("abcXab", 6, "content:\"ab\"; endswith;", true, 1);
+    TEST_RUN("abcXab", 6, "content:\"ab\"; content:\"Xa\"; distance:0; endswith;", false, 2);
+    TEST_FOOTER;
+}
+
+/** \test secondary matcher for lists with many contents */
+static int DetectEngineContentInspectionTest15(void) {
+    TEST_HEADER;
+    TEST_RUN("abcde", 5, "content:\"a\"; content:\"b\"; distance:0; content:\"c\"; distance:0; content:\"d\"; distance:0; content:\"e\"; distance:0;", true, 5);
+    TEST_RUN("abcde", 5, "content:\"a\"; content:\"b\"; distance:0; content:\"c\"; distance:0; content:\"d\"; distance:0; content:\"x\"; distance:0;", false, 5);
+    TEST_RUN("abcde", 5, "content:\"a\"; content:\"B\"; nocase; distance:0; content:!\"x\"; content:\"d\"; distance:0; pcre:\"/^e/R\";", true, 5);
+    /* 'a' has more matches than the recorded offsets */
+    TEST_RUN("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaabcd", 43, "content:\"a\"; content:\"b\"; distance:0; within:1; content:\"c\"; distance:0; content:\"d\"; distance:0;", true, 43);
+    TEST_FOOTER;
+}
+
+/** \test signatures with the same content on a tx buffer share the search */
+static int DetectEngineContentInspectionTest16(void) {
+    TEST_HEADER;
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    FAIL_IF_NULL(de_ctx);
+    DetectEngineThreadCtx *det_ctx = NULL;
+    Signature *s1 = DetectEngineAppendSig(de_ctx,
+            "alert http any any -> any any (http.uri; content:\"abc\"; sid:1;)");
+    FAIL_IF_NULL(s1);
+    Signature *s2 = DetectEngineAppendSig(de_ctx,
+            "alert http any any -> any any (http.uri; content:\"ABC\"; nocase; sid:2;)");
+    FAIL_IF_NULL(s2);
+    Signature *s3 = DetectEngineAppendSig(de_ctx,
+            "alert http any any -> any any (http.uri; content:\"abc\"; offset:1; sid:3;)");
+    FAIL_IF_NULL(s3);
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&tv, (void *)de_ctx, (void *)&det_ctx);
+    FAIL_IF_NULL(det_ctx);
+
+    FAIL_IF_NULL(s1->app_inspect);
+    FAIL_IF_NULL(s2->app_inspect);
+    FAIL_IF_NULL(s3->app_inspect);
+    const DetectContentData *cd1 = (const DetectContentData *)s1->app_inspect->smd->ctx;
+    const DetectContentData *cd2 = (const DetectContentData *)s2->app_inspect->smd->ctx;
+    const DetectContentData *cd3 = (const DetectContentData *)s3->app_inspect->smd->ctx;
+    FAIL_IF(cd1->ci_cache_id == 0);
+    FAIL_IF(cd1->ci_cache_id == cd2->ci_cache_id);
+    FAIL_IF_NOT(cd1->ci_cache_id == cd3->ci_cache_id);
+
+    uint8_t buf[] = "/xabc";
+    det_ctx->ci_cache.list_id = s1->app_inspect->sm_list;
+    Signature *sigs[3] = { s1, s3, s1 };
+    for (int i = 0; i < 3; i++) {
+        det_ctx->buffer_offset = 0;
+        det_ctx->discontinue_matching = 0;
+        det_ctx->inspection_recursion_counter = 0;
+        int r = DetectEngineContentInspection(de_ctx, det_ctx,
+                sigs[i], sigs[i]->app_inspect->smd, NULL, &f,
+                buf, sizeof(buf) - 1, 0, DETECT_CI_FLAGS_SINGLE,
+                DETECT_ENGINE_CONTENT_INSPECTION_MODE_STATE);
+        FAIL_IF_NOT(r == 1);
+    }
+    FAIL_IF_NOT(det_ctx->ci_cache.misses == 1);
+    FAIL_IF_NOT(det_ctx->ci_cache.hits == 2);
+
+    /* next tx */
+    InspectionBufferClean(det_ctx);
+    uint8_t buf2[] = "/xabd";
+    det_ctx->buffer_offset = 0;
+    det_ctx->discontinue_matching = 0;
+    det_ctx->inspection_recursion_counter = 0;
+    int r = DetectEngineContentInspection(de_ctx, det_ctx,
+            s1, s1->app_inspect->smd, NULL, &f,
+            buf2, sizeof(buf2) - 1, 0, DETECT_CI_FLAGS_SINGLE,
+            DETECT_ENGINE_CONTENT_INSPECTION_MODE_STATE);
+    FAIL_IF_NOT(r == 0);
+    FAIL_IF_NOT(det_ctx->ci_cache.misses == 2);
+    det_ctx->ci_cache.list_id = -1;
+
+    DetectEngineThreadCtxDeinit(&tv, det_ctx);
+    DetectEngineCtxFree(de_ctx);
+    TEST_FOOTER;
+}
+
 void DetectEngineContentInspectionRegisterTests(void)
 {
     UtRegisterTest("DetectEngineContentInspectionTest01",
@@ -291,8 +396,15 @@ void DetectEngineContentInspectionRegisterTests(void)
                    DetectEngineContentInspectionTest12);
     UtRegisterTest("DetectEngineContentInspectionTest13 mix startswith/endswith",
                    DetectEngineContentInspectionTest13);
+    UtRegisterTest("DetectEngineContentInspectionTest14 specialized matchers",
+                   DetectEngineContentInspectionTest14);
+    UtRegisterTest("DetectEngineContentInspectionTest15 secondary matcher",
+                   DetectEngineContentInspectionTest15);
+    UtRegisterTest("DetectEngineContentInspectionTest16 inspection cache",
+                   DetectEngineContentInspectionTest16);
 }
 
 #undef TEST_HEADER
 #undef TEST_RUN
+#undef TEST_PATH
 #undef TEST_FOOTER
@@ -24,6 +24,7 @@
 #include "../stream-tcp-util.h"
 #include "../util-streaming-buffer.h"
 #include "../util-print.h"
+#include "../util-cpu.h"
 #include "../util-unittest.h"
 
 static int VALIDATE(TcpStream *stream, uint8_t *data, uint32_t data_len)
@@ -708,6 +709,142 @@ static int StreamTcpReassembleTest32(void)
     OVERLAP_END;
 }
 
+/** \internal
+ *  \brief check the segments are ordered and within segs_right_edge */
+static int CheckSegmentTree(TcpStream *stream)
+{
+    TcpSegment *seg = NULL, *prev = NULL;
+    RB_FOREACH(seg, TCPSEG, &stream->seg_tree) {
+        if (prev != NULL && TcpSegmentCompare(prev, seg) >= 0)
+            return 0;
+        if (SEQ_GT(SEG_SEQ_RIGHT_EDGE(seg), stream->segs_right_edge))
+            return 0;
+        prev = seg;
+    }
+    return 1;
+}
+
+/** \test synthetic segment sequences: in order, reordered and
+ *        overlapping, as they mix in real traffic */
+static int StreamTcpReassembleTest33(void)
+{
+    OVERLAP_START(UINT_MAX - 500, OS_POLICY_BSD);
+
+    uint8_t data[1000];
+    for (uint32_t i = 0; i < sizeof(data); i++)
+        data[i] = 'a' + (i % 26);
+
+    /* in order */
+    for (uint32_t i = 0; i < 40; i++) {
+        OVERLAP_STEP(1 + i * 10, data + i * 10, 10, data, (i + 1) * 10);
+    }
+    FAIL_IF(!CheckSegmentTree(stream));
+
+    /* reordered: pairs swapped */
+    for (uint32_t i = 40; i < 80; i += 2) {
+        StreamTcpUTAddPayload(&tv, ra_ctx, &ssn, stream, stream->isn + 1 + (i + 1) * 10,
+                data + (i + 1) * 10, 10);
+        StreamTcpUTAddPayload(&tv, ra_ctx, &ssn, stream, stream->isn + 1 + i * 10,
+                data + i * 10, 10);
+        FAIL_IF(!VALIDATE(stream, data, (i + 2) * 10));
+    }
+    FAIL_IF(!CheckSegmentTree(stream));
+
+    /* overlapping: each segment retransmits the previous one */
+    for (uint32_t i = 80; i < 100; i++) {
+        OVERLAP_STEP(1 + (i - 1) * 10, data + (i - 1) * 10, 20, data, (i + 1) * 10);
+    }
+    FAIL_IF(!CheckSegmentTree(stream));
+
+    /* different data in an overlap: BSD keeps the old data */
+    OVERLAP_STEP(1 + 990, "XXXXXXXXXX", 10, data, 1000);
+    FAIL_IF(!CheckSegmentTree(stream));
+    FAIL_IF(stream->segs_right_edge != stream->isn + 1 + 1000);
+
+    OVERLAP_END;
+}
+
+/* segments in a tree: it's pruned as the data is acked, so it's small */
+#define SEG_BENCH_SEGMENTS  64
+#define SEG_BENCH_RUNS      10000
+
+/** \internal
+ *  \brief add in order segments to an empty tree, either appended to the
+ *         tail like DoInsertSegment() does or with the tree insert and
+ *         overlap check used before */
+static void SegBenchInsert(struct TCPSEG *tree, TcpSegment *segs, uint32_t cnt,
+        bool tail_append)
+{
+    RB_INIT(tree);
+    for (uint32_t i = 0; i < cnt; i++) {
+        TcpSegment *seg = &segs[i];
+        memset(&seg->rb, 0, sizeof(seg->rb));
+        if (tail_append && !RB_EMPTY(tree)) {
+            TcpSegmentTreeAppend(tree, RB_MAX(TCPSEG, tree), seg);
+        } else {
+            TCPSEG_RB_INSERT(tree, seg);
+            (void)CheckOverlap(tree, seg);
+        }
+    }
+}
+
+/** \test in order segments: appending to the tail gives the same tree
+ *        order as the tree insert. With profiling enabled, also print
+ *        the cost per segment of both ways. */
+static int StreamTcpReassembleTest34(void)
+{
+    TcpSegment *segs = SCCalloc(SEG_BENCH_SEGMENTS, sizeof(TcpSegment));
+    FAIL_IF_NULL(segs);
+    /* starts just before the sequence number wrap */
+    uint32_t seq = UINT_MAX - 50000;
+    for (uint32_t i = 0; i < SEG_BENCH_SEGMENTS; i++) {
+        segs[i].seq = seq;
+        segs[i].payload_len = 1448;
+        seq += 1448;
+    }
+
+    struct TCPSEG tree;
+    SegBenchInsert(&tree, segs, SEG_BENCH_SEGMENTS, true);
+    TcpSegment *seg = NULL;
+    uint32_t i = 0;
+    RB_FOREACH(seg, TCPSEG, &tree) {
+        FAIL_IF(seg != &segs[i]);
+        i++;
+    }
+    FAIL_IF(i != SEG_BENCH_SEGMENTS);
+
+    SegBenchInsert(&tree, segs, SEG_BENCH_SEGMENTS, false);
+    i = 0;
+    RB_FOREACH(seg, TCPSEG, &tree) {
+        FAIL_IF(seg != &segs[i]);
+        i++;
+    }
+    FAIL_IF(i != SEG_BENCH_SEGMENTS);
+
+#ifdef PROFILING
+    uint64_t ticks_start = UtilCpuGetTicks();
+    for (int r = 0; r < SEG_BENCH_RUNS; r++) {
+        SegBenchInsert(&tree, segs, SEG_BENCH_SEGMENTS, false);
+    }
+    uint64_t insert_ticks = UtilCpuGetTicks() - ticks_start;
+
+    ticks_start = UtilCpuGetTicks();
+    for (int r = 0; r < SEG_BENCH_RUNS; r++) {
+        SegBenchInsert(&tree, segs, SEG_BENCH_SEGMENTS, true);
+    }
+    uint64_t append_ticks = UtilCpuGetTicks() - ticks_start;
+
+    printf("\n%d in order segments (%d runs): tree insert %"PRIu64
+            " ticks/segment, tail append %"PRIu64" ticks/segment\n",
+            SEG_BENCH_SEGMENTS, SEG_BENCH_RUNS,
+            insert_ticks / ((uint64_t)SEG_BENCH_RUNS * SEG_BENCH_SEGMENTS),
+            append_ticks / ((uint64_t)SEG_BENCH_RUNS * SEG_BENCH_SEGMENTS));
+#endif
+
+    SCFree(segs);
+    PASS;
+}
+
 void StreamTcpListRegisterTests(void)
 {
     UtRegisterTest("StreamTcpReassembleTest01 -- BSD policy",
@@ -729,5 +866,9 @@ void StreamTcpListRegisterTests(void)
             StreamTcpReassembleTest31);
     UtRegisterTest("StreamTcpReassembleTest32",
             StreamTcpReassembleTest32);
+    UtRegisterTest("StreamTcpReassembleTest33",
+            StreamTcpReassembleTest33);
+    UtRegisterTest("StreamTcpReassembleTest34",
+            StreamTcpReassembleTest34);
 
 }
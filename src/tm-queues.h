@@ -24,6 +24,8 @@
 #ifndef __TM_QUEUES_H__
 #define __TM_QUEUES_H__
 
+#define TMQ_MAX_QUEUES 256
+
 typedef struct Tmq_ {
     char *name;
     uint16_t id;
@@ -34,6 +34,7 @@
 #include "tm-queuehandlers.h"
 #include "tm-threads.h"
 #include "tmqh-packetpool.h"
+#include "tmqh-flow.h"
 #include "threads.h"
 #include "util-debug.h"
 #include "util-privs.h"
@@ -108,6 +109,54 @@ void TmThreadsUnsetFlag(ThreadVars *tv, uint16_t flag)
     SC_ATOMIC_AND(tv->flags, ~flag);
 }
 
+/** \internal
+ *  \brief run the packets a slot put in its pre-pq through the rest
+ *         of the chain */
+static TmEcode TmThreadsSlotHandlePrePQ(ThreadVars *tv, TmSlot *s)
+{
+    Packet *extra_p;
+    TmEcode r;
+
+    while (s->slot_pre_pq.top != NULL) {
+        extra_p = PacketDequeue(&s->slot_pre_pq);
+        if (unlikely(extra_p == NULL))
+            continue;
+
+        /* see if we need to process the packet */
+        if (s->slot_next != NULL) {
+            r = TmThreadsSlotVarRun(tv, extra_p, s->slot_next);
+            if (unlikely(r == TM_ECODE_FAILED)) {
+                TmqhReleasePacketsToPacketPool(&s->slot_pre_pq);
+
+                SCMutexLock(&s->slot_post_pq.mutex_q);
+                TmqhReleasePacketsToPacketPool(&s->slot_post_pq);
+                SCMutexUnlock(&s->slot_post_pq.mutex_q);
+
+                TmqhOutputPacketpool(tv, extra_p);
+                TmThreadsSetFlag(tv, THV_FAILED);
+                return TM_ECODE_FAILED;
+            }
+        }
+        tv->tmqh_out(tv, extra_p);
+    }
+    return TM_ECODE_OK;
+}
+
+/** \internal
+ *  \brief handle a failing slot: return its queued packets to the pool */
+static TmEcode TmThreadsSlotFailed(ThreadVars *tv, TmSlot *s)
+{
+    /* Encountered error.  Return packets to packetpool and return */
+    TmqhReleasePacketsToPacketPool(&s->slot_pre_pq);
+
+    SCMutexLock(&s->slot_post_pq.mutex_q);
+    TmqhReleasePacketsToPacketPool(&s->slot_post_pq);
+    SCMutexUnlock(&s->slot_post_pq.mutex_q);
+
+    TmThreadsSetFlag(tv, THV_FAILED);
+    return TM_ECODE_FAILED;
+}
+
 /**
  * \brief Separate run function so we can call it recursively.
  *
@@ -118,7 +167,6 @@ TmEcode TmThreadsSlotVarRun(ThreadVars *tv, Packet *p,
 {
     TmEcode r;
     TmSlot *s;
-    Packet *extra_p;
 
     for (s = slot; s != NULL; s = s->slot_next) {
         TmSlotFunc SlotFunc = SC_ATOMIC_GET(s->SlotFunc);
@@ -134,45 +182,87 @@ TmEcode TmThreadsSlotVarRun(ThreadVars *tv, Packet *p,
 
         /* handle error */
         if (unlikely(r == TM_ECODE_FAILED)) {
-            /* Encountered error.  Return packets to packetpool and return */
-            TmqhReleasePacketsToPacketPool(&s->slot_pre_pq);
-
-            SCMutexLock(&s->slot_post_pq.mutex_q);
-            TmqhReleasePacketsToPacketPool(&s->slot_post_pq);
-            SCMutexUnlock(&s->slot_post_pq.mutex_q);
-
-            TmThreadsSetFlag(tv, THV_FAILED);
-            return TM_ECODE_FAILED;
+            return TmThreadsSlotFailed(tv, s);
         }
 
         /* handle new packets */
-        while (s->slot_pre_pq.top != NULL) {
-            extra_p = PacketDequeue(&s->slot_pre_pq);
-            if (unlikely(extra_p == NULL))
-                continue;
-
-            /* see if we need to process the packet */
-            if (s->slot_next != NULL) {
-                r = TmThreadsSlotVarRun(tv, extra_p, s->slot_next);
-                if (unlikely(r == TM_ECODE_FAILED)) {
-                    TmqhReleasePacketsToPacketPool(&s->slot_pre_pq);
-
-                    SCMutexLock(&s->slot_post_pq.mutex_q);
-                    TmqhReleasePacketsToPacketPool(&s->slot_post_pq);
-                    SCMutexUnlock(&s->slot_post_pq.mutex_q);
-
-                    TmqhOutputPacketpool(tv, extra_p);
-                    TmThreadsSetFlag(tv, THV_FAILED);
+        if (s->slot_pre_pq.top != NULL) {
+            if (TmThreadsSlotHandlePrePQ(tv, s) == TM_ECODE_FAILED)
+                return TM_ECODE_FAILED;
+        }
+    }
+
+    return TM_ECODE_OK;
+}
+
+/**
+ *  \brief run a burst of packets through the slots
+ *
+ *  Each slot processes all packets of the burst before the next slot
+ *  runs, so the code and data of a stage stay hot in the cache.
+ *
+ *  Packets a slot adds to its pre-pq are run through the rest of the
+ *  chain right away, so they are still handled before the packet that
+ *  created them moves on, like in TmThreadsSlotVarRun().
+ */
+TmEcode TmThreadsSlotVarRunBurst(ThreadVars *tv, Packet **pkts, uint32_t cnt,
+                                 TmSlot *slot)
+{
+    TmEcode r;
+    TmSlot *s;
+
+    for (s = slot; s != NULL; s = s->slot_next) {
+        TmSlotFunc SlotFunc = SC_ATOMIC_GET(s->SlotFunc);
+        void *slot_data = SC_ATOMIC_GET(s->slot_data);
+        PacketQueue *post_pq = unlikely(s->id == 0) ? &s->slot_post_pq : NULL;
+
+        for (uint32_t i = 0; i < cnt; i++) {
+            Packet *p = pkts[i];
+
+            PACKET_PROFILING_TMM_START(p, s->tm_id);
+            r = SlotFunc(tv, p, slot_data, &s->slot_pre_pq, post_pq);
+            PACKET_PROFILING_TMM_END(p, s->tm_id);
+
+            if (unlikely(r == TM_ECODE_FAILED)) {
+                return TmThreadsSlotFailed(tv, s);
+            }
+
+            if (unlikely(s->slot_pre_pq.top != NULL)) {
+                if (TmThreadsSlotHandlePrePQ(tv, s) == TM_ECODE_FAILED)
                     return TM_ECODE_FAILED;
-                }
             }
-            tv->tmqh_out(tv, extra_p);
         }
     }
 
     return TM_ECODE_OK;
 }
 
+/**
+ *  \brief setup the burst state of a capture thread
+ *
+ *  Needs to be called from the ThreadInit function of the capture
+ *  module as it registers the "capture.burst_size" counter.
+ *
+ *  \param size max packets per burst. 1 disables bursts.
+ */
+void TmPacketBurstInit(ThreadVars *tv, TmPacketBurst *b, uint32_t size)
+{
+    memset(b, 0x00, sizeof(*b));
+
+    if (size == 0)
+        size = 1;
+    if (size > TM_BURST_MAX) {
+        SCLogWarning(SC_ERR_INVALID_VALUE, "burst-size %u too big, "
+                "using max of %u", size, TM_BURST_MAX);
+        size = TM_BURST_MAX;
+    }
+    b->size = size;
+
+    if (b->size > 1) {
+        b->counter_burst_size = StatsRegisterAvgCounter("capture.burst_size", tv);
+    }
+}
+
 #ifndef AFLFUZZ_PCAP_RUNMODE
 
 /** \internal
@@ -1434,7 +1524,7 @@ static int TmThreadKillThread(ThreadVars *tv)
         if (!(strlen(tv->inq->name) == strlen("packetpool") &&
               strcasecmp(tv->inq->name, "packetpool") == 0)) {
             PacketQueue *q = &trans_q[tv->inq->id];
-            if (q->len != 0) {
+            if (q->len != 0 || TmqhFlowRingQueueLen(tv->inq->id) != 0) {
                 return 0;
             }
         }
@@ -1585,7 +1675,7 @@ again:
                 if (!(strlen(tv->inq->name) == strlen("packetpool") &&
                       strcasecmp(tv->inq->name, "packetpool") == 0)) {
                     PacketQueue *q = &trans_q[tv->inq->id];
-                    if (q->len != 0) {
+                    if (q->len != 0 || TmqhFlowRingQueueLen(tv->inq->id) != 0) {
                         SCMutexUnlock(&tv_root_lock);
                         /* don't sleep while holding a lock */
                         SleepMsec(1);
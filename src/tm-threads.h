@@ -47,6 +47,9 @@ static inline void SleepUsec(uint64_t usec)
 #define TM_QUEUE_NAME_MAX 16
 #define TM_THREAD_NAME_MAX 16
 
+/** max number of packets a capture module can pass in one burst */
+#define TM_BURST_MAX 64
+
 typedef TmEcode (*TmSlotFunc)(ThreadVars *, Packet *, void *, PacketQueue *,
                         PacketQueue *);
 
@@ -91,6 +94,15 @@ typedef struct TmSlot_ {
 
 } TmSlot;
 
+/** \brief packets collected by a capture module to be run through
+ *         the slots as one burst */
+typedef struct TmPacketBurst_ {
+    uint32_t size;                  /**< max packets per burst */
+    uint32_t cnt;                   /**< packets currently queued */
+    uint16_t counter_burst_size;    /**< avg burst size counter */
+    Packet *pkts[TM_BURST_MAX];
+} TmPacketBurst;
+
 extern ThreadVars *tv_root[TVT_MAX];
 
 extern SCMutex tv_root_lock;
@@ -139,6 +151,8 @@ void TmThreadsUnsetFlag(ThreadVars *, uint16_t);
 void TmThreadWaitForFlag(ThreadVars *, uint16_t);
 
 TmEcode TmThreadsSlotVarRun (ThreadVars *tv, Packet *p, TmSlot *slot);
+TmEcode TmThreadsSlotVarRunBurst(ThreadVars *tv, Packet **pkts, uint32_t cnt, TmSlot *slot);
+void TmPacketBurstInit(ThreadVars *tv, TmPacketBurst *b, uint32_t size);
 
 ThreadVars *TmThreadsGetTVContainingSlot(TmSlot *);
 void TmThreadDisablePacketThreads(void);
@@ -246,6 +260,77 @@ static inline TmEcode TmThreadsSlotHandlePostPQs(ThreadVars *tv, TmSlot *s)
     return TM_ECODE_OK;
 }
 
+/**
+ *  \brief Process a burst of packets through the rest of the slots
+ *         and queue them.
+ *
+ *  On failure all packets of the burst are returned to the pool.
+ */
+static inline TmEcode TmThreadsSlotProcessPktBurst(ThreadVars *tv, TmSlot *s,
+        Packet **pkts, uint32_t cnt)
+{
+    uint32_t i;
+
+    if (s == NULL) {
+        for (i = 0; i < cnt; i++)
+            tv->tmqh_out(tv, pkts[i]);
+        return TM_ECODE_OK;
+    }
+
+    if (TmThreadsSlotVarRunBurst(tv, pkts, cnt, s) == TM_ECODE_FAILED) {
+        for (i = 0; i < cnt; i++)
+            TmqhOutputPacketpool(tv, pkts[i]);
+        for (TmSlot *slot = s; slot != NULL; slot = slot->slot_next) {
+            SCMutexLock(&slot->slot_post_pq.mutex_q);
+            TmqhReleasePacketsToPacketPool(&slot->slot_post_pq);
+            SCMutexUnlock(&slot->slot_post_pq.mutex_q);
+        }
+        TmThreadsSetFlag(tv, THV_FAILED);
+        return TM_ECODE_FAILED;
+    }
+
+    for (i = 0; i < cnt; i++)
+        tv->tmqh_out(tv, pkts[i]);
+
+    return TmThreadsSlotHandlePostPQs(tv, s);
+}
+
+/**
+ *  \brief run the queued packets of a burst through the slots
+ *
+ *  \retval r TM_ECODE_OK or TM_ECODE_FAILED. In both cases the burst
+ *           is empty afterwards.
+ */
+static inline TmEcode TmPacketBurstFlush(ThreadVars *tv, TmSlot *s, TmPacketBurst *b)
+{
+    if (b->cnt == 0)
+        return TM_ECODE_OK;
+
+    StatsAddUI64(tv, b->counter_burst_size, b->cnt);
+    TmEcode r = TmThreadsSlotProcessPktBurst(tv, s, b->pkts, b->cnt);
+    b->cnt = 0;
+    return r;
+}
+
+/**
+ *  \brief add a packet to a burst, flushing the burst when it's full
+ *
+ *  If bursts are disabled the packet is processed right away.
+ *  On failure the packet(s) are returned to the pool.
+ */
+static inline TmEcode TmPacketBurstAdd(ThreadVars *tv, TmSlot *s, TmPacketBurst *b,
+        Packet *p)
+{
+    if (b->size <= 1) {
+        return TmThreadsSlotProcessPkt(tv, s, p);
+    }
+
+    b->pkts[b->cnt++] = p;
+    if (b->cnt >= b->size)
+        return TmPacketBurstFlush(tv, s, b);
+    return TM_ECODE_OK;
+}
+
 /** \brief inject packet if THV_CAPTURE_INJECT_PKT is set
  *  Allow caller to supply their own packet
  *
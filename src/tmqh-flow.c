@@ -32,12 +32,15 @@
 #include "decode.h"
 #include "threads.h"
 #include "threadvars.h"
+#include "tm-queues.h"
 #include "tmqh-flow.h"
 
 #include "tm-queuehandlers.h"
+#include "tm-threads.h"
 
 #include "conf.h"
 #include "util-unittest.h"
+#include "util-spsc-ring.h"
 
 Packet *TmqhInputFlow(ThreadVars *t);
 void TmqhOutputFlowHash(ThreadVars *t, Packet *p);
@@ -46,6 +49,56 @@ void *TmqhOutputFlowSetupCtx(const char *queue_str);
 void TmqhOutputFlowFreeCtx(void *ctx);
 void TmqhFlowRegisterTests(void);
 
+Packet *TmqhInputFlowRing(ThreadVars *t);
+void TmqhOutputFlowRingHash(ThreadVars *t, Packet *p);
+void TmqhOutputFlowRingIPPair(ThreadVars *t, Packet *p);
+void *TmqhOutputFlowRingSetupCtx(const char *queue_str);
+
+extern intmax_t max_pending_packets;
+
+/** max packets the reader takes from a ring in one go */
+#define FLOW_RING_BATCH     32
+/** bounds for the adaptive spin budget of an idle reader */
+#define FLOW_RING_SPIN_MIN  64
+#define FLOW_RING_SPIN_MAX  8192
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FLOW_RING_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define FLOW_RING_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define FLOW_RING_CPU_RELAX() cc_barrier()
+#endif
+
+/** \brief per input queue state for the flow-ring handler
+ *
+ *  Each writer (capture) thread gets its own SPSC ring into the queue,
+ *  so writers never contend with each other or with the reader. The
+ *  PacketQueue of the same id is still used for packets injected by
+ *  the flow manager and the detect reload logic, and its mutex/cond
+ *  pair is used to put the reader to sleep when all rings are idle.
+ */
+typedef struct TmqhFlowRingQueue_ {
+    SpscRing **rings;               /**< one ring per writer thread */
+    uint16_t rings_cnt;
+
+    /* reader side */
+    uint16_t next;                  /**< ring to poll first */
+    uint32_t spin;                  /**< current spin budget */
+    uint32_t batch_idx;
+    uint32_t batch_cnt;
+    Packet *batch[FLOW_RING_BATCH]; /**< packets taken from a ring */
+    /** size of the batch until the reader is done with it, for other
+     *  threads checking if the queue is drained */
+    SC_ATOMIC_DECLARE(uint32_t, batch_pending);
+
+    /** set by the reader while it waits on the queue cond */
+    SC_ATOMIC_DECLARE(int, sleeping);
+} TmqhFlowRingQueue;
+
+/** indexed by queue id */
+static TmqhFlowRingQueue flow_ring_queues[TMQ_MAX_QUEUES];
+
 void TmqhFlowRegister(void)
 {
     tmqh_table[TMQH_FLOW].name = "flow";
@@ -76,9 +129,37 @@ void TmqhFlowRegister(void)
         tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowHash;
     }
 
+    tmqh_table[TMQH_FLOW_RING].name = "flow-ring";
+    tmqh_table[TMQH_FLOW_RING].InHandler = TmqhInputFlowRing;
+    tmqh_table[TMQH_FLOW_RING].OutHandlerCtxSetup = TmqhOutputFlowRingSetupCtx;
+    tmqh_table[TMQH_FLOW_RING].OutHandlerCtxFree = TmqhOutputFlowFreeCtx;
+    if (tmqh_table[TMQH_FLOW].OutHandler == TmqhOutputFlowIPPair)
+        tmqh_table[TMQH_FLOW_RING].OutHandler = TmqhOutputFlowRingIPPair;
+    else
+        tmqh_table[TMQH_FLOW_RING].OutHandler = TmqhOutputFlowRingHash;
+
     return;
 }
 
+/** \brief free the per queue rings of the flow-ring handler
+ *
+ *  Rings are owned by the reader side: a writer may be gone before its
+ *  reader has drained the ring, so they are only released once all
+ *  packet threads are gone. Called when the queues are reset after a
+ *  run, so the next run (unix socket mode) starts without rings. */
+void TmqhFlowRingCleanup(void)
+{
+    for (int i = 0; i < TMQ_MAX_QUEUES; i++) {
+        TmqhFlowRingQueue *rq = &flow_ring_queues[i];
+        for (uint16_t r = 0; r < rq->rings_cnt; r++) {
+            SpscRingFree(rq->rings[r]);
+        }
+        if (rq->rings != NULL)
+            SCFree(rq->rings);
+        memset(rq, 0x00, sizeof(*rq));
+    }
+}
+
 void TmqhFlowPrintAutofpHandler(void)
 {
 #define PRINT_IF_FUNC(f, msg)                       \
@@ -220,12 +301,10 @@ void TmqhOutputFlowFreeCtx(void *ctx)
     return;
 }
 
-void TmqhOutputFlowHash(ThreadVars *tv, Packet *p)
+static inline int16_t TmqhFlowHashQueueId(TmqhFlowCtx *ctx, const Packet *p)
 {
     int16_t qid = 0;
 
-    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
-
     if (p->flags & PKT_WANTS_FLOW) {
         uint32_t hash = p->flow_hash;
         qid = hash % ctx->size;
@@ -235,6 +314,31 @@ void TmqhOutputFlowHash(ThreadVars *tv, Packet *p)
         if (ctx->last == ctx->size)
             ctx->last = 0;
     }
+    return qid;
+}
+
+static inline int16_t TmqhFlowIPPairQueueId(TmqhFlowCtx *ctx, const Packet *p)
+{
+    uint32_t addr_hash = 0;
+    int i;
+
+    if (p->src.family == AF_INET6) {
+        for (i = 0; i < 4; i++) {
+            addr_hash += p->src.addr_data32[i] + p->dst.addr_data32[i];
+        }
+    } else {
+        addr_hash = p->src.addr_data32[0] + p->dst.addr_data32[0];
+    }
+
+    /* we don't have to worry about possible overflow, since
+     * ctx->size will be lesser than 2 ** 31 for sure */
+    return addr_hash % ctx->size;
+}
+
+void TmqhOutputFlowHash(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int16_t qid = TmqhFlowHashQueueId(ctx, p);
 
     PacketQueue *q = ctx->queues[qid].q;
     SCMutexLock(&q->mutex_q);
@@ -253,31 +357,218 @@ void TmqhOutputFlowHash(ThreadVars *tv, Packet *p)
  */
 void TmqhOutputFlowIPPair(ThreadVars *tv, Packet *p)
 {
-    int16_t qid = 0;
-    uint32_t addr_hash = 0;
-    int i;
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int16_t qid = TmqhFlowIPPairQueueId(ctx, p);
+
+    PacketQueue *q = ctx->queues[qid].q;
+    SCMutexLock(&q->mutex_q);
+    PacketEnqueue(q, p);
+    SCCondSignal(&q->cond_q);
+    SCMutexUnlock(&q->mutex_q);
+
+    return;
+}
 
+/**
+ * \brief setup the flow-ring queue handlers ctx
+ *
+ * Same as TmqhOutputFlowSetupCtx(), but also creates a ring from this
+ * writer into each of the queues.
+ *
+ * \param queue_str comma separated string with output queue names
+ *
+ * \retval ctx queues handlers ctx or NULL in error
+ */
+void *TmqhOutputFlowRingSetupCtx(const char *queue_str)
+{
+    TmqhFlowCtx *ctx = TmqhOutputFlowSetupCtx(queue_str);
+    if (ctx == NULL)
+        return NULL;
+
+    /* a writer can't have more packets in flight than its packet pool
+     * holds, so rings of this size never fill up in practice */
+    uint32_t ring_size = max_pending_packets > 0 ? (uint32_t)max_pending_packets : 1024;
+
+    for (uint16_t i = 0; i < ctx->size; i++) {
+        uint16_t id = (uint16_t)(ctx->queues[i].q - trans_q);
+        TmqhFlowRingQueue *rq = &flow_ring_queues[id];
+
+        SpscRing *ring = SpscRingAlloc(ring_size);
+        if (ring == NULL)
+            goto error;
+
+        SpscRing **ptmp = SCRealloc(rq->rings, (rq->rings_cnt + 1) * sizeof(SpscRing *));
+        if (ptmp == NULL) {
+            SpscRingFree(ring);
+            goto error;
+        }
+        rq->rings = ptmp;
+        rq->rings[rq->rings_cnt++] = ring;
+        if (rq->spin == 0)
+            rq->spin = FLOW_RING_SPIN_MIN;
+
+        ctx->queues[i].ring = ring;
+    }
+
+    SCLogDebug("flow-ring: %u rings of %u slots", ctx->size, ring_size);
+    return ctx;
+
+error:
+    SCLogError(SC_ERR_MEM_ALLOC, "failed to set up flow-ring queues");
+    /* rings that were created are owned and freed by the queue */
+    TmqhOutputFlowFreeCtx(ctx);
+    return NULL;
+}
+
+static inline void TmqhFlowRingEnqueue(TmqhFlowMode *m, Packet *p)
+{
+    uint16_t id = (uint16_t)(m->q - trans_q);
+    TmqhFlowRingQueue *rq = &flow_ring_queues[id];
+
+    while (SpscRingEnqueue(m->ring, p) == 0) {
+        /* reader is behind: make sure it's awake and wait for room */
+        SCMutexLock(&m->q->mutex_q);
+        SCCondSignal(&m->q->cond_q);
+        SCMutexUnlock(&m->q->mutex_q);
+        SleepUsec(1);
+    }
+
+    /* pairs with the barrier on the reader side before it goes to
+     * sleep: either we see 'sleeping' or it sees our packet. */
+    hw_barrier();
+    if (SC_ATOMIC_GET(rq->sleeping)) {
+        SCMutexLock(&m->q->mutex_q);
+        SCCondSignal(&m->q->cond_q);
+        SCMutexUnlock(&m->q->mutex_q);
+    }
+}
+
+void TmqhOutputFlowRingHash(ThreadVars *tv, Packet *p)
+{
     TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int16_t qid = TmqhFlowHashQueueId(ctx, p);
 
-    if (p->src.family == AF_INET6) {
-        for (i = 0; i < 4; i++) {
-            addr_hash += p->src.addr_data32[i] + p->dst.addr_data32[i];
+    TmqhFlowRingEnqueue(&ctx->queues[qid], p);
+}
+
+void TmqhOutputFlowRingIPPair(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int16_t qid = TmqhFlowIPPairQueueId(ctx, p);
+
+    TmqhFlowRingEnqueue(&ctx->queues[qid], p);
+}
+
+/** \internal
+ *  \brief get a packet from the local batch, refilling it from the
+ *         rings round robin */
+static inline Packet *TmqhFlowRingQueueGet(TmqhFlowRingQueue *rq)
+{
+    if (rq->batch_idx < rq->batch_cnt)
+        return rq->batch[rq->batch_idx++];
+
+    if (rq->batch_cnt > 0) {
+        (void)SC_ATOMIC_SUB(rq->batch_pending, rq->batch_cnt);
+        rq->batch_cnt = 0;
+        rq->batch_idx = 0;
+    }
+
+    for (uint16_t i = 0; i < rq->rings_cnt; i++) {
+        SpscRing *ring = rq->rings[rq->next];
+        if (++rq->next == rq->rings_cnt)
+            rq->next = 0;
+
+        if (SpscRingCount(ring) == 0)
+            continue;
+
+        /* account for the batch before the packets leave the ring, so
+         * TmqhFlowRingQueueLen() never misses them */
+        (void)SC_ATOMIC_ADD(rq->batch_pending, FLOW_RING_BATCH);
+        uint32_t cnt = SpscRingDequeueBulk(ring, (void **)rq->batch, FLOW_RING_BATCH);
+        if (cnt < FLOW_RING_BATCH)
+            (void)SC_ATOMIC_SUB(rq->batch_pending, FLOW_RING_BATCH - cnt);
+        if (cnt > 0) {
+            rq->batch_cnt = cnt;
+            rq->batch_idx = 1;
+            return rq->batch[0];
         }
-    } else {
-        addr_hash = p->src.addr_data32[0] + p->dst.addr_data32[0];
     }
+    return NULL;
+}
+
+/**
+ * \brief number of packets waiting in the rings of a queue
+ *
+ * Counts the rings and the batch the reader is working on. The rings
+ * are read first: the reader accounts a batch before taking packets
+ * from a ring, so a packet moving to the batch is always seen.
+ */
+uint32_t TmqhFlowRingQueueLen(uint16_t id)
+{
+    TmqhFlowRingQueue *rq = &flow_ring_queues[id];
+    uint32_t len = 0;
+
+    for (uint16_t i = 0; i < rq->rings_cnt; i++) {
+        len += SpscRingCount(rq->rings[i]);
+    }
+    len += SC_ATOMIC_GET(rq->batch_pending);
+    return len;
+}
 
-    /* we don't have to worry about possible overflow, since
-     * ctx->size will be lesser than 2 ** 31 for sure */
-    qid = addr_hash % ctx->size;
+/**
+ * \brief flow-ring input handler
+ *
+ * Polls the rings of all writers, spinning for a while when they are
+ * empty. The spin budget grows when spinning finds packets and shrinks
+ * when it doesn't, so a busy reader never sleeps and an idle one falls
+ * back to the queue condition quickly.
+ */
+Packet *TmqhInputFlowRing(ThreadVars *tv)
+{
+    PacketQueue *q = &trans_q[tv->inq->id];
+    TmqhFlowRingQueue *rq = &flow_ring_queues[tv->inq->id];
+    Packet *p;
+
+    StatsSyncCountersIfSignalled(tv);
+
+    for (uint32_t spins = 0; spins < rq->spin; spins++) {
+        p = TmqhFlowRingQueueGet(rq);
+        if (p != NULL) {
+            if (spins > 0 && rq->spin < FLOW_RING_SPIN_MAX)
+                rq->spin <<= 1;
+            return p;
+        }
+
+        /* packets injected by the flow manager or a detect reload */
+        if (q->len > 0) {
+            SCMutexLock(&q->mutex_q);
+            p = PacketDequeue(q);
+            SCMutexUnlock(&q->mutex_q);
+            if (p != NULL)
+                return p;
+        }
+
+        FLOW_RING_CPU_RELAX();
+    }
+    if (rq->spin > FLOW_RING_SPIN_MIN)
+        rq->spin >>= 1;
 
-    PacketQueue *q = ctx->queues[qid].q;
     SCMutexLock(&q->mutex_q);
-    PacketEnqueue(q, p);
-    SCCondSignal(&q->cond_q);
+    SC_ATOMIC_SET(rq->sleeping, 1);
+    hw_barrier();
+    if (q->len == 0 && TmqhFlowRingQueueLen(tv->inq->id) == 0) {
+        /* if we have no packets in queue, wait... */
+        SCCondWait(&q->cond_q, &q->mutex_q);
+    }
+    SC_ATOMIC_SET(rq->sleeping, 0);
+
+    p = PacketDequeue(q);
     SCMutexUnlock(&q->mutex_q);
 
-    return;
+    if (p == NULL)
+        p = TmqhFlowRingQueueGet(rq);
+    /* return NULL if we have no pkt. Should only happen on signals. */
+    return p;
 }
 
 #ifdef UNITTESTS
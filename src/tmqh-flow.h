@@ -26,6 +26,7 @@
 
 typedef struct TmqhFlowMode_ {
     PacketQueue *q;
+    struct SpscRing_ *ring;     /**< writer's ring into q (flow-ring only) */
 } TmqhFlowMode;
 
 /** \brief Ctx for the flow queue handler
@@ -43,4 +44,7 @@ void TmqhFlowRegisterTests(void);
 
 void TmqhFlowPrintAutofpHandler(void);
 
+void TmqhFlowRingCleanup(void);
+uint32_t TmqhFlowRingQueueLen(uint16_t id);
+
 #endif /* __TMQH_FLOW_H__ */
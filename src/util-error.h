@@ -351,6 +351,7 @@ typedef enum {
     SC_WARN_EVE_MISSING_EVENTS,
     SC_ERR_PLEDGE_FAILED,
     SC_ERR_FTP_LOG_GENERIC,
+    SC_ERR_DATASET,
 
     SC_ERR_MAX,
 } SCError;
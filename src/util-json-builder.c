@@ -0,0 +1,800 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Append only JSON writer that writes into a MemBuffer.
+ */
+
+#include "suricata-common.h"
+#include <math.h>
+
+#include "util-buffer.h"
+#include "util-json-builder.h"
+
+#include "util-unittest.h"
+
+#define JB_STATE_ARRAY      0x01    /**< container is an array */
+#define JB_STATE_NONEMPTY   0x02    /**< container has members */
+
+/** buffers are grown in multiples of this */
+#define JSON_BUILDER_EXPAND_SIZE 4096
+
+static const char jb_hex[] = "0123456789ABCDEF";
+
+/** \internal
+ *  \brief make sure 'len' more bytes and a terminating NUL fit */
+static inline int JBReserve(JsonBuilder *jb, uint32_t len)
+{
+    if (unlikely(jb->error))
+        return -1;
+
+    const MemBuffer *b = *jb->buffer;
+    const uint64_t need = (uint64_t)b->offset + len + 1;
+    if (likely(need <= b->size))
+        return 0;
+
+    uint64_t expand_by = need - b->size;
+    expand_by = ((expand_by + JSON_BUILDER_EXPAND_SIZE - 1) /
+            JSON_BUILDER_EXPAND_SIZE) * JSON_BUILDER_EXPAND_SIZE;
+    if (expand_by > UINT32_MAX ||
+            MemBufferExpand(jb->buffer, (uint32_t)expand_by) != 0) {
+        jb->error = true;
+        return -1;
+    }
+    return 0;
+}
+
+static inline int JBWriteRaw(JsonBuilder *jb, const void *data, uint32_t len)
+{
+    if (JBReserve(jb, len) < 0)
+        return -1;
+
+    MemBuffer *b = *jb->buffer;
+    memcpy(b->buffer + b->offset, data, len);
+    b->offset += len;
+    return 0;
+}
+
+static inline int JBWriteChar(JsonBuilder *jb, const char c)
+{
+    if (JBReserve(jb, 1) < 0)
+        return -1;
+
+    MemBuffer *b = *jb->buffer;
+    b->buffer[b->offset++] = (uint8_t)c;
+    return 0;
+}
+
+/** \internal
+ *  \brief check if a byte can't be copied into a string as is
+ *
+ *  Bytes above 0x7f are checked to be valid UTF-8 even when they are
+ *  not escaped. */
+static inline bool JBNeedsEscape(const JsonBuilder *jb, const uint8_t c)
+{
+    return (c < 0x20 || c >= 0x80 || c == '"' || c == '\\' ||
+            (c == '/' && (jb->flags & JSON_BUILDER_ESCAPE_SLASH)));
+}
+
+/** \internal
+ *  \brief write \\uXXXX to 'dst' */
+static inline void JBHexEscape(char *dst, const uint32_t v)
+{
+    dst[0] = '\\';
+    dst[1] = 'u';
+    dst[2] = jb_hex[(v >> 12) & 0xf];
+    dst[3] = jb_hex[(v >> 8) & 0xf];
+    dst[4] = jb_hex[(v >> 4) & 0xf];
+    dst[5] = jb_hex[v & 0xf];
+}
+
+/** \internal
+ *  \brief escape sequence for an ASCII character
+ *
+ *  \retval len length of the sequence in 'seq'
+ */
+static inline uint32_t JBEscapeAscii(char *seq, const uint8_t c)
+{
+    seq[0] = '\\';
+    switch (c) {
+        case '"':  seq[1] = '"'; return 2;
+        case '\\': seq[1] = '\\'; return 2;
+        case '/':  seq[1] = '/'; return 2;
+        case '\b': seq[1] = 'b'; return 2;
+        case '\f': seq[1] = 'f'; return 2;
+        case '\n': seq[1] = 'n'; return 2;
+        case '\r': seq[1] = 'r'; return 2;
+        case '\t': seq[1] = 't'; return 2;
+        default:
+            JBHexEscape(seq, c);
+            return 6;
+    }
+}
+
+/** \internal
+ *  \brief decode a UTF-8 sequence the way jansson validates them
+ *
+ *  \retval len length of the sequence or 0 if it's not valid
+ */
+static inline uint32_t JBDecodeUtf8(const uint8_t *s, const uint32_t len,
+        uint32_t *codepoint)
+{
+    uint32_t size;
+    uint32_t cp;
+
+    const uint8_t c = s[0];
+    if (c >= 0xC2 && c <= 0xDF) {
+        size = 2;
+        cp = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        size = 3;
+        cp = c & 0x0F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        size = 4;
+        cp = c & 0x07;
+    } else {
+        return 0;
+    }
+    if (size > len)
+        return 0;
+
+    for (uint32_t i = 1; i < size; i++) {
+        if ((s[i] & 0xC0) != 0x80)
+            return 0;
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+
+    /* overlong encodings, surrogates and out of range */
+    if ((size == 3 && cp < 0x800) || (size == 4 && cp < 0x10000) ||
+            (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+        return 0;
+
+    *codepoint = cp;
+    return size;
+}
+
+/** \internal
+ *  \brief write a quoted and escaped UTF-8 string
+ *
+ *  \retval 0 ok
+ *  \retval 1 string is not valid UTF-8
+ *  \retval -1 error
+ */
+static int JBWriteUtf8(JsonBuilder *jb, const uint8_t *s, const uint32_t len)
+{
+    if (JBWriteChar(jb, '"') < 0)
+        return -1;
+
+    uint32_t i = 0;
+    while (i < len) {
+        /* copy the bytes that need no escaping in one go */
+        uint32_t run = i;
+        while (run < len && !JBNeedsEscape(jb, s[run]))
+            run++;
+        if (run > i) {
+            if (JBWriteRaw(jb, s + i, run - i) < 0)
+                return -1;
+            i = run;
+            if (i == len)
+                break;
+        }
+
+        char seq[12];
+        uint32_t seq_len;
+        if (s[i] < 0x80) {
+            seq_len = JBEscapeAscii(seq, s[i]);
+            i++;
+        } else {
+            uint32_t cp = 0;
+            const uint32_t size = JBDecodeUtf8(s + i, len - i, &cp);
+            if (size == 0)
+                return 1;
+
+            if (!(jb->flags & JSON_BUILDER_ENSURE_ASCII)) {
+                if (JBWriteRaw(jb, s + i, size) < 0)
+                    return -1;
+                i += size;
+                continue;
+            }
+            i += size;
+
+            if (cp < 0x10000) {
+                JBHexEscape(seq, cp);
+                seq_len = 6;
+            } else {
+                /* surrogate pair */
+                cp -= 0x10000;
+                JBHexEscape(seq, 0xD800 | (cp >> 10));
+                JBHexEscape(seq + 6, 0xDC00 | (cp & 0x3FF));
+                seq_len = 12;
+            }
+        }
+        if (JBWriteRaw(jb, seq, seq_len) < 0)
+            return -1;
+    }
+
+    return JBWriteChar(jb, '"');
+}
+
+/** \internal
+ *  \brief write a string that is not valid UTF-8
+ *
+ *  Same output as SCJsonString(): non printable bytes are written as
+ *  "\xNN". That prints the byte as a char promoted to int, so where
+ *  char is signed bytes above 0x7f come out as "\xFFFFFFNN".
+ */
+static int JBWriteInvalidUtf8(JsonBuilder *jb, const uint8_t *s, const uint32_t len)
+{
+    if (JBWriteChar(jb, '"') < 0)
+        return -1;
+
+    for (uint32_t i = 0; i < len; i++) {
+        char seq[11];
+        uint32_t seq_len;
+        if (isprint(s[i])) {
+            if (JBNeedsEscape(jb, s[i])) {
+                seq_len = JBEscapeAscii(seq, s[i]);
+            } else {
+                seq[0] = (char)s[i];
+                seq_len = 1;
+            }
+        } else {
+            seq[0] = '\\';
+            seq[1] = '\\';
+            seq[2] = 'x';
+            seq_len = 3;
+            if ((int)(char)s[i] < 0) {
+                memcpy(seq + seq_len, "FFFFFF", 6);
+                seq_len += 6;
+            }
+            seq[seq_len++] = jb_hex[s[i] >> 4];
+            seq[seq_len++] = jb_hex[s[i] & 0xf];
+        }
+        if (JBWriteRaw(jb, seq, seq_len) < 0)
+            return -1;
+    }
+
+    return JBWriteChar(jb, '"');
+}
+
+static int JBWriteString(JsonBuilder *jb, const uint8_t *s, const uint32_t len)
+{
+    const uint32_t start = (*jb->buffer)->offset;
+
+    const int r = JBWriteUtf8(jb, s, len);
+    if (r != 1)
+        return r;
+
+    (*jb->buffer)->offset = start;
+    return JBWriteInvalidUtf8(jb, s, len);
+}
+
+/** \internal
+ *  \brief write the separator and key for the next value
+ *
+ *  \param key key of the value, NULL for values in an array
+ */
+static int JBStartValue(JsonBuilder *jb, const char *key)
+{
+    if (unlikely(jb->error))
+        return -1;
+
+    if (unlikely(jb->depth == 0)) {
+        jb->error = true;
+        return -1;
+    }
+
+    uint8_t *state = &jb->state[jb->depth - 1];
+    const bool array = (*state & JB_STATE_ARRAY) != 0;
+    if (unlikely(array != (key == NULL))) {
+        jb->error = true;
+        return -1;
+    }
+
+    /* without JSON_BUILDER_COMPACT the separators are followed by a
+     * space, like jansson does when not indenting */
+    const bool compact = (jb->flags & JSON_BUILDER_COMPACT) != 0;
+    if (*state & JB_STATE_NONEMPTY) {
+        if (JBWriteRaw(jb, ", ", compact ? 1 : 2) < 0)
+            return -1;
+    }
+    *state |= JB_STATE_NONEMPTY;
+
+    if (key != NULL) {
+        if (JBWriteString(jb, (const uint8_t *)key, (uint32_t)strlen(key)) < 0)
+            return -1;
+        if (JBWriteRaw(jb, ": ", compact ? 1 : 2) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int JBWriteNumber(JsonBuilder *jb, uint64_t val, const bool neg)
+{
+    char tmp[21];
+    uint32_t i = sizeof(tmp);
+
+    do {
+        tmp[--i] = (char)('0' + (val % 10));
+        val /= 10;
+    } while (val != 0);
+    if (neg)
+        tmp[--i] = '-';
+
+    return JBWriteRaw(jb, tmp + i, (uint32_t)sizeof(tmp) - i);
+}
+
+/**
+ *  \brief start a JSON object at the current offset of a buffer
+ *
+ *  \param buffer buffer to write to. It's expanded if needed, so the
+ *                pointer may change.
+ */
+void JsonBuilderInit(JsonBuilder *jb, MemBuffer **buffer)
+{
+    JsonBuilderInitFlags(jb, buffer, JSON_BUILDER_DEFAULT_FLAGS);
+}
+
+/**
+ *  \brief start a JSON object with non default output options
+ *
+ *  \param flags JSON_BUILDER_* flags
+ */
+void JsonBuilderInitFlags(JsonBuilder *jb, MemBuffer **buffer, uint8_t flags)
+{
+    jb->buffer = buffer;
+    jb->error = false;
+    jb->depth = 0;
+    jb->flags = flags;
+
+    if (JBWriteChar(jb, '{') == 0) {
+        jb->state[0] = 0;
+        jb->depth = 1;
+    }
+}
+
+/**
+ *  \brief close the top level object
+ *
+ *  \retval 0 ok
+ *  \retval -1 an error happened while building or not all objects and
+ *          arrays were closed. The buffer content is not valid JSON.
+ */
+int JsonBuilderFinish(JsonBuilder *jb)
+{
+    if (jb->error || jb->depth != 1) {
+        jb->error = true;
+        return -1;
+    }
+
+    if (JBWriteChar(jb, '}') < 0)
+        return -1;
+    jb->depth = 0;
+
+    MemBuffer *b = *jb->buffer;
+    b->buffer[b->offset] = '\0';
+    return 0;
+}
+
+static int JBOpen(JsonBuilder *jb, const char *key, const uint8_t type)
+{
+    if (JBStartValue(jb, key) < 0)
+        return -1;
+
+    if (unlikely(jb->depth == JSON_BUILDER_MAX_DEPTH)) {
+        jb->error = true;
+        return -1;
+    }
+
+    if (JBWriteChar(jb, (type & JB_STATE_ARRAY) ? '[' : '{') < 0)
+        return -1;
+    jb->state[jb->depth++] = type;
+    return 0;
+}
+
+static int JBClose(JsonBuilder *jb, const uint8_t type)
+{
+    if (unlikely(jb->error))
+        return -1;
+
+    /* the top level object is closed by JsonBuilderFinish() */
+    if (unlikely(jb->depth <= 1 ||
+                (jb->state[jb->depth - 1] & JB_STATE_ARRAY) != type)) {
+        jb->error = true;
+        return -1;
+    }
+
+    if (JBWriteChar(jb, type ? ']' : '}') < 0)
+        return -1;
+    jb->depth--;
+    return 0;
+}
+
+/**
+ *  \brief open an object
+ *
+ *  \param key key in the parent object or NULL if the parent is an array
+ */
+int JsonBuilderOpenObject(JsonBuilder *jb, const char *key)
+{
+    return JBOpen(jb, key, 0);
+}
+
+int JsonBuilderCloseObject(JsonBuilder *jb)
+{
+    return JBClose(jb, 0);
+}
+
+/**
+ *  \brief open an array
+ *
+ *  \param key key in the parent object or NULL if the parent is an array
+ */
+int JsonBuilderOpenArray(JsonBuilder *jb, const char *key)
+{
+    return JBOpen(jb, key, JB_STATE_ARRAY);
+}
+
+int JsonBuilderCloseArray(JsonBuilder *jb)
+{
+    return JBClose(jb, JB_STATE_ARRAY);
+}
+
+/**
+ *  \brief add a string
+ *
+ *  Strings that are not valid UTF-8 are logged like SCJsonString() does.
+ */
+int JsonBuilderSetString(JsonBuilder *jb, const char *key, const char *val)
+{
+    if (val == NULL)
+        return -1;
+    if (JBStartValue(jb, key) < 0)
+        return -1;
+    return JBWriteString(jb, (const uint8_t *)val, (uint32_t)strlen(val));
+}
+
+/**
+ *  \brief add a string from a buffer that is not NUL terminated
+ *
+ *  Like JsonAddStringN(), the string ends at the first NUL byte.
+ */
+int JsonBuilderSetStringN(JsonBuilder *jb, const char *key,
+        const uint8_t *val, uint32_t len)
+{
+    if (val == NULL)
+        return -1;
+
+    const uint8_t *nul = memchr(val, '\0', len);
+    if (nul != NULL)
+        len = (uint32_t)(nul - val);
+
+    if (JBStartValue(jb, key) < 0)
+        return -1;
+    return JBWriteString(jb, val, len);
+}
+
+int JsonBuilderSetUint(JsonBuilder *jb, const char *key, uint64_t val)
+{
+    if (JBStartValue(jb, key) < 0)
+        return -1;
+    return JBWriteNumber(jb, val, false);
+}
+
+int JsonBuilderSetInt(JsonBuilder *jb, const char *key, int64_t val)
+{
+    if (JBStartValue(jb, key) < 0)
+        return -1;
+    if (val < 0)
+        return JBWriteNumber(jb, (uint64_t)0 - (uint64_t)val, true);
+    return JBWriteNumber(jb, (uint64_t)val, false);
+}
+
+/**
+ *  \brief add a floating point number
+ *
+ *  Infinity and NaN can't be represented in JSON. Like with json_real()
+ *  nothing is added for them.
+ */
+int JsonBuilderSetFloat(JsonBuilder *jb, const char *key, double val)
+{
+    if (!isfinite(val))
+        return -1;
+    if (JBStartValue(jb, key) < 0)
+        return -1;
+
+    char tmp[32];
+    int len = snprintf(tmp, sizeof(tmp) - 2, "%.17g", val);
+    if (len < 0 || len >= (int)sizeof(tmp) - 2) {
+        jb->error = true;
+        return -1;
+    }
+    /* make sure it's read back as a real, like jansson does */
+    if (strpbrk(tmp, ".eE") == NULL) {
+        tmp[len++] = '.';
+        tmp[len++] = '0';
+    }
+    return JBWriteRaw(jb, tmp, (uint32_t)len);
+}
+
+int JsonBuilderSetBool(JsonBuilder *jb, const char *key, bool val)
+{
+    if (JBStartValue(jb, key) < 0)
+        return -1;
+    if (val)
+        return JBWriteRaw(jb, "true", 4);
+    return JBWriteRaw(jb, "false", 5);
+}
+
+/**
+ *  \brief add a value that is already encoded as JSON
+ *
+ *  For parts of a record that are still built with jansson. The value
+ *  is written as is, so it has to be valid JSON encoded with the same
+ *  options as the builder's.
+ */
+int JsonBuilderSetRaw(JsonBuilder *jb, const char *key,
+        const char *json, const uint32_t len)
+{
+    if (JBStartValue(jb, key) < 0)
+        return -1;
+    return JBWriteRaw(jb, json, len);
+}
+
+/**
+ *  \brief remember the current position
+ *
+ *  Used to undo adding an object or array that turns out to be empty
+ *  or otherwise unwanted, with JsonBuilderRestoreMark().
+ */
+void JsonBuilderGetMark(const JsonBuilder *jb, JsonBuilderMark *mark)
+{
+    mark->offset = (*jb->buffer)->offset;
+    mark->depth = jb->depth;
+    mark->state = jb->depth ? jb->state[jb->depth - 1] : 0;
+}
+
+/**
+ *  \brief drop everything written since the mark was taken
+ *
+ *  The containers open at the time of the mark must not have been
+ *  closed since.
+ */
+void JsonBuilderRestoreMark(JsonBuilder *jb, const JsonBuilderMark *mark)
+{
+    if (mark->depth > jb->depth) {
+        jb->error = true;
+        return;
+    }
+
+    (*jb->buffer)->offset = mark->offset;
+    jb->depth = mark->depth;
+    if (jb->depth)
+        jb->state[jb->depth - 1] = mark->state;
+}
+
+#ifdef UNITTESTS
+#define JB_TEST_CHECK(jb, expected)                                         \
+    FAIL_IF(JsonBuilderFinish(&(jb)) != 0);                                 \
+    FAIL_IF((*(jb).buffer)->offset != strlen(expected));                    \
+    FAIL_IF(memcmp((*(jb).buffer)->buffer, (expected), strlen(expected)) != 0);
+
+/** \test objects, arrays and simple values */
+static int JsonBuilderTest01(void)
+{
+    MemBuffer *b = MemBufferCreateNew(1024);
+    FAIL_IF_NULL(b);
+    JsonBuilder jb;
+    JsonBuilderInit(&jb, &b);
+
+    JsonBuilderSetString(&jb, "event_type", "alert");
+    JsonBuilderSetUint(&jb, "flow_id", 1234567890123ULL);
+    JsonBuilderSetInt(&jb, "neg", -42);
+    JsonBuilderSetInt(&jb, "min", INT64_MIN);
+    JsonBuilderSetBool(&jb, "t", true);
+    JsonBuilderSetBool(&jb, "f", false);
+    JsonBuilderOpenArray(&jb, "vlan");
+    JsonBuilderSetUint(&jb, NULL, 0);
+    JsonBuilderSetUint(&jb, NULL, 10);
+    JsonBuilderCloseArray(&jb);
+    JsonBuilderOpenObject(&jb, "alert");
+    JsonBuilderOpenArray(&jb, "empty");
+    JsonBuilderCloseArray(&jb);
+    JsonBuilderOpenArray(&jb, "objects");
+    JsonBuilderOpenObject(&jb, NULL);
+    JsonBuilderCloseObject(&jb);
+    JsonBuilderOpenObject(&jb, NULL);
+    JsonBuilderSetString(&jb, "a", "b");
+    JsonBuilderCloseObject(&jb);
+    JsonBuilderCloseArray(&jb);
+    JsonBuilderCloseObject(&jb);
+
+    JB_TEST_CHECK(jb, "{\"event_type\":\"alert\",\"flow_id\":1234567890123,"
+            "\"neg\":-42,\"min\":-9223372036854775808,\"t\":true,\"f\":false,"
+            "\"vlan\":[0,10],\"alert\":{\"empty\":[],\"objects\":[{},{\"a\":\"b\"}]}}");
+
+    MemBufferFree(b);
+    PASS;
+}
+
+/* invalid UTF-8 is written like SCJsonString() does, see
+ * JBWriteInvalidUtf8() */
+#if CHAR_MIN < 0
+#define JB_TEST_HIGH "FFFFFF"
+#else
+#define JB_TEST_HIGH ""
+#endif
+
+/** \test string escaping matches jansson's JSON_ENSURE_ASCII and
+ *        JSON_ESCAPE_SLASH output */
+static int JsonBuilderTest02(void)
+{
+    MemBuffer *b = MemBufferCreateNew(1024);
+    FAIL_IF_NULL(b);
+    JsonBuilder jb;
+    JsonBuilderInit(&jb, &b);
+
+    JsonBuilderSetString(&jb, "s", "a\"b\\c/d\r\n\t\x01\x7f");
+    /* U+00E9, U+20AC and U+1F600 */
+    JsonBuilderSetString(&jb, "u", "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80");
+    /* invalid UTF-8 */
+    JsonBuilderSetString(&jb, "i", "a\xc3(\"");
+    /* overlong encoding of '/' */
+    JsonBuilderSetString(&jb, "o", "\xc0\xaf");
+    JsonBuilderSetStringN(&jb, "n", (const uint8_t *)"abc\0def", 7);
+    JsonBuilderSetString(&jb, "k\"ey", "");
+
+    JB_TEST_CHECK(jb, "{\"s\":\"a\\\"b\\\\c\\/d\\r\\n\\t\\u0001\x7f\","
+            "\"u\":\"\\u00E9\\u20AC\\uD83D\\uDE00\","
+            "\"i\":\"a\\\\x" JB_TEST_HIGH "C3(\\\"\","
+            "\"o\":\"\\\\x" JB_TEST_HIGH "C0\\\\x" JB_TEST_HIGH "AF\","
+            "\"n\":\"abc\",\"k\\\"ey\":\"\"}");
+
+    MemBufferFree(b);
+    PASS;
+}
+
+/** \test floats */
+static int JsonBuilderTest03(void)
+{
+    MemBuffer *b = MemBufferCreateNew(1024);
+    FAIL_IF_NULL(b);
+    JsonBuilder jb;
+    JsonBuilderInit(&jb, &b);
+
+    JsonBuilderSetFloat(&jb, "a", 1.0);
+    JsonBuilderSetFloat(&jb, "b", 0.5);
+    FAIL_IF(JsonBuilderSetFloat(&jb, "c", NAN) == 0);
+
+    JB_TEST_CHECK(jb, "{\"a\":1.0,\"b\":0.5}");
+
+    MemBufferFree(b);
+    PASS;
+}
+
+/** \test misuse is reported by JsonBuilderFinish */
+static int JsonBuilderTest04(void)
+{
+    MemBuffer *b = MemBufferCreateNew(1024);
+    FAIL_IF_NULL(b);
+    JsonBuilder jb;
+
+    /* value without key in an object */
+    JsonBuilderInit(&jb, &b);
+    FAIL_IF(JsonBuilderSetUint(&jb, NULL, 1) == 0);
+    FAIL_IF(JsonBuilderFinish(&jb) == 0);
+
+    /* value with key in an array */
+    MemBufferReset(b);
+    JsonBuilderInit(&jb, &b);
+    JsonBuilderOpenArray(&jb, "a");
+    FAIL_IF(JsonBuilderSetUint(&jb, "k", 1) == 0);
+    FAIL_IF(JsonBuilderFinish(&jb) == 0);
+
+    /* closing an object as array */
+    MemBufferReset(b);
+    JsonBuilderInit(&jb, &b);
+    JsonBuilderOpenObject(&jb, "o");
+    FAIL_IF(JsonBuilderCloseArray(&jb) == 0);
+    FAIL_IF(JsonBuilderFinish(&jb) == 0);
+
+    /* unclosed object */
+    MemBufferReset(b);
+    JsonBuilderInit(&jb, &b);
+    JsonBuilderOpenObject(&jb, "o");
+    FAIL_IF(JsonBuilderFinish(&jb) == 0);
+
+    /* closing the top level object */
+    MemBufferReset(b);
+    JsonBuilderInit(&jb, &b);
+    FAIL_IF(JsonBuilderCloseObject(&jb) == 0);
+
+    MemBufferFree(b);
+    PASS;
+}
+
+/** \test marks and buffer expansion */
+static int JsonBuilderTest05(void)
+{
+    MemBuffer *b = MemBufferCreateNew(8);
+    FAIL_IF_NULL(b);
+    JsonBuilder jb;
+    JsonBuilderInit(&jb, &b);
+
+    JsonBuilderSetString(&jb, "a", "1");
+    JsonBuilderMark mark;
+    JsonBuilderGetMark(&jb, &mark);
+    JsonBuilderOpenObject(&jb, "empty");
+    JsonBuilderRestoreMark(&jb, &mark);
+
+    char big[5000];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    JsonBuilderSetString(&jb, "big", big);
+    FAIL_IF(b->size <= 8);
+
+    FAIL_IF(JsonBuilderFinish(&jb) != 0);
+    FAIL_IF(b->offset != strlen("{\"a\":\"1\",\"big\":\"\"}") + sizeof(big) - 1);
+    FAIL_IF(memcmp(b->buffer, "{\"a\":\"1\",\"big\":\"xxx", 19) != 0);
+    FAIL_IF(b->buffer[b->offset] != '\0');
+
+    MemBufferFree(b);
+    PASS;
+}
+
+/** \test output options, like jansson without JSON_COMPACT,
+ *        JSON_ENSURE_ASCII and JSON_ESCAPE_SLASH */
+static int JsonBuilderTest06(void)
+{
+    MemBuffer *b = MemBufferCreateNew(1024);
+    FAIL_IF_NULL(b);
+    JsonBuilder jb;
+    JsonBuilderInitFlags(&jb, &b, 0);
+
+    JsonBuilderSetString(&jb, "s", "a/b\t");
+    JsonBuilderSetString(&jb, "u", "\xc3\xa9\xf0\x9f\x98\x80");
+    JsonBuilderSetString(&jb, "i", "/\xc3(");
+    JsonBuilderOpenArray(&jb, "a");
+    JsonBuilderSetUint(&jb, NULL, 1);
+    JsonBuilderSetUint(&jb, NULL, 2);
+    JsonBuilderCloseArray(&jb);
+    JsonBuilderOpenObject(&jb, "o");
+    JsonBuilderCloseObject(&jb);
+
+    JB_TEST_CHECK(jb, "{\"s\": \"a/b\\t\", "
+            "\"u\": \"\xc3\xa9\xf0\x9f\x98\x80\", "
+            "\"i\": \"/\\\\x" JB_TEST_HIGH "C3(\", "
+            "\"a\": [1, 2], \"o\": {}}");
+
+    MemBufferFree(b);
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void JsonBuilderRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("JsonBuilderTest01", JsonBuilderTest01);
+    UtRegisterTest("JsonBuilderTest02", JsonBuilderTest02);
+    UtRegisterTest("JsonBuilderTest03", JsonBuilderTest03);
+    UtRegisterTest("JsonBuilderTest04", JsonBuilderTest04);
+    UtRegisterTest("JsonBuilderTest05", JsonBuilderTest05);
+    UtRegisterTest("JsonBuilderTest06", JsonBuilderTest06);
+#endif
+}
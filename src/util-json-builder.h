@@ -0,0 +1,90 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Append only JSON writer.
+ *
+ * Writes a JSON object directly into a MemBuffer, normally the output
+ * thread's buffer, so building a record does not allocate. The output
+ * matches what jansson produces with JSON_PRESERVE_ORDER, JSON_COMPACT,
+ * JSON_ENSURE_ASCII and JSON_ESCAPE_SLASH, so loggers can be moved over
+ * one at a time.
+ *
+ * Values in an object are added with their key, values in an array with
+ * a NULL key. Errors, like running out of buffer space or closing the
+ * wrong container, are sticky and reported by JsonBuilderFinish().
+ */
+
+#ifndef __UTIL_JSON_BUILDER_H__
+#define __UTIL_JSON_BUILDER_H__
+
+#include "util-buffer.h"
+
+#define JSON_BUILDER_MAX_DEPTH  32
+
+/* output options, same meaning as the jansson encoding flags of the
+ * same name. The eve-log 'json' settings. */
+#define JSON_BUILDER_COMPACT        0x01
+#define JSON_BUILDER_ENSURE_ASCII   0x02
+#define JSON_BUILDER_ESCAPE_SLASH   0x04
+
+#define JSON_BUILDER_DEFAULT_FLAGS \
+    (JSON_BUILDER_COMPACT|JSON_BUILDER_ENSURE_ASCII|JSON_BUILDER_ESCAPE_SLASH)
+
+typedef struct JsonBuilder_ {
+    MemBuffer **buffer;     /**< buffer to write to, expanded as needed */
+    uint32_t depth;         /**< number of open objects and arrays */
+    bool error;
+    uint8_t flags;          /**< JSON_BUILDER_* output options */
+    /** per open container: JB_STATE_* flags */
+    uint8_t state[JSON_BUILDER_MAX_DEPTH];
+} JsonBuilder;
+
+/** position in the output to go back to, see JsonBuilderGetMark() */
+typedef struct JsonBuilderMark_ {
+    uint32_t offset;
+    uint32_t depth;
+    uint8_t state;
+} JsonBuilderMark;
+
+void JsonBuilderInit(JsonBuilder *jb, MemBuffer **buffer);
+void JsonBuilderInitFlags(JsonBuilder *jb, MemBuffer **buffer, uint8_t flags);
+int JsonBuilderFinish(JsonBuilder *jb);
+
+int JsonBuilderOpenObject(JsonBuilder *jb, const char *key);
+int JsonBuilderCloseObject(JsonBuilder *jb);
+int JsonBuilderOpenArray(JsonBuilder *jb, const char *key);
+int JsonBuilderCloseArray(JsonBuilder *jb);
+
+int JsonBuilderSetString(JsonBuilder *jb, const char *key, const char *val);
+int JsonBuilderSetStringN(JsonBuilder *jb, const char *key,
+        const uint8_t *val, uint32_t len);
+int JsonBuilderSetUint(JsonBuilder *jb, const char *key, uint64_t val);
+int JsonBuilderSetInt(JsonBuilder *jb, const char *key, int64_t val);
+int JsonBuilderSetFloat(JsonBuilder *jb, const char *key, double val);
+int JsonBuilderSetBool(JsonBuilder *jb, const char *key, bool val);
+int JsonBuilderSetRaw(JsonBuilder *jb, const char *key,
+        const char *json, const uint32_t len);
+
+void JsonBuilderGetMark(const JsonBuilder *jb, JsonBuilderMark *mark);
+void JsonBuilderRestoreMark(JsonBuilder *jb, const JsonBuilderMark *mark);
+
+void JsonBuilderRegisterTests(void);
+
+#endif /* __UTIL_JSON_BUILDER_H__ */
@@ -26,6 +26,9 @@
 #include "suricata-common.h" /* errno.h, string.h, etc. */
 #include "util-log-redis.h"
 #include "util-logopenfile.h"
+#include "util-misc.h"
+#include "counters.h"
+#include "util-unittest.h"
 
 #ifdef HAVE_LIBHIREDIS
 
@@ -36,12 +39,124 @@
 static const char * redis_lpush_cmd = "LPUSH";
 static const char * redis_rpush_cmd = "RPUSH";
 static const char * redis_publish_cmd = "PUBLISH";
+static const char * redis_xadd_cmd = "XADD";
 static const char * redis_default_key = "suricata";
 static const char * redis_default_server = "127.0.0.1";
 
+#define REDIS_DEFAULT_FLUSH_INTERVAL    100                 /**< msec */
+#define REDIS_DEFAULT_SPILL_SIZE        (4 * 1024 * 1024)
+#define REDIS_MIN_SPILL_SIZE            (64 * 1024)
+/** max time to send the pipeline on shutdown */
+#define REDIS_DRAIN_TIMEOUT             1000                /**< msec */
+/** max time a logging thread waits for a connection without pipelining */
+#define REDIS_CONNECT_TIMEOUT           100                 /**< msec */
+
+/* MSG_NOSIGNAL does not exists on OS X */
+#ifdef OS_DARWIN
+# ifndef MSG_NOSIGNAL
+#   define MSG_NOSIGNAL SO_NOSIGPIPE
+# endif
+#endif
+
+/** all redis contexts, for the global counters */
+static SCLogRedisContext *redis_contexts = NULL;
+static SCMutex redis_contexts_lock = SCMUTEX_INITIALIZER;
+
 static int SCConfLogReopenSyncRedis(LogFileCtx *log_ctx);
 static void SCLogFileCloseRedis(LogFileCtx *log_ctx);
 
+/** \brief command format, a stream entry takes an id and a field name */
+static const char *SCLogRedisFormat(const LogFileCtx *log_ctx)
+{
+    if (log_ctx->redis_setup.mode == REDIS_STREAM)
+        return "%s %s * event %s";
+    return "%s %s %s";
+}
+
+static uint64_t SCLogRedisSpilledCounter(void)
+{
+    uint64_t v = 0;
+    SCMutexLock(&redis_contexts_lock);
+    for (SCLogRedisContext *c = redis_contexts; c != NULL; c = c->next)
+        v += SC_ATOMIC_GET(c->spilled);
+    SCMutexUnlock(&redis_contexts_lock);
+    return v;
+}
+
+static uint64_t SCLogRedisDroppedCounter(void)
+{
+    uint64_t v = 0;
+    SCMutexLock(&redis_contexts_lock);
+    for (SCLogRedisContext *c = redis_contexts; c != NULL; c = c->next)
+        v += SC_ATOMIC_GET(c->dropped);
+    SCMutexUnlock(&redis_contexts_lock);
+    return v;
+}
+
+static uint64_t SCLogRedisFlushesCounter(void)
+{
+    uint64_t v = 0;
+    SCMutexLock(&redis_contexts_lock);
+    for (SCLogRedisContext *c = redis_contexts; c != NULL; c = c->next)
+        v += SC_ATOMIC_GET(c->flushes);
+    SCMutexUnlock(&redis_contexts_lock);
+    return v;
+}
+
+static uint64_t SCLogRedisErrorsCounter(void)
+{
+    uint64_t v = 0;
+    SCMutexLock(&redis_contexts_lock);
+    for (SCLogRedisContext *c = redis_contexts; c != NULL; c = c->next)
+        v += SC_ATOMIC_GET(c->errors);
+    SCMutexUnlock(&redis_contexts_lock);
+    return v;
+}
+
+/** \internal
+ *  \brief register a context for the counters */
+static void SCLogRedisContextRegister(SCLogRedisContext *ctx)
+{
+    SC_ATOMIC_INIT(ctx->spilled);
+    SC_ATOMIC_INIT(ctx->dropped);
+    SC_ATOMIC_INIT(ctx->flushes);
+    SC_ATOMIC_INIT(ctx->errors);
+
+    SCMutexLock(&redis_contexts_lock);
+    ctx->next = redis_contexts;
+    redis_contexts = ctx;
+    SCMutexUnlock(&redis_contexts_lock);
+}
+
+/** \internal
+ *  \brief unregister and free a context */
+static void SCLogRedisContextFree(SCLogRedisContext *ctx)
+{
+    SCMutexLock(&redis_contexts_lock);
+    SCLogRedisContext **pp = &redis_contexts;
+    while (*pp != NULL) {
+        if (*pp == ctx) {
+            *pp = ctx->next;
+            break;
+        }
+        pp = &(*pp)->next;
+    }
+    SCMutexUnlock(&redis_contexts_lock);
+
+    if (SC_ATOMIC_GET(ctx->dropped) > 0) {
+        SCLogWarning(SC_WARN_EVENT_DROPPED, "%"PRIu64" records were not sent "
+                "to redis as it could not keep up or was not reachable",
+                SC_ATOMIC_GET(ctx->dropped));
+    }
+    SC_ATOMIC_DESTROY(ctx->spilled);
+    SC_ATOMIC_DESTROY(ctx->dropped);
+    SC_ATOMIC_DESTROY(ctx->flushes);
+    SC_ATOMIC_DESTROY(ctx->errors);
+    if (ctx->pipe_buf != NULL)
+        SCFree(ctx->pipe_buf);
+    SCFree(ctx);
+}
+
 /**
  * \brief SCLogRedisInit() - Initializes global stuff before threads
  */
@@ -52,6 +167,36 @@ void SCLogRedisInit()
 #endif /* HAVE_LIBEVENT_PTHREADS */
 }
 
+/**
+ * \brief register the pipelining counters of a redis output
+ *
+ * Must be called when the output is set up, before the stats start:
+ * the contexts of a 'threaded' output are opened later, from the packet
+ * threads.
+ *
+ * \param redis_node the 'redis' node of the output
+ */
+void SCLogRedisRegisterCounters(ConfNode *redis_node)
+{
+    int enabled = 0;
+    ConfNode *pipelining = redis_node ?
+        ConfNodeLookupChild(redis_node, "pipelining") : NULL;
+    if (pipelining == NULL ||
+            ConfGetChildValueBool(pipelining, "enabled", &enabled) == 0 ||
+            !enabled) {
+        return;
+    }
+
+    StatsRegisterGlobalCounter("redis.pipelining.spilled_bytes",
+            SCLogRedisSpilledCounter);
+    StatsRegisterGlobalCounter("redis.pipelining.dropped",
+            SCLogRedisDroppedCounter);
+    StatsRegisterGlobalCounter("redis.pipelining.flushes",
+            SCLogRedisFlushesCounter);
+    StatsRegisterGlobalCounter("redis.pipelining.errors",
+            SCLogRedisErrorsCounter);
+}
+
 /** \brief SCLogRedisContextAlloc() - Allocates and initalizes redis context
  */
 static SCLogRedisContext *SCLogRedisContextAlloc(void)
@@ -68,6 +213,7 @@ static SCLogRedisContext *SCLogRedisContextAlloc(void)
 #endif
     ctx->batch_count = 0;
     ctx->tried = 0;
+    SCLogRedisContextRegister(ctx);
 
     return ctx;
 }
@@ -93,6 +239,7 @@ static SCLogRedisContext *SCLogRedisContextAsyncAlloc(void)
     ctx->connected = 0;
     ctx->batch_count = 0;
     ctx->tried = 0;
+    SCLogRedisContextRegister(ctx);
 
     return ctx;
 }
@@ -265,7 +412,7 @@ static int SCLogRedisWriteAsync(LogFileCtx *file_ctx, const char *string, size_t
     redisAsyncCommand(ctx->async,
             SCRedisAsyncCommandCallback,
             file_ctx,
-            "%s %s %s",
+            SCLogRedisFormat(file_ctx),
             file_ctx->redis_setup.command,
             file_ctx->redis_setup.key,
             string);
@@ -295,7 +442,20 @@ static int SCConfLogReopenSyncRedis(LogFileCtx *log_ctx)
     if (ctx->sync != NULL)  {
         redisFree(ctx->sync);
     }
-    ctx->sync = redisConnect(redis_server, redis_port);
+    if (log_ctx->redis_setup.batch_size) {
+        /* don't wait for the connection: sending gets EAGAIN until it
+         * is set up, so records are held back in the pipeline */
+        ctx->sync = redisConnectNonBlock(redis_server, redis_port);
+    } else {
+        const struct timeval timeout = { 0, REDIS_CONNECT_TIMEOUT * 1000 };
+        ctx->sync = redisConnectWithTimeout(redis_server, redis_port, timeout);
+        /* the timeout is also set on the socket: commands wait for the
+         * server as long as it takes, like before */
+        if (ctx->sync != NULL && ctx->sync->err == 0) {
+            const struct timeval no_timeout = { 0, 0 };
+            (void)redisSetTimeout(ctx->sync, no_timeout);
+        }
+    }
     if (ctx->sync == NULL) {
         SCLogError(SC_ERR_SOCKET, "Error connecting to redis server.");
         ctx->tried = time(NULL);
@@ -308,7 +468,8 @@ static int SCConfLogReopenSyncRedis(LogFileCtx *log_ctx)
         ctx->tried = time(NULL);
         return -1;
     }
-    SCLogInfo("Connected to redis server [%s].", log_ctx->redis_setup.server);
+    SCLogInfo("%s redis server [%s].", log_ctx->redis_setup.batch_size ?
+            "Connecting to" : "Connected to", log_ctx->redis_setup.server);
 
     log_ctx->redis = ctx;
     log_ctx->Close = SCLogFileCloseRedis;
@@ -332,78 +493,307 @@ static int SCLogRedisWriteSync(LogFileCtx *file_ctx, const char *string)
         }
     }
 
-    /* synchronous mode */
-    if (file_ctx->redis_setup.batch_size) {
-        redisAppendCommand(redis, "%s %s %s",
-                file_ctx->redis_setup.command,
-                file_ctx->redis_setup.key,
-                string);
-        if (ctx->batch_count == file_ctx->redis_setup.batch_size) {
-            redisReply *reply;
-            int i;
-            ctx->batch_count = 0;
-            for (i = 0; i <= file_ctx->redis_setup.batch_size; i++) {
-                if (redisGetReply(redis, (void **)&reply) == REDIS_OK) {
-                    freeReplyObject(reply);
-                    ret = 0;
-                } else {
-                    if (redis->err) {
-                        SCLogInfo("Error when fetching reply: %s (%d)",
-                                redis->errstr,
-                                redis->err);
-                    }
-                    switch (redis->err) {
-                        case REDIS_ERR_EOF:
-                        case REDIS_ERR_IO:
-                            SCLogInfo("Reopening connection to redis server");
-                            SCConfLogReopenSyncRedis(file_ctx);
-                            redis = ctx->sync;
-                            if (redis) {
-                                SCLogInfo("Reconnected to redis server");
-                            } else {
-                                SCLogInfo("Unable to reconnect to redis server");
-                                return -1;
-                            }
-                            break;
-                        default:
-                            SCLogWarning(SC_ERR_INVALID_VALUE,
-                                    "Unsupported error code %d",
-                                    redis->err);
-                            return -1;
-                    }
-                }
-            }
-        } else {
-            ctx->batch_count++;
+    redisReply *reply = redisCommand(redis, SCLogRedisFormat(file_ctx),
+            file_ctx->redis_setup.command,
+            file_ctx->redis_setup.key,
+            string);
+    /* We may lose the reply if disconnection happens*/
+    if (reply) {
+        switch (reply->type) {
+            case REDIS_REPLY_ERROR:
+                SCLogWarning(SC_ERR_SOCKET, "Redis error: %s", reply->str);
+                SCConfLogReopenSyncRedis(file_ctx);
+                break;
+            case REDIS_REPLY_INTEGER:
+                SCLogDebug("Redis integer %lld", reply->integer);
+                ret = 0;
+                break;
+            case REDIS_REPLY_STRING:
+                /* id of a stream entry */
+                ret = 0;
+                break;
+            default:
+                SCLogError(SC_ERR_INVALID_VALUE,
+                        "Redis default triggered with %d", reply->type);
+                SCConfLogReopenSyncRedis(file_ctx);
+                break;
         }
+        freeReplyObject(reply);
     } else {
-        redisReply *reply = redisCommand(redis, "%s %s %s",
-                file_ctx->redis_setup.command,
-                file_ctx->redis_setup.key,
-                string);
-        /* We may lose the reply if disconnection happens*/
-        if (reply) {
-            switch (reply->type) {
-                case REDIS_REPLY_ERROR:
-                    SCLogWarning(SC_ERR_SOCKET, "Redis error: %s", reply->str);
-                    SCConfLogReopenSyncRedis(file_ctx);
-                    break;
-                case REDIS_REPLY_INTEGER:
-                    SCLogDebug("Redis integer %lld", reply->integer);
-                    ret = 0;
-                    break;
-                default:
-                    SCLogError(SC_ERR_INVALID_VALUE,
-                            "Redis default triggered with %d", reply->type);
-                    SCConfLogReopenSyncRedis(file_ctx);
-                    break;
-            }
-            freeReplyObject(reply);
+        SCConfLogReopenSyncRedis(file_ctx);
+    }
+    return ret;
+}
+
+static uint64_t SCLogRedisTimeMsec(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/** \internal
+ *  \brief drop the connection and what was queued for it */
+static void SCLogRedisPipelineDisconnect(LogFileCtx *file_ctx)
+{
+    SCLogRedisContext *ctx = file_ctx->redis;
+
+    if (!ctx->pipe_error_logged) {
+        SCLogWarning(SC_ERR_SOCKET, "Lost connection to redis server [%s], "
+                "dropping %u queued records", file_ctx->redis_setup.server,
+                ctx->pipe_records);
+        ctx->pipe_error_logged = true;
+    }
+    redisFree(ctx->sync);
+    ctx->sync = NULL;
+
+    (void)SC_ATOMIC_ADD(ctx->dropped, ctx->pipe_records);
+    ctx->pipe_off = 0;
+    ctx->pipe_len = 0;
+    ctx->pipe_records = 0;
+    ctx->pipe_rec_left = 0;
+    SC_ATOMIC_SET(ctx->spilled, 0);
+}
+
+/** \internal
+ *  \brief length of the command at 'd', as queued by
+ *         SCLogRedisWritePipelined() */
+static uint32_t SCLogRedisPipelineCommandLen(const uint8_t *d)
+{
+    const char *p = (const char *)d;
+    char *end;
+
+    /* *<args>\r\n, then $<len>\r\n<arg>\r\n per argument */
+    unsigned long n = strtoul(p + 1, &end, 10);
+    p = end + 2;
+    for (unsigned long i = 0; i < n; i++) {
+        unsigned long l = strtoul(p + 1, &end, 10);
+        p = end + 2 + l + 2;
+    }
+    return (uint32_t)(p - (const char *)d);
+}
+
+/** \internal
+ *  \brief take 'sent' bytes off the front of the pipeline, counting
+ *         the records that were sent completely */
+static void SCLogRedisPipelineSent(SCLogRedisContext *ctx, uint32_t sent)
+{
+    const uint8_t *d = ctx->pipe_buf + ctx->pipe_off;
+
+    ctx->pipe_off += sent;
+    ctx->pipe_len -= sent;
+
+    if (ctx->pipe_rec_left > 0) {
+        if (sent < ctx->pipe_rec_left) {
+            ctx->pipe_rec_left -= sent;
+            sent = 0;
         } else {
-            SCConfLogReopenSyncRedis(file_ctx);
+            d += ctx->pipe_rec_left;
+            sent -= ctx->pipe_rec_left;
+            ctx->pipe_rec_left = 0;
+            ctx->pipe_records--;
         }
     }
-    return ret;
+    while (sent > 0) {
+        const uint32_t len = SCLogRedisPipelineCommandLen(d);
+        if (len > sent) {
+            ctx->pipe_rec_left = len - sent;
+            break;
+        }
+        d += len;
+        sent -= len;
+        ctx->pipe_records--;
+    }
+
+    if (ctx->pipe_len == 0)
+        ctx->pipe_off = 0;
+}
+
+/** \internal
+ *  \brief read the replies that arrived so far, without blocking
+ *
+ *  Replies are only checked for errors: records are not resent.
+ *
+ *  \retval 0 ok
+ *  \retval -1 connection lost
+ */
+static int SCLogRedisPipelineReadReplies(LogFileCtx *file_ctx)
+{
+    SCLogRedisContext *ctx = file_ctx->redis;
+    redisContext *redis = ctx->sync;
+    char buf[4096];
+
+    for (;;) {
+        ssize_t r = recv(redis->fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (r > 0) {
+            if (redisReaderFeed(redis->reader, buf, (size_t)r) != REDIS_OK)
+                return -1;
+            continue;
+        }
+        if (r == 0)
+            return -1;
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        return -1;
+    }
+
+    void *r = NULL;
+    while (redisReaderGetReply(redis->reader, &r) == REDIS_OK && r != NULL) {
+        redisReply *reply = r;
+        if (reply->type == REDIS_REPLY_ERROR) {
+            if (SC_ATOMIC_ADD(ctx->errors, 1) == 0) {
+                SCLogWarning(SC_ERR_SOCKET, "Redis error: %s", reply->str);
+            }
+        }
+        freeReplyObject(reply);
+        r = NULL;
+    }
+    if (redis->reader->err)
+        return -1;
+    return 0;
+}
+
+/** \internal
+ *  \brief send as much of the queued commands as the socket takes
+ *         without blocking
+ */
+static void SCLogRedisPipelineFlush(LogFileCtx *file_ctx)
+{
+    SCLogRedisContext *ctx = file_ctx->redis;
+
+    ctx->pipe_last_flush = SCLogRedisTimeMsec();
+
+    if (ctx->sync == NULL) {
+        /* keep what is queued while reconnecting, the spill buffer
+         * limits how much that can be */
+        if (SCConfLogReopenSyncRedis(file_ctx) < 0)
+            return;
+        ctx->pipe_error_logged = false;
+    }
+
+    uint32_t sent = 0;
+    while (sent < ctx->pipe_len) {
+        ssize_t r = send(ctx->sync->fd, ctx->pipe_buf + ctx->pipe_off + sent,
+                ctx->pipe_len - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            SCLogRedisPipelineDisconnect(file_ctx);
+            return;
+        }
+        sent += (uint32_t)r;
+    }
+    if (sent > 0) {
+        (void)SC_ATOMIC_ADD(ctx->flushes, 1);
+        SCLogRedisPipelineSent(ctx, sent);
+        SC_ATOMIC_SET(ctx->spilled, ctx->pipe_len);
+    }
+
+    if (SCLogRedisPipelineReadReplies(file_ctx) < 0) {
+        SCLogRedisPipelineDisconnect(file_ctx);
+    }
+}
+
+/** \internal
+ *  \brief send what is left in the pipeline on shutdown, giving the
+ *         server up to REDIS_DRAIN_TIMEOUT msec to take it
+ */
+static void SCLogRedisPipelineDrain(LogFileCtx *file_ctx)
+{
+    SCLogRedisContext *ctx = file_ctx->redis;
+    const uint64_t end = SCLogRedisTimeMsec() + REDIS_DRAIN_TIMEOUT;
+
+    while (ctx->pipe_len > 0) {
+        /* reconnecting is only tried once per second */
+        ctx->tried = 0;
+        SCLogRedisPipelineFlush(file_ctx);
+        if (ctx->pipe_len == 0 || ctx->sync == NULL)
+            break;
+        const uint64_t now = SCLogRedisTimeMsec();
+        if (now >= end)
+            break;
+        struct pollfd pfd = { .fd = ctx->sync->fd, .events = POLLOUT };
+        (void)poll(&pfd, 1, (int)(end - now));
+    }
+    (void)SC_ATOMIC_ADD(ctx->dropped, ctx->pipe_records);
+    ctx->pipe_off = 0;
+    ctx->pipe_len = 0;
+    ctx->pipe_records = 0;
+    ctx->pipe_rec_left = 0;
+}
+
+/** \brief SCLogRedisWritePipelined() queues string as a command in the
+ *         pipeline and sends the pipeline every 'batch-size' records or
+ *         'flush-interval' msec
+ *
+ *  Never blocks on the server: if it doesn't keep up, records are held
+ *  back up to 'spill-size' bytes and dropped after that.
+ *
+ *  \param file_ctx Log file context allocated by caller
+ *  \param string Buffer to output
+ *  \param string_len length of string
+ *  \retval 0 record queued
+ *  \retval -1 record dropped
+ */
+static int SCLogRedisWritePipelined(LogFileCtx *file_ctx, const char *string,
+        size_t string_len)
+{
+    SCLogRedisContext *ctx = file_ctx->redis;
+    const RedisSetup *setup = &file_ctx->redis_setup;
+    char hdr[512];
+    int hdr_len;
+
+    if (setup->mode == REDIS_STREAM) {
+        hdr_len = snprintf(hdr, sizeof(hdr),
+                "*5\r\n$4\r\nXADD\r\n$%"PRIuMAX"\r\n%s\r\n$1\r\n*\r\n"
+                "$5\r\nevent\r\n$%"PRIuMAX"\r\n",
+                (uintmax_t)strlen(setup->key), setup->key,
+                (uintmax_t)string_len);
+    } else {
+        hdr_len = snprintf(hdr, sizeof(hdr),
+                "*3\r\n$%"PRIuMAX"\r\n%s\r\n$%"PRIuMAX"\r\n%s\r\n$%"PRIuMAX"\r\n",
+                (uintmax_t)strlen(setup->command), setup->command,
+                (uintmax_t)strlen(setup->key), setup->key,
+                (uintmax_t)string_len);
+    }
+    if (hdr_len < 0 || (size_t)hdr_len >= sizeof(hdr)) {
+        (void)SC_ATOMIC_ADD(ctx->dropped, 1);
+        return -1;
+    }
+
+    const size_t need = (size_t)hdr_len + string_len + 2;
+    if (ctx->pipe_len + need > setup->spill_size) {
+        SCLogRedisPipelineFlush(file_ctx);
+        if (ctx->pipe_len + need > setup->spill_size) {
+            (void)SC_ATOMIC_ADD(ctx->dropped, 1);
+            return -1;
+        }
+    }
+
+    if (ctx->pipe_off + ctx->pipe_len + need > setup->spill_size) {
+        /* no room left after the unsent bytes, move them to the front */
+        memmove(ctx->pipe_buf, ctx->pipe_buf + ctx->pipe_off, ctx->pipe_len);
+        ctx->pipe_off = 0;
+    }
+
+    uint8_t *dst = ctx->pipe_buf + ctx->pipe_off + ctx->pipe_len;
+    memcpy(dst, hdr, hdr_len);
+    memcpy(dst + hdr_len, string, string_len);
+    memcpy(dst + hdr_len + string_len, "\r\n", 2);
+    ctx->pipe_len += need;
+    ctx->pipe_records++;
+    SC_ATOMIC_SET(ctx->spilled, ctx->pipe_len);
+
+    if (++ctx->batch_count >= setup->batch_size ||
+            SCLogRedisTimeMsec() - ctx->pipe_last_flush >= setup->flush_interval) {
+        ctx->batch_count = 0;
+        SCLogRedisPipelineFlush(file_ctx);
+    }
+    return 0;
 }
 
 /**
@@ -428,10 +818,11 @@ int LogFileWriteRedis(void *lf_ctx, const char *string, size_t string_len)
     }
 #endif
     /* sync mode */
-    if (! file_ctx->redis_setup.is_async) {
+    if (file_ctx->redis_setup.batch_size) {
+        return SCLogRedisWritePipelined(file_ctx, string, string_len);
+    } else {
         return SCLogRedisWriteSync(file_ctx, string);
     }
-    return -1;
 }
 
 /** \brief configure and initializes redis output logging
@@ -492,18 +883,52 @@ int SCConfLogOpenRedis(ConfNode *redis_node, void *lf_ctx)
                 } else {
                     log_ctx->redis_setup.batch_size = 10;
                 }
+
+                log_ctx->redis_setup.flush_interval = REDIS_DEFAULT_FLUSH_INTERVAL;
+                ret = ConfGetChildValueInt(pipelining, "flush-interval", &val);
+                if (ret) {
+                    if (val < 0 || val > 60000) {
+                        SCLogError(SC_ERR_REDIS_CONFIG, "Invalid redis "
+                                "pipelining.flush-interval %"PRIdMAX", should "
+                                "be between 0 and 60000 msec", val);
+                        exit(EXIT_FAILURE);
+                    }
+                    log_ctx->redis_setup.flush_interval = (uint32_t)val;
+                }
+
+                log_ctx->redis_setup.spill_size = REDIS_DEFAULT_SPILL_SIZE;
+                const char *spill = ConfNodeLookupChildValue(pipelining,
+                        "spill-size");
+                if (spill != NULL) {
+                    if (ParseSizeStringU32(spill,
+                                &log_ctx->redis_setup.spill_size) < 0 ||
+                            log_ctx->redis_setup.spill_size < REDIS_MIN_SPILL_SIZE) {
+                        SCLogError(SC_ERR_REDIS_CONFIG, "Invalid redis "
+                                "pipelining.spill-size %s, should be at "
+                                "least 64kb", spill);
+                        exit(EXIT_FAILURE);
+                    }
+                }
             }
         }
     } else {
         log_ctx->redis_setup.batch_size = 0;
     }
+    if (log_ctx->redis_setup.batch_size < 0) {
+        SCLogError(SC_ERR_REDIS_CONFIG, "Invalid redis pipelining.batch-size");
+        exit(EXIT_FAILURE);
+    }
 
     if (!strcmp(redis_mode, "list") || !strcmp(redis_mode,"lpush")) {
         log_ctx->redis_setup.command = redis_lpush_cmd;
     } else if(!strcmp(redis_mode, "rpush")){
         log_ctx->redis_setup.command = redis_rpush_cmd;
     } else if(!strcmp(redis_mode,"channel") || !strcmp(redis_mode,"publish")) {
+        log_ctx->redis_setup.mode = REDIS_CHANNEL;
         log_ctx->redis_setup.command = redis_publish_cmd;
+    } else if(!strcmp(redis_mode,"stream") || !strcmp(redis_mode,"xadd")) {
+        log_ctx->redis_setup.mode = REDIS_STREAM;
+        log_ctx->redis_setup.command = redis_xadd_cmd;
     } else {
         SCLogError(SC_ERR_REDIS_CONFIG,"Invalid redis mode");
         exit(EXIT_FAILURE);
@@ -524,6 +949,16 @@ int SCConfLogOpenRedis(ConfNode *redis_node, void *lf_ctx)
 #endif /*HAVE_LIBEVENT*/
     if (! is_async) {
         log_ctx->redis = SCLogRedisContextAlloc();
+        if (log_ctx->redis_setup.batch_size) {
+            SCLogRedisContext *ctx = log_ctx->redis;
+            ctx->pipe_buf = SCMalloc(log_ctx->redis_setup.spill_size);
+            if (ctx->pipe_buf == NULL) {
+                SCLogError(SC_ERR_MEM_ALLOC, "Unable to allocate redis "
+                        "pipelining buffer");
+                exit(EXIT_FAILURE);
+            }
+            ctx->pipe_last_flush = SCLogRedisTimeMsec();
+        }
         SCConfLogReopenSyncRedis(log_ctx);
     }
     return 0;
@@ -555,15 +990,10 @@ void SCLogFileCloseRedis(LogFileCtx *log_ctx)
 
     /* synchronous */
     if (!log_ctx->redis_setup.is_async) {
+        if (log_ctx->redis_setup.batch_size) {
+            SCLogRedisPipelineDrain(log_ctx);
+        }
         if (ctx->sync) {
-            redisReply *reply;
-            int i;
-            for (i = 0; i < ctx->batch_count; i++) {
-                redisGetReply(ctx->sync, (void **)&reply);
-                if (reply) {
-                    freeReplyObject(reply);
-                }
-            }
             redisFree(ctx->sync);
             ctx->sync = NULL;
         }
@@ -571,9 +1001,280 @@ void SCLogFileCloseRedis(LogFileCtx *log_ctx)
         ctx->batch_count = 0;
     }
 
+    SCLogRedisContextFree(ctx);
+    log_ctx->redis = NULL;
+}
+
+#endif //#ifdef HAVE_LIBHIREDIS
+
+#if defined(UNITTESTS) && defined(HAVE_LIBHIREDIS)
+#include "conf-yaml-loader.h"
+
+/** stand-in redis server: takes one connection and keeps what it
+ *  receives, without replying */
+typedef struct RedisTestServer_ {
+    int fd;
+    int port;
+    SC_ATOMIC_DECLARE(int, hold);   /**< don't read while set */
+    uint8_t *data;
+    size_t len;
+    size_t size;
+    pthread_t thread;
+} RedisTestServer;
+
+static void *RedisTestServerThread(void *arg)
+{
+    RedisTestServer *srv = arg;
+    int fd = accept(srv->fd, NULL, NULL);
+    if (fd < 0)
+        return NULL;
+
+    while (SC_ATOMIC_GET(srv->hold))
+        usleep(1000);
+
+    for (;;) {
+        if (srv->size - srv->len < 65536) {
+            srv->size = srv->size * 2 + 65536;
+            srv->data = SCRealloc(srv->data, srv->size + 1);
+            if (srv->data == NULL)
+                break;
+        }
+        ssize_t r = recv(fd, srv->data + srv->len, srv->size - srv->len, 0);
+        if (r <= 0)
+            break;
+        srv->len += r;
+    }
+    close(fd);
+    return NULL;
+}
+
+static int RedisTestServerStart(RedisTestServer *srv, int hold)
+{
+    memset(srv, 0, sizeof(*srv));
+    SC_ATOMIC_INIT(srv->hold);
+    SC_ATOMIC_SET(srv->hold, hold);
+
+    srv->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (srv->fd < 0)
+        return -1;
+    if (hold) {
+        /* keep the socket buffers small so the client backs up */
+        int sz = 4096;
+        (void)setsockopt(srv->fd, SOL_SOCKET, SO_RCVBUF, &sz, sizeof(sz));
+    }
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t slen = sizeof(sin);
+    if (bind(srv->fd, (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+            listen(srv->fd, 1) < 0 ||
+            getsockname(srv->fd, (struct sockaddr *)&sin, &slen) < 0) {
+        close(srv->fd);
+        return -1;
+    }
+    srv->port = ntohs(sin.sin_port);
+    if (pthread_create(&srv->thread, NULL, RedisTestServerThread, srv) != 0) {
+        close(srv->fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void RedisTestServerStop(RedisTestServer *srv)
+{
+    SC_ATOMIC_SET(srv->hold, 0);
+    pthread_join(srv->thread, NULL);
+    close(srv->fd);
+    if (srv->data != NULL)
+        srv->data[srv->len] = '\0';
+    SC_ATOMIC_DESTROY(srv->hold);
+}
+
+/** \brief count the commands the server got, checking each is 'cmd'
+ *         with 'nargs' arguments
+ *  \retval cnt number of commands or -1 on a malformed stream */
+static int RedisTestCountCommands(const RedisTestServer *srv,
+        const char *cmd, unsigned long nargs)
+{
+    const char *d = (const char *)srv->data;
+    const char *end = d + srv->len;
+    int cnt = 0;
+
+    while (d != NULL && d < end) {
+        char *p;
+        if (*d != '*')
+            return -1;
+        unsigned long n = strtoul(d + 1, &p, 10);
+        if (n != nargs)
+            return -1;
+        d = p + 2;
+        for (unsigned long i = 0; i < n; i++) {
+            if (d >= end || *d != '$')
+                return -1;
+            unsigned long l = strtoul(d + 1, &p, 10);
+            d = p + 2;
+            if (i == 0 && (l != strlen(cmd) || memcmp(d, cmd, l) != 0))
+                return -1;
+            d += l + 2;
+        }
+        cnt++;
+    }
+    return d == end ? cnt : -1;
+}
+
+static LogFileCtx *RedisTestOpen(int port, const char *mode, int batch_size)
+{
+    char config[512];
+    snprintf(config, sizeof(config),
+            "%%YAML 1.1\n"
+            "---\n"
+            "redis:\n"
+            "  server: 127.0.0.1\n"
+            "  port: %d\n"
+            "  mode: %s\n"
+            "  pipelining:\n"
+            "    enabled: yes\n"
+            "    batch-size: %d\n"
+            "    flush-interval: 1000\n"
+            "    spill-size: 64kb\n", port, mode, batch_size);
+
+    ConfCreateContextBackup();
+    ConfInit();
+    ConfYamlLoadString(config, strlen(config));
+
+    LogFileCtx *ctx = LogFileNewCtx();
     if (ctx != NULL) {
-        SCFree(ctx);
+        ctx->type = LOGFILE_TYPE_REDIS;
+        if (SCConfLogOpenRedis(ConfGetNode("redis"), ctx) < 0) {
+            LogFileFreeCtx(ctx);
+            ctx = NULL;
+        }
     }
+    ConfRestoreContextBackup();
+    return ctx;
 }
 
-#endif //#ifdef HAVE_LIBHIREDIS
+/** \test pipelined RPUSH, the partial last batch sent on close */
+static int SCLogRedisTest01(void)
+{
+    RedisTestServer srv;
+    FAIL_IF(RedisTestServerStart(&srv, 0) < 0);
+
+    LogFileCtx *ctx = RedisTestOpen(srv.port, "rpush", 64);
+    FAIL_IF_NULL(ctx);
+    FAIL_IF_NULL(((SCLogRedisContext *)ctx->redis)->sync);
+
+    const char rec[] = "{\"event_type\":\"alert\",\"msg\":\"a b c\"}";
+    for (int i = 0; i < 1000; i++) {
+        FAIL_IF(LogFileWriteRedis(ctx, rec, sizeof(rec) - 1) != 0);
+    }
+    FAIL_IF_NOT(SC_ATOMIC_GET(((SCLogRedisContext *)ctx->redis)->dropped) == 0);
+    LogFileFreeCtx(ctx);
+
+    RedisTestServerStop(&srv);
+    FAIL_IF_NOT(RedisTestCountCommands(&srv, "RPUSH", 3) == 1000);
+    FAIL_IF_NULL(strstr((char *)srv.data, "$8\r\nsuricata\r\n$36\r\n{\"event_type\""));
+    SCFree(srv.data);
+    PASS;
+}
+
+/** \test a server not reading doesn't block the writer: records beyond
+ *        the spill buffer are dropped and counted */
+static int SCLogRedisTest02(void)
+{
+    RedisTestServer srv;
+    FAIL_IF(RedisTestServerStart(&srv, 1) < 0);
+
+    LogFileCtx *ctx = RedisTestOpen(srv.port, "list", 1);
+    FAIL_IF_NULL(ctx);
+    SCLogRedisContext *rctx = ctx->redis;
+
+    char rec[4096];
+    memset(rec, 'x', sizeof(rec));
+    int queued = 0;
+    for (int i = 0; i < 5000; i++) {
+        if (LogFileWriteRedis(ctx, rec, sizeof(rec)) == 0)
+            queued++;
+    }
+    const uint64_t dropped = SC_ATOMIC_GET(rctx->dropped);
+    FAIL_IF_NOT(dropped > 0);
+    FAIL_IF_NOT(queued + dropped == 5000);
+    FAIL_IF_NOT(rctx->pipe_len <= 64 * 1024);
+
+    /* let the server read, the queued records go out on close */
+    SC_ATOMIC_SET(srv.hold, 0);
+    LogFileFreeCtx(ctx);
+
+    RedisTestServerStop(&srv);
+    FAIL_IF_NOT(RedisTestCountCommands(&srv, "LPUSH", 3) == queued);
+    SCFree(srv.data);
+    PASS;
+}
+
+/** \test stream mode writes XADD <key> * event <record> */
+static int SCLogRedisTest03(void)
+{
+    RedisTestServer srv;
+    FAIL_IF(RedisTestServerStart(&srv, 0) < 0);
+
+    LogFileCtx *ctx = RedisTestOpen(srv.port, "stream", 8);
+    FAIL_IF_NULL(ctx);
+
+    const char rec[] = "{\"event_type\":\"flow\"}";
+    for (int i = 0; i < 20; i++) {
+        FAIL_IF(LogFileWriteRedis(ctx, rec, sizeof(rec) - 1) != 0);
+    }
+    LogFileFreeCtx(ctx);
+
+    RedisTestServerStop(&srv);
+    FAIL_IF_NOT(RedisTestCountCommands(&srv, "XADD", 5) == 20);
+    FAIL_IF_NOT(memcmp(srv.data, "*5\r\n$4\r\nXADD\r\n$8\r\nsuricata\r\n"
+                "$1\r\n*\r\n$5\r\nevent\r\n$21\r\n{\"event_type\":\"flow\"}\r\n",
+                74) == 0);
+    SCFree(srv.data);
+    PASS;
+}
+
+/** \test partial sends only count the records sent completely */
+static int SCLogRedisTest04(void)
+{
+    const char cmd[] = "*3\r\n$5\r\nLPUSH\r\n$8\r\nsuricata\r\n$2\r\n{}\r\n";
+    const uint32_t len = sizeof(cmd) - 1;
+    uint8_t buf[3 * sizeof(cmd)];
+    SCLogRedisContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+
+    for (int i = 0; i < 3; i++)
+        memcpy(buf + i * len, cmd, len);
+    ctx.pipe_buf = buf;
+    ctx.pipe_len = 3 * len;
+    ctx.pipe_records = 3;
+
+    SCLogRedisPipelineSent(&ctx, 10);
+    FAIL_IF_NOT(ctx.pipe_records == 3);
+    FAIL_IF_NOT(ctx.pipe_rec_left == len - 10);
+    FAIL_IF_NOT(ctx.pipe_off == 10);
+
+    SCLogRedisPipelineSent(&ctx, len);
+    FAIL_IF_NOT(ctx.pipe_records == 2);
+    FAIL_IF_NOT(ctx.pipe_rec_left == len - 10);
+
+    SCLogRedisPipelineSent(&ctx, len - 10 + len);
+    FAIL_IF_NOT(ctx.pipe_records == 0);
+    FAIL_IF_NOT(ctx.pipe_rec_left == 0);
+    FAIL_IF_NOT(ctx.pipe_len == 0);
+    FAIL_IF_NOT(ctx.pipe_off == 0);
+    PASS;
+}
+#endif /* UNITTESTS && HAVE_LIBHIREDIS */
+
+void SCLogRedisRegisterTests(void)
+{
+#if defined(UNITTESTS) && defined(HAVE_LIBHIREDIS)
+    UtRegisterTest("SCLogRedisTest01", SCLogRedisTest01);
+    UtRegisterTest("SCLogRedisTest02", SCLogRedisTest02);
+    UtRegisterTest("SCLogRedisTest03", SCLogRedisTest03);
+    UtRegisterTest("SCLogRedisTest04", SCLogRedisTest04);
+#endif
+}
@@ -34,7 +34,7 @@
 
 #include "conf.h"            /* ConfNode   */
 
-enum RedisMode { REDIS_LIST, REDIS_CHANNEL };
+enum RedisMode { REDIS_LIST, REDIS_CHANNEL, REDIS_STREAM };
 
 typedef struct RedisSetup_ {
     enum RedisMode mode;
@@ -44,6 +44,8 @@ typedef struct RedisSetup_ {
     int  port;
     int is_async;
     int  batch_size;
+    uint32_t flush_interval;    /**< pipelining: msec */
+    uint32_t spill_size;        /**< pipelining: max bytes held back */
 } RedisSetup;
 
 typedef struct SCLogRedisContext_ {
@@ -55,11 +57,30 @@ typedef struct SCLogRedisContext_ {
 #endif /* HAVE_LIBEVENT */
     time_t tried;
     int  batch_count;
+
+    /* pipelining: commands not yet sent to the server */
+    uint8_t *pipe_buf;
+    uint32_t pipe_off;          /**< start of the unsent bytes */
+    uint32_t pipe_len;          /**< unsent bytes */
+    uint32_t pipe_records;      /**< records with unsent bytes */
+    uint32_t pipe_rec_left;     /**< unsent bytes of a partly sent record */
+    uint64_t pipe_last_flush;   /**< msec */
+    bool pipe_error_logged;
+
+    SC_ATOMIC_DECLARE(uint64_t, spilled);   /**< bytes in pipe_buf */
+    SC_ATOMIC_DECLARE(uint64_t, dropped);   /**< records dropped */
+    SC_ATOMIC_DECLARE(uint64_t, flushes);   /**< send calls */
+    SC_ATOMIC_DECLARE(uint64_t, errors);    /**< error replies */
+
+    struct SCLogRedisContext_ *next;
 } SCLogRedisContext;
 
 void SCLogRedisInit(void);
+void SCLogRedisRegisterCounters(ConfNode *redis_node);
 int SCConfLogOpenRedis(ConfNode *, void *);
 int LogFileWriteRedis(void *, const char *, size_t);
 
 #endif /* HAVE_LIBHIREDIS */
+
+void SCLogRedisRegisterTests(void);
 #endif /* __UTIL_LOG_REDIS_H__ */
@@ -0,0 +1,708 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Writer thread for regular log files.
+ *
+ * Each thread logging to the file gets a single producer, single
+ * consumer byte ring. Records are copied in whole and published by
+ * moving 'head'. The writer thread builds an iovec of the used part of
+ * every ring, writes it with writev() and then releases the space by
+ * moving 'tail'. The rings are found through a small thread local cache
+ * keyed by the id of the writer, or on a cache miss by looking up the
+ * ring owned by the thread.
+ */
+
+#include "suricata-common.h"
+#include "conf.h"
+#include "threads.h"
+#include "counters.h"
+#include "util-atomic.h"
+#include "util-misc.h"
+#include "util-logopenfile.h"
+#include "util-log-writer.h"
+#include "util-spsc-ring.h"
+#include "tm-threads.h"
+#include "util-unittest.h"
+
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#else
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+#endif
+
+#define LOG_WRITER_DEFAULT_BUFFER_SIZE      (1024 * 1024)
+#define LOG_WRITER_MIN_BUFFER_SIZE          (64 * 1024)
+#define LOG_WRITER_DEFAULT_FLUSH_INTERVAL   100     /**< msec */
+/** max buffers written by one writev() call, two iovecs each */
+#define LOG_WRITER_MAX_BUFFERS              32
+/** writers a thread can remember its buffer for */
+#define LOG_WRITER_CACHE_SIZE               8
+
+typedef struct LogWriterBuffer_ {
+    /* producer side */
+    uint32_t head __attribute__((aligned(CLS)));
+    uint32_t tail_cache;            /**< producer's view of 'tail' */
+
+    /* consumer side */
+    uint32_t tail __attribute__((aligned(CLS)));
+
+    /* read only after init */
+    uint32_t size __attribute__((aligned(CLS)));
+    uint32_t mask;
+    uint8_t *data;
+    pthread_t owner;                /**< thread producing into the ring */
+    struct LogWriterBuffer_ *next;
+} LogWriterBuffer;
+
+typedef struct LogWriterCtx_ {
+    struct LogFileCtx_ *log_ctx;
+    /** write function of the file, used for records too large for
+     *  a buffer */
+    int (*DirectWrite)(const char *buffer, int buffer_len, struct LogFileCtx_ *);
+    uint64_t id;
+
+    uint32_t buffer_size;
+    uint32_t flush_interval;        /**< msec */
+    enum LogWriterFullPolicy policy;
+
+    /** per thread buffers. Only ever prepended to until the writer
+     *  is freed, so the writer thread can walk it without a lock. */
+    LogWriterBuffer *buffers;
+    SCMutex buffers_lock;
+
+    pthread_t thread;
+    SCCtrlMutex ctrl_mutex;
+    SCCtrlCondT ctrl_cond;
+    int stop;
+    SC_ATOMIC_DECLARE(int, wakeup);
+    bool write_error;
+
+    SC_ATOMIC_DECLARE(uint64_t, queued);    /**< bytes taken in last pass */
+    SC_ATOMIC_DECLARE(uint64_t, dropped);   /**< records dropped */
+    SC_ATOMIC_DECLARE(uint64_t, writes);    /**< write calls */
+
+    struct LogWriterCtx_ *next;
+} LogWriterCtx;
+
+/** all writers, for the global counters */
+static LogWriterCtx *log_writers = NULL;
+static SCMutex log_writers_lock = SCMUTEX_INITIALIZER;
+static uint64_t log_writers_id = 0;
+
+static __thread struct {
+    uint64_t id;
+    LogWriterBuffer *buffer;
+} log_writer_cache[LOG_WRITER_CACHE_SIZE];
+static __thread uint32_t log_writer_cache_next = 0;
+
+static uint64_t LogWriterQueuedCounter(void)
+{
+    uint64_t v = 0;
+    SCMutexLock(&log_writers_lock);
+    for (LogWriterCtx *w = log_writers; w != NULL; w = w->next)
+        v += SC_ATOMIC_GET(w->queued);
+    SCMutexUnlock(&log_writers_lock);
+    return v;
+}
+
+static uint64_t LogWriterDroppedCounter(void)
+{
+    uint64_t v = 0;
+    SCMutexLock(&log_writers_lock);
+    for (LogWriterCtx *w = log_writers; w != NULL; w = w->next)
+        v += SC_ATOMIC_GET(w->dropped);
+    SCMutexUnlock(&log_writers_lock);
+    return v;
+}
+
+static uint64_t LogWriterWritesCounter(void)
+{
+    uint64_t v = 0;
+    SCMutexLock(&log_writers_lock);
+    for (LogWriterCtx *w = log_writers; w != NULL; w = w->next)
+        v += SC_ATOMIC_GET(w->writes);
+    SCMutexUnlock(&log_writers_lock);
+    return v;
+}
+
+/** \internal
+ *  \brief get the calling thread's buffer, setting it up on first use
+ *
+ *  A thread has one buffer per writer, also after the writer was evicted
+ *  from the cache. A thread id is only reused after the thread exited,
+ *  so the buffer still has a single producer.
+ */
+static LogWriterBuffer *LogWriterGetBuffer(LogWriterCtx *w)
+{
+    for (uint32_t i = 0; i < LOG_WRITER_CACHE_SIZE; i++) {
+        if (log_writer_cache[i].id == w->id)
+            return log_writer_cache[i].buffer;
+    }
+
+    const pthread_t self = pthread_self();
+    LogWriterBuffer *b;
+
+    SCMutexLock(&w->buffers_lock);
+    for (b = w->buffers; b != NULL; b = b->next) {
+        if (pthread_equal(b->owner, self))
+            break;
+    }
+    if (b == NULL) {
+        b = SCCalloc(1, sizeof(*b));
+        if (unlikely(b == NULL)) {
+            SCMutexUnlock(&w->buffers_lock);
+            return NULL;
+        }
+        b->data = SCMalloc(w->buffer_size);
+        if (unlikely(b->data == NULL)) {
+            SCFree(b);
+            SCMutexUnlock(&w->buffers_lock);
+            return NULL;
+        }
+        b->size = w->buffer_size;
+        b->mask = w->buffer_size - 1;
+        b->owner = self;
+
+        b->next = w->buffers;
+        __atomic_store_n(&w->buffers, b, __ATOMIC_RELEASE);
+    }
+    SCMutexUnlock(&w->buffers_lock);
+
+    const uint32_t slot = log_writer_cache_next++ % LOG_WRITER_CACHE_SIZE;
+    log_writer_cache[slot].id = w->id;
+    log_writer_cache[slot].buffer = b;
+    return b;
+}
+
+/** \internal
+ *  \brief wake up the writer thread, unless a wakeup is pending */
+static void LogWriterWakeup(LogWriterCtx *w)
+{
+    if (SC_ATOMIC_GET(w->wakeup))
+        return;
+    SC_ATOMIC_SET(w->wakeup, 1);
+
+    SCCtrlMutexLock(&w->ctrl_mutex);
+    SCCtrlCondSignal(&w->ctrl_cond);
+    SCCtrlMutexUnlock(&w->ctrl_mutex);
+}
+
+/**
+ *  \brief queue a record for the writer thread
+ *
+ *  Used as the LogFileCtx::Write callback.
+ *
+ *  \retval 0 record queued or written
+ *  \retval -1 record dropped
+ */
+static int LogWriterWrite(const char *buffer, int buffer_len, LogFileCtx *log_ctx)
+{
+    LogWriterCtx *w = log_ctx->writer;
+    const uint32_t len = (uint32_t)buffer_len;
+
+    LogWriterBuffer *b = LogWriterGetBuffer(w);
+    if (unlikely(b == NULL || len > b->size)) {
+        /* can't be queued, write it ourselves */
+        return w->DirectWrite(buffer, buffer_len, log_ctx) > 0 ? 0 : -1;
+    }
+
+    const uint32_t head = b->head;
+    if (b->size - (head - b->tail_cache) < len) {
+        b->tail_cache = SPSC_LOAD_ACQ(&b->tail);
+        while (b->size - (head - b->tail_cache) < len) {
+            LogWriterWakeup(w);
+            if (w->policy == LOG_WRITER_FULL_DROP) {
+                (void) SC_ATOMIC_ADD(w->dropped, 1);
+                return -1;
+            }
+            SleepUsec(100);
+            b->tail_cache = SPSC_LOAD_ACQ(&b->tail);
+        }
+    }
+
+    const uint32_t offset = head & b->mask;
+    const uint32_t first = MIN(len, b->size - offset);
+    memcpy(b->data + offset, buffer, first);
+    if (first < len)
+        memcpy(b->data, buffer + first, len - first);
+    SPSC_STORE_REL(&b->head, head + len);
+
+    /* don't wait for the flush interval if the buffer is filling up */
+    if (head + len - b->tail_cache > b->size / 2) {
+        b->tail_cache = SPSC_LOAD_ACQ(&b->tail);
+        if (head + len - b->tail_cache > b->size / 2)
+            LogWriterWakeup(w);
+    }
+    return 0;
+}
+
+/** \internal
+ *  \brief write out an iovec, handling partial writes */
+static void LogWriterWritev(LogWriterCtx *w, struct iovec *iov, int cnt)
+{
+    LogFileCtx *log_ctx = w->log_ctx;
+
+    SCMutexLock(&log_ctx->fp_mutex);
+    LogFileCheckRotation(log_ctx);
+    if (log_ctx->fp != NULL) {
+#ifdef HAVE_SYS_UIO_H
+        const int fd = fileno(log_ctx->fp);
+        while (cnt > 0) {
+            ssize_t r = writev(fd, iov, cnt);
+            if (r < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (!w->write_error) {
+                    SCLogWarning(SC_ERR_FWRITE, "writing to %s failed: %s",
+                            log_ctx->filename, strerror(errno));
+                    w->write_error = true;
+                }
+                break;
+            }
+            (void) SC_ATOMIC_ADD(w->writes, 1);
+
+            while (cnt > 0 && (size_t)r >= iov->iov_len) {
+                r -= iov->iov_len;
+                iov++;
+                cnt--;
+            }
+            if (cnt > 0) {
+                iov->iov_base = (uint8_t *)iov->iov_base + r;
+                iov->iov_len -= r;
+            }
+        }
+#else
+        for (int i = 0; i < cnt; i++) {
+            if (fwrite(iov[i].iov_base, iov[i].iov_len, 1, log_ctx->fp) != 1)
+                break;
+        }
+        fflush(log_ctx->fp);
+        (void) SC_ATOMIC_ADD(w->writes, 1);
+#endif
+    }
+    SCMutexUnlock(&log_ctx->fp_mutex);
+}
+
+/** \internal
+ *  \brief write out everything queued in the buffers */
+static void LogWriterFlush(LogWriterCtx *w)
+{
+    struct iovec iov[LOG_WRITER_MAX_BUFFERS * 2];
+    LogWriterBuffer *bufs[LOG_WRITER_MAX_BUFFERS];
+    uint32_t heads[LOG_WRITER_MAX_BUFFERS];
+    uint64_t queued = 0;
+
+    LogWriterBuffer *b = __atomic_load_n(&w->buffers, __ATOMIC_ACQUIRE);
+    while (b != NULL) {
+        int n = 0;
+        int nb = 0;
+
+        for ( ; b != NULL && nb < LOG_WRITER_MAX_BUFFERS; b = b->next) {
+            const uint32_t tail = b->tail;
+            const uint32_t head = SPSC_LOAD_ACQ(&b->head);
+            if (head == tail)
+                continue;
+
+            const uint32_t len = head - tail;
+            const uint32_t offset = tail & b->mask;
+            const uint32_t first = MIN(len, b->size - offset);
+            iov[n].iov_base = b->data + offset;
+            iov[n].iov_len = first;
+            n++;
+            if (first < len) {
+                iov[n].iov_base = b->data;
+                iov[n].iov_len = len - first;
+                n++;
+            }
+            bufs[nb] = b;
+            heads[nb] = head;
+            nb++;
+            queued += len;
+        }
+
+        if (n > 0) {
+            LogWriterWritev(w, iov, n);
+            for (int i = 0; i < nb; i++)
+                SPSC_STORE_REL(&bufs[i]->tail, heads[i]);
+        }
+    }
+
+    SC_ATOMIC_SET(w->queued, queued);
+}
+
+static void *LogWriterThread(void *arg)
+{
+    LogWriterCtx *w = arg;
+
+    SCSetThreadName("LogWriter");
+
+    while (1) {
+        SCCtrlMutexLock(&w->ctrl_mutex);
+        if (!w->stop && !SC_ATOMIC_GET(w->wakeup)) {
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            uint64_t usec = (uint64_t)now.tv_usec + (uint64_t)w->flush_interval * 1000;
+            struct timespec cond_time;
+            cond_time.tv_sec = now.tv_sec + (time_t)(usec / 1000000);
+            cond_time.tv_nsec = (long)(usec % 1000000) * 1000;
+            SCCtrlCondTimedwait(&w->ctrl_cond, &w->ctrl_mutex, &cond_time);
+        }
+        const int stop = w->stop;
+        SCCtrlMutexUnlock(&w->ctrl_mutex);
+
+        SC_ATOMIC_SET(w->wakeup, 0);
+        LogWriterFlush(w);
+
+        if (stop)
+            break;
+    }
+    return NULL;
+}
+
+/** \internal
+ *  \brief set up the writer and start its thread */
+static int LogWriterStart(LogFileCtx *log_ctx, uint32_t buffer_size,
+        uint32_t flush_interval, enum LogWriterFullPolicy policy)
+{
+    LogWriterCtx *w = SCCalloc(1, sizeof(*w));
+    if (unlikely(w == NULL))
+        return -1;
+
+    w->log_ctx = log_ctx;
+    w->DirectWrite = log_ctx->Write;
+    w->buffer_size = buffer_size;
+    w->flush_interval = flush_interval;
+    w->policy = policy;
+    SCMutexInit(&w->buffers_lock, NULL);
+    SCCtrlMutexInit(&w->ctrl_mutex, NULL);
+    SCCtrlCondInit(&w->ctrl_cond, NULL);
+    SC_ATOMIC_INIT(w->wakeup);
+    SC_ATOMIC_INIT(w->queued);
+    SC_ATOMIC_INIT(w->dropped);
+    SC_ATOMIC_INIT(w->writes);
+
+    SCMutexLock(&log_writers_lock);
+    w->id = ++log_writers_id;
+    SCMutexUnlock(&log_writers_lock);
+
+    if (pthread_create(&w->thread, NULL, LogWriterThread, w) != 0) {
+        SCLogError(SC_ERR_THREAD_CREATE, "failed to create log writer thread");
+        SCMutexDestroy(&w->buffers_lock);
+        SCCtrlMutexDestroy(&w->ctrl_mutex);
+        SCCtrlCondDestroy(&w->ctrl_cond);
+        SCFree(w);
+        return -1;
+    }
+
+    SCMutexLock(&log_writers_lock);
+    w->next = log_writers;
+    log_writers = w;
+    SCMutexUnlock(&log_writers_lock);
+
+    log_ctx->writer = w;
+    log_ctx->Write = LogWriterWrite;
+    return 0;
+}
+
+/**
+ *  \brief set up a writer thread for a regular file if enabled
+ *
+ *  \param conf the 'writer-thread' node of the output
+ *  \param log_ctx log file, already opened
+ *
+ *  \retval 0 ok or not enabled
+ *  \retval -1 error
+ */
+int LogWriterInit(ConfNode *conf, LogFileCtx *log_ctx)
+{
+    int enabled = 0;
+    if (conf == NULL || ConfGetChildValueBool(conf, "enabled", &enabled) == 0 ||
+            !enabled) {
+        return 0;
+    }
+
+    uint32_t buffer_size = LOG_WRITER_DEFAULT_BUFFER_SIZE;
+    const char *str = ConfNodeLookupChildValue(conf, "buffer-size");
+    if (str != NULL && ParseSizeStringU32(str, &buffer_size) < 0) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "invalid writer-thread.buffer-size "
+                "value: %s", str);
+        return -1;
+    }
+    if (buffer_size < LOG_WRITER_MIN_BUFFER_SIZE)
+        buffer_size = LOG_WRITER_MIN_BUFFER_SIZE;
+    /* round up to a power of 2 */
+    uint32_t size = LOG_WRITER_MIN_BUFFER_SIZE;
+    while (size < buffer_size && size < (1U << 31))
+        size <<= 1;
+    buffer_size = size;
+
+    intmax_t flush_interval = LOG_WRITER_DEFAULT_FLUSH_INTERVAL;
+    if (ConfGetChildValueInt(conf, "flush-interval", &flush_interval) == 1 &&
+            (flush_interval < 1 || flush_interval > 60000)) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "invalid writer-thread.flush-interval "
+                "value %"PRIdMAX", expected 1-60000 msec", flush_interval);
+        return -1;
+    }
+
+    enum LogWriterFullPolicy policy = LOG_WRITER_FULL_DROP;
+    str = ConfNodeLookupChildValue(conf, "full-policy");
+    if (str != NULL) {
+        if (strcasecmp(str, "block") == 0) {
+            policy = LOG_WRITER_FULL_BLOCK;
+        } else if (strcasecmp(str, "drop") != 0) {
+            SCLogError(SC_ERR_INVALID_ARGUMENT, "invalid writer-thread.full-policy "
+                    "value %s, expected 'drop' or 'block'", str);
+            return -1;
+        }
+    }
+
+    if (LogWriterStart(log_ctx, buffer_size, (uint32_t)flush_interval, policy) < 0)
+        return -1;
+
+    StatsRegisterGlobalCounter("logfile.writer.queued_bytes", LogWriterQueuedCounter);
+    StatsRegisterGlobalCounter("logfile.writer.dropped", LogWriterDroppedCounter);
+    StatsRegisterGlobalCounter("logfile.writer.writes", LogWriterWritesCounter);
+
+    SCLogConfig("%s: writer thread with %"PRIu32" byte buffers per thread, "
+            "flushed every %"PRIdMAX" msec, %s records if full",
+            log_ctx->filename ? log_ctx->filename : "log file", buffer_size,
+            flush_interval, policy == LOG_WRITER_FULL_DROP ? "dropping" : "blocking on");
+    return 0;
+}
+
+/**
+ *  \brief stop the writer thread, write out what is left and free
+ *         the writer
+ *
+ *  Must only be called when no thread logs to the file anymore.
+ */
+void LogWriterDeinit(LogFileCtx *log_ctx)
+{
+    LogWriterCtx *w = log_ctx->writer;
+    if (w == NULL)
+        return;
+
+    SCCtrlMutexLock(&w->ctrl_mutex);
+    w->stop = 1;
+    SCCtrlCondSignal(&w->ctrl_cond);
+    SCCtrlMutexUnlock(&w->ctrl_mutex);
+    pthread_join(w->thread, NULL);
+
+    if (SC_ATOMIC_GET(w->dropped) > 0) {
+        SCLogWarning(SC_WARN_EVENT_DROPPED, "%s: %"PRIu64" records were dropped "
+                "as the writer thread could not keep up",
+                log_ctx->filename ? log_ctx->filename : "log file",
+                SC_ATOMIC_GET(w->dropped));
+    }
+
+    SCMutexLock(&log_writers_lock);
+    LogWriterCtx **pw = &log_writers;
+    while (*pw != NULL && *pw != w)
+        pw = &(*pw)->next;
+    if (*pw != NULL)
+        *pw = w->next;
+    SCMutexUnlock(&log_writers_lock);
+
+    LogWriterBuffer *b = w->buffers;
+    while (b != NULL) {
+        LogWriterBuffer *next = b->next;
+        SCFree(b->data);
+        SCFree(b);
+        b = next;
+    }
+
+    log_ctx->Write = w->DirectWrite;
+    log_ctx->writer = NULL;
+
+    SCMutexDestroy(&w->buffers_lock);
+    SCCtrlMutexDestroy(&w->ctrl_mutex);
+    SCCtrlCondDestroy(&w->ctrl_cond);
+    SC_ATOMIC_DESTROY(w->wakeup);
+    SC_ATOMIC_DESTROY(w->queued);
+    SC_ATOMIC_DESTROY(w->dropped);
+    SC_ATOMIC_DESTROY(w->writes);
+    SCFree(w);
+}
+
+#ifdef UNITTESTS
+#define LOG_WRITER_TEST_THREADS 4
+#define LOG_WRITER_TEST_RECORDS 20000
+
+static void *LogWriterTestThread(void *arg)
+{
+    LogFileCtx *log_ctx = arg;
+    char rec[64];
+
+    for (int i = 0; i < LOG_WRITER_TEST_RECORDS; i++) {
+        int len = snprintf(rec, sizeof(rec), "{\"record\":%d}\n", i);
+        log_ctx->Write(rec, len, log_ctx);
+    }
+    return NULL;
+}
+
+/** \internal
+ *  \brief count the lines in the file, checking each is a whole record */
+static int LogWriterTestCountLines(FILE *fp, uint64_t *lines)
+{
+    char line[128];
+
+    *lines = 0;
+    rewind(fp);
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        int v;
+        char end;
+        if (sscanf(line, "{\"record\":%d}%c", &v, &end) != 2 || end != '\n')
+            return 0;
+        (*lines)++;
+    }
+    return 1;
+}
+
+static int LogWriterTestRun(enum LogWriterFullPolicy policy, uint64_t *lines,
+        uint64_t *dropped)
+{
+    LogFileCtx *log_ctx = LogFileNewCtx();
+    FAIL_IF_NULL(log_ctx);
+    log_ctx->fp = tmpfile();
+    FAIL_IF_NULL(log_ctx->fp);
+    log_ctx->is_regular = 1;
+
+    FAIL_IF(LogWriterStart(log_ctx, LOG_WRITER_MIN_BUFFER_SIZE, 10, policy) != 0);
+
+    pthread_t threads[LOG_WRITER_TEST_THREADS];
+    for (int i = 0; i < LOG_WRITER_TEST_THREADS; i++) {
+        FAIL_IF(pthread_create(&threads[i], NULL, LogWriterTestThread, log_ctx) != 0);
+    }
+    for (int i = 0; i < LOG_WRITER_TEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    *dropped = SC_ATOMIC_GET(log_ctx->writer->dropped);
+    LogWriterDeinit(log_ctx);
+    FAIL_IF_NOT_NULL(log_ctx->writer);
+
+    FAIL_IF_NOT(LogWriterTestCountLines(log_ctx->fp, lines));
+
+    LogFileFreeCtx(log_ctx);
+    PASS;
+}
+
+/** \test with the block policy no record is lost or broken up */
+static int LogWriterTest01(void)
+{
+    uint64_t lines = 0;
+    uint64_t dropped = 0;
+
+    FAIL_IF_NOT(LogWriterTestRun(LOG_WRITER_FULL_BLOCK, &lines, &dropped));
+    FAIL_IF(dropped != 0);
+    FAIL_IF(lines != LOG_WRITER_TEST_THREADS * LOG_WRITER_TEST_RECORDS);
+    PASS;
+}
+
+/** \test with the drop policy every record is written or counted */
+static int LogWriterTest02(void)
+{
+    uint64_t lines = 0;
+    uint64_t dropped = 0;
+
+    FAIL_IF_NOT(LogWriterTestRun(LOG_WRITER_FULL_DROP, &lines, &dropped));
+    FAIL_IF(lines + dropped != LOG_WRITER_TEST_THREADS * LOG_WRITER_TEST_RECORDS);
+    PASS;
+}
+
+/** \test records larger than the buffer bypass it */
+static int LogWriterTest03(void)
+{
+    LogFileCtx *log_ctx = LogFileNewCtx();
+    FAIL_IF_NULL(log_ctx);
+    log_ctx->fp = tmpfile();
+    FAIL_IF_NULL(log_ctx->fp);
+    log_ctx->is_regular = 1;
+
+    FAIL_IF(LogWriterStart(log_ctx, LOG_WRITER_MIN_BUFFER_SIZE, 1000,
+                LOG_WRITER_FULL_DROP) != 0);
+
+    const uint32_t len = LOG_WRITER_MIN_BUFFER_SIZE + 1;
+    char *big = SCMalloc(len);
+    FAIL_IF_NULL(big);
+    memset(big, 'x', len - 1);
+    big[len - 1] = '\n';
+    FAIL_IF(log_ctx->Write(big, len, log_ctx) != 0);
+    SCFree(big);
+
+    LogWriterDeinit(log_ctx);
+    FAIL_IF(ftell(log_ctx->fp) != (long)len);
+
+    LogFileFreeCtx(log_ctx);
+    PASS;
+}
+
+/** \test a thread logging to more writers than its cache holds keeps
+ *        using one buffer per writer */
+static int LogWriterTest04(void)
+{
+#define LOG_WRITER_TEST_FILES (LOG_WRITER_CACHE_SIZE + 2)
+    LogFileCtx *ctxs[LOG_WRITER_TEST_FILES];
+
+    for (int i = 0; i < LOG_WRITER_TEST_FILES; i++) {
+        ctxs[i] = LogFileNewCtx();
+        FAIL_IF_NULL(ctxs[i]);
+        ctxs[i]->fp = tmpfile();
+        FAIL_IF_NULL(ctxs[i]->fp);
+        ctxs[i]->is_regular = 1;
+        FAIL_IF(LogWriterStart(ctxs[i], LOG_WRITER_MIN_BUFFER_SIZE, 1000,
+                    LOG_WRITER_FULL_BLOCK) != 0);
+    }
+
+    const char rec[] = "{\"record\":0}\n";
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < LOG_WRITER_TEST_FILES; i++) {
+            FAIL_IF(ctxs[i]->Write(rec, sizeof(rec) - 1, ctxs[i]) != 0);
+        }
+    }
+
+    for (int i = 0; i < LOG_WRITER_TEST_FILES; i++) {
+        LogWriterBuffer *b = ctxs[i]->writer->buffers;
+        FAIL_IF_NULL(b);
+        FAIL_IF_NOT_NULL(b->next);
+
+        LogWriterDeinit(ctxs[i]);
+        uint64_t lines = 0;
+        FAIL_IF_NOT(LogWriterTestCountLines(ctxs[i]->fp, &lines));
+        FAIL_IF(lines != 3);
+        LogFileFreeCtx(ctxs[i]);
+    }
+#undef LOG_WRITER_TEST_FILES
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void LogWriterRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("LogWriterTest01", LogWriterTest01);
+    UtRegisterTest("LogWriterTest02", LogWriterTest02);
+    UtRegisterTest("LogWriterTest03", LogWriterTest03);
+    UtRegisterTest("LogWriterTest04", LogWriterTest04);
+#endif
+}
@@ -0,0 +1,47 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Writer thread for regular log files.
+ *
+ * Threads logging to the file copy their records into a lock-free
+ * buffer of their own. A dedicated thread collects the buffers and
+ * writes them out with a single writev() call, either every
+ * 'flush-interval' or when a buffer is filling up.
+ */
+
+#ifndef __UTIL_LOG_WRITER_H__
+#define __UTIL_LOG_WRITER_H__
+
+#include "conf.h"
+
+struct LogFileCtx_;
+
+/** what to do when a thread's buffer has no room for a record */
+enum LogWriterFullPolicy {
+    LOG_WRITER_FULL_DROP = 0,   /**< drop the record */
+    LOG_WRITER_FULL_BLOCK,      /**< wait for the writer thread */
+};
+
+int LogWriterInit(ConfNode *conf, struct LogFileCtx_ *log_ctx);
+void LogWriterDeinit(struct LogFileCtx_ *log_ctx);
+
+void LogWriterRegisterTests(void);
+
+#endif /* __UTIL_LOG_WRITER_H__ */
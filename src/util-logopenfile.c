@@ -31,6 +31,8 @@
 #include "util-byte.h"
 #include "util-path.h"
 #include "util-logopenfile.h"
+#include "util-log-writer.h"
+#include "util-unittest.h"
 
 #if defined(HAVE_SYS_UN_H) && defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_TYPES_H)
 #define BUILD_WITH_UNIXSOCKET
@@ -177,6 +179,28 @@ tryagain:
 }
 #endif /* BUILD_WITH_UNIXSOCKET */
 
+/**
+ * \brief Reopen a regular log file if rotation was requested or its
+ *        rotate interval passed.
+ *
+ * Must be called with the fp_mutex held.
+ */
+void LogFileCheckRotation(LogFileCtx *log_ctx)
+{
+    if (log_ctx->rotation_flag) {
+        log_ctx->rotation_flag = 0;
+        SCConfLogReopen(log_ctx);
+    }
+
+    if (log_ctx->flags & LOGFILE_ROTATE_INTERVAL) {
+        time_t now = time(NULL);
+        if (now >= log_ctx->rotate_time) {
+            SCConfLogReopen(log_ctx);
+            log_ctx->rotate_time = now + log_ctx->rotate_interval;
+        }
+    }
+}
+
 /**
  * \brief Write buffer to log file.
  * \retval 0 on failure; otherwise, the return value of fwrite (number of
@@ -193,20 +217,7 @@ static int SCLogFileWrite(const char *buffer, int buffer_len, LogFileCtx *log_ct
     } else
 #endif
     {
-
-        /* Check for rotation. */
-        if (log_ctx->rotation_flag) {
-            log_ctx->rotation_flag = 0;
-            SCConfLogReopen(log_ctx);
-        }
-
-        if (log_ctx->flags & LOGFILE_ROTATE_INTERVAL) {
-            time_t now = time(NULL);
-            if (now >= log_ctx->rotate_time) {
-                SCConfLogReopen(log_ctx);
-                log_ctx->rotate_time = now + log_ctx->rotate_interval;
-            }
-        }
+        LogFileCheckRotation(log_ctx);
 
         if (log_ctx->fp) {
             clearerr(log_ctx->fp);
@@ -220,6 +231,135 @@ static int SCLogFileWrite(const char *buffer, int buffer_len, LogFileCtx *log_ct
     return ret;
 }
 
+/** threaded outputs a thread can remember its context for */
+#define LOGFILE_THREAD_CACHE_SIZE   8
+
+static SCMutex logfile_threaded_lock = SCMUTEX_INITIALIZER;
+static uint64_t logfile_threaded_id = 0;
+
+static __thread struct {
+    uint64_t id;
+    LogFileCtx *ctx;
+} logfile_thread_cache[LOGFILE_THREAD_CACHE_SIZE];
+static __thread uint32_t logfile_thread_cache_next = 0;
+
+/** \internal
+ *  \brief set up the calling thread's context of a threaded output
+ *
+ *  Called with the parent's fp_mutex held. The context is kept even if
+ *  opening fails, so that a broken output doesn't get retried (and
+ *  logged) for every record.
+ */
+static LogFileCtx *LogFileNewThreadCtx(LogFileCtx *parent)
+{
+    LogFileCtx *t = LogFileNewCtx();
+    if (unlikely(t == NULL))
+        return NULL;
+
+    t->parent = parent;
+    t->thread = pthread_self();
+    t->thread_idx = ++parent->threads_cnt;
+    t->type = parent->type;
+    t->rotation_gen_seen = SC_ATOMIC_GET(parent->rotation_gen);
+
+    if (SCConfLogOpenGeneric(parent->threaded_conf, t, parent->filename, 0) < 0) {
+        SCLogWarning(SC_ERR_FOPEN, "failed to open per thread output %u "
+                "of %s", t->thread_idx, parent->filename);
+    }
+
+    t->threads_next = parent->threads;
+    parent->threads = t;
+    return t;
+}
+
+/**
+ * \brief get the calling thread's context of a threaded output
+ *
+ * The context is looked up in a small thread local cache, so the
+ * parent's fp_mutex is only taken on a thread's first write and while
+ * handing on a rotation request.
+ *
+ * \retval ctx the thread's context, or NULL on memory error
+ */
+LogFileCtx *LogFileGetThreadCtx(LogFileCtx *log_ctx)
+{
+    LogFileCtx *t = NULL;
+    for (uint32_t i = 0; i < LOGFILE_THREAD_CACHE_SIZE; i++) {
+        if (logfile_thread_cache[i].id == log_ctx->threaded_id) {
+            t = logfile_thread_cache[i].ctx;
+            break;
+        }
+    }
+
+    if (unlikely(t == NULL)) {
+        SCMutexLock(&log_ctx->fp_mutex);
+        /* the thread may have been evicted from the cache */
+        for (t = log_ctx->threads; t != NULL; t = t->threads_next) {
+            if (pthread_equal(t->thread, pthread_self()))
+                break;
+        }
+        if (t == NULL)
+            t = LogFileNewThreadCtx(log_ctx);
+        SCMutexUnlock(&log_ctx->fp_mutex);
+        if (t == NULL)
+            return NULL;
+
+        const uint32_t slot = logfile_thread_cache_next++ % LOGFILE_THREAD_CACHE_SIZE;
+        logfile_thread_cache[slot].id = log_ctx->threaded_id;
+        logfile_thread_cache[slot].ctx = t;
+    }
+
+    /* the rotation flag is registered for the parent: turn it into a
+     * new generation that each thread picks up on its next write */
+    if (unlikely(log_ctx->rotation_flag)) {
+        SCMutexLock(&log_ctx->fp_mutex);
+        if (log_ctx->rotation_flag) {
+            log_ctx->rotation_flag = 0;
+            (void)SC_ATOMIC_ADD(log_ctx->rotation_gen, 1);
+        }
+        SCMutexUnlock(&log_ctx->fp_mutex);
+    }
+    const uint32_t gen = SC_ATOMIC_GET(log_ctx->rotation_gen);
+    if (unlikely(t->rotation_gen_seen != gen)) {
+        t->rotation_gen_seen = gen;
+        t->rotation_flag = 1;
+    }
+
+    return t;
+}
+
+/**
+ * \brief Write buffer to the calling thread's output of a threaded
+ *        output.
+ */
+static int SCLogFileWriteThreaded(const char *buffer, int buffer_len,
+        LogFileCtx *log_ctx)
+{
+    LogFileCtx *t = LogFileGetThreadCtx(log_ctx);
+    if (unlikely(t == NULL))
+        return 0;
+    return t->Write(buffer, buffer_len, t);
+}
+
+/** \internal
+ *  \brief name of a per thread file: eve.json becomes eve.<idx>.json
+ */
+static void LogFileThreadPath(char *path, size_t size, uint32_t idx)
+{
+    char orig[PATH_MAX];
+    strlcpy(orig, path, sizeof(orig));
+
+    char *base = strrchr(orig, '/');
+    base = base ? base + 1 : orig;
+    char *dot = strrchr(base, '.');
+    if (dot == NULL || dot == base) {
+        snprintf(path, size, "%s.%u", orig, idx);
+    } else {
+        *dot = '\0';
+        snprintf(path, size, "%s.%u.%s", orig, idx, dot + 1);
+    }
+}
+
 /** \brief generate filename based on pattern
  *  \param pattern pattern to use
  *  \retval char* on success
@@ -414,6 +554,44 @@ SCConfLogOpenGeneric(ConfNode *conf,
     }
 #endif /* HAVE_LIBJANSSON */
 
+#ifdef HAVE_LIBHIREDIS
+    /* register the counters now, before the stats start: the contexts
+     * of a threaded output are opened later from the packet threads */
+    if (log_ctx->parent == NULL && strcasecmp(filetype, "redis") == 0)
+        SCLogRedisRegisterCounters(ConfNodeLookupChild(conf, "redis"));
+#endif
+
+    /* With 'threaded' nothing is opened here: each thread opens a file
+     * or connection of its own on its first write. */
+    int threaded = 0;
+    if (log_ctx->parent == NULL &&
+            ConfGetChildValueBool(conf, "threaded", &threaded) == 1 && threaded) {
+        if (strcasecmp(filetype, "syslog") == 0 ||
+                strcasecmp(filetype, "pcie") == 0) {
+            SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "%s.threaded is not "
+                    "supported with filetype %s", conf->name, filetype);
+            return -1;
+        }
+        log_ctx->filename = SCStrdup(log_path);
+        if (unlikely(log_ctx->filename == NULL)) {
+            SCLogError(SC_ERR_MEM_ALLOC,
+                "Failed to allocate memory for filename");
+            return -1;
+        }
+        log_ctx->threaded = true;
+        log_ctx->threaded_conf = conf;
+        SCMutexLock(&logfile_threaded_lock);
+        log_ctx->threaded_id = ++logfile_threaded_id;
+        SCMutexUnlock(&logfile_threaded_lock);
+        log_ctx->Write = SCLogFileWriteThreaded;
+        if (rotate) {
+            OutputRegisterFileRotationFlag(&log_ctx->rotation_flag);
+        }
+        SCLogInfo("%s output device (%s) initialized per thread: %s",
+                conf->name, filetype, filename);
+        return 0;
+    }
+
     // Now, what have we been asked to open?
     if (strcasecmp(filetype, "unix_stream") == 0) {
 #ifdef BUILD_WITH_UNIXSOCKET
@@ -435,6 +613,9 @@ SCConfLogOpenGeneric(ConfNode *conf,
 #endif
     } else if (strcasecmp(filetype, DEFAULT_LOG_FILETYPE) == 0 ||
                strcasecmp(filetype, "file") == 0) {
+        if (log_ctx->parent != NULL) {
+            LogFileThreadPath(log_path, sizeof(log_path), log_ctx->thread_idx);
+        }
         log_ctx->fp = SCLogOpenFileFp(log_path, append, log_ctx->filemode);
         if (log_ctx->fp == NULL)
             return -1; // Error already logged by Open...Fp routine
@@ -442,6 +623,12 @@ SCConfLogOpenGeneric(ConfNode *conf,
         if (rotate) {
             OutputRegisterFileRotationFlag(&log_ctx->rotation_flag);
         }
+        /* a thread's own file has no lock contention to avoid */
+        if (log_ctx->parent == NULL &&
+                LogWriterInit(ConfNodeLookupChild(conf, "writer-thread"),
+                    log_ctx) < 0) {
+            return -1;
+        }
 #ifdef HAVE_LIBHIREDIS
     } else if (strcasecmp(filetype, "redis") == 0) {
         ConfNode *redis_node = ConfNodeLookupChild(conf, "redis");
@@ -472,8 +659,13 @@ SCConfLogOpenGeneric(ConfNode *conf,
         log_ctx->send_flags |= MSG_DONTWAIT;
     }
 #endif
-    SCLogInfo("%s output device (%s) initialized: %s", conf->name, filetype,
-              filename);
+    if (log_ctx->parent == NULL) {
+        SCLogInfo("%s output device (%s) initialized: %s", conf->name, filetype,
+                  filename);
+    } else {
+        SCLogConfig("%s output device (%s) opened for thread %u: %s",
+                conf->name, filetype, log_ctx->thread_idx, log_ctx->filename);
+    }
 
     return 0;
 }
@@ -526,6 +718,7 @@ LogFileCtx *LogFileNewCtx(void)
     memset(lf_ctx, 0, sizeof(LogFileCtx));
 
     SCMutexInit(&lf_ctx->fp_mutex,NULL);
+    SC_ATOMIC_INIT(lf_ctx->rotation_gen);
 
     // Default Write and Close functions
     lf_ctx->Write = SCLogFileWrite;
@@ -544,9 +737,22 @@ int LogFileFreeCtx(LogFileCtx *lf_ctx)
         SCReturnInt(0);
     }
 
-    if (lf_ctx->fp != NULL) {
+    /* write out what the writer thread has queued */
+    LogWriterDeinit(lf_ctx);
+
+    LogFileCtx *t = lf_ctx->threads;
+    while (t != NULL) {
+        LogFileCtx *next = t->threads_next;
+        LogFileFreeCtx(t);
+        t = next;
+    }
+    lf_ctx->threads = NULL;
+
+    /* redis has no fp, but has a connection and maybe queued records */
+    if (lf_ctx->fp != NULL || lf_ctx->type == LOGFILE_TYPE_REDIS) {
         SCMutexLock(&lf_ctx->fp_mutex);
-        lf_ctx->Close(lf_ctx);
+        if (lf_ctx->Close != NULL)
+            lf_ctx->Close(lf_ctx);
         SCMutexUnlock(&lf_ctx->fp_mutex);
     }
 
@@ -565,6 +771,7 @@ int LogFileFreeCtx(LogFileCtx *lf_ctx)
 
     OutputUnregisterFileRotationFlag(&lf_ctx->rotation_flag);
 
+    SC_ATOMIC_DESTROY(lf_ctx->rotation_gen);
     SCFree(lf_ctx);
 
     SCReturnInt(1);
@@ -572,6 +779,12 @@ int LogFileFreeCtx(LogFileCtx *lf_ctx)
 
 int LogFileWrite(LogFileCtx *file_ctx, MemBuffer *buffer)
 {
+    if (file_ctx->threaded) {
+        file_ctx = LogFileGetThreadCtx(file_ctx);
+        if (unlikely(file_ctx == NULL))
+            return -1;
+    }
+
     if (file_ctx->type == LOGFILE_TYPE_SYSLOG) {
         syslog(file_ctx->syslog_setup.alert_syslog_level, "%s",
                 (const char *)MEMBUFFER_BUFFER(buffer));
@@ -595,3 +808,120 @@ int LogFileWrite(LogFileCtx *file_ctx, MemBuffer *buffer)
 
     return 0;
 }
+
+#ifdef UNITTESTS
+#include "conf-yaml-loader.h"
+
+static int LogFileTest01(void)
+{
+    char path[PATH_MAX];
+
+    strlcpy(path, "/var/log/suricata/eve.json", sizeof(path));
+    LogFileThreadPath(path, sizeof(path), 1);
+    FAIL_IF_NOT(strcmp(path, "/var/log/suricata/eve.1.json") == 0);
+
+    strlcpy(path, "/var/log/suri.cata/eve", sizeof(path));
+    LogFileThreadPath(path, sizeof(path), 12);
+    FAIL_IF_NOT(strcmp(path, "/var/log/suri.cata/eve.12") == 0);
+
+    strlcpy(path, "/var/log/.eve", sizeof(path));
+    LogFileThreadPath(path, sizeof(path), 2);
+    FAIL_IF_NOT(strcmp(path, "/var/log/.eve.2") == 0);
+
+    strlcpy(path, "eve.log.json", sizeof(path));
+    LogFileThreadPath(path, sizeof(path), 3);
+    FAIL_IF_NOT(strcmp(path, "eve.log.3.json") == 0);
+
+    PASS;
+}
+
+static void *LogFileTestThread(void *arg)
+{
+    LogFileCtx *ctx = arg;
+    const char rec[] = "record\n";
+    for (int i = 0; i < 100; i++) {
+        ctx->Write(rec, sizeof(rec) - 1, ctx);
+    }
+    return NULL;
+}
+
+static long LogFileTestSize(const char *dir, const char *name)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (stat(path, &st) != 0)
+        return -1;
+    return (long)st.st_size;
+}
+
+/** \test threaded: a file per thread, rotation handed on to each */
+static int LogFileTest02(void)
+{
+    char dir[] = "/tmp/suricata-logfile-XXXXXX";
+    FAIL_IF_NULL(mkdtemp(dir));
+
+    char config[512];
+    snprintf(config, sizeof(config),
+            "%%YAML 1.1\n"
+            "---\n"
+            "eve-log:\n"
+            "  filetype: regular\n"
+            "  filename: %s/eve.json\n"
+            "  threaded: yes\n", dir);
+
+    ConfCreateContextBackup();
+    ConfInit();
+    ConfYamlLoadString(config, strlen(config));
+
+    LogFileCtx *ctx = LogFileNewCtx();
+    FAIL_IF_NULL(ctx);
+    FAIL_IF(SCConfLogOpenGeneric(ConfGetNode("eve-log"), ctx, "eve.json", 1) < 0);
+    FAIL_IF_NOT(ctx->threaded);
+    /* nothing opened for the output itself */
+    FAIL_IF_NOT(LogFileTestSize(dir, "eve.json") == -1);
+
+    pthread_t threads[2];
+    for (int i = 0; i < 2; i++)
+        FAIL_IF(pthread_create(&threads[i], NULL, LogFileTestThread, ctx) != 0);
+    for (int i = 0; i < 2; i++)
+        pthread_join(threads[i], NULL);
+
+    FAIL_IF_NOT(ctx->threads_cnt == 2);
+    FAIL_IF_NOT(LogFileTestSize(dir, "eve.1.json") == 700);
+    FAIL_IF_NOT(LogFileTestSize(dir, "eve.2.json") == 700);
+
+    /* this thread gets a file of its own too */
+    LogFileTestThread(ctx);
+    FAIL_IF_NOT(LogFileTestSize(dir, "eve.3.json") == 700);
+
+    /* a rotation request reopens the thread's file */
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/eve.3.json", dir);
+    FAIL_IF(unlink(path) != 0);
+    ctx->rotation_flag = 1;
+    LogFileTestThread(ctx);
+    FAIL_IF_NOT(ctx->rotation_flag == 0);
+    FAIL_IF_NOT(LogFileTestSize(dir, "eve.3.json") == 700);
+    FAIL_IF_NOT(ctx->threads_cnt == 3);
+
+    LogFileFreeCtx(ctx);
+    ConfRestoreContextBackup();
+
+    const char *names[] = { "eve.1.json", "eve.2.json", "eve.3.json" };
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        unlink(path);
+    }
+    rmdir(dir);
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void LogFileRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("LogFileTest01", LogFileTest01);
+    UtRegisterTest("LogFileTest02", LogFileTest02);
+#endif
+}
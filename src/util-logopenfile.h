@@ -131,6 +131,27 @@ typedef struct LogFileCtx_ {
     /* Socket types may need to drop events to keep from blocking
      * Suricata. */
     uint64_t dropped;
+
+    /** writer thread, if the file is written by one */
+    struct LogWriterCtx_ *writer;
+
+    /** With 'threaded' each thread writes to a LogFileCtx of its own,
+     *  opened from 'threaded_conf' on the thread's first write. */
+    bool threaded;
+    uint64_t threaded_id;           /**< unique id for the thread lookup */
+    ConfNode *threaded_conf;
+    uint32_t threads_cnt;
+    struct LogFileCtx_ *threads;    /**< list of per thread contexts */
+    /** incremented on each rotation request, per thread contexts
+     *  reopen their file when they see it change */
+    SC_ATOMIC_DECLARE(uint32_t, rotation_gen);
+
+    /* per thread context fields */
+    struct LogFileCtx_ *parent;
+    struct LogFileCtx_ *threads_next;
+    pthread_t thread;
+    uint32_t thread_idx;            /**< 1 based, used in the file name */
+    uint32_t rotation_gen_seen;
 } LogFileCtx;
 
 /* Min time (msecs) before trying to reconnect a Unix domain socket */
@@ -144,8 +165,12 @@ typedef struct LogFileCtx_ {
 LogFileCtx *LogFileNewCtx(void);
 int LogFileFreeCtx(LogFileCtx *);
 int LogFileWrite(LogFileCtx *file_ctx, MemBuffer *buffer);
+void LogFileCheckRotation(LogFileCtx *log_ctx);
+LogFileCtx *LogFileGetThreadCtx(LogFileCtx *log_ctx);
 
 int SCConfLogOpenGeneric(ConfNode *conf, LogFileCtx *, const char *, int);
 int SCConfLogReopen(LogFileCtx *);
 
+void LogFileRegisterTests(void);
+
 #endif /* __UTIL_LOGOPENFILE_H__ */
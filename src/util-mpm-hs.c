@@ -41,10 +41,13 @@
 #include "util-hash.h"
 #include "util-hash-lookup3.h"
 #include "util-hyperscan.h"
+#include "util-misc.h"
 
 #ifdef BUILD_HYPERSCAN
 
 #include <hs.h>
+#include <dirent.h>
+#include <utime.h>
 
 void SCHSInitCtx(MpmCtx *);
 void SCHSInitThreadCtx(MpmCtx *, MpmThreadCtx *);
@@ -576,6 +579,336 @@ static PatternDatabase *PatternDatabaseAlloc(uint32_t pattern_cnt)
     return pd;
 }
 
+/* On disk cache of compiled databases, see detect.hyperscan-cache. Access
+ * is serialised via g_hs_cache_mutex. */
+#define HS_CACHE_MAGIC              "SCHSDB1"
+#define HS_CACHE_DEFAULT_MAX_SIZE   (1024ULL * 1024 * 1024)
+
+typedef struct SCHSCacheHeader_ {
+    char magic[8];
+    uint64_t key;
+    uint32_t input_len;     /**< length of the compile input that follows */
+    uint32_t db_len;        /**< length of the serialized database */
+} SCHSCacheHeader;
+
+typedef struct SCHSCacheFile_ {
+    char name[32];
+    time_t mtime;
+    uint64_t size;
+} SCHSCacheFile;
+
+static struct {
+    bool init;
+    bool enabled;
+    char path[PATH_MAX];
+    uint64_t max_size;
+    uint64_t size;          /**< bytes in the cache dir, as far as we know */
+
+    /* since the last MpmHSCacheReport() */
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t stores;
+} g_hs_cache;
+static SCMutex g_hs_cache_mutex = SCMUTEX_INITIALIZER;
+
+static void SCHSCacheScan(uint64_t limit);
+
+/** \internal
+ *  \brief read the cache config on first use */
+static void SCHSCacheInit(void)
+{
+    if (g_hs_cache.init)
+        return;
+    g_hs_cache.init = true;
+
+    ConfNode *conf = ConfGetNode("detect.hyperscan-cache");
+    int enabled = 0;
+    if (conf == NULL ||
+            ConfGetChildValueBool(conf, "enabled", &enabled) != 1 || !enabled)
+        return;
+
+    const char *path = ConfNodeLookupChildValue(conf, "path");
+    if (path != NULL) {
+        strlcpy(g_hs_cache.path, path, sizeof(g_hs_cache.path));
+    } else {
+        snprintf(g_hs_cache.path, sizeof(g_hs_cache.path), "%s/hs-cache",
+                ConfigGetLogDirectory());
+    }
+
+    g_hs_cache.max_size = HS_CACHE_DEFAULT_MAX_SIZE;
+    const char *max_size = ConfNodeLookupChildValue(conf, "max-size");
+    if (max_size != NULL &&
+            ParseSizeStringU64(max_size, &g_hs_cache.max_size) < 0) {
+        SCLogError(SC_ERR_SIZE_PARSE, "invalid detect.hyperscan-cache.max-size "
+                "\"%s\", cache disabled", max_size);
+        return;
+    }
+
+    if (SCCreateDirectoryTree(g_hs_cache.path, true) < 0) {
+        SCLogWarning(SC_ERR_CREATE_DIRECTORY, "failed to create Hyperscan "
+                "cache directory %s, cache disabled", g_hs_cache.path);
+        return;
+    }
+
+    g_hs_cache.enabled = true;
+    SCHSCacheScan(g_hs_cache.max_size);
+    SCLogConfig("Hyperscan database cache in %s, %"PRIu64" bytes used",
+            g_hs_cache.path, g_hs_cache.size);
+}
+
+static int SCHSCacheFileCompare(const void *a, const void *b)
+{
+    const SCHSCacheFile *fa = a;
+    const SCHSCacheFile *fb = b;
+    if (fa->mtime != fb->mtime)
+        return fa->mtime < fb->mtime ? -1 : 1;
+    return strcmp(fa->name, fb->name);
+}
+
+/** \internal
+ *  \brief update the cache size and, if it exceeds 'limit', remove the
+ *         least recently used databases until it is below 90% of it
+ */
+static void SCHSCacheScan(uint64_t limit)
+{
+    DIR *dir = opendir(g_hs_cache.path);
+    if (dir == NULL)
+        return;
+
+    SCHSCacheFile *files = NULL;
+    uint32_t cnt = 0, size = 0;
+    uint64_t total = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        const size_t len = strlen(de->d_name);
+        if (len < 4 || len >= sizeof(files[0].name) ||
+                strcmp(de->d_name + len - 3, ".hs") != 0)
+            continue;
+
+        char fpath[PATH_MAX];
+        struct stat st;
+        snprintf(fpath, sizeof(fpath), "%s/%s", g_hs_cache.path, de->d_name);
+        if (stat(fpath, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        if (cnt == size) {
+            size = size ? size * 2 : 64;
+            SCHSCacheFile *ptr = SCRealloc(files, size * sizeof(*files));
+            if (ptr == NULL)
+                break;
+            files = ptr;
+        }
+        strlcpy(files[cnt].name, de->d_name, sizeof(files[cnt].name));
+        files[cnt].mtime = st.st_mtime;
+        files[cnt].size = (uint64_t)st.st_size;
+        total += files[cnt].size;
+        cnt++;
+    }
+    closedir(dir);
+
+    if (total > limit && cnt > 0) {
+        qsort(files, cnt, sizeof(*files), SCHSCacheFileCompare);
+        const uint64_t target = limit - limit / 10;
+        for (uint32_t i = 0; i < cnt && total > target; i++) {
+            char fpath[PATH_MAX];
+            snprintf(fpath, sizeof(fpath), "%s/%s", g_hs_cache.path,
+                    files[i].name);
+            if (unlink(fpath) == 0) {
+                SCLogDebug("evicted %s from the Hyperscan cache", fpath);
+                total -= files[i].size;
+            }
+        }
+    }
+    g_hs_cache.size = total;
+    SCFree(files);
+}
+
+/** \internal
+ *  \brief serialize everything the compiled database depends on
+ *
+ *  The key of a database in the cache is a hash of this. The input is also
+ *  stored with the database and compared on load, so a hash collision
+ *  can't lead to using the wrong database.
+ *
+ *  \retval input buffer to be freed by the caller, NULL on error
+ */
+static uint8_t *SCHSCacheInput(const SCHSCompileData *cd, uint32_t *input_len,
+        uint64_t *key)
+{
+    const char *version = hs_version();
+    const uint32_t mode = HS_MODE_BLOCK;
+
+    size_t len = strlen(version) + 1 + sizeof(mode) + sizeof(cd->pattern_cnt);
+    for (uint32_t i = 0; i < cd->pattern_cnt; i++) {
+        len += 4 * sizeof(uint32_t) + sizeof(uint64_t) * 2 +
+            strlen(cd->expressions[i]);
+    }
+    if (len > UINT32_MAX)
+        return NULL;
+
+    uint8_t *input = SCMalloc(len);
+    if (input == NULL)
+        return NULL;
+
+    uint8_t *ptr = input;
+#define HS_CACHE_PUT(src, n) do { memcpy(ptr, (src), (n)); ptr += (n); } while (0)
+    HS_CACHE_PUT(version, strlen(version) + 1);
+    HS_CACHE_PUT(&mode, sizeof(mode));
+    HS_CACHE_PUT(&cd->pattern_cnt, sizeof(cd->pattern_cnt));
+    for (uint32_t i = 0; i < cd->pattern_cnt; i++) {
+        const uint32_t ext_flags = cd->ext[i] ? (uint32_t)cd->ext[i]->flags : 0;
+        const uint64_t min_offset = cd->ext[i] ? cd->ext[i]->min_offset : 0;
+        const uint64_t max_offset = cd->ext[i] ? cd->ext[i]->max_offset : 0;
+        const uint32_t expr_len = strlen(cd->expressions[i]);
+        const uint32_t id = cd->ids[i];
+        const uint32_t flags = cd->flags[i];
+
+        HS_CACHE_PUT(&id, sizeof(id));
+        HS_CACHE_PUT(&flags, sizeof(flags));
+        HS_CACHE_PUT(&ext_flags, sizeof(ext_flags));
+        HS_CACHE_PUT(&min_offset, sizeof(min_offset));
+        HS_CACHE_PUT(&max_offset, sizeof(max_offset));
+        HS_CACHE_PUT(&expr_len, sizeof(expr_len));
+        HS_CACHE_PUT(cd->expressions[i], expr_len);
+    }
+#undef HS_CACHE_PUT
+    BUG_ON((size_t)(ptr - input) != len);
+
+    uint32_t h1 = 0, h2 = 0;
+    hashlittle2(input, len, &h1, &h2);
+    *key = ((uint64_t)h1 << 32) | h2;
+    *input_len = (uint32_t)len;
+    return input;
+}
+
+static void SCHSCacheFilename(char *buf, size_t size, uint64_t key)
+{
+    snprintf(buf, size, "%s/%016"PRIx64".hs", g_hs_cache.path, key);
+}
+
+/** \internal
+ *  \brief load a database from the cache
+ *  \retval db the database or NULL if not in the cache
+ */
+static hs_database_t *SCHSCacheLoad(const uint8_t *input, uint32_t input_len,
+        uint64_t key)
+{
+    char fpath[PATH_MAX];
+    SCHSCacheFilename(fpath, sizeof(fpath), key);
+
+    FILE *fp = fopen(fpath, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    hs_database_t *db = NULL;
+    uint8_t *data = NULL;
+    SCHSCacheHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+            memcmp(hdr.magic, HS_CACHE_MAGIC, sizeof(hdr.magic)) != 0 ||
+            hdr.key != key || hdr.input_len != input_len || hdr.db_len == 0) {
+        goto end;
+    }
+
+    data = SCMalloc((size_t)input_len + hdr.db_len);
+    if (data == NULL)
+        goto end;
+    if (fread(data, (size_t)input_len + hdr.db_len, 1, fp) != 1 ||
+            memcmp(data, input, input_len) != 0) {
+        goto end;
+    }
+
+    hs_error_t err = hs_deserialize_database((const char *)data + input_len,
+            hdr.db_len, &db);
+    if (err != HS_SUCCESS) {
+        SCLogDebug("failed to deserialize %s: %d", fpath, err);
+        db = NULL;
+        goto end;
+    }
+
+    /* the mtime tells the eviction what was used last */
+    (void)utime(fpath, NULL);
+end:
+    fclose(fp);
+    if (data != NULL)
+        SCFree(data);
+    return db;
+}
+
+/** \internal
+ *  \brief store a database in the cache
+ *
+ *  Written to a temporary file that is then renamed, so other processes
+ *  sharing the cache never see a partial file.
+ */
+static void SCHSCacheStore(const hs_database_t *db, const uint8_t *input,
+        uint32_t input_len, uint64_t key)
+{
+    char *bytes = NULL;
+    size_t bytes_len = 0;
+    if (hs_serialize_database(db, &bytes, &bytes_len) != HS_SUCCESS)
+        return;
+    if (bytes_len > UINT32_MAX) {
+        SCFree(bytes);
+        return;
+    }
+
+    char fpath[PATH_MAX], tmp[PATH_MAX];
+    SCHSCacheFilename(fpath, sizeof(fpath), key);
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", fpath, (int)getpid());
+
+    SCHSCacheHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, HS_CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.key = key;
+    hdr.input_len = input_len;
+    hdr.db_len = (uint32_t)bytes_len;
+
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL) {
+        SCLogWarning(SC_ERR_FOPEN, "failed to write Hyperscan cache file "
+                "%s: %s", tmp, strerror(errno));
+        SCFree(bytes);
+        return;
+    }
+    int ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+        fwrite(input, input_len, 1, fp) == 1 &&
+        fwrite(bytes, bytes_len, 1, fp) == 1;
+    ok = (fclose(fp) == 0) && ok;
+    SCFree(bytes);
+
+    if (!ok || rename(tmp, fpath) != 0) {
+        SCLogWarning(SC_ERR_FOPEN, "failed to write Hyperscan cache file "
+                "%s: %s", fpath, strerror(errno));
+        unlink(tmp);
+        return;
+    }
+
+    g_hs_cache.stores++;
+    g_hs_cache.size += sizeof(hdr) + input_len + bytes_len;
+    if (g_hs_cache.size > g_hs_cache.max_size) {
+        SCHSCacheScan(g_hs_cache.max_size);
+    }
+}
+
+/**
+ * \brief Log how many databases came from the on disk cache since the
+ *        last call.
+ */
+void MpmHSCacheReport(void)
+{
+    SCMutexLock(&g_hs_cache_mutex);
+    if (g_hs_cache.enabled) {
+        SCLogInfo("Hyperscan cache: %u databases loaded, %u compiled, "
+                "%u stored, %"PRIu64" bytes in %s", g_hs_cache.hits,
+                g_hs_cache.misses, g_hs_cache.stores, g_hs_cache.size,
+                g_hs_cache.path);
+    }
+    g_hs_cache.hits = 0;
+    g_hs_cache.misses = 0;
+    g_hs_cache.stores = 0;
+    SCMutexUnlock(&g_hs_cache_mutex);
+}
+
 /**
  * \brief Process the patterns added to the mpm, and create the internal tables.
  *
@@ -620,8 +953,9 @@ int SCHSPreparePatterns(MpmCtx *mpm_ctx)
     SCFree(ctx->init_hash);
     ctx->init_hash = NULL;
 
-    /* Serialise whole database compilation as a relatively easy way to ensure
-     * dedupe is safe. */
+    /* Dedupe against the global table under g_db_table_mutex, but compile
+     * without holding it so that mpm contexts can be prepared in parallel
+     * (see detect.mpm-prepare-threads). */
     SCMutexLock(&g_db_table_mutex);
 
     /* Init global pattern database hash if necessary. */
@@ -651,6 +985,7 @@ int SCHSPreparePatterns(MpmCtx *mpm_ctx)
         SCHSFreeCompileData(cd);
         return 0;
     }
+    SCMutexUnlock(&g_db_table_mutex);
 
     BUG_ON(ctx->pattern_db != NULL); /* already built? */
 
@@ -668,7 +1003,6 @@ int SCHSPreparePatterns(MpmCtx *mpm_ctx)
         if (p->flags & (MPM_PATTERN_FLAG_OFFSET | MPM_PATTERN_FLAG_DEPTH)) {
             cd->ext[i] = SCMalloc(sizeof(hs_expr_ext_t));
             if (cd->ext[i] == NULL) {
-                SCMutexUnlock(&g_db_table_mutex);
                 goto error;
             }
             memset(cd->ext[i], 0, sizeof(hs_expr_ext_t));
@@ -686,19 +1020,62 @@ int SCHSPreparePatterns(MpmCtx *mpm_ctx)
 
     BUG_ON(mpm_ctx->pattern_cnt == 0);
 
-    err = hs_compile_ext_multi((const char *const *)cd->expressions, cd->flags,
-                               cd->ids, (const hs_expr_ext_t *const *)cd->ext,
-                               cd->pattern_cnt, HS_MODE_BLOCK, NULL, &pd->hs_db,
-                               &compile_err);
+    uint8_t *cache_input = NULL;
+    uint32_t cache_input_len = 0;
+    uint64_t cache_key = 0;
+    SCMutexLock(&g_hs_cache_mutex);
+    SCHSCacheInit();
+    if (g_hs_cache.enabled) {
+        cache_input = SCHSCacheInput(cd, &cache_input_len, &cache_key);
+        if (cache_input != NULL) {
+            pd->hs_db = SCHSCacheLoad(cache_input, cache_input_len, cache_key);
+            if (pd->hs_db != NULL) {
+                g_hs_cache.hits++;
+            } else {
+                g_hs_cache.misses++;
+            }
+        }
+    }
+    SCMutexUnlock(&g_hs_cache_mutex);
+
+    if (pd->hs_db == NULL) {
+        err = hs_compile_ext_multi((const char *const *)cd->expressions, cd->flags,
+                                   cd->ids, (const hs_expr_ext_t *const *)cd->ext,
+                                   cd->pattern_cnt, HS_MODE_BLOCK, NULL, &pd->hs_db,
+                                   &compile_err);
+
+        if (err != HS_SUCCESS) {
+            SCLogError(SC_ERR_FATAL, "failed to compile hyperscan database");
+            if (compile_err) {
+                SCLogError(SC_ERR_FATAL, "compile error: %s", compile_err->message);
+            }
+            hs_free_compile_error(compile_err);
+            if (cache_input != NULL)
+                SCFree(cache_input);
+            goto error;
+        }
 
-    if (err != HS_SUCCESS) {
-        SCLogError(SC_ERR_FATAL, "failed to compile hyperscan database");
-        if (compile_err) {
-            SCLogError(SC_ERR_FATAL, "compile error: %s", compile_err->message);
+        if (cache_input != NULL) {
+            SCMutexLock(&g_hs_cache_mutex);
+            SCHSCacheStore(pd->hs_db, cache_input, cache_input_len, cache_key);
+            SCMutexUnlock(&g_hs_cache_mutex);
         }
-        hs_free_compile_error(compile_err);
+    }
+    if (cache_input != NULL)
+        SCFree(cache_input);
+
+    SCMutexLock(&g_db_table_mutex);
+
+    /* another thread may have built the same database while we were
+     * compiling, in which case we use theirs */
+    pd_cached = HashTableLookup(g_db_table, pd, 1);
+    if (pd_cached != NULL) {
+        pd_cached->ref_cnt++;
+        ctx->pattern_db = pd_cached;
         SCMutexUnlock(&g_db_table_mutex);
-        goto error;
+        PatternDatabaseFree(pd);
+        SCHSFreeCompileData(cd);
+        return 0;
     }
 
     ctx->pattern_db = pd;
@@ -2145,6 +2522,103 @@ end:
     return result;
 }
 
+static int SCHSCacheTestCount(const char *path)
+{
+    int cnt = 0;
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+        return -1;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (de->d_name[0] != '.')
+            cnt++;
+    }
+    closedir(dir);
+    return cnt;
+}
+
+static uint32_t SCHSCacheTestSearch(const char *pattern, const char *buf)
+{
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PrefilterRuleStore pmq;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_HS);
+    MpmAddPatternCI(&mpm_ctx, (uint8_t *)pattern, strlen(pattern), 0, 0, 0, 0, 0);
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"xyz", 3, 0, 0, 1, 0, 0);
+    PmqSetup(&pmq);
+
+    SCHSPreparePatterns(&mpm_ctx);
+    SCHSInitThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    uint32_t cnt = SCHSSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
+            (const uint8_t *)buf, strlen(buf));
+
+    SCHSDestroyCtx(&mpm_ctx);
+    SCHSDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    return cnt;
+}
+
+/** \test on disk cache: store, load instead of compile, evict */
+static int SCHSTestCache01(void)
+{
+    char path[] = "/tmp/suricata-hs-cache-XXXXXX";
+    FAIL_IF_NULL(mkdtemp(path));
+
+    SCMutexLock(&g_hs_cache_mutex);
+    memset(&g_hs_cache, 0, sizeof(g_hs_cache));
+    g_hs_cache.init = true;
+    g_hs_cache.enabled = true;
+    g_hs_cache.max_size = HS_CACHE_DEFAULT_MAX_SIZE;
+    strlcpy(g_hs_cache.path, path, sizeof(g_hs_cache.path));
+    SCMutexUnlock(&g_hs_cache_mutex);
+
+    /* compiled and stored */
+    FAIL_IF_NOT(SCHSCacheTestSearch("aBcD", "xxabcdxyz") == 2);
+    FAIL_IF_NOT(g_hs_cache.misses == 1 && g_hs_cache.stores == 1);
+    FAIL_IF_NOT(SCHSCacheTestCount(path) == 1);
+
+    /* the database was freed with its ctx, so this one comes from disk */
+    FAIL_IF_NOT(SCHSCacheTestSearch("aBcD", "xxabcdxyz") == 2);
+    FAIL_IF_NOT(g_hs_cache.hits == 1 && g_hs_cache.misses == 1);
+    FAIL_IF_NOT(SCHSCacheTestSearch("aBcD", "xxabcdxy") == 1);
+    FAIL_IF_NOT(g_hs_cache.hits == 2);
+
+    /* a different pattern set gets a database of its own */
+    FAIL_IF_NOT(SCHSCacheTestSearch("efgh", "xxabcdxyz") == 1);
+    FAIL_IF_NOT(g_hs_cache.misses == 2 && g_hs_cache.stores == 2);
+    FAIL_IF_NOT(SCHSCacheTestCount(path) == 2);
+
+    /* going over max-size evicts */
+    const uint64_t used = g_hs_cache.size;
+    g_hs_cache.max_size = used - 1;
+    SCHSCacheScan(g_hs_cache.max_size);
+    FAIL_IF_NOT(SCHSCacheTestCount(path) == 1);
+    FAIL_IF_NOT(g_hs_cache.size < used);
+
+    /* the cache is disabled for the other tests */
+    SCMutexLock(&g_hs_cache_mutex);
+    memset(&g_hs_cache, 0, sizeof(g_hs_cache));
+    g_hs_cache.init = true;
+    SCMutexUnlock(&g_hs_cache_mutex);
+
+    DIR *dir = opendir(path);
+    FAIL_IF_NULL(dir);
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.')
+            continue;
+        char fpath[PATH_MAX];
+        snprintf(fpath, sizeof(fpath), "%s/%s", path, de->d_name);
+        unlink(fpath);
+    }
+    closedir(dir);
+    rmdir(path);
+    PASS;
+}
+
 #endif /* UNITTESTS */
 
 void SCHSRegisterTests(void)
@@ -2179,6 +2653,7 @@ void SCHSRegisterTests(void)
     UtRegisterTest("SCHSTest27", SCHSTest27);
     UtRegisterTest("SCHSTest28", SCHSTest28);
     UtRegisterTest("SCHSTest29", SCHSTest29);
+    UtRegisterTest("SCHSTestCache01", SCHSTestCache01);
 #endif
 
     return;
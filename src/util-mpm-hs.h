@@ -72,5 +72,6 @@ typedef struct SCHSThreadCtx_ {
 void MpmHSRegister(void);
 
 void MpmHSGlobalCleanup(void);
+void MpmHSCacheReport(void);
 
 #endif /* __UTIL_MPM_HS__H__ */
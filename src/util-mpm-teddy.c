@@ -0,0 +1,950 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Teddy style literal matcher, after the algorithm used in Hyperscan.
+ *
+ * The patterns are sorted on their first bytes and spread over 8
+ * buckets. For each of the first 'masklen' (1 to 3) pattern positions
+ * two 16 byte tables hold, per low and per high nibble, the buckets that
+ * have a pattern with such a byte at that position. A pshufb of the
+ * tables with the nibbles of 16 (SSSE3, NEON) or 32 (AVX2) input bytes
+ * gives, per input position, the buckets that may have a pattern
+ * starting there. Only those candidates are verified against the
+ * patterns of the bucket.
+ *
+ * The tables are a few hundred bytes per context, so unlike the AC state
+ * tables they stay in L1 for any pattern set size. The scan does not
+ * depend on the number of patterns, but with large sets the buckets get
+ * crowded and more candidates have to be verified.
+ *
+ * Without SIMD support the per byte versions of the tables are used.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+
+#include "detect.h"
+#include "detect-parse.h"
+#include "detect-engine.h"
+
+#include "util-debug.h"
+#include "util-unittest.h"
+#include "util-memcmp.h"
+#include "util-mpm-teddy.h"
+#include "util-memcpy.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+void SCTeddyInitCtx(MpmCtx *);
+void SCTeddyInitThreadCtx(MpmCtx *, MpmThreadCtx *);
+void SCTeddyDestroyCtx(MpmCtx *);
+void SCTeddyDestroyThreadCtx(MpmCtx *, MpmThreadCtx *);
+int SCTeddyAddPatternCI(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
+                        uint32_t, SigIntId, uint8_t);
+int SCTeddyAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
+                        uint32_t, SigIntId, uint8_t);
+int SCTeddyPreparePatterns(MpmCtx *mpm_ctx);
+uint32_t SCTeddySearch(const MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                       PrefilterRuleStore *pmq, const uint8_t *buf, uint32_t buflen);
+void SCTeddyPrintInfo(MpmCtx *mpm_ctx);
+void SCTeddyPrintSearchStats(MpmThreadCtx *mpm_thread_ctx);
+void SCTeddyRegisterTests(void);
+
+/** \internal
+ *  \brief sort on the lowercased leading bytes, so that patterns that
+ *         start the same end up in the same bucket */
+static int SCTeddyComparePatterns(const void *a, const void *b)
+{
+    const MpmPattern *pa = *(const MpmPattern **)a;
+    const MpmPattern *pb = *(const MpmPattern **)b;
+
+    int r = memcmp(pa->ci, pb->ci, MIN(TEDDY_MAX_MASKLEN, MIN(pa->len, pb->len)));
+    if (r != 0)
+        return r;
+    if (pa->len != pb->len)
+        return pa->len < pb->len ? -1 : 1;
+    return 0;
+}
+
+/** \internal
+ *  \brief add a pattern byte at position 'pos' to the masks of 'bucket' */
+static void SCTeddyMaskAdd(SCTeddyCtx *ctx, uint8_t pos, uint8_t bucket, uint8_t c)
+{
+    ctx->lo[pos][c & 0x0f] |= (1 << bucket);
+    ctx->hi[pos][c >> 4] |= (1 << bucket);
+    ctx->byte_mask[pos][c] |= (1 << bucket);
+}
+
+/**
+ * \brief Process the patterns added to the mpm, and create the masks and
+ *        the bucket index.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int SCTeddyPreparePatterns(MpmCtx *mpm_ctx)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+
+    if (mpm_ctx->pattern_cnt == 0 || mpm_ctx->init_hash == NULL) {
+        SCLogDebug("no patterns supplied to this mpm_ctx");
+        return 0;
+    }
+
+    MpmPattern **parray = SCMalloc(mpm_ctx->pattern_cnt * sizeof(MpmPattern *));
+    if (parray == NULL)
+        goto error;
+
+    /* populate it with the patterns in the hash */
+    uint32_t p = 0;
+    uint32_t data_len = 0;
+    for (uint32_t i = 0; i < MPM_INIT_HASH_SIZE; i++) {
+        MpmPattern *node = mpm_ctx->init_hash[i], *nnode = NULL;
+        while (node != NULL) {
+            nnode = node->next;
+            node->next = NULL;
+            parray[p++] = node;
+            data_len += node->len;
+            node = nnode;
+        }
+    }
+
+    /* we no longer need the hash, so free it's memory */
+    SCFree(mpm_ctx->init_hash);
+    mpm_ctx->init_hash = NULL;
+
+    qsort(parray, mpm_ctx->pattern_cnt, sizeof(MpmPattern *),
+            SCTeddyComparePatterns);
+
+    ctx->patterns = SCCalloc(mpm_ctx->pattern_cnt, sizeof(SCTeddyPattern));
+    ctx->index = SCCalloc(TEDDY_BUCKETS, sizeof(*ctx->index));
+    ctx->pattern_data = SCMalloc(data_len);
+    if (ctx->patterns == NULL || ctx->index == NULL || ctx->pattern_data == NULL)
+        goto error;
+    ctx->pattern_cnt = mpm_ctx->pattern_cnt;
+    ctx->pattern_data_len = data_len;
+    mpm_ctx->memory_cnt += 3;
+    mpm_ctx->memory_size += ctx->pattern_cnt * sizeof(SCTeddyPattern) +
+        TEDDY_BUCKETS * sizeof(*ctx->index) + data_len;
+
+    ctx->minlen = mpm_ctx->minlen;
+    ctx->masklen = (uint8_t)MIN(TEDDY_MAX_MASKLEN, mpm_ctx->minlen);
+
+    /* patterns are sorted, so consecutive ranges make up the buckets
+     * and each bucket is ordered on the first byte */
+    uint8_t *data = ctx->pattern_data;
+    for (uint32_t b = 0; b < TEDDY_BUCKETS; b++) {
+        const uint32_t start = (uint32_t)(((uint64_t)ctx->pattern_cnt * b) / TEDDY_BUCKETS);
+        const uint32_t end = (uint32_t)(((uint64_t)ctx->pattern_cnt * (b + 1)) / TEDDY_BUCKETS);
+
+        uint32_t i = start;
+        for (uint32_t c = 0; c < 257; c++) {
+            while (i < end && parray[i]->ci[0] < c)
+                i++;
+            ctx->index[b][c] = i;
+        }
+
+        for (i = start; i < end; i++) {
+            MpmPattern *mp = parray[i];
+            SCTeddyPattern *tp = &ctx->patterns[i];
+            const int nocase = (mp->flags & MPM_PATTERN_FLAG_NOCASE) != 0;
+
+            memcpy(data, nocase ? mp->ci : mp->original_pat, mp->len);
+            tp->pat = data;
+            data += mp->len;
+            tp->len = mp->len;
+            tp->offset = mp->offset;
+            tp->depth = mp->depth;
+            tp->nocase = (uint8_t)nocase;
+            tp->id = mp->id;
+
+            /* SCTeddyPattern now owns this memory */
+            tp->sids_size = mp->sids_size;
+            tp->sids = mp->sids;
+            mp->sids_size = 0;
+            mp->sids = NULL;
+
+            for (uint8_t j = 0; j < ctx->masklen; j++) {
+                if (nocase) {
+                    SCTeddyMaskAdd(ctx, j, (uint8_t)b, u8_tolower(mp->ci[j]));
+                    SCTeddyMaskAdd(ctx, j, (uint8_t)b, (uint8_t)toupper(mp->ci[j]));
+                } else {
+                    SCTeddyMaskAdd(ctx, j, (uint8_t)b, mp->original_pat[j]);
+                }
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        MpmFreePattern(mpm_ctx, parray[i]);
+    }
+    SCFree(parray);
+
+    ctx->pattern_id_bitarray_size = (mpm_ctx->max_pat_id / 8) + 1;
+    SCLogDebug("%u patterns, masklen %u", ctx->pattern_cnt, ctx->masklen);
+    return 0;
+
+error:
+    if (parray != NULL) {
+        for (uint32_t i = 0; i < mpm_ctx->pattern_cnt; i++) {
+            MpmFreePattern(mpm_ctx, parray[i]);
+        }
+        SCFree(parray);
+    }
+    return -1;
+}
+
+/** \internal
+ *  \brief check the patterns of 'buckets' that start with the byte at
+ *         'pos' against the buffer
+ *
+ *  \retval matches number of patterns found at 'pos'
+ */
+static inline uint32_t SCTeddyVerify(const SCTeddyCtx *ctx, uint32_t buckets,
+        PrefilterRuleStore *pmq, uint8_t *bitarray,
+        const uint8_t *buf, const uint32_t buflen, const uint32_t pos)
+{
+    uint32_t matches = 0;
+    const uint8_t c = u8_tolower(buf[pos]);
+
+    while (buckets != 0) {
+        const uint32_t b = (uint32_t)__builtin_ctz(buckets);
+        buckets &= buckets - 1;
+
+        for (uint32_t i = ctx->index[b][c]; i < ctx->index[b][c + 1]; i++) {
+            const SCTeddyPattern *pat = &ctx->patterns[i];
+
+            if (pat->len > buflen - pos)
+                continue;
+            if (pos < pat->offset ||
+                    (pat->depth && pos + pat->len - 1 > pat->depth))
+                continue;
+            if (pat->nocase) {
+                if (SCMemcmpLowercase(pat->pat, buf + pos, pat->len) != 0)
+                    continue;
+            } else {
+                if (SCMemcmp(pat->pat, buf + pos, pat->len) != 0)
+                    continue;
+            }
+
+            if (!(bitarray[pat->id / 8] & (1 << (pat->id % 8)))) {
+                bitarray[pat->id / 8] |= (1 << (pat->id % 8));
+                PrefilterAddSids(pmq, pat->sids, pat->sids_size);
+            }
+            matches++;
+        }
+    }
+    return matches;
+}
+
+/** \internal
+ *  \brief byte by byte scan, used as fallback and for the buffer tail
+ *
+ *  \param pos position to start at
+ */
+static uint32_t SCTeddyScanScalar(const SCTeddyCtx *ctx,
+        PrefilterRuleStore *pmq, uint8_t *bitarray,
+        const uint8_t *buf, const uint32_t buflen, uint32_t pos)
+{
+    uint32_t matches = 0;
+
+    for ( ; pos + ctx->minlen <= buflen; pos++) {
+        uint32_t buckets = ctx->byte_mask[0][buf[pos]];
+        for (uint8_t j = 1; buckets != 0 && j < ctx->masklen; j++) {
+            buckets &= ctx->byte_mask[j][buf[pos + j]];
+        }
+        if (buckets != 0) {
+            matches += SCTeddyVerify(ctx, buckets, pmq, bitarray, buf, buflen, pos);
+        }
+    }
+    return matches;
+}
+
+#if defined(__AVX2__)
+/** \internal
+ *  \brief scan 32 bytes at a time
+ *
+ *  \param pos in: position to start at, out: position to continue at
+ */
+static uint32_t SCTeddyScanSIMD(const SCTeddyCtx *ctx,
+        PrefilterRuleStore *pmq, uint8_t *bitarray,
+        const uint8_t *buf, const uint32_t buflen, uint32_t *pos)
+{
+    uint32_t matches = 0;
+    uint32_t i = *pos;
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo[TEDDY_MAX_MASKLEN], hi[TEDDY_MAX_MASKLEN];
+    for (uint8_t j = 0; j < ctx->masklen; j++) {
+        lo[j] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)ctx->lo[j]));
+        hi[j] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)ctx->hi[j]));
+    }
+
+    for ( ; i + 32 + ctx->masklen - 1 <= buflen; i += 32) {
+        __m256i res = _mm256_set1_epi8((char)0xff);
+        for (uint8_t j = 0; j < ctx->masklen; j++) {
+            const __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i + j));
+            const __m256i vlo = _mm256_and_si256(v, nibble);
+            const __m256i vhi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+            res = _mm256_and_si256(res, _mm256_and_si256(
+                        _mm256_shuffle_epi8(lo[j], vlo),
+                        _mm256_shuffle_epi8(hi[j], vhi)));
+        }
+        uint32_t cands = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(res, zero));
+        if (cands == 0)
+            continue;
+
+        uint8_t r[32];
+        _mm256_storeu_si256((__m256i *)r, res);
+        while (cands != 0) {
+            const uint32_t k = (uint32_t)__builtin_ctz(cands);
+            cands &= cands - 1;
+            matches += SCTeddyVerify(ctx, r[k], pmq, bitarray, buf, buflen, i + k);
+        }
+    }
+
+    *pos = i;
+    return matches;
+}
+#elif defined(__SSSE3__)
+/** \internal
+ *  \brief scan 16 bytes at a time
+ *
+ *  \param pos in: position to start at, out: position to continue at
+ */
+static uint32_t SCTeddyScanSIMD(const SCTeddyCtx *ctx,
+        PrefilterRuleStore *pmq, uint8_t *bitarray,
+        const uint8_t *buf, const uint32_t buflen, uint32_t *pos)
+{
+    uint32_t matches = 0;
+    uint32_t i = *pos;
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo[TEDDY_MAX_MASKLEN], hi[TEDDY_MAX_MASKLEN];
+    for (uint8_t j = 0; j < ctx->masklen; j++) {
+        lo[j] = _mm_load_si128((const __m128i *)ctx->lo[j]);
+        hi[j] = _mm_load_si128((const __m128i *)ctx->hi[j]);
+    }
+
+    for ( ; i + 16 + ctx->masklen - 1 <= buflen; i += 16) {
+        __m128i res = _mm_set1_epi8((char)0xff);
+        for (uint8_t j = 0; j < ctx->masklen; j++) {
+            const __m128i v = _mm_loadu_si128((const __m128i *)(buf + i + j));
+            const __m128i vlo = _mm_and_si128(v, nibble);
+            const __m128i vhi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+            res = _mm_and_si128(res, _mm_and_si128(
+                        _mm_shuffle_epi8(lo[j], vlo),
+                        _mm_shuffle_epi8(hi[j], vhi)));
+        }
+        uint32_t cands = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(res, zero)) & 0xffff;
+        if (cands == 0)
+            continue;
+
+        uint8_t r[16];
+        _mm_storeu_si128((__m128i *)r, res);
+        while (cands != 0) {
+            const uint32_t k = (uint32_t)__builtin_ctz(cands);
+            cands &= cands - 1;
+            matches += SCTeddyVerify(ctx, r[k], pmq, bitarray, buf, buflen, i + k);
+        }
+    }
+
+    *pos = i;
+    return matches;
+}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+/** \internal
+ *  \brief scan 16 bytes at a time
+ *
+ *  \param pos in: position to start at, out: position to continue at
+ */
+static uint32_t SCTeddyScanSIMD(const SCTeddyCtx *ctx,
+        PrefilterRuleStore *pmq, uint8_t *bitarray,
+        const uint8_t *buf, const uint32_t buflen, uint32_t *pos)
+{
+    uint32_t matches = 0;
+    uint32_t i = *pos;
+    const uint8x16_t nibble = vdupq_n_u8(0x0f);
+    uint8x16_t lo[TEDDY_MAX_MASKLEN], hi[TEDDY_MAX_MASKLEN];
+    for (uint8_t j = 0; j < ctx->masklen; j++) {
+        lo[j] = vld1q_u8(ctx->lo[j]);
+        hi[j] = vld1q_u8(ctx->hi[j]);
+    }
+
+    for ( ; i + 16 + ctx->masklen - 1 <= buflen; i += 16) {
+        uint8x16_t res = vdupq_n_u8(0xff);
+        for (uint8_t j = 0; j < ctx->masklen; j++) {
+            const uint8x16_t v = vld1q_u8(buf + i + j);
+            res = vandq_u8(res, vandq_u8(
+                        vqtbl1q_u8(lo[j], vandq_u8(v, nibble)),
+                        vqtbl1q_u8(hi[j], vshrq_n_u8(v, 4))));
+        }
+        if (vmaxvq_u8(res) == 0)
+            continue;
+
+        uint8_t r[16];
+        vst1q_u8(r, res);
+        for (uint32_t k = 0; k < 16; k++) {
+            if (r[k] != 0) {
+                matches += SCTeddyVerify(ctx, r[k], pmq, bitarray, buf, buflen, i + k);
+            }
+        }
+    }
+
+    *pos = i;
+    return matches;
+}
+#endif
+
+/**
+ * \brief The teddy search function.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Buffer to be searched.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+uint32_t SCTeddySearch(const MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                       PrefilterRuleStore *pmq, const uint8_t *buf, uint32_t buflen)
+{
+    const SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+
+    if (ctx->pattern_cnt == 0 || buflen < ctx->minlen)
+        return 0;
+
+    uint8_t bitarray[ctx->pattern_id_bitarray_size];
+    memset(bitarray, 0, ctx->pattern_id_bitarray_size);
+
+    uint32_t matches = 0;
+    uint32_t pos = 0;
+#if defined(__AVX2__) || defined(__SSSE3__) || \
+    (defined(__aarch64__) && defined(__ARM_NEON))
+    matches += SCTeddyScanSIMD(ctx, pmq, bitarray, buf, buflen, &pos);
+#endif
+    matches += SCTeddyScanScalar(ctx, pmq, bitarray, buf, buflen, pos);
+    return matches;
+}
+
+/**
+ * \brief Init the mpm thread context. Teddy keeps no per thread state.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ */
+void SCTeddyInitThreadCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx)
+{
+    memset(mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+}
+
+/**
+ * \brief Initialize the teddy context.
+ *
+ * \param mpm_ctx       Mpm context.
+ */
+void SCTeddyInitCtx(MpmCtx *mpm_ctx)
+{
+    if (mpm_ctx->ctx != NULL)
+        return;
+
+    mpm_ctx->ctx = SCMallocAligned(sizeof(SCTeddyCtx), 16);
+    if (mpm_ctx->ctx == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(mpm_ctx->ctx, 0, sizeof(SCTeddyCtx));
+
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += sizeof(SCTeddyCtx);
+
+    /* initialize the hash we use to speed up pattern insertions */
+    mpm_ctx->init_hash = SCMalloc(sizeof(MpmPattern *) * MPM_INIT_HASH_SIZE);
+    if (mpm_ctx->init_hash == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(mpm_ctx->init_hash, 0, sizeof(MpmPattern *) * MPM_INIT_HASH_SIZE);
+}
+
+/**
+ * \brief Destroy the mpm thread context.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ */
+void SCTeddyDestroyThreadCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx)
+{
+}
+
+/**
+ * \brief Destroy the mpm context.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+void SCTeddyDestroyCtx(MpmCtx *mpm_ctx)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+    if (ctx == NULL)
+        return;
+
+    if (mpm_ctx->init_hash != NULL) {
+        for (uint32_t i = 0; i < MPM_INIT_HASH_SIZE; i++) {
+            MpmPattern *node = mpm_ctx->init_hash[i], *nnode = NULL;
+            while (node != NULL) {
+                nnode = node->next;
+                MpmFreePattern(mpm_ctx, node);
+                node = nnode;
+            }
+        }
+        SCFree(mpm_ctx->init_hash);
+        mpm_ctx->init_hash = NULL;
+    }
+
+    if (ctx->patterns != NULL) {
+        for (uint32_t i = 0; i < ctx->pattern_cnt; i++) {
+            if (ctx->patterns[i].sids != NULL)
+                SCFree(ctx->patterns[i].sids);
+        }
+        SCFree(ctx->patterns);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= ctx->pattern_cnt * sizeof(SCTeddyPattern);
+    }
+    if (ctx->index != NULL) {
+        SCFree(ctx->index);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= TEDDY_BUCKETS * sizeof(*ctx->index);
+    }
+    if (ctx->pattern_data != NULL) {
+        SCFree(ctx->pattern_data);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= ctx->pattern_data_len;
+    }
+
+    SCFreeAligned(mpm_ctx->ctx);
+    mpm_ctx->ctx = NULL;
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= sizeof(SCTeddyCtx);
+}
+
+/**
+ * \brief Add a case insensitive pattern.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param pat     The pattern to add.
+ * \param patnen  The pattern length.
+ * \param offset  The pattern offset.
+ * \param depth   The pattern depth.
+ * \param pid     The pattern id.
+ * \param sid     The signature internal id.
+ * \param flags   Flags associated with this pattern.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int SCTeddyAddPatternCI(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                        uint16_t offset, uint16_t depth, uint32_t pid,
+                        SigIntId sid, uint8_t flags)
+{
+    flags |= MPM_PATTERN_FLAG_NOCASE;
+    return MpmAddPattern(mpm_ctx, pat, patlen, offset, depth, pid, sid, flags);
+}
+
+/**
+ * \brief Add a case sensitive pattern.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param pat     The pattern to add.
+ * \param patnen  The pattern length.
+ * \param offset  The pattern offset.
+ * \param depth   The pattern depth.
+ * \param pid     The pattern id.
+ * \param sid     The signature internal id.
+ * \param flags   Flags associated with this pattern.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int SCTeddyAddPatternCS(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                        uint16_t offset, uint16_t depth, uint32_t pid,
+                        SigIntId sid, uint8_t flags)
+{
+    return MpmAddPattern(mpm_ctx, pat, patlen, offset, depth, pid, sid, flags);
+}
+
+void SCTeddyPrintSearchStats(MpmThreadCtx *mpm_thread_ctx)
+{
+    return;
+}
+
+void SCTeddyPrintInfo(MpmCtx *mpm_ctx)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+
+    printf("MPM Teddy Information:\n");
+    printf("Memory allocs:   %" PRIu32 "\n", mpm_ctx->memory_cnt);
+    printf("Memory alloced:  %" PRIu32 "\n", mpm_ctx->memory_size);
+    printf(" Sizeof:\n");
+    printf("  MpmCtx         %" PRIuMAX "\n", (uintmax_t)sizeof(MpmCtx));
+    printf("  SCTeddyCtx:    %" PRIuMAX "\n", (uintmax_t)sizeof(SCTeddyCtx));
+    printf("  SCTeddyPattern %" PRIuMAX "\n", (uintmax_t)sizeof(SCTeddyPattern));
+    printf("Unique Patterns: %" PRIu32 "\n", mpm_ctx->pattern_cnt);
+    printf("Smallest:        %" PRIu32 "\n", mpm_ctx->minlen);
+    printf("Largest:         %" PRIu32 "\n", mpm_ctx->maxlen);
+    printf("Mask length:     %" PRIu32 "\n", ctx->masklen);
+    printf("\n");
+}
+
+/************************** Mpm Registration ***************************/
+
+/**
+ * \brief Register the teddy mpm.
+ */
+void MpmTeddyRegister(void)
+{
+    mpm_table[MPM_TEDDY].name = "teddy";
+    mpm_table[MPM_TEDDY].InitCtx = SCTeddyInitCtx;
+    mpm_table[MPM_TEDDY].InitThreadCtx = SCTeddyInitThreadCtx;
+    mpm_table[MPM_TEDDY].DestroyCtx = SCTeddyDestroyCtx;
+    mpm_table[MPM_TEDDY].DestroyThreadCtx = SCTeddyDestroyThreadCtx;
+    mpm_table[MPM_TEDDY].AddPattern = SCTeddyAddPatternCS;
+    mpm_table[MPM_TEDDY].AddPatternNocase = SCTeddyAddPatternCI;
+    mpm_table[MPM_TEDDY].Prepare = SCTeddyPreparePatterns;
+    mpm_table[MPM_TEDDY].Search = SCTeddySearch;
+    mpm_table[MPM_TEDDY].PrintCtx = SCTeddyPrintInfo;
+    mpm_table[MPM_TEDDY].PrintThreadCtx = SCTeddyPrintSearchStats;
+    mpm_table[MPM_TEDDY].RegisterUnittests = SCTeddyRegisterTests;
+}
+
+/*************************************Unittests********************************/
+
+#ifdef UNITTESTS
+#include "util-cpu.h"
+
+#define TEST_RUNS 100
+
+/** \internal
+ *  \brief run a single search over 'buf' with the given patterns, which
+ *         are added case sensitive unless prefixed with "i:" */
+static uint32_t SCTeddyTestSearch(uint16_t matcher, const char **pats,
+        uint16_t offset, uint16_t depth, const uint8_t *buf, uint32_t buflen,
+        uint32_t *sids_cnt)
+{
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PrefilterRuleStore pmq;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, matcher);
+    mpm_table[matcher].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqSetup(&pmq);
+
+    for (uint32_t i = 0; pats[i] != NULL; i++) {
+        if (strncmp(pats[i], "i:", 2) == 0) {
+            MpmAddPatternCI(&mpm_ctx, (uint8_t *)pats[i] + 2,
+                    (uint16_t)strlen(pats[i]) - 2, offset, depth, i, i, 0);
+        } else {
+            MpmAddPatternCS(&mpm_ctx, (uint8_t *)pats[i],
+                    (uint16_t)strlen(pats[i]), offset, depth, i, i, 0);
+        }
+    }
+    mpm_table[matcher].Prepare(&mpm_ctx);
+
+    uint32_t cnt = mpm_table[matcher].Search(&mpm_ctx, &mpm_thread_ctx, &pmq,
+            buf, buflen);
+    if (sids_cnt != NULL)
+        *sids_cnt = pmq.rule_id_array_cnt;
+
+    mpm_table[matcher].DestroyCtx(&mpm_ctx);
+    mpm_table[matcher].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    return cnt;
+}
+
+/** \test single pattern, single match */
+static int SCTeddyTest01(void)
+{
+    const char *pats[] = { "abcd", NULL };
+    const char *buf = "abcdefghjiklmnopqrstuvwxyz";
+
+    uint32_t sids = 0;
+    FAIL_IF_NOT(SCTeddyTestSearch(MPM_TEDDY, pats, 0, 0,
+                (uint8_t *)buf, strlen(buf), &sids) == 1);
+    FAIL_IF_NOT(sids == 1);
+    PASS;
+}
+
+/** \test no match, and buffers shorter than the patterns */
+static int SCTeddyTest02(void)
+{
+    const char *pats[] = { "abce", NULL };
+    const char *buf = "abcdefghjiklmnopqrstuvwxyz";
+
+    FAIL_IF_NOT(SCTeddyTestSearch(MPM_TEDDY, pats, 0, 0,
+                (uint8_t *)buf, strlen(buf), NULL) == 0);
+    FAIL_IF_NOT(SCTeddyTestSearch(MPM_TEDDY, pats, 0, 0,
+                (uint8_t *)"abc", 3, NULL) == 0);
+    FAIL_IF_NOT(SCTeddyTestSearch(MPM_TEDDY, pats, 0, 0,
+                (uint8_t *)"", 0, NULL) == 0);
+    PASS;
+}
+
+/** \test every occurence is counted, including at the start and the end
+ *        of buffers longer than a SIMD register */
+static int SCTeddyTest03(void)
+{
+    const char *pats[] = { "ab", "xyz", NULL };
+    uint8_t buf[100];
+    memset(buf, 'a', sizeof(buf));
+    memcpy(buf, "xyz", 3);
+    memcpy(buf + 31, "ab", 2);
+    memcpy(buf + 47, "xyz", 3);
+    memcpy(buf + 97, "xyz", 3);
+
+    uint32_t sids = 0;
+    FAIL_IF_NOT(SCTeddyTestSearch(MPM_TEDDY, pats, 0, 0,
+                buf, sizeof(buf), &sids) == 4);
+    FAIL_IF_NOT(sids == 2);
+    PASS;
+}
+
+/** \test case sensitive and nocase patterns */
+static int SCTeddyTest04(void)
+{
+    const char *pats[] = { "ABCD", "i:EfGh", "i:z", NULL };
+    const char *buf = "abcdABCDefghEFGHZz";
+
+    FAIL_IF_NOT(SCTeddyTestSearch(MPM_TEDDY, pats, 0, 0,
+                (uint8_t *)buf, strlen(buf), NULL) == 5);
+    PASS;
+}
+
+/** \test offset and depth */
+static int SCTeddyTest05(void)
+{
+    const char *pats[] = { "abc", NULL };
+    const char *buf = "abcxxabcxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxabc";
+
+    FAIL_IF_NOT(SCTeddyTestSearch(MPM_TEDDY, pats, 1, 0,
+                (uint8_t *)buf, strlen(buf), NULL) == 2);
+    FAIL_IF_NOT(SCTeddyTestSearch(MPM_TEDDY, pats, 0, 8,
+                (uint8_t *)buf, strlen(buf), NULL) == 2);
+    FAIL_IF_NOT(SCTeddyTestSearch(MPM_TEDDY, pats, 1, 8,
+                (uint8_t *)buf, strlen(buf), NULL) == 1);
+    PASS;
+}
+
+/** \test more patterns than buckets, sharing prefixes */
+static int SCTeddyTest06(void)
+{
+    const char *pats[] = { "GET", "POST", "HEAD", "Host:", "User-Agent:",
+        "i:cmd.exe", "/etc/passwd", "union select", "i:<script", "Cookie:",
+        "Content-Length:", "Content-Type:", "HTTP/1.1", "HTTP/1.0", "..%2f",
+        "/bin/sh", "wget ", NULL };
+    const char *buf = "GET /index.php?q=union%20select HTTP/1.1\r\n"
+        "Host: www.example.com\r\nUser-Agent: curl\r\n"
+        "Content-Type: text/html\r\nContent-Length: 10\r\n\r\n"
+        "<SCRIPT>cmd.EXE /bin/sh</SCRIPT>";
+
+    uint32_t sids = 0;
+    FAIL_IF_NOT(SCTeddyTestSearch(MPM_TEDDY, pats, 0, 0,
+                (uint8_t *)buf, strlen(buf), &sids) == 9);
+    FAIL_IF_NOT(sids == 9);
+    PASS;
+}
+
+/** \internal
+ *  \brief deterministic pseudo random generator for the tests below */
+static uint32_t SCTeddyTestRand(uint32_t *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return (*state >> 16) & 0x7fff;
+}
+
+/** \internal
+ *  \brief fill 'pats' with 'cnt' random patterns of 1 to 12 bytes from a
+ *         small alphabet, a quarter of them nocase */
+static void SCTeddyTestPatterns(uint32_t *state, char **pats, uint32_t cnt,
+        uint32_t minlen)
+{
+    for (uint32_t i = 0; i < cnt; i++) {
+        uint32_t len = minlen + SCTeddyTestRand(state) % (13 - minlen);
+        char *p = SCMalloc(len + 3);
+        BUG_ON(p == NULL);
+        uint32_t o = 0;
+        if (SCTeddyTestRand(state) % 4 == 0) {
+            p[o++] = 'i';
+            p[o++] = ':';
+        }
+        for (uint32_t j = 0; j < len; j++) {
+            p[o++] = "abcdeABCDE/. \r\n"[SCTeddyTestRand(state) % 15];
+        }
+        p[o] = '\0';
+        pats[i] = p;
+    }
+    pats[cnt] = NULL;
+}
+
+/** \test same results as ac on random pattern sets and data */
+static int SCTeddyTest07(void)
+{
+    uint32_t state = 1;
+    uint8_t buf[1500];
+    char *pats[201];
+
+    for (int run = 0; run < 40; run++) {
+        const uint32_t cnt = 1 + SCTeddyTestRand(&state) % 200;
+        SCTeddyTestPatterns(&state, pats, cnt, 1 + run % 4);
+        for (uint32_t i = 0; i < sizeof(buf); i++) {
+            buf[i] = (uint8_t)"abcdeABCDE/. \r\n"[SCTeddyTestRand(&state) % 15];
+        }
+        const uint32_t buflen = SCTeddyTestRand(&state) % sizeof(buf);
+
+        uint32_t ac_sids = 0, teddy_sids = 0;
+        uint32_t ac = SCTeddyTestSearch(MPM_AC, (const char **)pats, 0, 0,
+                buf, buflen, &ac_sids);
+        uint32_t teddy = SCTeddyTestSearch(MPM_TEDDY, (const char **)pats, 0, 0,
+                buf, buflen, &teddy_sids);
+
+        for (uint32_t i = 0; i < cnt; i++)
+            SCFree(pats[i]);
+
+        FAIL_IF_NOT(ac == teddy);
+        FAIL_IF_NOT(ac_sids == teddy_sids);
+    }
+    PASS;
+}
+
+/** \test compare the search speed of ac, ac-ks and teddy on pattern sets
+ *        of various sizes over http like traffic */
+static int SCTeddyTest08(void)
+{
+#ifdef PROFILING
+    static const char *words[] = { "GET ", "POST ", "HTTP/1.1", "Host: ",
+        "User-Agent: ", "Mozilla/5.0", "Accept: ", "text/html", "Cookie: ",
+        "Content-Length: ", "Content-Type: ", "application/x-www-form",
+        "Connection: keep-alive", "gzip, deflate", "/index.php", "?id=",
+        "&action=", "Cache-Control: ", "no-cache", "Referer: ", "<html>",
+        "<body>", "</div>", "<script", "function(", "var ", "return ",
+        "\r\n", "200 OK", "Server: ", "nginx", "Apache", NULL };
+    const uint16_t matchers[] = { MPM_AC, MPM_AC_KS, MPM_TEDDY };
+    const uint32_t sizes[] = { 10, 100, 1000 };
+
+    /* 64k of http like traffic */
+    uint32_t state = 1;
+    const uint32_t buflen = 65536;
+    uint8_t *buf = SCMalloc(buflen);
+    FAIL_IF_NULL(buf);
+    uint32_t len = 0;
+    while (len < buflen) {
+        const char *w = words[SCTeddyTestRand(&state) % 32];
+        for (uint32_t i = 0; w[i] != '\0' && len < buflen; i++)
+            buf[len++] = (uint8_t)w[i];
+        uint32_t rnd = SCTeddyTestRand(&state) % 16;
+        for (uint32_t i = 0; i < rnd && len < buflen; i++)
+            buf[len++] = (uint8_t)('a' + SCTeddyTestRand(&state) % 26);
+    }
+
+    /* rule like patterns: protocol tokens plus random words */
+    char *pats[1001];
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        const uint32_t cnt = sizes[s];
+        for (uint32_t i = 0; i < cnt; i++) {
+            char *p = SCMalloc(32);
+            FAIL_IF_NULL(p);
+            if (i % 4 == 0) {
+                snprintf(p, 32, "%s%c%c", words[i % 32],
+                        'a' + SCTeddyTestRand(&state) % 26,
+                        'a' + SCTeddyTestRand(&state) % 26);
+            } else {
+                uint32_t plen = 4 + SCTeddyTestRand(&state) % 10;
+                for (uint32_t j = 0; j < plen; j++)
+                    p[j] = 'a' + SCTeddyTestRand(&state) % 26;
+                p[plen] = '\0';
+            }
+            pats[i] = p;
+        }
+        pats[cnt] = NULL;
+
+        uint32_t results[3];
+        for (uint32_t m = 0; m < 3; m++) {
+            MpmCtx mpm_ctx;
+            MpmThreadCtx mpm_thread_ctx;
+            PrefilterRuleStore pmq;
+            memset(&mpm_ctx, 0, sizeof(MpmCtx));
+            MpmInitCtx(&mpm_ctx, matchers[m]);
+            mpm_table[matchers[m]].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+            PmqSetup(&pmq);
+            for (uint32_t i = 0; i < cnt; i++) {
+                MpmAddPatternCS(&mpm_ctx, (uint8_t *)pats[i],
+                        (uint16_t)strlen(pats[i]), 0, 0, i, i, 0);
+            }
+            mpm_table[matchers[m]].Prepare(&mpm_ctx);
+
+            uint64_t ticks_start = UtilCpuGetTicks();
+            for (int r = 0; r < TEST_RUNS; r++) {
+                PmqReset(&pmq);
+                results[m] = mpm_table[matchers[m]].Search(&mpm_ctx,
+                        &mpm_thread_ctx, &pmq, buf, buflen);
+            }
+            uint64_t ticks_end = UtilCpuGetTicks();
+            printf("%-6s %4u patterns: %"PRIu64" ticks per 64k, "
+                    "%u bytes\n", mpm_table[matchers[m]].name, cnt,
+                    (ticks_end - ticks_start) / TEST_RUNS,
+                    mpm_ctx.memory_size);
+
+            mpm_table[matchers[m]].DestroyCtx(&mpm_ctx);
+            mpm_table[matchers[m]].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+            PmqFree(&pmq);
+        }
+        for (uint32_t i = 0; i < cnt; i++)
+            SCFree(pats[i]);
+
+        FAIL_IF_NOT(results[0] == results[1]);
+        FAIL_IF_NOT(results[0] == results[2]);
+    }
+    SCFree(buf);
+#endif
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void SCTeddyRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("SCTeddyTest01", SCTeddyTest01);
+    UtRegisterTest("SCTeddyTest02", SCTeddyTest02);
+    UtRegisterTest("SCTeddyTest03", SCTeddyTest03);
+    UtRegisterTest("SCTeddyTest04", SCTeddyTest04);
+    UtRegisterTest("SCTeddyTest05", SCTeddyTest05);
+    UtRegisterTest("SCTeddyTest06", SCTeddyTest06);
+    UtRegisterTest("SCTeddyTest07", SCTeddyTest07);
+    UtRegisterTest("SCTeddyTest08", SCTeddyTest08);
+#endif /* UNITTESTS */
+}
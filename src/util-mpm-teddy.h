@@ -0,0 +1,77 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Teddy style SIMD literal matcher.
+ */
+
+#ifndef __UTIL_MPM_TEDDY__H__
+#define __UTIL_MPM_TEDDY__H__
+
+/** patterns are spread over this many buckets, one bit each in the masks */
+#define TEDDY_BUCKETS       8
+/** max number of leading pattern bytes used by the masks */
+#define TEDDY_MAX_MASKLEN   3
+
+typedef struct SCTeddyPattern_ {
+    /* pattern to compare against, lowercase for nocase patterns */
+    const uint8_t *pat;
+    uint16_t len;
+    uint16_t offset;
+    uint16_t depth;
+    uint8_t nocase;
+
+    /* pattern id */
+    uint32_t id;
+
+    /* sid(s) for this pattern */
+    uint32_t sids_size;
+    SigIntId *sids;
+} SCTeddyPattern;
+
+typedef struct SCTeddyCtx_ {
+    /* nibble masks per mask position: bit b is set if a pattern in bucket
+     * b may have a byte with this low/high nibble at that position. */
+    uint8_t lo[TEDDY_MAX_MASKLEN][16] __attribute__((aligned(16)));
+    uint8_t hi[TEDDY_MAX_MASKLEN][16] __attribute__((aligned(16)));
+
+    /* the same per full byte, for the scalar code and the buffer tail */
+    uint8_t byte_mask[TEDDY_MAX_MASKLEN][256];
+
+    uint8_t masklen;
+    uint16_t minlen;
+
+    /* patterns ordered by bucket and first (lowercased) byte */
+    SCTeddyPattern *patterns;
+    uint32_t pattern_cnt;
+
+    /* patterns in bucket b starting with byte c:
+     * patterns[index[b][c]] up to patterns[index[b][c + 1]] */
+    uint32_t (*index)[257];
+
+    /* memory for the pattern bytes */
+    uint8_t *pattern_data;
+    uint32_t pattern_data_len;
+
+    uint32_t pattern_id_bitarray_size;
+} SCTeddyCtx;
+
+void MpmTeddyRegister(void);
+
+#endif /* __UTIL_MPM_TEDDY__H__ */
@@ -31,6 +31,7 @@
 #include "util-mpm-ac.h"
 #include "util-mpm-ac-bs.h"
 #include "util-mpm-ac-ks.h"
+#include "util-mpm-teddy.h"
 #include "util-mpm-hs.h"
 #include "util-hashlist.h"
 
@@ -281,6 +282,7 @@ void MpmTableSetup(void)
     MpmACRegister();
     MpmACBSRegister();
     MpmACTileRegister();
+    MpmTeddyRegister();
 #ifdef BUILD_HYPERSCAN
     #ifdef HAVE_HS_VALID_PLATFORM
     /* Enable runtime check for SSSE3. Do not use Hyperscan MPM matcher if
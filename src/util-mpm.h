@@ -35,6 +35,8 @@ enum {
     MPM_AC,
     MPM_AC_BS,
     MPM_AC_KS,
+    /* teddy literal matcher */
+    MPM_TEDDY,
     MPM_HS,
     /* table size */
     MPM_TABLE_SIZE,
@@ -178,6 +180,8 @@ void MpmFactoryDeRegisterAllMpmCtxProfiles(struct DetectEngineCtx_ *);
 int32_t MpmFactoryIsMpmCtxAvailable(const struct DetectEngineCtx_ *, const MpmCtx *);
 
 int PmqSetup(PrefilterRuleStore *);
+int PmqSetupBitmap(PrefilterRuleStore *, uint32_t);
+void PmqBitmapToArray(PrefilterRuleStore *);
 void PmqReset(PrefilterRuleStore *);
 void PmqCleanup(PrefilterRuleStore *);
 void PmqFree(PrefilterRuleStore *);
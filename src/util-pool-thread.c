@@ -34,6 +34,10 @@
 #include "util-pool-thread.h"
 #include "util-unittest.h"
 #include "util-debug.h"
+#include "util-validate.h"
+
+/** identifies the calling thread as the owner of a pool element */
+static __thread char pool_thread_self;
 
 /**
  *  \brief per thread Pool, initialization function
@@ -67,6 +71,8 @@ PoolThread *PoolThreadInit(int threads, uint32_t size, uint32_t prealloc_size,
         PoolThreadElement *e = &pt->array[i];
 
         SCMutexInit(&e->lock, NULL);
+        e->owner = NULL;
+        SC_ATOMIC_INIT(e->returned);
         SCMutexLock(&e->lock);
 //        SCLogDebug("size %u prealloc_size %u elt_size %u Alloc %p Init %p InitData %p Cleanup %p Free %p",
 //                size, prealloc_size, elt_size,
@@ -147,6 +153,28 @@ int PoolThreadSize(PoolThread *pt)
     return (int)pt->size;
 }
 
+/** \internal
+ *  \brief take the data returned by other threads back into the pool
+ *
+ *  Only called by the owner, or when no other thread uses the pool.
+ */
+static void PoolThreadTakeReturned(PoolThreadElement *e)
+{
+    void *data = SC_ATOMIC_GET(e->returned);
+    while (data != NULL && !SC_ATOMIC_CAS(&e->returned, data, NULL)) {
+        data = SC_ATOMIC_GET(e->returned);
+    }
+
+    while (data != NULL) {
+        uint8_t *link = (uint8_t *)data + sizeof(PoolThreadReserved);
+        void *next;
+        memcpy(&next, link, sizeof(next));
+        memset(link, 0, sizeof(next));
+        PoolReturn(e->pool, data);
+        data = next;
+    }
+}
+
 void PoolThreadFree(PoolThread *pt)
 {
     if (pt == NULL)
@@ -156,6 +184,7 @@ void PoolThreadFree(PoolThread *pt)
         for (int i = 0; i < (int)pt->size; i++) {
             PoolThreadElement *e = &pt->array[i];
             SCMutexLock(&e->lock);
+            PoolThreadTakeReturned(e);
             PoolFree(e->pool);
             SCMutexUnlock(&e->lock);
             SCMutexDestroy(&e->lock);
@@ -173,9 +202,14 @@ void *PoolThreadGetById(PoolThread *pt, uint16_t id)
         return NULL;
 
     PoolThreadElement *e = &pt->array[id];
-    SCMutexLock(&e->lock);
+    if (e->owner == NULL)
+        e->owner = &pool_thread_self;
+    DEBUG_VALIDATE_BUG_ON(e->owner != &pool_thread_self);
+
+    if (e->pool->alloc_stack == NULL && SC_ATOMIC_GET(e->returned) != NULL) {
+        PoolThreadTakeReturned(e);
+    }
     data = PoolGet(e->pool);
-    SCMutexUnlock(&e->lock);
     if (data) {
         PoolThreadReserved *did = data;
         *did = id;
@@ -194,9 +228,19 @@ void PoolThreadReturn(PoolThread *pt, void *data)
     SCLogDebug("returning to id %u", *id);
 
     PoolThreadElement *e = &pt->array[*id];
-    SCMutexLock(&e->lock);
-    PoolReturn(e->pool, data);
-    SCMutexUnlock(&e->lock);
+    if (e->owner == &pool_thread_self) {
+        PoolReturn(e->pool, data);
+        return;
+    }
+
+    /* returned by another thread, e.g. the flow recycler: push it
+     * on the return list */
+    uint8_t *link = (uint8_t *)data + sizeof(PoolThreadReserved);
+    void *head;
+    do {
+        head = SC_ATOMIC_GET(e->returned);
+        memcpy(link, &head, sizeof(head));
+    } while (!SC_ATOMIC_CAS(&e->returned, head, data));
 }
 
 #ifdef UNITTESTS
@@ -316,6 +360,54 @@ static int PoolThreadTestReturn01(void)
     PASS;
 }
 
+struct PoolThreadTestReturnCtx {
+    PoolThread *pt;
+    void *data;
+};
+
+static void *PoolThreadTestReturnThread(void *arg)
+{
+    struct PoolThreadTestReturnCtx *ctx = arg;
+    PoolThreadReturn(ctx->pt, ctx->data);
+    return NULL;
+}
+
+/** \test return from another thread goes through the return list */
+static int PoolThreadTestReturn02(void)
+{
+    int i = 123;
+
+    PoolThread *pt = PoolThreadInit(1, /* threads */
+                                    10, 0, 16, NULL,
+                                    PoolThreadTestInit, &i, PoolThreadTestFree, NULL);
+    FAIL_IF_NULL(pt);
+
+    void *data = PoolThreadGetById(pt, 0);
+    FAIL_IF_NULL(data);
+    FAIL_IF_NOT (pt->array[0].pool->outstanding == 1);
+
+    struct PoolThreadTestReturnCtx ctx = { pt, data };
+    pthread_t t;
+    FAIL_IF(pthread_create(&t, NULL, PoolThreadTestReturnThread, &ctx) != 0);
+    FAIL_IF(pthread_join(t, NULL) != 0);
+
+    /* on the return list, not in the pool yet */
+    FAIL_IF_NOT (SC_ATOMIC_GET(pt->array[0].returned) == data);
+    FAIL_IF_NOT (pt->array[0].pool->outstanding == 1);
+
+    /* taken back when the pool is empty */
+    void *data2 = PoolThreadGetById(pt, 0);
+    FAIL_IF_NOT (data2 == data);
+    FAIL_IF_NOT (SC_ATOMIC_GET(pt->array[0].returned) == NULL);
+    FAIL_IF_NOT (pt->array[0].pool->outstanding == 1);
+
+    PoolThreadReturn(pt, data2);
+    FAIL_IF_NOT (pt->array[0].pool->outstanding == 0);
+
+    PoolThreadFree(pt);
+    PASS;
+}
+
 static int PoolThreadTestGrow01(void)
 {
     PoolThread *pt = PoolThreadInit(4, /* threads */
@@ -382,6 +474,7 @@ void PoolThreadRegisterTests(void)
     UtRegisterTest("PoolThreadTestGet02", PoolThreadTestGet02);
 
     UtRegisterTest("PoolThreadTestReturn01", PoolThreadTestReturn01);
+    UtRegisterTest("PoolThreadTestReturn02", PoolThreadTestReturn02);
 
     UtRegisterTest("PoolThreadTestGrow01", PoolThreadTestGrow01);
     UtRegisterTest("PoolThreadTestGrow02", PoolThreadTestGrow02);
@@ -34,6 +34,14 @@
  *
  *  It's purpose is to make sure thread X can return data to a pool
  *  from thread Y.
+ *
+ *  Each element is used by one thread, its owner: the thread that gets
+ *  data from it. The owner gets and returns data without locking. Data
+ *  returned by other threads is put on a lock free return list, that
+ *  the owner takes back into its pool when the pool runs empty. The list
+ *  is linked through the bytes right after PoolThreadReserved, so data
+ *  items MUST be large enough to hold a pointer there. These bytes are
+ *  zeroed when the owner takes the data back.
  */
 
 #ifndef __UTIL_POOL_THREAD_H__
@@ -41,7 +49,10 @@
 
 struct PoolThreadElement_ {
     SCMutex lock;                   /**< lock, should have low contention */
-    Pool *pool;                     /**< actual pool */
+    Pool *pool;                     /**< actual pool, only used by the owner */
+    const void *owner;              /**< thread getting data from the pool */
+    /** data returned by other threads, for the owner to take */
+    SC_ATOMIC_DECLARE(void *, returned);
 };
 // __attribute__((aligned(CLS))); <- VJ: breaks on clang 32bit, segv in PoolThreadTestGrow01
 
@@ -0,0 +1,546 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Poptrie: read only longest prefix match for IP addresses.
+ *
+ * Compiled from a radix tree once it is complete. The first 16 bits of
+ * the address index a flat root array, each node after that resolves 6
+ * bits. A node has a 64 bit vector of the slots with a child and one of
+ * the slots where a run of equal leaves starts; the popcount of the bits
+ * up to the slot is the offset in the node's children or leaves. An IPv4
+ * lookup reads the root entry and at most 3 nodes.
+ *
+ * Based on "Poptrie: A Compressed Trie with Population Count for Fast
+ * and Scalable Software IP Routing Table Lookup" (Asai, Ohara).
+ */
+
+#include "suricata-common.h"
+#include "util-poptrie.h"
+#include "util-debug.h"
+#include "util-error.h"
+#include "util-unittest.h"
+
+/* prefix as collected from the radix tree. The key is stored msb first
+ * and zero padded, so reading a stride past the end of an address is
+ * fine. */
+typedef struct PoptriePrefix_ {
+    uint64_t key[3];
+    uint32_t value;
+    uint8_t len;
+} PoptriePrefix;
+
+typedef struct PoptriePrefixList_ {
+    PoptriePrefix *array;
+    uint32_t cnt;
+    uint32_t size;
+    void **user;
+} PoptriePrefixList;
+
+static inline uint32_t PoptrieBits(const uint64_t *w, const uint32_t pos)
+{
+    const uint32_t o = pos % 64;
+    uint64_t v = w[pos / 64] << o;
+    if (o > 0)
+        v |= w[pos / 64 + 1] >> (64 - o);
+    return (uint32_t)(v >> (64 - SC_POPTRIE_STRIDE));
+}
+
+/** \internal
+ *  \brief number of set bits in x up to and including bit 'bit' */
+static inline uint32_t PoptriePopcnt(const uint64_t x, const uint32_t bit)
+{
+    return (uint32_t)__builtin_popcountll(x << (63 - bit));
+}
+
+static uint32_t PoptrieLookup(const SCPoptrie *pt, const uint64_t *w)
+{
+    const uint32_t e = pt->root[w[0] >> (64 - SC_POPTRIE_DIRECT_BITS)];
+    if (!(e & SC_POPTRIE_NODE))
+        return e;
+
+    uint32_t idx = e & ~SC_POPTRIE_NODE;
+    for (uint32_t pos = SC_POPTRIE_DIRECT_BITS; ; pos += SC_POPTRIE_STRIDE) {
+        const SCPoptrieNode *n = &pt->nodes[idx];
+        const uint32_t v = PoptrieBits(w, pos);
+        if (!(n->vector & (1ULL << v)))
+            return pt->leaves[n->base0 + PoptriePopcnt(n->leafvec, v) - 1];
+        idx = n->base1 + PoptriePopcnt(n->vector, v) - 1;
+    }
+}
+
+static inline void *PoptrieUser(const SCPoptrie *pt, const uint32_t leaf)
+{
+    return leaf ? pt->user[leaf - 1] : NULL;
+}
+
+/**
+ *  \brief longest prefix match
+ *
+ *  \param addr IPv4 address in network byte order
+ *
+ *  \retval user user data of the best match or NULL
+ */
+void *SCPoptrieLookupIPV4(const SCPoptrie *pt, const uint8_t *addr)
+{
+    const uint64_t w[3] = {
+        (uint64_t)((uint32_t)addr[0] << 24 | (uint32_t)addr[1] << 16 |
+                   (uint32_t)addr[2] << 8 | addr[3]) << 32, 0, 0 };
+    return PoptrieUser(pt, PoptrieLookup(pt, w));
+}
+
+/**
+ *  \brief longest prefix match
+ *
+ *  \param addr IPv6 address in network byte order
+ *
+ *  \retval user user data of the best match or NULL
+ */
+void *SCPoptrieLookupIPV6(const SCPoptrie *pt, const uint8_t *addr)
+{
+    uint64_t w[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+        w[i / 8] |= (uint64_t)addr[i] << (56 - 8 * (i % 8));
+    return PoptrieUser(pt, PoptrieLookup(pt, w));
+}
+
+/**
+ *  \brief longest prefix match for a batch of addresses
+ *
+ *  The root entries of the whole batch are read first so that their cache
+ *  misses overlap, then the remaining nodes are walked per address.
+ *
+ *  \param addrs IPv4 addresses in network byte order
+ *  \param user  array of cnt entries receiving the user data or NULL
+ */
+void SCPoptrieLookupIPV4Batch(const SCPoptrie *pt, const uint32_t *addrs,
+        void **user, const uint32_t cnt)
+{
+#define POPTRIE_BATCH 16
+    uint32_t e[POPTRIE_BATCH];
+
+    for (uint32_t i = 0; i < cnt; i += POPTRIE_BATCH) {
+        const uint32_t n = MIN(cnt - i, POPTRIE_BATCH);
+        for (uint32_t j = 0; j < n; j++) {
+            e[j] = pt->root[ntohl(addrs[i + j]) >> (32 - SC_POPTRIE_DIRECT_BITS)];
+        }
+        for (uint32_t j = 0; j < n; j++) {
+            if (e[j] & SC_POPTRIE_NODE) {
+                const uint64_t w[3] = { (uint64_t)ntohl(addrs[i + j]) << 32, 0, 0 };
+                e[j] = PoptrieLookup(pt, w);
+            }
+            user[i + j] = PoptrieUser(pt, e[j]);
+        }
+    }
+#undef POPTRIE_BATCH
+}
+
+static int PoptriePrefixCompare(const void *a, const void *b)
+{
+    const PoptriePrefix *p1 = a;
+    const PoptriePrefix *p2 = b;
+    for (int i = 0; i < 2; i++) {
+        if (p1->key[i] != p2->key[i])
+            return p1->key[i] < p2->key[i] ? -1 : 1;
+    }
+    return (int)p1->len - (int)p2->len;
+}
+
+static int PoptrieCollect(const SCRadixNode *node, const uint8_t keylen,
+        PoptriePrefixList *list)
+{
+    for ( ; node != NULL; node = node->right) {
+        if (node->prefix != NULL && node->prefix->bitlen == keylen) {
+            for (const SCRadixUserData *ud = node->prefix->user_data;
+                    ud != NULL; ud = ud->next)
+            {
+                if (ud->netmask > keylen)
+                    continue;
+
+                if (list->cnt == list->size) {
+                    const uint32_t size = list->size ? list->size * 2 : 64;
+                    PoptriePrefix *array = SCRealloc(list->array, size * sizeof(PoptriePrefix));
+                    if (array == NULL)
+                        return -1;
+                    void **user = SCRealloc(list->user, size * sizeof(void *));
+                    if (user == NULL) {
+                        list->array = array;
+                        return -1;
+                    }
+                    list->array = array;
+                    list->user = user;
+                    list->size = size;
+                }
+
+                PoptriePrefix *p = &list->array[list->cnt];
+                memset(p, 0, sizeof(*p));
+                for (int i = 0; i < keylen / 8; i++)
+                    p->key[i / 8] |= (uint64_t)node->prefix->stream[i] << (56 - 8 * (i % 8));
+                /* mask the key to the netmask */
+                for (int i = 0; i < 2; i++) {
+                    const int rem = (int)ud->netmask - 64 * i;
+                    if (rem <= 0)
+                        p->key[i] = 0;
+                    else if (rem < 64)
+                        p->key[i] &= ~0ULL << (64 - rem);
+                }
+                p->len = ud->netmask;
+                list->user[list->cnt] = ud->user;
+                p->value = ++list->cnt;
+            }
+        }
+        /* recurse left, loop right */
+        if (PoptrieCollect(node->left, keylen, list) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int PoptrieGrowNodes(SCPoptrie *pt, const uint32_t cnt)
+{
+    if (pt->nodes_cnt + cnt > pt->nodes_size) {
+        uint32_t size = pt->nodes_size ? pt->nodes_size : 64;
+        while (size < pt->nodes_cnt + cnt)
+            size *= 2;
+        SCPoptrieNode *nodes = SCRealloc(pt->nodes, size * sizeof(SCPoptrieNode));
+        if (nodes == NULL)
+            return -1;
+        pt->nodes = nodes;
+        pt->nodes_size = size;
+    }
+    pt->nodes_cnt += cnt;
+    return 0;
+}
+
+static int PoptrieAddLeaf(SCPoptrie *pt, const uint32_t leaf)
+{
+    if (pt->leaves_cnt == pt->leaves_size) {
+        const uint32_t size = pt->leaves_size ? pt->leaves_size * 2 : 256;
+        uint32_t *leaves = SCRealloc(pt->leaves, size * sizeof(uint32_t));
+        if (leaves == NULL)
+            return -1;
+        pt->leaves = leaves;
+        pt->leaves_size = size;
+    }
+    pt->leaves[pt->leaves_cnt++] = leaf;
+    return 0;
+}
+
+/** \internal
+ *  \brief fill node 'idx' for the address bits from 'pos'
+ *
+ *  \param p sorted prefixes that share the first 'pos' bits. Prefixes
+ *           not longer than pos are already part of 'inherited'.
+ *  \param inherited leaf of the longest prefix not longer than pos
+ */
+static int PoptrieBuildNode(SCPoptrie *pt, const uint32_t idx,
+        const PoptriePrefix *p, const uint32_t cnt, const uint32_t pos,
+        const uint32_t inherited)
+{
+    const uint32_t end = pos + SC_POPTRIE_STRIDE;
+    uint32_t leaf[1 << SC_POPTRIE_STRIDE];
+    uint64_t vector = 0;
+
+    for (uint32_t j = 0; j < (1 << SC_POPTRIE_STRIDE); j++)
+        leaf[j] = inherited;
+    /* shortest first so that longer prefixes overwrite them */
+    for (uint32_t len = pos + 1; len <= end; len++) {
+        for (uint32_t i = 0; i < cnt; i++) {
+            if (p[i].len != len)
+                continue;
+            const uint32_t span = 1U << (end - len);
+            const uint32_t first = PoptrieBits(p[i].key, pos) & ~(span - 1);
+            for (uint32_t j = first; j < first + span; j++)
+                leaf[j] = p[i].value;
+        }
+    }
+    for (uint32_t i = 0; i < cnt; i++) {
+        if (p[i].len > end)
+            vector |= 1ULL << PoptrieBits(p[i].key, pos);
+    }
+
+    uint64_t leafvec = 0;
+    const uint32_t base0 = pt->leaves_cnt;
+    for (uint32_t j = 0; j < (1 << SC_POPTRIE_STRIDE); j++) {
+        if (vector & (1ULL << j))
+            continue;
+        if (leafvec == 0 || leaf[j] != pt->leaves[pt->leaves_cnt - 1]) {
+            if (PoptrieAddLeaf(pt, leaf[j]) < 0)
+                return -1;
+            leafvec |= 1ULL << j;
+        }
+    }
+
+    const uint32_t base1 = pt->nodes_cnt;
+    if (PoptrieGrowNodes(pt, (uint32_t)__builtin_popcountll(vector)) < 0)
+        return -1;
+    pt->nodes[idx].vector = vector;
+    pt->nodes[idx].leafvec = leafvec;
+    pt->nodes[idx].base0 = base0;
+    pt->nodes[idx].base1 = base1;
+
+    /* the prefixes are sorted, so the ones in a slot are next to each
+     * other and the slots are in order */
+    uint32_t child = base1;
+    for (uint32_t i = 0; i < cnt; ) {
+        const uint32_t j = PoptrieBits(p[i].key, pos);
+        uint32_t e = i + 1;
+        while (e < cnt && PoptrieBits(p[e].key, pos) == j)
+            e++;
+        if (vector & (1ULL << j)) {
+            if (PoptrieBuildNode(pt, child, p + i, e - i, end, leaf[j]) < 0)
+                return -1;
+            child++;
+        }
+        i = e;
+    }
+    return 0;
+}
+
+void SCPoptrieFree(SCPoptrie *pt)
+{
+    if (pt == NULL)
+        return;
+    if (pt->root)
+        SCFree(pt->root);
+    if (pt->nodes)
+        SCFree(pt->nodes);
+    if (pt->leaves)
+        SCFree(pt->leaves);
+    if (pt->user)
+        SCFree(pt->user);
+    SCFree(pt);
+}
+
+/**
+ *  \brief compile a radix tree of IP addresses and netblocks
+ *
+ *  The user data is not copied: the tree keeps owning it and has to stay
+ *  around as long as the poptrie is used. Later changes to the tree are
+ *  not reflected in the poptrie.
+ *
+ *  \param keylen 32 for an IPv4 tree, 128 for IPv6
+ *
+ *  \retval pt poptrie or NULL on error
+ */
+SCPoptrie *SCPoptrieFromRadixTree(const SCRadixTree *tree, const uint8_t keylen)
+{
+    if (tree == NULL || (keylen != 32 && keylen != 128))
+        return NULL;
+
+    PoptriePrefixList list = { NULL, 0, 0, NULL };
+    SCPoptrie *pt = SCCalloc(1, sizeof(*pt));
+    if (unlikely(pt == NULL))
+        return NULL;
+    pt->keylen = keylen;
+    pt->root = SCCalloc(1 << SC_POPTRIE_DIRECT_BITS, sizeof(uint32_t));
+    if (pt->root == NULL)
+        goto error;
+
+    if (PoptrieCollect(tree->head, keylen, &list) < 0)
+        goto error;
+    pt->user = list.user;
+    pt->user_cnt = list.cnt;
+    list.user = NULL;
+    if (list.cnt >= SC_POPTRIE_NODE)
+        goto error;
+
+    qsort(list.array, list.cnt, sizeof(PoptriePrefix), PoptriePrefixCompare);
+
+    /* prefixes that fit the root array, shortest first */
+    for (uint32_t len = 0; len <= SC_POPTRIE_DIRECT_BITS; len++) {
+        for (uint32_t i = 0; i < list.cnt; i++) {
+            const PoptriePrefix *p = &list.array[i];
+            if (p->len != len)
+                continue;
+            const uint32_t span = 1U << (SC_POPTRIE_DIRECT_BITS - len);
+            const uint32_t first = (uint32_t)(p->key[0] >> (64 - SC_POPTRIE_DIRECT_BITS)) & ~(span - 1);
+            for (uint32_t j = first; j < first + span; j++)
+                pt->root[j] = p->value;
+        }
+    }
+
+    /* a node for each root entry covering longer prefixes */
+    for (uint32_t i = 0; i < list.cnt; ) {
+        const uint32_t r = (uint32_t)(list.array[i].key[0] >> (64 - SC_POPTRIE_DIRECT_BITS));
+        int has_longer = 0;
+        uint32_t e = i;
+        while (e < list.cnt &&
+                (uint32_t)(list.array[e].key[0] >> (64 - SC_POPTRIE_DIRECT_BITS)) == r)
+        {
+            if (list.array[e].len > SC_POPTRIE_DIRECT_BITS)
+                has_longer = 1;
+            e++;
+        }
+        if (has_longer) {
+            const uint32_t idx = pt->nodes_cnt;
+            if (PoptrieGrowNodes(pt, 1) < 0)
+                goto error;
+            if (PoptrieBuildNode(pt, idx, list.array + i, e - i,
+                        SC_POPTRIE_DIRECT_BITS, pt->root[r]) < 0)
+                goto error;
+            pt->root[r] = SC_POPTRIE_NODE | idx;
+        }
+        i = e;
+    }
+
+    if (list.array)
+        SCFree(list.array);
+    SCLogDebug("poptrie: %u prefixes, %u nodes, %u leaves", pt->user_cnt,
+            pt->nodes_cnt, pt->leaves_cnt);
+    return pt;
+
+error:
+    if (list.array)
+        SCFree(list.array);
+    if (list.user)
+        SCFree(list.user);
+    SCPoptrieFree(pt);
+    return NULL;
+}
+
+uint64_t SCPoptrieMemoryUse(const SCPoptrie *pt)
+{
+    if (pt == NULL)
+        return 0;
+    return sizeof(*pt) +
+        (uint64_t)(1 << SC_POPTRIE_DIRECT_BITS) * sizeof(uint32_t) +
+        (uint64_t)pt->nodes_size * sizeof(SCPoptrieNode) +
+        (uint64_t)pt->leaves_size * sizeof(uint32_t) +
+        (uint64_t)pt->user_cnt * sizeof(void *);
+}
+
+/*------------------------------------Unit_Tests------------------------------*/
+
+#ifdef UNITTESTS
+
+static uint32_t PoptrieTestRand(uint32_t *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state;
+}
+
+/**
+ * \test compare with the radix tree on random netblocks and addresses and
+ *       log the lookup time of both
+ */
+static int SCPoptrieTest01(void)
+{
+    static int values[4096];
+    uint32_t seed = 1;
+    uint32_t addrs[4096];
+    void *batch[4096];
+
+    SCRadixTree *tree = SCRadixCreateRadixTree(NULL, NULL);
+    FAIL_IF_NULL(tree);
+
+    for (int i = 0; i < 4096; i++) {
+        uint32_t ip = PoptrieTestRand(&seed);
+        /* keep most of them in a few /8's so that they overlap */
+        ip = (ip & 0x00ffffff) | ((10 + (ip % 4)) << 24);
+        uint32_t nip = htonl(ip);
+        uint8_t netmask = 8 + PoptrieTestRand(&seed) % 25;
+        SCRadixAddKeyIPV4Netblock((uint8_t *)&nip, tree, &values[i], netmask);
+    }
+
+    SCPoptrie *pt = SCPoptrieFromRadixTree(tree, 32);
+    FAIL_IF_NULL(pt);
+
+    for (int i = 0; i < 4096; i++) {
+        uint32_t ip = PoptrieTestRand(&seed);
+        if (i % 4 != 0)
+            ip = (ip & 0x00ffffff) | ((10 + (ip % 4)) << 24);
+        addrs[i] = htonl(ip);
+
+        void *user = NULL;
+        SCRadixFindKeyIPV4BestMatch((uint8_t *)&addrs[i], tree, &user);
+        FAIL_IF(SCPoptrieLookupIPV4(pt, (uint8_t *)&addrs[i]) != user);
+    }
+    SCPoptrieLookupIPV4Batch(pt, addrs, batch, 4096);
+    for (int i = 0; i < 4096; i++) {
+        FAIL_IF(batch[i] != SCPoptrieLookupIPV4(pt, (uint8_t *)&addrs[i]));
+    }
+
+    struct timeval start, end;
+    void *user = NULL;
+    gettimeofday(&start, NULL);
+    for (int r = 0; r < 100; r++) {
+        for (int i = 0; i < 4096; i++)
+            SCRadixFindKeyIPV4BestMatch((uint8_t *)&addrs[i], tree, &user);
+    }
+    gettimeofday(&end, NULL);
+    SCLogInfo("radix: %"PRIu64" usec for 409600 lookups",
+            (uint64_t)((end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec)));
+    gettimeofday(&start, NULL);
+    for (int r = 0; r < 100; r++) {
+        SCPoptrieLookupIPV4Batch(pt, addrs, batch, 4096);
+    }
+    gettimeofday(&end, NULL);
+    SCLogInfo("poptrie: %"PRIu64" usec for 409600 lookups, %"PRIu64" bytes",
+            (uint64_t)((end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec)),
+            SCPoptrieMemoryUse(pt));
+
+    SCPoptrieFree(pt);
+    SCRadixReleaseRadixTree(tree);
+    PASS;
+}
+
+/**
+ * \test IPv6 netblocks and a default route
+ */
+static int SCPoptrieTest02(void)
+{
+    int v1 = 1, v2 = 2, v3 = 3, v4 = 4;
+    struct in6_addr addr;
+
+    SCRadixTree *tree = SCRadixCreateRadixTree(NULL, NULL);
+    FAIL_IF_NULL(tree);
+    FAIL_IF_NULL(SCRadixAddKeyIPV6String("::/0", tree, &v1));
+    FAIL_IF_NULL(SCRadixAddKeyIPV6String("2001:db8::/32", tree, &v2));
+    FAIL_IF_NULL(SCRadixAddKeyIPV6String("2001:db8:0:1::/64", tree, &v3));
+    FAIL_IF_NULL(SCRadixAddKeyIPV6String("2001:db8:0:1::5", tree, &v4));
+
+    SCPoptrie *pt = SCPoptrieFromRadixTree(tree, 128);
+    FAIL_IF_NULL(pt);
+
+    FAIL_IF(inet_pton(AF_INET6, "fe80::1", &addr) <= 0);
+    FAIL_IF(SCPoptrieLookupIPV6(pt, (uint8_t *)&addr) != &v1);
+    FAIL_IF(inet_pton(AF_INET6, "2001:db8:5::1", &addr) <= 0);
+    FAIL_IF(SCPoptrieLookupIPV6(pt, (uint8_t *)&addr) != &v2);
+    FAIL_IF(inet_pton(AF_INET6, "2001:db8:0:1::4", &addr) <= 0);
+    FAIL_IF(SCPoptrieLookupIPV6(pt, (uint8_t *)&addr) != &v3);
+    FAIL_IF(inet_pton(AF_INET6, "2001:db8:0:1::5", &addr) <= 0);
+    FAIL_IF(SCPoptrieLookupIPV6(pt, (uint8_t *)&addr) != &v4);
+    FAIL_IF(inet_pton(AF_INET6, "2001:db8:0:1::6", &addr) <= 0);
+    FAIL_IF(SCPoptrieLookupIPV6(pt, (uint8_t *)&addr) != &v3);
+
+    SCPoptrieFree(pt);
+    SCRadixReleaseRadixTree(tree);
+    PASS;
+}
+
+#endif /* UNITTESTS */
+
+void SCPoptrieRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("SCPoptrieTest01", SCPoptrieTest01);
+    UtRegisterTest("SCPoptrieTest02", SCPoptrieTest02);
+#endif
+}
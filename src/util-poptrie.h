@@ -0,0 +1,75 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Poptrie: read only longest prefix match for IP addresses.
+ */
+
+#ifndef __UTIL_POPTRIE_H__
+#define __UTIL_POPTRIE_H__
+
+#include "util-radix-tree.h"
+
+/** bits of the address resolved by the direct pointing root array */
+#define SC_POPTRIE_DIRECT_BITS  16
+/** bits of the address resolved per node */
+#define SC_POPTRIE_STRIDE       6
+/** root entry flag: the entry is a node index, not a leaf */
+#define SC_POPTRIE_NODE         0x80000000U
+
+typedef struct SCPoptrieNode_ {
+    uint64_t vector;    /**< slots that have a child node */
+    uint64_t leafvec;   /**< slots where a run of equal leaves starts */
+    uint32_t base0;     /**< index of the node's first leaf */
+    uint32_t base1;     /**< index of the node's first child */
+} SCPoptrieNode;
+
+typedef struct SCPoptrie_ {
+    /* leaf or SC_POPTRIE_NODE|node index, per value of the first
+     * SC_POPTRIE_DIRECT_BITS bits */
+    uint32_t *root;
+
+    /* the children of a node are stored next to each other, as are its
+     * leaves */
+    SCPoptrieNode *nodes;
+    uint32_t nodes_cnt;
+    uint32_t nodes_size;
+    uint32_t *leaves;
+    uint32_t leaves_cnt;
+    uint32_t leaves_size;
+
+    /* leaf value v > 0 is user[v - 1], 0 is no match */
+    void **user;
+    uint32_t user_cnt;
+
+    uint8_t keylen;     /**< 32 or 128 bits */
+} SCPoptrie;
+
+SCPoptrie *SCPoptrieFromRadixTree(const SCRadixTree *tree, const uint8_t keylen);
+void SCPoptrieFree(SCPoptrie *pt);
+uint64_t SCPoptrieMemoryUse(const SCPoptrie *pt);
+
+void *SCPoptrieLookupIPV4(const SCPoptrie *pt, const uint8_t *addr);
+void *SCPoptrieLookupIPV6(const SCPoptrie *pt, const uint8_t *addr);
+void SCPoptrieLookupIPV4Batch(const SCPoptrie *pt, const uint32_t *addrs,
+        void **user, const uint32_t cnt);
+
+void SCPoptrieRegisterTests(void);
+
+#endif /* __UTIL_POPTRIE_H__ */
@@ -93,6 +93,103 @@ PrefilterAddSidsResize(PrefilterRuleStore *pmq, uint32_t new_size)
     return new_size;
 }
 
+/**
+ *  \brief Setup the rule id bitmap of a pmq
+ *
+ *  With the bitmap set up, PrefilterAddSids drops duplicate rule ids on
+ *  insertion and PmqBitmapToArray produces the ordered rule id array,
+ *  so that the candidates don't need to be sorted.
+ *
+ *  \param pmq Pattern matcher queue set up by PmqSetup()
+ *  \param max_id number of rule ids, e.g. the size of the sig_array
+ *
+ *  \retval -1 error
+ *  \retval 0 ok
+ */
+int PmqSetupBitmap(PrefilterRuleStore *pmq, uint32_t max_id)
+{
+    if (pmq == NULL || max_id == 0)
+        return -1;
+
+    const uint32_t words = (max_id + 63) / 64;
+    const uint32_t summary_words = (words + 63) / 64;
+
+    pmq->rule_id_bitmap = SCCalloc(words, sizeof(uint64_t));
+    if (pmq->rule_id_bitmap == NULL)
+        return -1;
+    pmq->rule_id_bitmap_summary = SCCalloc(summary_words, sizeof(uint64_t));
+    if (pmq->rule_id_bitmap_summary == NULL) {
+        SCFree(pmq->rule_id_bitmap);
+        pmq->rule_id_bitmap = NULL;
+        return -1;
+    }
+    pmq->rule_id_bitmap_words = words;
+    pmq->rule_id_bitmap_cnt = 0;
+    pmq->rule_id_bitmap_adds = 0;
+    return 0;
+}
+
+/**
+ *  \brief Move the rule ids from the bitmap to the rule id array
+ *
+ *  Walks the set bits using the summary, so the cost depends on the number
+ *  of candidates rather than on the number of rules. The array is replaced
+ *  by the unique rule ids in ascending order. The bitmap is cleared.
+ *
+ *  \param pmq Pattern matcher queue with a bitmap
+ */
+void PmqBitmapToArray(PrefilterRuleStore *pmq)
+{
+    pmq->rule_id_array_cnt = 0;
+    if (pmq->rule_id_bitmap_cnt == 0)
+        return;
+
+    uint64_t *bitmap = pmq->rule_id_bitmap;
+    uint64_t *summary = pmq->rule_id_bitmap_summary;
+    const uint32_t summary_words = (pmq->rule_id_bitmap_words + 63) / 64;
+
+    if (pmq->rule_id_bitmap_cnt > pmq->rule_id_array_size) {
+        (void)PrefilterAddSidsResize(pmq, pmq->rule_id_bitmap_cnt);
+    }
+    SigIntId *ptr = pmq->rule_id_array;
+    SigIntId *end = ptr + pmq->rule_id_array_size;
+
+    for (uint32_t s = 0; s < summary_words; s++) {
+        uint64_t sbits = summary[s];
+        if (sbits == 0)
+            continue;
+        summary[s] = 0;
+
+        while (sbits) {
+            const uint32_t word = s * 64 + (uint32_t)__builtin_ctzll(sbits);
+            sbits &= sbits - 1;
+
+            uint64_t bits = bitmap[word];
+            bitmap[word] = 0;
+            while (bits) {
+                /* if the array couldn't be grown, keep as many as we can */
+                if (likely(ptr < end)) {
+                    *ptr++ = (SigIntId)(word * 64 + (uint32_t)__builtin_ctzll(bits));
+                }
+                bits &= bits - 1;
+            }
+        }
+    }
+    pmq->rule_id_array_cnt = ptr - pmq->rule_id_array;
+    pmq->rule_id_bitmap_cnt = 0;
+}
+
+static void PmqBitmapClear(PrefilterRuleStore *pmq)
+{
+    if (pmq->rule_id_bitmap_cnt) {
+        const uint32_t summary_words = (pmq->rule_id_bitmap_words + 63) / 64;
+        memset(pmq->rule_id_bitmap, 0, pmq->rule_id_bitmap_words * sizeof(uint64_t));
+        memset(pmq->rule_id_bitmap_summary, 0, summary_words * sizeof(uint64_t));
+        pmq->rule_id_bitmap_cnt = 0;
+    }
+    pmq->rule_id_bitmap_adds = 0;
+}
+
 /** \brief Reset a Pmq for reusage. Meant to be called after a single search.
  *  \param pmq Pattern matcher to be reset.
  *  \todo memset is expensive, but we need it as we merge pmq's. We might use
@@ -105,6 +202,10 @@ void PmqReset(PrefilterRuleStore *pmq)
 
     pmq->rule_id_array_cnt = 0;
     /* TODO: Realloc the rule id array smaller at some size? */
+
+    if (pmq->rule_id_bitmap != NULL) {
+        PmqBitmapClear(pmq);
+    }
 }
 
 /** \brief Cleanup a Pmq
@@ -118,6 +219,14 @@ void PmqCleanup(PrefilterRuleStore *pmq)
         SCFree(pmq->rule_id_array);
         pmq->rule_id_array = NULL;
     }
+    if (pmq->rule_id_bitmap != NULL) {
+        SCFree(pmq->rule_id_bitmap);
+        pmq->rule_id_bitmap = NULL;
+    }
+    if (pmq->rule_id_bitmap_summary != NULL) {
+        SCFree(pmq->rule_id_bitmap_summary);
+        pmq->rule_id_bitmap_summary = NULL;
+    }
 }
 
 /** \brief Cleanup and free a Pmq
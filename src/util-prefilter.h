@@ -39,11 +39,43 @@ typedef struct PrefilterRuleStore_ {
     /* The number of slots allocated for storing rule IDs */
     uint32_t rule_id_array_size;
 
+    /* Optional bitmap of rule IDs. If set, PrefilterAddSids sets bits here
+     * instead of appending to the array, so duplicates are dropped on
+     * insertion. PmqBitmapToArray moves the bits to the array in rule ID
+     * order. The summary has a bit per non-zero bitmap word. */
+    uint64_t *rule_id_bitmap;
+    uint64_t *rule_id_bitmap_summary;
+    uint32_t rule_id_bitmap_words;
+    /* Number of unique rule IDs in the bitmap. */
+    uint32_t rule_id_bitmap_cnt;
+    /* Number of rule IDs added to the bitmap, including duplicates. */
+    uint32_t rule_id_bitmap_adds;
+
 } PrefilterRuleStore;
 
 /* Resize Signature ID array. Only called from MpmAddSids(). */
 int PrefilterAddSidsResize(PrefilterRuleStore *pmq, uint32_t new_size);
 
+static inline void
+PrefilterAddSidsBitmap(PrefilterRuleStore *pmq, const SigIntId *sids, uint32_t sids_size)
+{
+    uint64_t *bitmap = pmq->rule_id_bitmap;
+    uint64_t *summary = pmq->rule_id_bitmap_summary;
+    uint32_t cnt = 0;
+
+    for (uint32_t i = 0; i < sids_size; i++) {
+        const uint32_t word = sids[i] / 64;
+        const uint64_t bit = (uint64_t)1 << (sids[i] % 64);
+        if (!(bitmap[word] & bit)) {
+            bitmap[word] |= bit;
+            summary[word / 64] |= (uint64_t)1 << (word % 64);
+            cnt++;
+        }
+    }
+    pmq->rule_id_bitmap_cnt += cnt;
+    pmq->rule_id_bitmap_adds += sids_size;
+}
+
 /** \brief Add array of Signature IDs to rule ID array.
  *
  *   Checks size of the array first. Calls PrefilterAddSidsResize to increase
@@ -60,6 +92,11 @@ PrefilterAddSids(PrefilterRuleStore *pmq, SigIntId *sids, uint32_t sids_size)
     if (sids_size == 0)
         return;
 
+    if (pmq->rule_id_bitmap != NULL) {
+        PrefilterAddSidsBitmap(pmq, sids, sids_size);
+        return;
+    }
+
     uint32_t new_size = pmq->rule_id_array_cnt + sids_size;
     if (new_size > pmq->rule_id_array_size) {
         if (PrefilterAddSidsResize(pmq, new_size) == 0) {
@@ -27,6 +27,7 @@
 #include "suricata-common.h"
 #include "decode.h"
 #include "detect.h"
+#include "detect-engine-content-inspection.h"
 #include "conf.h"
 
 #include "tm-threads.h"
@@ -45,6 +46,8 @@ typedef struct SCProfileData_ {
     uint32_t sid;
     uint32_t gid;
     uint32_t rev;
+    /* content inspection path, see DetectEngineContentInspectionPath() */
+    const char *inspect_path;
     uint64_t checks;
     uint64_t matches;
     uint64_t max;
@@ -66,6 +69,7 @@ typedef struct SCProfileSummary_ {
     uint32_t sid;
     uint32_t gid;
     uint32_t rev;
+    const char *inspect_path;
     uint64_t ticks;
     double avgticks;
     double avgticks_match;
@@ -330,6 +334,8 @@ static void DumpJson(FILE *fp, SCProfileSummary *summary,
             json_object_set_new(jsm, "signature_id", json_integer(summary[i].sid));
             json_object_set_new(jsm, "gid", json_integer(summary[i].gid));
             json_object_set_new(jsm, "rev", json_integer(summary[i].rev));
+            json_object_set_new(jsm, "inspect", json_string(summary[i].inspect_path ?
+                        summary[i].inspect_path : "-"));
 
             json_object_set_new(jsm, "checks", json_integer(summary[i].checks));
             json_object_set_new(jsm, "matches", json_integer(summary[i].matches));
@@ -380,7 +386,7 @@ static void DumpText(FILE *fp, SCProfileSummary *summary,
     fprintf(fp, " Sorted by: %s.\n", sort_desc);
     fprintf(fp, "  ----------------------------------------------"
             "----------------------------\n");
-    fprintf(fp, "   %-8s %-12s %-8s %-8s %-12s %-6s %-8s %-8s %-11s %-11s %-11s %-11s\n", "Num", "Rule", "Gid", "Rev", "Ticks", "%", "Checks", "Matches", "Max Ticks", "Avg Ticks", "Avg Match", "Avg No Match");
+    fprintf(fp, "   %-8s %-12s %-8s %-8s %-12s %-6s %-8s %-8s %-11s %-11s %-11s %-14s %-8s\n", "Num", "Rule", "Gid", "Rev", "Ticks", "%", "Checks", "Matches", "Max Ticks", "Avg Ticks", "Avg Match", "Avg No Match", "Inspect");
     fprintf(fp, "  -------- "
         "------------ "
         "-------- "
@@ -393,6 +399,7 @@ static void DumpText(FILE *fp, SCProfileSummary *summary,
         "----------- "
         "----------- "
         "-------------- "
+        "-------- "
         "\n");
     for (i = 0; i < MIN(count, profiling_rules_limit); i++) {
 
@@ -405,7 +412,7 @@ static void DumpText(FILE *fp, SCProfileSummary *summary,
         double percent = (long double)summary[i].ticks /
             (long double)total_ticks * 100;
         fprintf(fp,
-            "  %-8"PRIu32" %-12u %-8"PRIu32" %-8"PRIu32" %-12"PRIu64" %-6.2f %-8"PRIu64" %-8"PRIu64" %-11"PRIu64" %-11.2f %-11.2f %-11.2f\n",
+            "  %-8"PRIu32" %-12u %-8"PRIu32" %-8"PRIu32" %-12"PRIu64" %-6.2f %-8"PRIu64" %-8"PRIu64" %-11"PRIu64" %-11.2f %-11.2f %-14.2f %-8s\n",
             i + 1,
             summary[i].sid,
             summary[i].gid,
@@ -417,7 +424,8 @@ static void DumpText(FILE *fp, SCProfileSummary *summary,
             summary[i].max,
             summary[i].avgticks,
             summary[i].avgticks_match,
-            summary[i].avgticks_no_match);
+            summary[i].avgticks_no_match,
+            summary[i].inspect_path ? summary[i].inspect_path : "-");
     }
 
     fprintf(fp,"\n");
@@ -466,6 +474,7 @@ SCProfilingRuleDump(SCProfileDetectCtx *rules_ctx)
         summary[i].sid = rules_ctx->data[i].sid;
         summary[i].rev = rules_ctx->data[i].rev;
         summary[i].gid = rules_ctx->data[i].gid;
+        summary[i].inspect_path = rules_ctx->data[i].inspect_path;
 
         summary[i].ticks = rules_ctx->data[i].ticks_match + rules_ctx->data[i].ticks_no_match;
         summary[i].checks = rules_ctx->data[i].checks;
@@ -687,6 +696,8 @@ SCProfilingRuleInitCounters(DetectEngineCtx *de_ctx)
             de_ctx->profile_ctx->data[sig->profiling_id].sid = sig->id;
             de_ctx->profile_ctx->data[sig->profiling_id].gid = sig->gid;
             de_ctx->profile_ctx->data[sig->profiling_id].rev = sig->rev;
+            de_ctx->profile_ctx->data[sig->profiling_id].inspect_path =
+                DetectEngineContentInspectionPath(sig);
             sig = sig->next;
         }
     }
@@ -84,6 +84,29 @@ char *RunmodeAutoFpCreatePickupQueuesString(int n)
     return queues;
 }
 
+/**
+ *  \brief get the name of the queue handler autofp uses between the
+ *         capture and the worker threads
+ *
+ *  "autofp-queue: ring" selects the lockless "flow-ring" handler,
+ *  "autofp-queue: mutex" (default) the "flow" handler.
+ */
+const char *RunmodeAutoFpGetQueueHandler(void)
+{
+    const char *type = NULL;
+
+    if (ConfGet("autofp-queue", &type) == 1 && type != NULL) {
+        if (strcasecmp(type, "ring") == 0) {
+            SCLogConfig("AutoFP mode using lockless ring queues");
+            return "flow-ring";
+        } else if (strcasecmp(type, "mutex") != 0) {
+            SCLogWarning(SC_ERR_INVALID_YAML_CONF_ENTRY, "Invalid entry \"%s\" "
+                    "for autofp-queue, using \"mutex\"", type);
+        }
+    }
+    return "flow";
+}
+
 /**
  */
 int RunModeSetLiveCaptureAutoFp(ConfigIfaceParserFunc ConfigParser,
@@ -116,6 +139,7 @@ int RunModeSetLiveCaptureAutoFp(ConfigIfaceParserFunc ConfigParser,
         SCLogError(SC_ERR_RUNMODE, "RunmodeAutoFpCreatePickupQueuesString failed");
          exit(EXIT_FAILURE);
     }
+    const char *qhandler = RunmodeAutoFpGetQueueHandler();
 
     if ((nlive <= 1) && (live_dev != NULL)) {
         void *aconf;
@@ -140,7 +164,7 @@ int RunModeSetLiveCaptureAutoFp(ConfigIfaceParserFunc ConfigParser,
             ThreadVars *tv_receive =
                 TmThreadCreatePacketHandler(tname,
                         "packetpool", "packetpool",
-                        queues, "flow", "pktacqloop");
+                        queues, qhandler, "pktacqloop");
             if (tv_receive == NULL) {
                 SCLogError(SC_ERR_RUNMODE, "TmThreadsCreate failed");
                 exit(EXIT_FAILURE);
@@ -207,7 +231,7 @@ int RunModeSetLiveCaptureAutoFp(ConfigIfaceParserFunc ConfigParser,
                 ThreadVars *tv_receive =
                     TmThreadCreatePacketHandler(tname,
                             "packetpool", "packetpool",
-                            queues, "flow", "pktacqloop");
+                            queues, qhandler, "pktacqloop");
                 if (tv_receive == NULL) {
                     SCLogError(SC_ERR_RUNMODE, "TmThreadsCreate failed");
                     exit(EXIT_FAILURE);
@@ -245,7 +269,7 @@ int RunModeSetLiveCaptureAutoFp(ConfigIfaceParserFunc ConfigParser,
 
         ThreadVars *tv_detect_ncpu =
             TmThreadCreatePacketHandler(tname,
-                                        qname, "flow",
+                                        qname, qhandler,
                                         "packetpool", "packetpool",
                                         "varslot");
         if (tv_detect_ncpu == NULL) {
@@ -472,6 +496,7 @@ int RunModeSetIPSAutoFp(ConfigIPSParserFunc ConfigParser,
         SCLogError(SC_ERR_RUNMODE, "RunmodeAutoFpCreatePickupQueuesString failed");
         exit(EXIT_FAILURE);
     }
+    const char *qhandler = RunmodeAutoFpGetQueueHandler();
 
     for (int i = 0; i < nqueue; i++) {
     /* create the threads */
@@ -486,7 +511,7 @@ int RunModeSetIPSAutoFp(ConfigIPSParserFunc ConfigParser,
         ThreadVars *tv_receive =
             TmThreadCreatePacketHandler(tname,
                     "packetpool", "packetpool",
-                    queues, "flow", "pktacqloop");
+                    queues, qhandler, "pktacqloop");
         if (tv_receive == NULL) {
             SCLogError(SC_ERR_RUNMODE, "TmThreadsCreate failed");
             exit(EXIT_FAILURE);
@@ -521,7 +546,7 @@ int RunModeSetIPSAutoFp(ConfigIPSParserFunc ConfigParser,
 
         ThreadVars *tv_detect_ncpu =
             TmThreadCreatePacketHandler(tname,
-                                        qname, "flow",
+                                        qname, qhandler,
                                         "verdict-queue", "simple",
                                         "varslot");
         if (tv_detect_ncpu == NULL) {
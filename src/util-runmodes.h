@@ -62,5 +62,6 @@ int RunModeSetIPSWorker(ConfigIPSParserFunc ConfigParser,
                         const char *decode_mod_name);
 
 char *RunmodeAutoFpCreatePickupQueuesString(int n);
+const char *RunmodeAutoFpGetQueueHandler(void);
 
 #endif /* __UTIL_RUNMODES_H__ */
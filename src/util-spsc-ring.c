@@ -0,0 +1,127 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Bounded lock-free single producer, single consumer ring.
+ */
+
+#include "suricata-common.h"
+#include "util-spsc-ring.h"
+#include "util-unittest.h"
+
+/**
+ *  \brief allocate a ring
+ *
+ *  \param size minimal number of slots, rounded up to a power of 2
+ *
+ *  \retval r ring or NULL on error
+ */
+SpscRing *SpscRingAlloc(uint32_t size)
+{
+    if (size == 0 || size > (1U << 31))
+        return NULL;
+
+    uint32_t slots = 1;
+    while (slots < size)
+        slots <<= 1;
+
+    SpscRing *r = SCMallocAligned(sizeof(*r), CLS);
+    if (unlikely(r == NULL))
+        return NULL;
+    memset(r, 0x00, sizeof(*r));
+
+    r->slots = SCCalloc(slots, sizeof(void *));
+    if (unlikely(r->slots == NULL)) {
+        SCFreeAligned(r);
+        return NULL;
+    }
+    r->size = slots;
+    r->mask = slots - 1;
+    return r;
+}
+
+void SpscRingFree(SpscRing *r)
+{
+    if (r == NULL)
+        return;
+    SCFree(r->slots);
+    SCFreeAligned(r);
+}
+
+#ifdef UNITTESTS
+static int SpscRingTest01(void)
+{
+    SpscRing *r = SpscRingAlloc(3);
+    FAIL_IF_NULL(r);
+    FAIL_IF_NOT(r->size == 4);
+
+    int a[5];
+    FAIL_IF_NOT(SpscRingEnqueue(r, &a[0]) == 1);
+    FAIL_IF_NOT(SpscRingEnqueue(r, &a[1]) == 1);
+    FAIL_IF_NOT(SpscRingEnqueue(r, &a[2]) == 1);
+    FAIL_IF_NOT(SpscRingEnqueue(r, &a[3]) == 1);
+    /* full */
+    FAIL_IF_NOT(SpscRingEnqueue(r, &a[4]) == 0);
+    FAIL_IF_NOT(SpscRingCount(r) == 4);
+
+    FAIL_IF_NOT(SpscRingDequeue(r) == &a[0]);
+    FAIL_IF_NOT(SpscRingEnqueue(r, &a[4]) == 1);
+
+    void *ptrs[8];
+    FAIL_IF_NOT(SpscRingDequeueBulk(r, ptrs, 8) == 4);
+    FAIL_IF_NOT(ptrs[0] == &a[1]);
+    FAIL_IF_NOT(ptrs[3] == &a[4]);
+    FAIL_IF_NOT(SpscRingDequeue(r) == NULL);
+    FAIL_IF_NOT(SpscRingCount(r) == 0);
+
+    SpscRingFree(r);
+    PASS;
+}
+
+/** \test wrap around the index space */
+static int SpscRingTest02(void)
+{
+    SpscRing *r = SpscRingAlloc(8);
+    FAIL_IF_NULL(r);
+    r->head = r->tail = r->head_cache = r->tail_cache = UINT32_MAX - 2;
+
+    int a[8];
+    for (int i = 0; i < 8; i++) {
+        FAIL_IF_NOT(SpscRingEnqueue(r, &a[i]) == 1);
+    }
+    FAIL_IF_NOT(SpscRingEnqueue(r, &a[0]) == 0);
+    FAIL_IF_NOT(SpscRingCount(r) == 8);
+
+    for (int i = 0; i < 8; i++) {
+        FAIL_IF_NOT(SpscRingDequeue(r) == &a[i]);
+    }
+    FAIL_IF_NOT(SpscRingDequeue(r) == NULL);
+
+    SpscRingFree(r);
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void SpscRingRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("SpscRingTest01", SpscRingTest01);
+    UtRegisterTest("SpscRingTest02", SpscRingTest02);
+#endif
+}
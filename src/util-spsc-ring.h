@@ -0,0 +1,118 @@
+/* Copyright (C) 2019 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Bounded lock-free single producer, single consumer ring of pointers.
+ *
+ * The producer owns 'head', the consumer owns 'tail'. Each side keeps a
+ * cached copy of the other side's index so that the shared cache line is
+ * only read when the cached value says the ring is full (producer) or
+ * empty (consumer). The consumer publishes its tail once per bulk
+ * dequeue instead of once per item.
+ */
+
+#ifndef __UTIL_SPSC_RING_H__
+#define __UTIL_SPSC_RING_H__
+
+#define SPSC_LOAD_ACQ(ptr)          __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define SPSC_STORE_REL(ptr, val)    __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+
+typedef struct SpscRing_ {
+    /* producer side */
+    uint32_t head __attribute__((aligned(CLS)));
+    uint32_t tail_cache;            /**< producer's view of 'tail' */
+
+    /* consumer side */
+    uint32_t tail __attribute__((aligned(CLS)));
+    uint32_t head_cache;            /**< consumer's view of 'head' */
+
+    /* read only after init */
+    uint32_t size __attribute__((aligned(CLS)));
+    uint32_t mask;
+    void **slots;
+} SpscRing;
+
+SpscRing *SpscRingAlloc(uint32_t size);
+void SpscRingFree(SpscRing *r);
+void SpscRingRegisterTests(void);
+
+/**
+ *  \brief add a pointer to the ring
+ *
+ *  \retval 1 on success
+ *  \retval 0 if the ring is full
+ */
+static inline int SpscRingEnqueue(SpscRing *r, void *ptr)
+{
+    const uint32_t head = r->head;
+
+    if (unlikely(head - r->tail_cache == r->size)) {
+        r->tail_cache = SPSC_LOAD_ACQ(&r->tail);
+        if (head - r->tail_cache == r->size)
+            return 0;
+    }
+
+    r->slots[head & r->mask] = ptr;
+    SPSC_STORE_REL(&r->head, head + 1);
+    return 1;
+}
+
+/**
+ *  \brief take up to 'max' pointers from the ring
+ *
+ *  \retval cnt number of pointers stored in 'ptrs'
+ */
+static inline uint32_t SpscRingDequeueBulk(SpscRing *r, void **ptrs, uint32_t max)
+{
+    const uint32_t tail = r->tail;
+    uint32_t avail = r->head_cache - tail;
+
+    if (avail == 0) {
+        r->head_cache = SPSC_LOAD_ACQ(&r->head);
+        avail = r->head_cache - tail;
+        if (avail == 0)
+            return 0;
+    }
+
+    uint32_t cnt = avail < max ? avail : max;
+    for (uint32_t i = 0; i < cnt; i++) {
+        ptrs[i] = r->slots[(tail + i) & r->mask];
+    }
+    SPSC_STORE_REL(&r->tail, tail + cnt);
+    return cnt;
+}
+
+/** \brief take a single pointer from the ring
+ *  \retval ptr or NULL if the ring is empty */
+static inline void *SpscRingDequeue(SpscRing *r)
+{
+    void *ptr = NULL;
+    if (SpscRingDequeueBulk(r, &ptr, 1) == 0)
+        return NULL;
+    return ptr;
+}
+
+/** \brief number of pointers in the ring. Only a hint if called
+ *         from a thread other than the consumer. */
+static inline uint32_t SpscRingCount(SpscRing *r)
+{
+    return SPSC_LOAD_ACQ(&r->head) - SPSC_LOAD_ACQ(&r->tail);
+}
+
+#endif /* __UTIL_SPSC_RING_H__ */
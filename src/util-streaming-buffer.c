@@ -99,6 +99,341 @@ StreamingBufferBlock *SBB_RB_FIND_INCLUSIVE(struct SBB *head, StreamingBufferBlo
 }
 
 
+/* Paged buffer
+ *
+ * With STREAMING_BUFFER_PAGED the data is kept in fixed size pages instead
+ * of in one contiguous block. Growing adds pages and sliding hands the pages
+ * before the new window start back, so data is never realloc'd or moved.
+ * Released pages are kept in a small per thread pool for reuse.
+ *
+ * Getters return a pointer into a page if the requested range fits in it.
+ * A range that crosses a page boundary is copied into 'flat'. That pointer
+ * is valid until the next call on the buffer. StreamingBufferGetIov gives
+ * the range as a list of page pointers without copying.
+ */
+typedef struct StreamingBufferPages_ {
+    uint8_t **page;         /**< page[0] starts at stream offset 'base' */
+    uint32_t page_cnt;
+    uint32_t page_max;      /**< size of the 'page' array */
+    uint64_t base;
+
+    /* copy of [flat_offset, flat_offset + flat_len) */
+    uint8_t *flat;
+    uint32_t flat_size;
+    uint32_t flat_len;
+    uint64_t flat_offset;
+} StreamingBufferPages;
+
+#define IS_PAGED(sb) ((sb)->cfg->flags & STREAMING_BUFFER_PAGED)
+
+static inline uint32_t PageSize(const StreamingBufferConfig *cfg)
+{
+    if (cfg->page_size == 0)
+        return STREAMING_BUFFER_PAGE_SIZE_DEFAULT;
+    return MAX(cfg->page_size, STREAMING_BUFFER_PAGE_SIZE_MIN);
+}
+
+/* per thread pools of unused pages, one per config. Pages in the pool are
+ * still accounted to the config's memory wrappers. */
+#define PAGE_POOLS_MAX      8
+#define PAGE_POOL_BYTES     (1024 * 1024)
+
+typedef struct PagePool_ {
+    const StreamingBufferConfig *cfg;
+    uint32_t cnt;
+    void *head;             /**< free pages, linked through their first bytes */
+} PagePool;
+
+static __thread PagePool page_pools[PAGE_POOLS_MAX];
+
+static PagePool *PagePoolGet(const StreamingBufferConfig *cfg)
+{
+    for (int i = 0; i < PAGE_POOLS_MAX; i++) {
+        if (page_pools[i].cfg == cfg)
+            return &page_pools[i];
+        if (page_pools[i].cfg == NULL) {
+            page_pools[i].cfg = cfg;
+            return &page_pools[i];
+        }
+    }
+    return NULL;
+}
+
+static uint8_t *PageAlloc(const StreamingBufferConfig *cfg)
+{
+    const uint32_t ps = PageSize(cfg);
+    uint8_t *page = NULL;
+
+    PagePool *pool = PagePoolGet(cfg);
+    if (pool != NULL && pool->head != NULL) {
+        page = pool->head;
+        pool->head = *(void **)page;
+        pool->cnt--;
+    } else {
+        page = MALLOC(cfg, ps);
+        if (page == NULL)
+            return NULL;
+    }
+    /* for safe printing and general caution */
+    memset(page, 0, ps);
+    return page;
+}
+
+static void PageFree(const StreamingBufferConfig *cfg, uint8_t *page)
+{
+    const uint32_t ps = PageSize(cfg);
+    PagePool *pool = PagePoolGet(cfg);
+    if (pool != NULL && pool->cnt < PAGE_POOL_BYTES / ps) {
+        *(void **)page = pool->head;
+        pool->head = page;
+        pool->cnt++;
+    } else {
+        FREE(cfg, page, ps);
+    }
+}
+
+/**
+ *  \brief free the pages pooled by the calling thread
+ */
+void StreamingBufferPagePoolCleanup(void)
+{
+    for (int i = 0; i < PAGE_POOLS_MAX; i++) {
+        PagePool *pool = &page_pools[i];
+        if (pool->cfg == NULL)
+            break;
+        const uint32_t ps = PageSize(pool->cfg);
+        while (pool->head != NULL) {
+            void *page = pool->head;
+            pool->head = *(void **)page;
+            FREE(pool->cfg, page, ps);
+        }
+        pool->cnt = 0;
+        pool->cfg = NULL;
+    }
+}
+
+static void PagesFree(StreamingBuffer *sb)
+{
+    StreamingBufferPages *pg = sb->pages;
+    if (pg == NULL)
+        return;
+
+    for (uint32_t i = 0; i < pg->page_cnt; i++) {
+        PageFree(sb->cfg, pg->page[i]);
+    }
+    if (pg->page != NULL)
+        FREE(sb->cfg, pg->page, pg->page_max * sizeof(uint8_t *));
+    if (pg->flat != NULL)
+        FREE(sb->cfg, pg->flat, pg->flat_size);
+    FREE(sb->cfg, pg, sizeof(*pg));
+    sb->pages = NULL;
+    sb->buf_size = 0;
+}
+
+/** \internal
+ *  \brief buf_size is the room from the window start to the end of the
+ *         last page */
+static inline void PagesUpdateSize(StreamingBuffer *sb)
+{
+    const StreamingBufferPages *pg = sb->pages;
+    sb->buf_size = pg->page_cnt * PageSize(sb->cfg) -
+        (uint32_t)(sb->stream_offset - pg->base);
+#ifdef DEBUG
+    if (sb->buf_size > sb->buf_size_max) {
+        sb->buf_size_max = sb->buf_size;
+    }
+#endif
+}
+
+/** \internal
+ *  \brief make sure the pages up to stream offset 'end' exist
+ *  \retval 0 ok
+ *  \retval -1 error
+ */
+static int __attribute__((warn_unused_result))
+PagesEnsure(StreamingBuffer *sb, uint64_t end)
+{
+    if (sb->pages == NULL) {
+        sb->pages = CALLOC(sb->cfg, 1, sizeof(StreamingBufferPages));
+        if (sb->pages == NULL)
+            return -1;
+        sb->pages->base = sb->stream_offset;
+    }
+    StreamingBufferPages *pg = sb->pages;
+    const uint32_t ps = PageSize(sb->cfg);
+    const uint32_t need = (uint32_t)((end - pg->base + ps - 1) / ps);
+    if (need <= pg->page_cnt)
+        return 0;
+
+    if (need > pg->page_max) {
+        uint32_t max = pg->page_max ? pg->page_max * 2 : 8;
+        while (max < need)
+            max *= 2;
+        void *ptr = REALLOC(sb->cfg, pg->page,
+                pg->page_max * sizeof(uint8_t *), max * sizeof(uint8_t *));
+        if (ptr == NULL)
+            return -1;
+        pg->page = ptr;
+        pg->page_max = max;
+    }
+
+    int r = 0;
+    while (pg->page_cnt < need) {
+        uint8_t *page = PageAlloc(sb->cfg);
+        if (page == NULL) {
+            r = -1;
+            break;
+        }
+        pg->page[pg->page_cnt++] = page;
+    }
+    PagesUpdateSize(sb);
+    SCLogDebug("%u pages, buf_size %u", pg->page_cnt, sb->buf_size);
+    return r;
+}
+
+/** \internal
+ *  \brief copy [offset, offset + len) out of the pages */
+static void PagesCopyOut(const StreamingBuffer *sb,
+        uint64_t offset, uint8_t *dst, uint32_t len)
+{
+    const StreamingBufferPages *pg = sb->pages;
+    const uint32_t ps = PageSize(sb->cfg);
+    uint32_t idx = (uint32_t)((offset - pg->base) / ps);
+    uint32_t in_page = (uint32_t)((offset - pg->base) % ps);
+
+    while (len > 0) {
+        const uint32_t chunk = MIN(ps - in_page, len);
+        memcpy(dst, pg->page[idx] + in_page, chunk);
+        dst += chunk;
+        len -= chunk;
+        in_page = 0;
+        idx++;
+    }
+}
+
+/** \internal
+ *  \brief write data at stream offset 'offset', adding pages as needed
+ *  \retval 0 ok
+ *  \retval -1 error, buffer unchanged
+ */
+static int __attribute__((warn_unused_result))
+PagesWrite(StreamingBuffer *sb, uint64_t offset,
+        const uint8_t *data, uint32_t data_len)
+{
+    if (PagesEnsure(sb, offset + data_len) != 0)
+        return -1;
+
+    StreamingBufferPages *pg = sb->pages;
+    if (pg->flat_len && offset < pg->flat_offset + pg->flat_len &&
+            offset + data_len > pg->flat_offset) {
+        pg->flat_len = 0;
+    }
+
+    const uint32_t ps = PageSize(sb->cfg);
+    uint32_t idx = (uint32_t)((offset - pg->base) / ps);
+    uint32_t in_page = (uint32_t)((offset - pg->base) % ps);
+    while (data_len > 0) {
+        const uint32_t chunk = MIN(ps - in_page, data_len);
+        memcpy(pg->page[idx] + in_page, data, chunk);
+        data += chunk;
+        data_len -= chunk;
+        in_page = 0;
+        idx++;
+    }
+    return 0;
+}
+
+/** \internal
+ *  \brief hand back the pages that are now fully before the window */
+static void PagesSlide(StreamingBuffer *sb)
+{
+    StreamingBufferPages *pg = sb->pages;
+    if (pg == NULL)
+        return;
+
+    const uint32_t ps = PageSize(sb->cfg);
+    uint32_t drop = (uint32_t)((sb->stream_offset - pg->base) / ps);
+    drop = MIN(drop, pg->page_cnt);
+    for (uint32_t i = 0; i < drop; i++) {
+        PageFree(sb->cfg, pg->page[i]);
+    }
+    if (drop > 0) {
+        memmove(pg->page, pg->page + drop,
+                (pg->page_cnt - drop) * sizeof(uint8_t *));
+        pg->page_cnt -= drop;
+        pg->base += (uint64_t)drop * ps;
+    }
+    if (pg->page_cnt == 0)
+        pg->base = sb->stream_offset;
+    if (pg->flat_offset < sb->stream_offset)
+        pg->flat_len = 0;
+    PagesUpdateSize(sb);
+}
+
+/** \internal
+ *  \brief get a pointer to [offset, offset + len)
+ *
+ *  Zero copy if the range is in a single page, otherwise the range is
+ *  copied to the 'flat' buffer. A request that starts close to what is
+ *  in 'flat' already only copies the missing tail.
+ *
+ *  \retval ptr or NULL if out of memory
+ */
+static const uint8_t *PagesGetRange(const StreamingBuffer *sb,
+        uint64_t offset, uint32_t len)
+{
+    StreamingBufferPages *pg = sb->pages;
+    if (pg == NULL)
+        return NULL;
+
+    const uint32_t ps = PageSize(sb->cfg);
+    const uint32_t idx = (uint32_t)((offset - pg->base) / ps);
+    const uint32_t in_page = (uint32_t)((offset - pg->base) % ps);
+    if (idx >= pg->page_cnt)
+        return NULL;
+    if (in_page + len <= ps)
+        return pg->page[idx] + in_page;
+
+    uint32_t keep = 0;
+    if (pg->flat_len && offset >= pg->flat_offset &&
+            offset - pg->flat_offset <= MIN(pg->flat_len, ps)) {
+        keep = pg->flat_len;
+    } else {
+        pg->flat_offset = offset;
+    }
+    const uint32_t skip = (uint32_t)(offset - pg->flat_offset);
+    if (skip + len > keep) {
+        const uint32_t size = skip + len;
+        if (size > pg->flat_size) {
+            const uint32_t grow = ((size + ps - 1) / ps) * ps;
+            void *ptr = REALLOC(sb->cfg, pg->flat, pg->flat_size, grow);
+            if (ptr == NULL) {
+                pg->flat_len = 0;
+                return NULL;
+            }
+            pg->flat = ptr;
+            pg->flat_size = grow;
+        }
+        PagesCopyOut(sb, pg->flat_offset + keep, pg->flat + keep, size - keep);
+        pg->flat_len = size;
+    }
+    return pg->flat + skip;
+}
+
+/** \internal
+ *  \brief get pointer to data at 'rel_offset' from the window start */
+static inline const uint8_t *GetPtr(const StreamingBuffer *sb,
+        uint64_t rel_offset, uint32_t len)
+{
+    if (IS_PAGED(sb))
+        return PagesGetRange(sb, sb->stream_offset + rel_offset, len);
+    return sb->buf + rel_offset;
+}
+
+#define HAS_DATA(sb) \
+    (IS_PAGED((sb)) ? (sb)->pages != NULL : (sb)->buf != NULL)
+
+
 static inline int InitBuffer(StreamingBuffer *sb)
 {
     sb->buf = CALLOC(sb->cfg, 1, sb->cfg->buf_size);
@@ -116,7 +451,10 @@ StreamingBuffer *StreamingBufferInit(const StreamingBufferConfig *cfg)
         sb->buf_size = cfg->buf_size;
         sb->cfg = cfg;
 
-        if (cfg->buf_size > 0) {
+        if (cfg->flags & STREAMING_BUFFER_PAGED) {
+            sb->buf_size = 0;
+            return sb;
+        } else if (cfg->buf_size > 0) {
             if (InitBuffer(sb) == 0) {
                 return sb;
             }
@@ -139,6 +477,7 @@ void StreamingBufferClear(StreamingBuffer *sb)
             FREE(sb->cfg, sb->buf, sb->buf_size);
             sb->buf = NULL;
         }
+        PagesFree(sb);
     }
 }
 
@@ -436,9 +775,15 @@ static void AutoSlide(StreamingBuffer *sb)
     uint32_t size = sb->cfg->buf_slide;
     uint32_t slide = sb->buf_offset - size;
     SCLogDebug("sliding %u forward, size of original buffer left after slide %u", slide, size);
-    memmove(sb->buf, sb->buf+slide, size);
-    sb->stream_offset += slide;
-    sb->buf_offset = size;
+    if (IS_PAGED(sb)) {
+        sb->stream_offset += slide;
+        sb->buf_offset = size;
+        PagesSlide(sb);
+    } else {
+        memmove(sb->buf, sb->buf+slide, size);
+        sb->stream_offset += slide;
+        sb->buf_offset = size;
+    }
     SBBPrune(sb);
 }
 
@@ -512,28 +857,99 @@ void StreamingBufferSlideToOffset(StreamingBuffer *sb, uint64_t offset)
         uint32_t slide = offset - sb->stream_offset;
         uint32_t size = sb->buf_offset - slide;
         SCLogDebug("sliding %u forward, size of original buffer left after slide %u", slide, size);
-        memmove(sb->buf, sb->buf+slide, size);
-        sb->stream_offset += slide;
-        sb->buf_offset = size;
+        if (IS_PAGED(sb)) {
+            sb->stream_offset += slide;
+            sb->buf_offset = size;
+            PagesSlide(sb);
+        } else {
+            memmove(sb->buf, sb->buf+slide, size);
+            sb->stream_offset += slide;
+            sb->buf_offset = size;
+        }
         SBBPrune(sb);
     }
 }
 
+/**
+ *  \brief move the buffer to 'offset' beyond the end of its data
+ *
+ *  For data that was consumed without being added to the buffer. All
+ *  data the buffer holds is dropped.
+ *
+ *  \retval 0 ok
+ *  \retval -1 offset is before the end of the data or the buffer has
+ *              out of order data blocks
+ */
+int StreamingBufferSkipToOffset(StreamingBuffer *sb, uint64_t offset)
+{
+    if (!RB_EMPTY(&sb->sbb_tree) ||
+        offset < sb->stream_offset + sb->buf_offset)
+        return -1;
+
+    SCLogDebug("skipping to %"PRIu64", dropping %u", offset, sb->buf_offset);
+    sb->stream_offset = offset;
+    sb->buf_offset = 0;
+    if (IS_PAGED(sb))
+        PagesSlide(sb);
+    return 0;
+}
+
 void StreamingBufferSlide(StreamingBuffer *sb, uint32_t slide)
 {
     uint32_t size = sb->buf_offset - slide;
     SCLogDebug("sliding %u forward, size of original buffer left after slide %u", slide, size);
-    memmove(sb->buf, sb->buf+slide, size);
-    sb->stream_offset += slide;
-    sb->buf_offset = size;
+    if (IS_PAGED(sb)) {
+        sb->stream_offset += slide;
+        sb->buf_offset = size;
+        PagesSlide(sb);
+    } else {
+        memmove(sb->buf, sb->buf+slide, size);
+        sb->stream_offset += slide;
+        sb->buf_offset = size;
+    }
     SBBPrune(sb);
 }
 
 #define DATA_FITS(sb, len) \
     ((sb)->buf_offset + (len) <= (sb)->buf_size)
 
+/** \internal
+ *  \brief append for STREAMING_BUFFER_PAGED
+ *  \param seg segment to fill in, can be NULL
+ */
+static int __attribute__((warn_unused_result))
+PagedAppend(StreamingBuffer *sb, StreamingBufferSegment *seg,
+        const uint8_t *data, uint32_t data_len)
+{
+    if (!DATA_FITS(sb, data_len) && (sb->cfg->flags & STREAMING_BUFFER_AUTOSLIDE))
+        AutoSlide(sb);
+    if (PagesWrite(sb, sb->stream_offset + sb->buf_offset, data, data_len) != 0)
+        return -1;
+
+    if (seg != NULL) {
+        seg->stream_offset = sb->stream_offset + sb->buf_offset;
+        seg->segment_len = data_len;
+    }
+    uint32_t rel_offset = sb->buf_offset;
+    sb->buf_offset += data_len;
+
+    if (!RB_EMPTY(&sb->sbb_tree)) {
+        SBBUpdate(sb, rel_offset, data_len);
+    }
+    return 0;
+}
+
 StreamingBufferSegment *StreamingBufferAppendRaw(StreamingBuffer *sb, const uint8_t *data, uint32_t data_len)
 {
+    if (IS_PAGED(sb)) {
+        StreamingBufferSegment *seg = CALLOC(sb->cfg, 1, sizeof(StreamingBufferSegment));
+        if (seg != NULL && PagedAppend(sb, seg, data, data_len) != 0) {
+            FREE(sb->cfg, seg, sizeof(StreamingBufferSegment));
+            seg = NULL;
+        }
+        return seg;
+    }
+
     if (sb->buf == NULL) {
         if (InitBuffer(sb) == -1)
             return NULL;
@@ -578,6 +994,9 @@ int StreamingBufferAppend(StreamingBuffer *sb, StreamingBufferSegment *seg,
 {
     BUG_ON(seg == NULL);
 
+    if (IS_PAGED(sb))
+        return PagedAppend(sb, seg, data, data_len);
+
     if (sb->buf == NULL) {
         if (InitBuffer(sb) == -1)
             return -1;
@@ -619,6 +1038,9 @@ int StreamingBufferAppend(StreamingBuffer *sb, StreamingBufferSegment *seg,
 int StreamingBufferAppendNoTrack(StreamingBuffer *sb,
                                  const uint8_t *data, uint32_t data_len)
 {
+    if (IS_PAGED(sb))
+        return PagedAppend(sb, NULL, data, data_len);
+
     if (sb->buf == NULL) {
         if (InitBuffer(sb) == -1)
             return -1;
@@ -667,27 +1089,37 @@ int StreamingBufferInsertAt(StreamingBuffer *sb, StreamingBufferSegment *seg,
     if (offset < sb->stream_offset)
         return -1;
 
-    if (sb->buf == NULL) {
-        if (InitBuffer(sb) == -1)
-            return -1;
-    }
-
     uint32_t rel_offset = offset - sb->stream_offset;
-    if (!DATA_FITS_AT_OFFSET(sb, data_len, rel_offset)) {
-        if (sb->cfg->flags & STREAMING_BUFFER_AUTOSLIDE) {
+    if (IS_PAGED(sb)) {
+        if (!DATA_FITS_AT_OFFSET(sb, data_len, rel_offset) &&
+                (sb->cfg->flags & STREAMING_BUFFER_AUTOSLIDE)) {
             AutoSlide(sb);
             rel_offset = offset - sb->stream_offset;
         }
-        if (!DATA_FITS_AT_OFFSET(sb, data_len, rel_offset)) {
-            if (GrowToSize(sb, (rel_offset + data_len)) != 0)
+        if (PagesWrite(sb, offset, data, data_len) != 0)
+            return -1;
+    } else {
+        if (sb->buf == NULL) {
+            if (InitBuffer(sb) == -1)
                 return -1;
         }
-    }
-    if (!DATA_FITS_AT_OFFSET(sb, data_len, rel_offset)) {
-        return -1;
-    }
 
-    memcpy(sb->buf + rel_offset, data, data_len);
+        if (!DATA_FITS_AT_OFFSET(sb, data_len, rel_offset)) {
+            if (sb->cfg->flags & STREAMING_BUFFER_AUTOSLIDE) {
+                AutoSlide(sb);
+                rel_offset = offset - sb->stream_offset;
+            }
+            if (!DATA_FITS_AT_OFFSET(sb, data_len, rel_offset)) {
+                if (GrowToSize(sb, (rel_offset + data_len)) != 0)
+                    return -1;
+            }
+        }
+        if (!DATA_FITS_AT_OFFSET(sb, data_len, rel_offset)) {
+            return -1;
+        }
+
+        memcpy(sb->buf + rel_offset, data, data_len);
+    }
     seg->stream_offset = offset;
     seg->segment_len = data_len;
 
@@ -746,17 +1178,17 @@ void StreamingBufferSBBGetData(const StreamingBuffer *sb,
 {
     if (sbb->offset >= sb->stream_offset) {
         uint64_t offset = sbb->offset - sb->stream_offset;
-        *data = sb->buf + offset;
         if (offset + sbb->len > sb->buf_offset)
             *data_len = sb->buf_offset - offset;
         else
             *data_len = sbb->len;
+        *data = GetPtr(sb, offset, *data_len);
         return;
     } else {
         uint64_t offset = sb->stream_offset - sbb->offset;
         if (offset < sbb->len) {
-            *data = sb->buf;
             *data_len = sbb->len - offset;
+            *data = GetPtr(sb, 0, *data_len);
             return;
         }
     }
@@ -776,19 +1208,19 @@ void StreamingBufferSBBGetDataAtOffset(const StreamingBuffer *sb,
 
         if (offset >= sb->stream_offset) {
             uint64_t data_offset = offset - sb->stream_offset;
-            *data = sb->buf + data_offset;
             if (data_offset + sbblen > sb->buf_size)
                 *data_len = sb->buf_size - data_offset;
             else
                 *data_len = sbblen;
             BUG_ON(*data_len > sbblen);
+            *data = GetPtr(sb, data_offset, *data_len);
             return;
         } else {
             uint64_t data_offset = sb->stream_offset - sbb->offset;
             if (data_offset < sbblen) {
-                *data = sb->buf;
                 *data_len = sbblen - data_offset;
                 BUG_ON(*data_len > sbblen);
+                *data = GetPtr(sb, 0, *data_len);
                 return;
             }
         }
@@ -803,20 +1235,20 @@ void StreamingBufferSegmentGetData(const StreamingBuffer *sb,
                                    const StreamingBufferSegment *seg,
                                    const uint8_t **data, uint32_t *data_len)
 {
-    if (likely(sb->buf)) {
+    if (likely(HAS_DATA(sb))) {
         if (seg->stream_offset >= sb->stream_offset) {
             uint64_t offset = seg->stream_offset - sb->stream_offset;
-            *data = sb->buf + offset;
             if (offset + seg->segment_len > sb->buf_size)
                 *data_len = sb->buf_size - offset;
             else
                 *data_len = seg->segment_len;
+            *data = GetPtr(sb, offset, *data_len);
             return;
         } else {
             uint64_t offset = sb->stream_offset - seg->stream_offset;
             if (offset < seg->segment_len) {
-                *data = sb->buf;
                 *data_len = seg->segment_len - offset;
+                *data = GetPtr(sb, 0, *data_len);
                 return;
             }
         }
@@ -850,8 +1282,8 @@ int StreamingBufferGetData(const StreamingBuffer *sb,
         const uint8_t **data, uint32_t *data_len,
         uint64_t *stream_offset)
 {
-    if (sb != NULL && sb->buf != NULL) {
-        *data = sb->buf;
+    if (sb != NULL && HAS_DATA(sb) &&
+            (*data = GetPtr(sb, 0, sb->buf_offset)) != NULL) {
         *data_len = sb->buf_offset;
         *stream_offset = sb->stream_offset;
         return 1;
@@ -867,14 +1299,14 @@ int StreamingBufferGetDataAtOffset (const StreamingBuffer *sb,
         const uint8_t **data, uint32_t *data_len,
         uint64_t offset)
 {
-    if (sb != NULL && sb->buf != NULL &&
+    if (sb != NULL && HAS_DATA(sb) &&
             offset >= sb->stream_offset &&
             offset < (sb->stream_offset + sb->buf_offset))
     {
         uint32_t skip = offset - sb->stream_offset;
-        *data = sb->buf + skip;
         *data_len = sb->buf_offset - skip;
-        return 1;
+        *data = GetPtr(sb, skip, *data_len);
+        return *data != NULL;
     } else {
         *data = NULL;
         *data_len = 0;
@@ -882,6 +1314,52 @@ int StreamingBufferGetDataAtOffset (const StreamingBuffer *sb,
     }
 }
 
+/**
+ *  \brief get the data from 'offset' without copying it
+ *
+ *  The contiguous buffer always fits in one iov. For a paged buffer
+ *  there is one per page, so iov_size 1 gets the data up to the end of
+ *  the page 'offset' is in.
+ *
+ *  \param offset stream offset
+ *  \param len max number of bytes to get
+ *  \param iov array of iov_size to fill
+ *
+ *  \retval cnt number of iovs filled
+ */
+uint32_t StreamingBufferGetIov(const StreamingBuffer *sb,
+        uint64_t offset, uint32_t len,
+        StreamingBufferIov *iov, uint32_t iov_size)
+{
+    if (sb == NULL || !HAS_DATA(sb) || iov_size == 0 ||
+            offset < sb->stream_offset ||
+            offset >= (sb->stream_offset + sb->buf_offset))
+        return 0;
+
+    len = MIN(len, (uint32_t)(sb->stream_offset + sb->buf_offset - offset));
+    if (!IS_PAGED(sb)) {
+        iov[0].data = sb->buf + (offset - sb->stream_offset);
+        iov[0].len = len;
+        return 1;
+    }
+
+    const StreamingBufferPages *pg = sb->pages;
+    const uint32_t ps = PageSize(sb->cfg);
+    uint32_t idx = (uint32_t)((offset - pg->base) / ps);
+    uint32_t in_page = (uint32_t)((offset - pg->base) % ps);
+    uint32_t cnt = 0;
+    while (len > 0 && cnt < iov_size) {
+        const uint32_t chunk = MIN(ps - in_page, len);
+        iov[cnt].data = pg->page[idx] + in_page;
+        iov[cnt].len = chunk;
+        cnt++;
+        len -= chunk;
+        in_page = 0;
+        idx++;
+    }
+    return cnt;
+}
+
 /**
  *  \retval 1 data is the same
  *  \retval 0 data is different
@@ -1472,6 +1950,127 @@ static int StreamingBufferTest10(void)
     PASS;
 }
 
+/** \test paged buffer: appends across pages, sliding, gaps and iovs */
+static int StreamingBufferTest11(void)
+{
+    StreamingBufferConfig cfg = { STREAMING_BUFFER_PAGED, 0, 0,
+        NULL, NULL, NULL, NULL, STREAMING_BUFFER_PAGE_SIZE_MIN };
+    StreamingBuffer *sb = StreamingBufferInit(&cfg);
+    FAIL_IF(sb == NULL);
+
+    uint8_t data[1000];
+    for (uint32_t i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t)(i % 251);
+
+    StreamingBufferSegment seg1;
+    FAIL_IF(StreamingBufferAppend(sb, &seg1, data, 200) != 0);
+    StreamingBufferSegment seg2;
+    FAIL_IF(StreamingBufferAppend(sb, &seg2, data + 200, 400) != 0);
+    FAIL_IF(sb->buf != NULL);
+    FAIL_IF(sb->buf_offset != 600);
+    FAIL_IF(sb->buf_size != 768);
+    FAIL_IF(seg2.stream_offset != 200);
+    FAIL_IF(!StreamingBufferSegmentCompareRawData(sb, &seg1, data, 200));
+    FAIL_IF(!StreamingBufferSegmentCompareRawData(sb, &seg2, data + 200, 400));
+    FAIL_IF(!StreamingBufferCompareRawData(sb, data, 600));
+
+    /* in one page: no copy */
+    const uint8_t *d = NULL;
+    uint32_t d_len = 0;
+    FAIL_IF(StreamingBufferGetDataAtOffset(sb, &d, &d_len, 520) != 1);
+    FAIL_IF(d_len != 80);
+    FAIL_IF(d != sb->pages->page[2] + 8);
+    FAIL_IF(memcmp(d, data + 520, 80) != 0);
+
+    StreamingBufferIov iov[4];
+    FAIL_IF(StreamingBufferGetIov(sb, 100, UINT32_MAX, iov, 4) != 3);
+    FAIL_IF(iov[0].len != 156 || iov[1].len != 256 || iov[2].len != 88);
+    FAIL_IF(memcmp(iov[0].data, data + 100, 156) != 0);
+    FAIL_IF(memcmp(iov[2].data, data + 512, 88) != 0);
+    FAIL_IF(StreamingBufferGetIov(sb, 100, 10, iov, 4) != 1);
+    FAIL_IF(iov[0].len != 10);
+
+    /* slide into the 2nd page: 1st page is released */
+    StreamingBufferSlideToOffset(sb, 300);
+    FAIL_IF(sb->stream_offset != 300);
+    FAIL_IF(sb->buf_offset != 300);
+    FAIL_IF(sb->pages->page_cnt != 2);
+    FAIL_IF(sb->pages->base != 256);
+    FAIL_IF(sb->buf_size != 468);
+    FAIL_IF(StreamingBufferSegmentIsBeforeWindow(sb, &seg2));
+    FAIL_IF(!StreamingBufferSegmentIsBeforeWindow(sb, &seg1));
+    FAIL_IF(!StreamingBufferSegmentCompareRawData(sb, &seg2, data + 300, 300));
+
+    /* gap, then data after it */
+    StreamingBufferSegment seg3;
+    FAIL_IF(StreamingBufferInsertAt(sb, &seg3, data + 700, 300, 700) != 0);
+    FAIL_IF(sb->buf_offset != 700);
+    StreamingBufferBlock *sbb1 = RB_MIN(SBB, &sb->sbb_tree);
+    FAIL_IF_NULL(sbb1);
+    FAIL_IF(sbb1->offset != 300 || sbb1->len != 300);
+    StreamingBufferBlock *sbb2 = SBB_RB_NEXT(sbb1);
+    FAIL_IF_NULL(sbb2);
+    FAIL_IF(sbb2->offset != 700 || sbb2->len != 300);
+    StreamingBufferSBBGetData(sb, sbb2, &d, &d_len);
+    FAIL_IF(d_len != 300);
+    FAIL_IF(memcmp(d, data + 700, 300) != 0);
+
+    /* fill the gap */
+    StreamingBufferSegment seg4;
+    FAIL_IF(StreamingBufferInsertAt(sb, &seg4, data + 600, 100, 600) != 0);
+    FAIL_IF(SBB_RB_NEXT(RB_MIN(SBB, &sb->sbb_tree)) != NULL);
+    uint64_t offset = 0;
+    FAIL_IF(StreamingBufferGetData(sb, &d, &d_len, &offset) != 1);
+    FAIL_IF(offset != 300 || d_len != 700);
+    FAIL_IF(memcmp(d, data + 300, 700) != 0);
+
+    StreamingBufferFree(sb);
+    StreamingBufferPagePoolCleanup();
+    PASS;
+}
+
+static int StreamingBufferTest12Run(StreamingBufferConfig *cfg)
+{
+    StreamingBuffer *sb = StreamingBufferInit(cfg);
+    FAIL_IF(sb == NULL);
+
+    uint8_t data[600];
+    memset(data, 'A', sizeof(data));
+
+    StreamingBufferSegment seg1;
+    FAIL_IF(StreamingBufferAppend(sb, &seg1, data, 300) != 0);
+    FAIL_IF(StreamingBufferSkipToOffset(sb, 200) != -1);
+    FAIL_IF(StreamingBufferSkipToOffset(sb, 500) != 0);
+    FAIL_IF(sb->stream_offset != 500);
+    FAIL_IF(sb->buf_offset != 0);
+    FAIL_IF(!StreamingBufferSegmentIsBeforeWindow(sb, &seg1));
+
+    /* data after the skip starts at the new offset */
+    StreamingBufferSegment seg2;
+    FAIL_IF(StreamingBufferAppend(sb, &seg2, data, 100) != 0);
+    FAIL_IF(seg2.stream_offset != 500);
+    FAIL_IF(!StreamingBufferSegmentCompareRawData(sb, &seg2, data, 100));
+
+    /* not with out of order data */
+    StreamingBufferSegment seg3;
+    FAIL_IF(StreamingBufferInsertAt(sb, &seg3, data, 100, 700) != 0);
+    FAIL_IF(StreamingBufferSkipToOffset(sb, 900) != -1);
+
+    StreamingBufferFree(sb);
+    PASS;
+}
+
+static int StreamingBufferTest12(void)
+{
+    StreamingBufferConfig cfg = { 0, 8, 24, NULL, NULL, NULL, NULL };
+    FAIL_IF(StreamingBufferTest12Run(&cfg) != 1);
+    StreamingBufferConfig paged_cfg = { STREAMING_BUFFER_PAGED, 0, 0,
+        NULL, NULL, NULL, NULL, STREAMING_BUFFER_PAGE_SIZE_MIN };
+    FAIL_IF(StreamingBufferTest12Run(&paged_cfg) != 1);
+    StreamingBufferPagePoolCleanup();
+    PASS;
+}
+
 #endif
 
 void StreamingBufferRegisterTests(void)
@@ -1487,5 +2086,7 @@ void StreamingBufferRegisterTests(void)
     UtRegisterTest("StreamingBufferTest08", StreamingBufferTest08);
     UtRegisterTest("StreamingBufferTest09", StreamingBufferTest09);
     UtRegisterTest("StreamingBufferTest10", StreamingBufferTest10);
+    UtRegisterTest("StreamingBufferTest11", StreamingBufferTest11);
+    UtRegisterTest("StreamingBufferTest12", StreamingBufferTest12);
 #endif
 }
@@ -63,6 +63,11 @@
 
 #define STREAMING_BUFFER_NOFLAGS     0
 #define STREAMING_BUFFER_AUTOSLIDE  (1<<0)
+/** keep the data in fixed size pages instead of one contiguous block */
+#define STREAMING_BUFFER_PAGED      (1<<1)
+
+#define STREAMING_BUFFER_PAGE_SIZE_DEFAULT  4096
+#define STREAMING_BUFFER_PAGE_SIZE_MIN      256
 
 typedef struct StreamingBufferConfig_ {
     uint32_t flags;
@@ -72,9 +77,10 @@ typedef struct StreamingBufferConfig_ {
     void *(*Calloc)(size_t n, size_t size);
     void *(*Realloc)(void *ptr, size_t orig_size, size_t size);
     void (*Free)(void *ptr, size_t size);
+    uint32_t page_size;     /**< page size for STREAMING_BUFFER_PAGED, 0 for default */
 } StreamingBufferConfig;
 
-#define STREAMING_BUFFER_CONFIG_INITIALIZER { 0, 0, 0, NULL, NULL, NULL, NULL, }
+#define STREAMING_BUFFER_CONFIG_INITIALIZER { 0, 0, 0, NULL, NULL, NULL, NULL, 0, }
 
 /**
  *  \brief block of continues data
@@ -102,15 +108,17 @@ typedef struct StreamingBuffer_ {
 
     struct SBB sbb_tree;    /**< red black tree of Stream Buffer Blocks */
     StreamingBufferBlock *head; /**< head, should always be the same as RB_MIN */
+    struct StreamingBufferPages_ *pages; /**< data for STREAMING_BUFFER_PAGED,
+                                          *   'buf' is unused then */
 #ifdef DEBUG
     uint32_t buf_size_max;
 #endif
 } StreamingBuffer;
 
 #ifndef DEBUG
-#define STREAMING_BUFFER_INITIALIZER(cfg) { (cfg), 0, NULL, 0, 0, { NULL }, NULL, };
+#define STREAMING_BUFFER_INITIALIZER(cfg) { (cfg), 0, NULL, 0, 0, { NULL }, NULL, NULL, };
 #else
-#define STREAMING_BUFFER_INITIALIZER(cfg) { (cfg), 0, NULL, 0, 0, { NULL }, NULL, 0 };
+#define STREAMING_BUFFER_INITIALIZER(cfg) { (cfg), 0, NULL, 0, 0, { NULL }, NULL, NULL, 0 };
 #endif
 
 typedef struct StreamingBufferSegment_ {
@@ -118,12 +126,19 @@ typedef struct StreamingBufferSegment_ {
     uint64_t stream_offset;
 } __attribute__((__packed__)) StreamingBufferSegment;
 
+/** zero copy view of part of the buffer */
+typedef struct StreamingBufferIov_ {
+    const uint8_t *data;
+    uint32_t len;
+} StreamingBufferIov;
+
 StreamingBuffer *StreamingBufferInit(const StreamingBufferConfig *cfg);
 void StreamingBufferClear(StreamingBuffer *sb);
 void StreamingBufferFree(StreamingBuffer *sb);
 
 void StreamingBufferSlide(StreamingBuffer *sb, uint32_t slide);
 void StreamingBufferSlideToOffset(StreamingBuffer *sb, uint64_t offset);
+int StreamingBufferSkipToOffset(StreamingBuffer *sb, uint64_t offset);
 
 StreamingBufferSegment *StreamingBufferAppendRaw(StreamingBuffer *sb,
         const uint8_t *data, uint32_t data_len) __attribute__((warn_unused_result));
@@ -162,9 +177,15 @@ int StreamingBufferGetDataAtOffset (const StreamingBuffer *sb,
         const uint8_t **data, uint32_t *data_len,
         uint64_t offset);
 
+uint32_t StreamingBufferGetIov(const StreamingBuffer *sb,
+        uint64_t offset, uint32_t len,
+        StreamingBufferIov *iov, uint32_t iov_size);
+
 int StreamingBufferSegmentIsBeforeWindow(const StreamingBuffer *sb,
                                          const StreamingBufferSegment *seg);
 
+void StreamingBufferPagePoolCleanup(void);
+
 void StreamingBufferRegisterTests(void);
 
 #endif /* __UTIL_STREAMING_BUFFER_H__ */